@@ -0,0 +1,123 @@
+#pragma once
+
+// Picks the monitor's sampling interval from what the last samples looked like.
+//
+// The fixed 500 ms cadence is too slow when a metric hovers at a rule threshold and
+// wasteful when nothing moves, or on battery. After every sample SamplingController
+// looks at the metrics against the active RuleSet and chooses:
+//
+//   fast (100 ms)     a metric is within its margin of a threshold, or jumped since
+//                     the last sample; held for fastHoldMs after the last such sample
+//   normal (500 ms)   anything else; also "fast" while on battery
+//   slow (2 s)        every metric stayed flat for stableSamples samples
+//   battery (5 s)     running on battery and nothing calls for fast
+//
+// Pure logic like StateMachine: the caller passes the clock and the power source.
+// The app runs it on the monitor thread; tools/sampling_replay.cpp replays synthetic
+// signals through it.
+
+#include <chrono>
+#include <cmath>
+#include "state_rules.h"
+
+// The period the smoothing filters are tuned for (see signal_filter.h)
+const int NOMINAL_SAMPLING_MS = 500;
+
+struct SamplingPolicy {
+    int fastMs = 100;
+    int normalMs = NOMINAL_SAMPLING_MS;
+    int slowMs = 2000;
+    int batteryMs = 5000;
+    int fastHoldMs = 2000;     // Stay fast this long after the last sample that called for it
+    int stableSamples = 8;     // Flat samples in a row before slowing down
+};
+
+// Per RuleMetric: distance from a threshold that counts as near (0 = never), a jump
+// between two samples that counts as fast change (0 = never), and the largest change
+// that still counts as flat. Core counts move in steps; the battery moves too slowly
+// for either.
+constexpr double SAMPLING_NEAR_MARGIN[METRIC_COUNT] = { 8.0, 0.0, 0.0, 2.0 };
+constexpr double SAMPLING_JUMP[METRIC_COUNT] = { 15.0, 1.0, 0.0, 3.0 };
+constexpr double SAMPLING_FLAT[METRIC_COUNT] = { 3.0, 0.5, 1.0, 0.5 };
+
+enum SamplingReason {
+    SAMPLING_NORMAL,
+    SAMPLING_NEAR_THRESHOLD,
+    SAMPLING_CHANGING,
+    SAMPLING_STABLE,
+    SAMPLING_ON_BATTERY,
+    SAMPLING_REASON_COUNT
+};
+
+const char* const SAMPLING_REASON_NAMES[SAMPLING_REASON_COUNT] = {
+    "normal", "near threshold", "changing", "stable", "on battery"
+};
+
+class SamplingController {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    explicit SamplingController(const SamplingPolicy& policy = SamplingPolicy()) : m_policy(policy) {}
+
+    // Takes the latest raw sample and returns the interval until the next one
+    std::chrono::milliseconds Update(const MetricValues& metrics, const RuleSet* rules, bool onBattery, TimePoint now) {
+        bool changing = false;
+        bool flat = m_hasPrevious;
+        for (int i = 0; i < METRIC_COUNT && m_hasPrevious; i++) {
+            bool missing = std::isnan(metrics.values[i]);
+            if (missing || std::isnan(m_previous.values[i])) {
+                flat &= missing == std::isnan(m_previous.values[i]);
+                continue;
+            }
+            double delta = std::fabs(metrics.values[i] - m_previous.values[i]);
+            changing |= SAMPLING_JUMP[i] > 0 && delta >= SAMPLING_JUMP[i];
+            flat &= delta <= SAMPLING_FLAT[i];
+        }
+        m_previous = metrics;
+        m_hasPrevious = true;
+        m_flatSamples = flat ? m_flatSamples + 1 : 0;
+
+        bool near = false;
+        for (int i = 0; rules && i < rules->count && !near; i++) {
+            const StateRule& rule = rules->rules[i];
+            double value = metrics[rule.metric];
+            double margin = SAMPLING_NEAR_MARGIN[rule.metric];
+            near = margin > 0 && !std::isnan(value) && std::fabs(value - rule.threshold) <= margin;
+        }
+
+        if (near || changing) {
+            m_fastUntil = now + std::chrono::milliseconds(m_policy.fastHoldMs);
+            m_fastReason = near ? SAMPLING_NEAR_THRESHOLD : SAMPLING_CHANGING;
+        }
+
+        int intervalMs;
+        if (now < m_fastUntil) {
+            m_reason = m_fastReason;
+            intervalMs = onBattery ? m_policy.normalMs : m_policy.fastMs;
+        } else if (onBattery) {
+            m_reason = SAMPLING_ON_BATTERY;
+            intervalMs = m_policy.batteryMs;
+        } else if (m_flatSamples >= m_policy.stableSamples) {
+            m_reason = SAMPLING_STABLE;
+            intervalMs = m_policy.slowMs;
+        } else {
+            m_reason = SAMPLING_NORMAL;
+            intervalMs = m_policy.normalMs;
+        }
+        m_interval = std::chrono::milliseconds(intervalMs);
+        return m_interval;
+    }
+
+    std::chrono::milliseconds Interval() const { return m_interval; }
+    SamplingReason Reason() const { return m_reason; }
+
+private:
+    SamplingPolicy m_policy;
+    MetricValues m_previous = {};
+    bool m_hasPrevious = false;
+    int m_flatSamples = 0;
+    TimePoint m_fastUntil;                     // Fast sampling until then
+    SamplingReason m_fastReason = SAMPLING_NORMAL;
+    SamplingReason m_reason = SAMPLING_NORMAL;
+    std::chrono::milliseconds m_interval{ NOMINAL_SAMPLING_MS };
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+// Per-core CPU utilization, stored structure-of-arrays so the aggregation kernel can
+// stream over it four cores at a time.
+
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CORE_STATS_SSE2 1
+#endif
+
+const int MAX_CORES = 1024;
+
+// Thresholds matching the ANGUISH / ANGUISH_VERY / ANGUISH_EXTREMELY CPU rules
+const float CORE_THRESHOLD_ANGUISH = 50.0f;
+const float CORE_THRESHOLD_ANGUISH_VERY = 70.0f;
+const float CORE_THRESHOLD_ANGUISH_EXTREMELY = 90.0f;
+
+struct CoreSamples {
+    int count = 0;
+#if defined(_MSC_VER)
+    __declspec(align(16)) float usage[MAX_CORES];   // Percent busy per core
+#else
+    float usage[MAX_CORES] __attribute__((aligned(16)));
+#endif
+};
+
+struct CoreStats {
+    float mean = 0.0f;
+    float max = 0.0f;
+    int aboveAnguish = 0;           // Cores above CORE_THRESHOLD_ANGUISH
+    int aboveAnguishVery = 0;       // Cores above CORE_THRESHOLD_ANGUISH_VERY
+    int aboveAnguishExtremely = 0;  // Cores above CORE_THRESHOLD_ANGUISH_EXTREMELY
+};
+
+// Mean, max and per-threshold counts in a single pass
+inline CoreStats AggregateCores(const float* usage, int count) {
+    CoreStats stats;
+    if (count <= 0) {
+        return stats;
+    }
+
+    float sum = 0.0f;
+    float max = 0.0f;
+    int above[3] = { 0, 0, 0 };
+    int i = 0;
+
+#ifdef CORE_STATS_SSE2
+    const __m128 t1 = _mm_set1_ps(CORE_THRESHOLD_ANGUISH);
+    const __m128 t2 = _mm_set1_ps(CORE_THRESHOLD_ANGUISH_VERY);
+    const __m128 t3 = _mm_set1_ps(CORE_THRESHOLD_ANGUISH_EXTREMELY);
+    __m128 vsum = _mm_setzero_ps();
+    __m128 vmax = _mm_setzero_ps();
+    // Compare masks are all-ones (-1) per lane, so subtracting them counts matches
+    __m128i c1 = _mm_setzero_si128();
+    __m128i c2 = _mm_setzero_si128();
+    __m128i c3 = _mm_setzero_si128();
+    for (; i + 4 <= count; i += 4) {
+        __m128 v = _mm_loadu_ps(usage + i);
+        vsum = _mm_add_ps(vsum, v);
+        vmax = _mm_max_ps(vmax, v);
+        c1 = _mm_sub_epi32(c1, _mm_castps_si128(_mm_cmpgt_ps(v, t1)));
+        c2 = _mm_sub_epi32(c2, _mm_castps_si128(_mm_cmpgt_ps(v, t2)));
+        c3 = _mm_sub_epi32(c3, _mm_castps_si128(_mm_cmpgt_ps(v, t3)));
+    }
+
+    float lanes[4];
+    int counts[4];
+    _mm_storeu_ps(lanes, vsum);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    _mm_storeu_ps(lanes, vmax);
+    for (int lane = 0; lane < 4; lane++) {
+        if (lanes[lane] > max) max = lanes[lane];
+    }
+    _mm_storeu_si128((__m128i*)counts, c1);
+    above[0] = counts[0] + counts[1] + counts[2] + counts[3];
+    _mm_storeu_si128((__m128i*)counts, c2);
+    above[1] = counts[0] + counts[1] + counts[2] + counts[3];
+    _mm_storeu_si128((__m128i*)counts, c3);
+    above[2] = counts[0] + counts[1] + counts[2] + counts[3];
+#endif
+
+    // Scalar tail (or the whole array without SSE2)
+    for (; i < count; i++) {
+        float v = usage[i];
+        sum += v;
+        if (v > max) max = v;
+        above[0] += v > CORE_THRESHOLD_ANGUISH;
+        above[1] += v > CORE_THRESHOLD_ANGUISH_VERY;
+        above[2] += v > CORE_THRESHOLD_ANGUISH_EXTREMELY;
+    }
+
+    stats.mean = sum / (float)count;
+    stats.max = max;
+    stats.aboveAnguish = above[0];
+    stats.aboveAnguishVery = above[1];
+    stats.aboveAnguishExtremely = above[2];
+    return stats;
+}
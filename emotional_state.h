@@ -0,0 +1,25 @@
+#pragma once
+
+// Enum for emotional states
+enum EmotionalState {
+    HAPPY,               // Default
+    PLEASED,             // Below thresholds after being above
+    NEUTRAL,             // Memory > 90%
+    GRIMACE,             // App error
+    GRIMACE_TWO_SWEAT,   // Memory > 95%
+    SURPRISED,           // Device connect/disconnect
+    ANGUISH,             // CPU > 50% or any core > 90%
+    ANGUISH_VERY,        // CPU > 70%
+    ANGUISH_EXTREMELY,   // CPU > 90%
+    TIRED,               // Battery < 30%
+    TIRED_VERY,          // Battery < 20%
+    TIRED_EXTREMELY      // Battery < 10% 
+};
+
+const int EMOTIONAL_STATE_COUNT = TIRED_EXTREMELY + 1;
+
+// Enum names, as used in config files and diagnostics
+constexpr const char* EMOTIONAL_STATE_NAMES[EMOTIONAL_STATE_COUNT] = {
+    "HAPPY", "PLEASED", "NEUTRAL", "GRIMACE", "GRIMACE_TWO_SWEAT", "SURPRISED",
+    "ANGUISH", "ANGUISH_VERY", "ANGUISH_EXTREMELY", "TIRED", "TIRED_VERY", "TIRED_EXTREMELY"
+};
@@ -0,0 +1,231 @@
+#pragma once
+
+// Temporary-state events handed from any thread to the monitor thread.
+//
+// Event sources (the event log callback, device notifications) used to write one
+// pending state into an atomic, so a burst of errors overwrote itself and a GRIMACE
+// could replace a SURPRISED that had only just appeared. Producers now push a
+// StateEvent (type, priority, timestamp) into StateEventQueue, a bounded MPSC ring
+// that never blocks: when it is full the event is dropped and counted. The monitor
+// thread drains it into EventArbiter, which
+//
+//   - merges events of the same type that arrive before it acts on them,
+//   - rate limits each type, so a flood of errors shows one GRIMACE per
+//     STATE_EVENT_TYPES[type].rateLimitMs instead of restarting it every time,
+//   - orders temporary states by priority: an event never replaces a temporary state
+//     of higher priority; it waits until that one expires, and is forgotten if it
+//     is older than TEMPORARY_STATE_MS by then.
+//
+// EventArbiter is pure logic like StateMachine. tools/event_queue_stress.cpp runs the
+// queue with many producer threads and measures events per second.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include "emotional_state.h"
+#include "state_machine.h"
+
+enum StateEventType {
+    STATE_EVENT_APP_ERROR,       // An application error in the event log
+    STATE_EVENT_DEVICE_CHANGE,   // A device burst began (already debounced)
+    STATE_EVENT_TYPE_COUNT
+};
+
+struct StateEventTypeInfo {
+    const char* name;
+    EmotionalState state;    // Shown for this event
+    uint8_t priority;        // Higher wins; see TemporaryStatePriority()
+    int rateLimitMs;         // Shown at most once per this long (0 = no limit)
+};
+
+const StateEventTypeInfo STATE_EVENT_TYPES[STATE_EVENT_TYPE_COUNT] = {
+    { "app error",     GRIMACE,   1, TEMPORARY_STATE_MS },
+    { "device change", SURPRISED, 2, 0 },
+};
+
+// Priority of a temporary state already showing. PLEASED comes from the state
+// machine itself and gives way to any event.
+inline uint8_t TemporaryStatePriority(EmotionalState state) {
+    for (int type = 0; type < STATE_EVENT_TYPE_COUNT; type++) {
+        if (STATE_EVENT_TYPES[type].state == state) {
+            return STATE_EVENT_TYPES[type].priority;
+        }
+    }
+    return 0;
+}
+
+struct StateEvent {
+    std::chrono::steady_clock::time_point time;
+    uint8_t type;        // StateEventType
+    uint8_t priority;
+};
+
+inline StateEvent MakeStateEvent(StateEventType type, std::chrono::steady_clock::time_point time) {
+    return StateEvent{ time, (uint8_t)type, STATE_EVENT_TYPES[type].priority };
+}
+
+// Bounded multi-producer, single-consumer ring (Vyukov's sequence-numbered cells).
+// Push() is safe from any thread and never blocks; Pop() is for the one consumer.
+// A producer preempted between claiming a cell and filling it holds back the cells
+// after it until it resumes; the consumer just sees the queue as empty meanwhile.
+template <std::size_t CAPACITY>
+class StateEventQueue {
+    static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+public:
+    StateEventQueue() {
+        for (std::size_t i = 0; i < CAPACITY; i++) {
+            m_cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // False if the queue is full; the event is dropped
+    bool Push(const StateEvent& event) {
+        std::size_t position = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = m_cells[position & (CAPACITY - 1)];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t difference = (std::ptrdiff_t)sequence - (std::ptrdiff_t)position;
+            if (difference == 0) {
+                if (m_tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.event = event;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                position = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer only
+    bool Pop(StateEvent& event) {
+        Cell& cell = m_cells[m_head & (CAPACITY - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != m_head + 1) {
+            return false;
+        }
+        event = cell.event;
+        cell.sequence.store(m_head + CAPACITY, std::memory_order_release);
+        m_head++;
+        return true;
+    }
+
+    // Producers call this after a successful Push(); true means nobody has woken the
+    // consumer since it last called Disarm(), so this producer must
+    bool ArmWake() { return !m_wakeArmed.exchange(true, std::memory_order_acq_rel); }
+
+    // Consumer, before draining: the next Push() wakes it again. An exchange rather
+    // than a store, so it synchronizes with the ArmWake() of every event pushed so far
+    // and the drain that follows sees them.
+    void Disarm() { m_wakeArmed.exchange(false, std::memory_order_acq_rel); }
+
+    uint64_t Dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        StateEvent event;
+    };
+
+    // Producers and the consumer each get their own cache line
+    alignas(64) std::atomic<std::size_t> m_tail{ 0 };
+    alignas(64) std::size_t m_head = 0;
+    alignas(64) std::atomic<bool> m_wakeArmed{ false };
+    std::atomic<uint64_t> m_dropped{ 0 };
+    alignas(64) Cell m_cells[CAPACITY];
+};
+
+// Decides which drained events turn into temporary states, and when. Runs on the
+// consumer's thread.
+class EventArbiter {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    void Add(const StateEvent& event) {
+        m_received++;
+        if (event.type >= STATE_EVENT_TYPE_COUNT) {
+            return;
+        }
+        Pending& pending = m_pending[event.type];
+        if (pending.count > 0) {
+            m_merged++;
+        } else {
+            pending.first = event.time;
+        }
+        pending.count++;
+        pending.last = event.time;
+        pending.priority = event.priority;
+    }
+
+    // The state to show now, if any. `showingPriority` is the priority of the
+    // temporary state on screen, or -1 if none is. Pending events of lower priority
+    // are kept for the next call; call again when that temporary state expires.
+    bool Next(TimePoint now, int showingPriority, EmotionalState& state) {
+        int best = -1;
+        for (int type = 0; type < STATE_EVENT_TYPE_COUNT; type++) {
+            Pending& pending = m_pending[type];
+            if (pending.count == 0) {
+                continue;
+            }
+            if (now - pending.last >= std::chrono::milliseconds(TEMPORARY_STATE_MS)) {
+                m_expired += pending.count;
+                pending.count = 0;
+                continue;
+            }
+            int limitMs = STATE_EVENT_TYPES[type].rateLimitMs;
+            if (m_shownAny[type] && limitMs > 0 && pending.first - m_lastShown[type] < std::chrono::milliseconds(limitMs)) {
+                m_rateLimited += pending.count;
+                pending.count = 0;
+                continue;
+            }
+            if (best < 0 || pending.priority > m_pending[best].priority ||
+                (pending.priority == m_pending[best].priority && pending.last > m_pending[best].last)) {
+                best = type;
+            }
+        }
+        if (best < 0 || (int)m_pending[best].priority < showingPriority) {
+            return false;
+        }
+
+        m_pending[best].count = 0;
+        m_lastShown[best] = now;
+        m_shownAny[best] = true;
+        m_shown++;
+        state = STATE_EVENT_TYPES[best].state;
+        return true;
+    }
+
+    bool HasPending() const {
+        for (int type = 0; type < STATE_EVENT_TYPE_COUNT; type++) {
+            if (m_pending[type].count > 0) return true;
+        }
+        return false;
+    }
+
+    uint64_t Received() const { return m_received; }
+    uint64_t Merged() const { return m_merged; }
+    uint64_t RateLimited() const { return m_rateLimited; }
+    uint64_t Expired() const { return m_expired; }
+    uint64_t Shown() const { return m_shown; }
+
+private:
+    struct Pending {
+        uint64_t count = 0;
+        TimePoint first;       // Oldest event not acted on yet
+        TimePoint last;        // Newest one
+        uint8_t priority = 0;
+    };
+
+    Pending m_pending[STATE_EVENT_TYPE_COUNT];
+    TimePoint m_lastShown[STATE_EVENT_TYPE_COUNT];
+    bool m_shownAny[STATE_EVENT_TYPE_COUNT] = {};
+    uint64_t m_received = 0;
+    uint64_t m_merged = 0;
+    uint64_t m_rateLimited = 0;
+    uint64_t m_expired = 0;
+    uint64_t m_shown = 0;
+};
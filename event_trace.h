@@ -0,0 +1,289 @@
+#pragma once
+
+// Opt-in timeline tracer writing the Chrome trace-event format, for chrome://tracing
+// or ui.perfetto.dev.
+//
+// Each thread records into its own fixed ring of events; the ring is single-producer
+// single-consumer, so recording is a couple of clock reads and a store with no lock
+// and no allocation. A scope becomes one complete ("X") event with its duration, so
+// a dropped event can't unbalance a begin/end pair. A writer thread drains every
+// ring a few times a second and appends JSON to the file; a ring that fills up
+// between drains drops events and counts them.
+//
+// The only allocation is a thread's ring, on its first event (or RegisterThread).
+// Building with ETM_TRACING=0 compiles TRACE_SCOPE and TRACE_INSTANT away; otherwise
+// they cost one atomic load while the tracer isn't running.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef ETM_TRACING
+#define ETM_TRACING 1
+#endif
+
+struct TraceEvent {
+    const char* name;    // String literal; never escaped or copied
+    int64_t startNs;     // Since the tracer started
+    int64_t durationNs;  // Complete events only
+    char phase;          // 'X' complete, 'i' instant
+};
+
+class TraceRing {
+public:
+    static const uint32_t CAPACITY = 16384;   // Power of two
+
+    TraceRing(uint32_t tid, const char* name) : m_tid(tid), m_name(name) {}
+
+    // Producer (the owning thread) only
+    void Push(const TraceEvent& event) {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) >= CAPACITY) {
+            m_dropped.store(m_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+        m_events[head & (CAPACITY - 1)] = event;
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    // Consumer (the writer thread) only: visit(const TraceEvent&) for everything pushed so far
+    template <typename Visit>
+    void Drain(Visit visit) {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        uint32_t head = m_head.load(std::memory_order_acquire);
+        for (; tail != head; tail++) {
+            visit(m_events[tail & (CAPACITY - 1)]);
+        }
+        m_tail.store(tail, std::memory_order_release);
+    }
+
+    uint32_t Tid() const { return m_tid; }
+    const char* Name() const { return m_name; }
+    uint64_t Dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    uint32_t Pending() const {
+        return m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_acquire);
+    }
+
+private:
+    std::atomic<uint32_t> m_head{ 0 };
+    std::atomic<uint32_t> m_tail{ 0 };
+    std::atomic<uint64_t> m_dropped{ 0 };
+    uint32_t m_tid;
+    const char* m_name;
+    TraceEvent m_events[CAPACITY];
+};
+
+class EventTracer {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    ~EventTracer() { Stop(); }
+
+    // Starts recording and writing to `path`, replacing the file
+    bool Start(const char* path) {
+        Stop();
+        return Begin(std::fopen(path, "wb"));
+    }
+
+#ifdef _WIN32
+    bool Start(const wchar_t* path) {
+        Stop();
+        return Begin(_wfopen(path, L"wb"));
+    }
+#endif
+
+    // Stops recording, writes what's left and closes the file. Rings stay registered
+    // (threads keep their pointers) and are reused by the next Start().
+    void Stop() {
+        if (!m_file) {
+            return;
+        }
+        m_running.store(false, std::memory_order_relaxed);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        if (m_writer.joinable()) m_writer.join();
+
+        WriteEvents();
+        uint64_t dropped = 0;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const std::unique_ptr<TraceRing>& ring : m_rings) {
+            dropped += ring->Dropped();
+        }
+        std::fprintf(m_file, "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped_events\":\"%llu\"}}\n",
+                     (unsigned long long)dropped);
+        std::fclose(m_file);
+        m_file = nullptr;
+    }
+
+    bool Running() const { return m_running.load(std::memory_order_acquire); }
+
+    // Names the calling thread in the trace and allocates its ring up front
+    void RegisterThread(const char* name) {
+        Ring(name);
+    }
+
+    void Complete(const char* name, Clock::time_point start, Clock::time_point end) {
+        TraceEvent event = { name, Since(start), std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(), 'X' };
+        Ring(nullptr)->Push(event);
+    }
+
+    void Instant(const char* name) {
+        if (!Running()) {
+            return;
+        }
+        TraceEvent event = { name, Since(Clock::now()), 0, 'i' };
+        Ring(nullptr)->Push(event);
+    }
+
+    // Asks the writer to drain the rings now instead of at its next tick
+    void Flush() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_flush = true;
+        }
+        m_wake.notify_all();
+    }
+
+    // The calling thread's ring: events not written yet, and events dropped so far
+    uint32_t Pending() { return Ring(nullptr)->Pending(); }
+    uint64_t Dropped() { return Ring(nullptr)->Dropped(); }
+
+private:
+    bool Begin(FILE* file) {
+        if (!file) {
+            return false;
+        }
+        m_file = file;
+        m_first = true;
+        m_stopping = false;
+        m_flush = false;
+        m_named.clear();
+        std::fputs("{\"traceEvents\":[", m_file);
+
+        // Anything pushed after the last Stop() belongs to no file
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const std::unique_ptr<TraceRing>& ring : m_rings) {
+            ring->Drain([](const TraceEvent&) {});
+        }
+        m_origin = Clock::now();
+        m_running.store(true, std::memory_order_release);   // Publishes m_origin to recording threads
+        m_writer = std::thread(&EventTracer::WriterLoop, this);
+        return true;
+    }
+
+    int64_t Since(Clock::time_point time) const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time - m_origin).count();
+    }
+
+    // The calling thread's ring, registering it on first use
+    TraceRing* Ring(const char* name) {
+        thread_local EventTracer* owner = nullptr;
+        thread_local TraceRing* ring = nullptr;
+        if (owner != this) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_rings.emplace_back(new TraceRing((uint32_t)m_rings.size() + 1, name ? name : "thread"));
+            ring = m_rings.back().get();
+            owner = this;
+        }
+        return ring;
+    }
+
+    void WriterLoop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_stopping) {
+            m_wake.wait_for(lock, std::chrono::milliseconds(250), [this] { return m_stopping || m_flush; });
+            m_flush = false;
+            lock.unlock();
+            WriteEvents();
+            lock.lock();
+        }
+    }
+
+    // Drains every ring into the file. Writer thread, or Stop() once it has joined.
+    void WriteEvents() {
+        std::vector<TraceRing*> rings;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const std::unique_ptr<TraceRing>& ring : m_rings) rings.push_back(ring.get());
+        }
+        for (TraceRing* ring : rings) {
+            if (m_named.size() < rings.size()) {
+                m_named.resize(rings.size(), false);
+            }
+            if (!m_named[ring->Tid() - 1]) {
+                Separator();
+                std::fprintf(m_file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                             ring->Tid(), ring->Name());
+                m_named[ring->Tid() - 1] = true;
+            }
+            ring->Drain([&](const TraceEvent& event) {
+                Separator();
+                if (event.phase == 'X') {
+                    std::fprintf(m_file, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                                 event.name, event.startNs / 1e3, event.durationNs / 1e3, ring->Tid());
+                } else {
+                    std::fprintf(m_file, "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                                 event.name, event.startNs / 1e3, ring->Tid());
+                }
+            });
+        }
+        std::fflush(m_file);
+    }
+
+    void Separator() {
+        std::fputs(m_first ? "\n" : ",\n", m_file);
+        m_first = false;
+    }
+
+    std::atomic<bool> m_running{ false };
+    Clock::time_point m_origin;
+    std::mutex m_mutex;                                 // Guards m_rings, m_stopping and m_flush
+    std::condition_variable m_wake;
+    std::vector<std::unique_ptr<TraceRing>> m_rings;
+    bool m_stopping = false;
+    bool m_flush = false;
+    std::thread m_writer;
+    FILE* m_file = nullptr;                             // Writer side only from here down
+    bool m_first = true;
+    std::vector<bool> m_named;
+};
+
+// Records the enclosing block as one complete event, if the tracer is running
+class TraceScope {
+public:
+    TraceScope(EventTracer& tracer, const char* name)
+        : m_tracer(tracer.Running() ? &tracer : nullptr), m_name(name) {
+        if (m_tracer) m_start = EventTracer::Clock::now();
+    }
+
+    ~TraceScope() {
+        if (m_tracer) m_tracer->Complete(m_name, m_start, EventTracer::Clock::now());
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    EventTracer* m_tracer;
+    const char* m_name;
+    EventTracer::Clock::time_point m_start;
+};
+
+#if ETM_TRACING
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(tracer, name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(tracer, name)
+#define TRACE_INSTANT(tracer, name) (tracer).Instant(name)
+#else
+#define TRACE_SCOPE(tracer, name) ((void)0)
+#define TRACE_INSTANT(tracer, name) ((void)0)
+#endif
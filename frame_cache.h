@@ -0,0 +1,84 @@
+#pragma once
+
+// Cache of fully composed frames, one per (EmotionalState, blink) pair.
+//
+// A frame is composited once (background fill + sprite draw) and every later paint
+// of the same pair is a single blit. The surface type is a template parameter so
+// the Win32 build can store HBITMAPs while a headless build stores plain pixel
+// buffers; nothing here touches GDI.
+
+#include "emotional_state.h"
+
+template <typename Surface>
+class FrameCache {
+public:
+    FrameCache() {
+        for (int state = 0; state < EMOTIONAL_STATE_COUNT; state++) {
+            m_valid[state][0] = m_valid[state][1] = false;
+            m_surfaces[state][0] = m_surfaces[state][1] = Surface();
+        }
+    }
+
+    // Returns the frame for the pair, calling compose(Surface&) to build it on a miss
+    template <typename Compose>
+    Surface& Acquire(EmotionalState state, bool blink, Compose compose) {
+        int b = blink ? 1 : 0;
+        if (!m_valid[state][b]) {
+            compose(m_surfaces[state][b]);
+            m_valid[state][b] = true;
+            m_composites++;
+        }
+        m_blits++;
+        return m_surfaces[state][b];
+    }
+
+    // Drops every frame (size, DPI or display format changed), calling release(Surface&)
+    // on each one that was built
+    template <typename Release>
+    void Invalidate(Release release) {
+        for (int state = 0; state < EMOTIONAL_STATE_COUNT; state++) {
+            for (int b = 0; b < 2; b++) {
+                if (m_valid[state][b]) {
+                    release(m_surfaces[state][b]);
+                    m_surfaces[state][b] = Surface();
+                    m_valid[state][b] = false;
+                }
+            }
+        }
+    }
+
+    unsigned long Composites() const { return m_composites; }
+    unsigned long Blits() const { return m_blits; }
+
+private:
+    Surface m_surfaces[EMOTIONAL_STATE_COUNT][2];
+    bool m_valid[EMOTIONAL_STATE_COUNT][2];
+    unsigned long m_composites = 0;
+    unsigned long m_blits = 0;
+};
+
+// Remembers the last (state, blink) pair a repaint was requested for, so callers can
+// skip InvalidateRect when the visible frame would not change. Not thread-safe: owned
+// by whichever thread issues the repaints.
+class FrameKeyTracker {
+public:
+    // True if the pair differs from the last one marked (and records it)
+    bool Changed(EmotionalState state, bool blink) {
+        int key = (int)state * 2 + (blink ? 1 : 0);
+        if (key == m_lastKey) {
+            m_skipped++;
+            return false;
+        }
+        m_lastKey = key;
+        return true;
+    }
+
+    // Forces the next Changed() to report a change (e.g. after the cache was dropped)
+    void Reset() { m_lastKey = -1; }
+
+    unsigned long Skipped() const { return m_skipped; }
+
+private:
+    int m_lastKey = -1;
+    unsigned long m_skipped = 0;
+};
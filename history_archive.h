@@ -0,0 +1,531 @@
+#pragma once
+
+// Long-term, compressed history of samples with 1-minute and 1-hour rollups.
+//
+// history.ring (history_ring.h) keeps the last day or so at full detail; the archive
+// keeps months. Samples are buffered in memory and sealed into blocks of up to
+// BLOCK_SAMPLES or ARCHIVE_SEAL_MS, each stored column by column:
+//
+//   time     delta-of-delta, zigzag varint (a steady cadence costs one byte)
+//   cpu      delta from the previous sample, zigzag varint (hundredths of a percent)
+//   memory   same
+//   battery  XOR with the previous value, varint
+//   state    run-length (state, run) varint pairs
+//
+// Every block also carries a summary with the time spent in each EmotionalState and
+// the cpu/memory min/max/avg, so a time-in-state query over a range only decodes the
+// blocks cut by the range ends, and only their time and state columns.
+//
+// The file is a sequence of chunks (block or rollup batch), each with a small header,
+// appended whenever a block is sealed. Opening scans the chunk headers into an index
+// and drops a trailing chunk cut short by a crash. Offsets are 64-bit, so an archive
+// can grow past 2 GiB.
+//
+// Readers: tools/history_dump.cpp --archive.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "emotional_state.h"
+#include "history_ring.h"
+
+namespace ArchiveEncoding {
+
+inline void PutVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+inline void PutZigzag(std::vector<uint8_t>& out, int64_t value) {
+    PutVarint(out, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+inline uint64_t GetVarint(const uint8_t*& p, const uint8_t* end) {
+    uint64_t value = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t byte = *p++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    return value;
+}
+
+inline int64_t GetZigzag(const uint8_t*& p, const uint8_t* end) {
+    uint64_t value = GetVarint(p, end);
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+} // namespace ArchiveEncoding
+
+// A sample covers the time until the next one, but no more than this (the app was
+// closed or the machine asleep)
+const int64_t ARCHIVE_MAX_SAMPLE_GAP_MS = 10000;
+
+// A block is sealed once it spans this long, so a crash loses about a minute at most
+const int64_t ARCHIVE_SEAL_MS = 60000;
+
+enum ArchiveColumn { COLUMN_TIME, COLUMN_CPU, COLUMN_MEMORY, COLUMN_BATTERY, COLUMN_STATE, COLUMN_COUNT };
+
+enum RollupLevel { ROLLUP_MINUTE, ROLLUP_HOUR, ROLLUP_LEVELS };
+const int64_t ROLLUP_SPAN_MS[ROLLUP_LEVELS] = { 60000, 3600000 };
+
+struct Rollup {
+    int64_t startMs;           // Start of the minute or hour
+    uint32_t count;            // Samples rolled up
+    uint16_t cpuMin, cpuMax;   // Hundredths of a percent
+    uint16_t memoryMin, memoryMax;
+    float cpuAvg, memoryAvg;
+    int8_t batteryMin, batteryMax;   // -1 without a battery
+    uint8_t state;             // State with the most samples
+    uint8_t level;             // RollupLevel
+};
+
+struct BlockSummary {
+    uint32_t count;
+    uint32_t stateMs[EMOTIONAL_STATE_COUNT];   // Time spent in each state
+    uint16_t cpuMin, cpuMax;
+    uint16_t memoryMin, memoryMax;
+    float cpuAvg, memoryAvg;
+    uint32_t columnBytes[COLUMN_COUNT];
+};
+
+class HistoryArchive {
+public:
+    static const int BLOCK_SAMPLES = 4096;
+
+    ~HistoryArchive() { Close(); }
+
+    // Opens (or creates) the archive and indexes its chunks
+    bool Open(const char* path) {
+        Close();
+        m_file = std::fopen(path, "r+b");
+        if (!m_file) m_file = std::fopen(path, "w+b");
+        if (!m_file) return false;
+        return LoadIndex();
+    }
+
+    // For queries only, e.g. while the app has the file open; nothing may be appended
+    bool OpenForReading(const char* path) {
+        Close();
+        m_file = std::fopen(path, "rb");
+        if (!m_file) return false;
+        m_readOnly = true;
+        return LoadIndex();
+    }
+
+#ifdef _WIN32
+    bool Open(const wchar_t* path) {
+        Close();
+        m_file = _wfopen(path, L"r+b");
+        if (!m_file) m_file = _wfopen(path, L"w+b");
+        if (!m_file) return false;
+        return LoadIndex();
+    }
+#endif
+
+    // Seals what's buffered so nothing is lost, then closes the file. A minute or hour
+    // still in progress is written as it stands; after a restart it continues as a
+    // second rollup with the same start.
+    void Close() {
+        if (m_file) {
+            for (int level = 0; level < ROLLUP_LEVELS && !m_readOnly; level++) {
+                if (m_open[level].count) Finish(m_open[level], (RollupLevel)level);
+            }
+            Seal();
+            std::fclose(m_file);
+            m_file = nullptr;
+        }
+        m_readOnly = false;
+        m_blocks.clear();
+        m_rollups[ROLLUP_MINUTE].clear();
+        m_rollups[ROLLUP_HOUR].clear();
+        m_count = 0;
+    }
+
+    // Samples must arrive in time order; the block is sealed (written) when full or
+    // when it would span more than ARCHIVE_SEAL_MS
+    void Append(const HistoryRecord& sample) {
+        if (m_count > 0 && sample.timeMs < m_time[m_count - 1]) {
+            return;
+        }
+        if (m_count > 0 && sample.timeMs - m_time[0] >= ARCHIVE_SEAL_MS) {
+            Seal();
+        }
+        m_time[m_count] = sample.timeMs;
+        m_cpu[m_count] = sample.cpu;
+        m_memory[m_count] = sample.memory;
+        m_battery[m_count] = sample.battery;
+        m_state[m_count] = sample.state < EMOTIONAL_STATE_COUNT ? sample.state : 0;
+        m_count++;
+        for (int level = 0; level < ROLLUP_LEVELS; level++) {
+            Accumulate(m_open[level], (RollupLevel)level, sample);
+        }
+        if (m_count == BLOCK_SAMPLES) {
+            Seal();
+        }
+    }
+
+    // Writes the buffered samples as a block, plus any finished rollups
+    void Seal() {
+        if (!m_file || m_readOnly) {
+            return;
+        }
+        std::vector<uint8_t> payload;
+        if (m_count > 0) {
+            BlockSummary summary = Summarize(m_time, m_state, m_count);
+            EncodeBlock(summary, payload);
+            WriteChunk(CHUNK_BLOCK, m_time[0], m_time[m_count - 1], payload, &summary);
+        }
+
+        // Rollups that can no longer change go out with the block
+        for (int level = 0; level < ROLLUP_LEVELS; level++) {
+            if (m_finished[level].empty()) continue;
+            payload.assign((const uint8_t*)m_finished[level].data(),
+                           (const uint8_t*)(m_finished[level].data() + m_finished[level].size()));
+            WriteChunk(CHUNK_ROLLUP, m_finished[level].front().startMs, m_finished[level].back().startMs, payload, nullptr);
+            m_rollups[level].insert(m_rollups[level].end(), m_finished[level].begin(), m_finished[level].end());
+            m_finished[level].clear();
+        }
+        std::fflush(m_file);
+        m_count = 0;
+    }
+
+    // Adds the milliseconds spent in each state within [fromMs, toMs) to `durations`
+    void TimeInState(int64_t fromMs, int64_t toMs, uint64_t (&durations)[EMOTIONAL_STATE_COUNT]) {
+        int64_t time[BLOCK_SAMPLES];
+        uint8_t state[BLOCK_SAMPLES];
+        for (const BlockIndex& block : m_blocks) {
+            // Samples can reach past their block's last timestamp by up to the max gap
+            if (block.endMs + ARCHIVE_MAX_SAMPLE_GAP_MS <= fromMs || block.startMs >= toMs) {
+                continue;
+            }
+            if (block.startMs >= fromMs && block.endMs + ARCHIVE_MAX_SAMPLE_GAP_MS <= toMs) {
+                for (int s = 0; s < EMOTIONAL_STATE_COUNT; s++) {
+                    durations[s] += block.summary.stateMs[s];
+                }
+                continue;
+            }
+            int count = DecodeTimeAndState(block, time, state);
+            ClipStates(time, state, count, fromMs, toMs, durations);
+        }
+        ClipStates(m_time, m_state, m_count, fromMs, toMs, durations);
+    }
+
+    // Calls visit(const Rollup&) for every finished rollup starting in [fromMs, toMs)
+    template <typename Visit>
+    void ForEachRollup(RollupLevel level, int64_t fromMs, int64_t toMs, Visit visit) const {
+        for (const std::vector<Rollup>* list : { &m_rollups[level], &m_finished[level] }) {
+            for (const Rollup& rollup : *list) {
+                if (rollup.startMs >= fromMs && rollup.startMs < toMs) visit(rollup);
+            }
+        }
+    }
+
+    // Decodes every sealed block in range, oldest first, calling visit(const HistoryRecord&)
+    template <typename Visit>
+    void ForEachSample(int64_t fromMs, int64_t toMs, Visit visit) {
+        std::vector<uint8_t> payload;
+        for (const BlockIndex& block : m_blocks) {
+            if (block.endMs < fromMs || block.startMs >= toMs || !ReadPayload(block, payload)) {
+                continue;
+            }
+            const uint8_t* columns[COLUMN_COUNT];
+            ColumnStarts(block.summary, payload, columns);
+            const uint8_t* p[COLUMN_COUNT];
+            for (int c = 0; c < COLUMN_COUNT; c++) p[c] = columns[c];
+            const uint8_t* end = payload.data() + payload.size();
+
+            HistoryRecord record = {};
+            int64_t delta = 0;
+            uint32_t run = 0;
+            for (uint32_t i = 0; i < block.summary.count; i++) {
+                int64_t value = ArchiveEncoding::GetZigzag(p[COLUMN_TIME], end);
+                if (i == 0) {
+                    record.timeMs = value;
+                } else {
+                    delta = i == 1 ? value : delta + value;
+                    record.timeMs += delta;
+                }
+                record.cpu = (uint16_t)(record.cpu + ArchiveEncoding::GetZigzag(p[COLUMN_CPU], end));
+                record.memory = (uint16_t)(record.memory + ArchiveEncoding::GetZigzag(p[COLUMN_MEMORY], end));
+                record.battery = (int8_t)((uint8_t)record.battery ^ (uint8_t)ArchiveEncoding::GetVarint(p[COLUMN_BATTERY], end));
+                if (run == 0) {
+                    record.state = (uint8_t)ArchiveEncoding::GetVarint(p[COLUMN_STATE], end);
+                    run = (uint32_t)ArchiveEncoding::GetVarint(p[COLUMN_STATE], end);
+                }
+                run--;
+                if (record.timeMs >= fromMs && record.timeMs < toMs) visit(record);
+            }
+        }
+    }
+
+    int BlockCount() const { return (int)m_blocks.size(); }
+
+    int64_t FileBytes() const {
+        return m_file ? m_fileEnd : 0;
+    }
+
+private:
+    enum ChunkType : uint8_t { CHUNK_BLOCK = 1, CHUNK_ROLLUP = 2 };
+
+    struct ChunkHeader {
+        char magic[4];         // "ETMA"
+        uint8_t type;          // ChunkType
+        uint8_t reserved[3];
+        uint32_t payloadBytes;
+        uint32_t padding;
+        int64_t startMs;
+        int64_t endMs;
+    };
+    static_assert(sizeof(ChunkHeader) == 32, "chunk header layout is part of the file format");
+
+    struct BlockIndex {
+        int64_t startMs;
+        int64_t endMs;
+        int64_t offset;        // Payload position in the file
+        uint32_t payloadBytes;
+        BlockSummary summary;
+    };
+
+    bool LoadIndex() {
+        Seek(0, SEEK_END);
+        int64_t size = Tell();
+        m_fileEnd = 0;
+
+        ChunkHeader header;
+        while (ReadAt(m_fileEnd, &header, sizeof(header)) && std::memcmp(header.magic, "ETMA", 4) == 0) {
+            int64_t payload = m_fileEnd + (int64_t)sizeof(header);
+            // A chunk cut short by a crash ends the archive; the next write replaces it
+            if (payload + (int64_t)header.payloadBytes > size) {
+                break;
+            }
+            if (header.type == CHUNK_BLOCK) {
+                BlockIndex block = { header.startMs, header.endMs, payload, header.payloadBytes, {} };
+                if (header.payloadBytes < sizeof(BlockSummary) || !ReadAt(payload, &block.summary, sizeof(BlockSummary))) {
+                    break;
+                }
+                m_blocks.push_back(block);
+            } else if (header.type == CHUNK_ROLLUP) {
+                std::vector<Rollup> rollups(header.payloadBytes / sizeof(Rollup));
+                if (!ReadAt(payload, rollups.data(), rollups.size() * sizeof(Rollup))) {
+                    break;
+                }
+                for (const Rollup& rollup : rollups) {
+                    if (rollup.level < ROLLUP_LEVELS) m_rollups[rollup.level].push_back(rollup);
+                }
+            }
+            m_fileEnd = payload + (int64_t)header.payloadBytes;
+        }
+        return true;
+    }
+
+    // fseek/ftell take a long, which is 32 bits on Windows
+    int Seek(int64_t offset, int origin) {
+#ifdef _WIN32
+        return _fseeki64(m_file, offset, origin);
+#else
+        return fseeko(m_file, (off_t)offset, origin);
+#endif
+    }
+
+    int64_t Tell() {
+#ifdef _WIN32
+        return _ftelli64(m_file);
+#else
+        return (int64_t)ftello(m_file);
+#endif
+    }
+
+    bool ReadAt(int64_t offset, void* data, std::size_t size) {
+        if (Seek(offset, SEEK_SET) != 0) return false;
+        return size == 0 || std::fread(data, 1, size, m_file) == size;
+    }
+
+    bool ReadPayload(const BlockIndex& block, std::vector<uint8_t>& payload) {
+        payload.resize(block.payloadBytes);
+        return ReadAt(block.offset, payload.data(), payload.size());
+    }
+
+    void WriteChunk(ChunkType type, int64_t startMs, int64_t endMs, const std::vector<uint8_t>& payload,
+                    const BlockSummary* summary) {
+        ChunkHeader header = {};
+        std::memcpy(header.magic, "ETMA", 4);
+        header.type = type;
+        header.payloadBytes = (uint32_t)payload.size();
+        header.startMs = startMs;
+        header.endMs = endMs;
+        Seek(m_fileEnd, SEEK_SET);
+        std::fwrite(&header, sizeof(header), 1, m_file);
+        std::fwrite(payload.data(), 1, payload.size(), m_file);
+        if (summary) {
+            m_blocks.push_back(BlockIndex{ startMs, endMs, m_fileEnd + (int64_t)sizeof(header), header.payloadBytes, *summary });
+        }
+        m_fileEnd += (int64_t)(sizeof(header) + payload.size());
+    }
+
+    static int64_t SampleSpan(const int64_t* time, int count, int i) {
+        int64_t span = i + 1 < count ? time[i + 1] - time[i] : (i > 0 ? time[i] - time[i - 1] : 0);
+        return span < ARCHIVE_MAX_SAMPLE_GAP_MS ? span : ARCHIVE_MAX_SAMPLE_GAP_MS;
+    }
+
+    BlockSummary Summarize(const int64_t* time, const uint8_t* state, int count) const {
+        BlockSummary summary = {};
+        summary.count = (uint32_t)count;
+        summary.cpuMin = summary.memoryMin = 0xFFFF;
+        double cpuSum = 0;
+        double memorySum = 0;
+        for (int i = 0; i < count; i++) {
+            summary.stateMs[state[i]] += (uint32_t)SampleSpan(time, count, i);
+            if (m_cpu[i] < summary.cpuMin) summary.cpuMin = m_cpu[i];
+            if (m_cpu[i] > summary.cpuMax) summary.cpuMax = m_cpu[i];
+            if (m_memory[i] < summary.memoryMin) summary.memoryMin = m_memory[i];
+            if (m_memory[i] > summary.memoryMax) summary.memoryMax = m_memory[i];
+            cpuSum += m_cpu[i];
+            memorySum += m_memory[i];
+        }
+        summary.cpuAvg = (float)(cpuSum / count);
+        summary.memoryAvg = (float)(memorySum / count);
+        return summary;
+    }
+
+    void EncodeBlock(BlockSummary& summary, std::vector<uint8_t>& payload) const {
+        using namespace ArchiveEncoding;
+        std::vector<uint8_t> columns[COLUMN_COUNT];
+        int64_t previousDelta = 0;
+        for (int i = 0; i < m_count; i++) {
+            if (i == 0) {
+                PutZigzag(columns[COLUMN_TIME], m_time[0]);
+            } else {
+                int64_t delta = m_time[i] - m_time[i - 1];
+                PutZigzag(columns[COLUMN_TIME], i == 1 ? delta : delta - previousDelta);
+                previousDelta = delta;
+            }
+            PutZigzag(columns[COLUMN_CPU], (int64_t)m_cpu[i] - (i ? m_cpu[i - 1] : 0));
+            PutZigzag(columns[COLUMN_MEMORY], (int64_t)m_memory[i] - (i ? m_memory[i - 1] : 0));
+            PutVarint(columns[COLUMN_BATTERY], (uint8_t)m_battery[i] ^ (uint8_t)(i ? m_battery[i - 1] : 0));
+            if (i == 0 || m_state[i] != m_state[i - 1]) {
+                int run = 1;
+                while (i + run < m_count && m_state[i + run] == m_state[i]) run++;
+                PutVarint(columns[COLUMN_STATE], m_state[i]);
+                PutVarint(columns[COLUMN_STATE], (uint64_t)run);
+            }
+        }
+        for (int c = 0; c < COLUMN_COUNT; c++) {
+            summary.columnBytes[c] = (uint32_t)columns[c].size();
+        }
+        payload.assign((const uint8_t*)&summary, (const uint8_t*)&summary + sizeof(summary));
+        for (int c = 0; c < COLUMN_COUNT; c++) {
+            payload.insert(payload.end(), columns[c].begin(), columns[c].end());
+        }
+    }
+
+    static void ColumnStarts(const BlockSummary& summary, const std::vector<uint8_t>& payload,
+                             const uint8_t* (&columns)[COLUMN_COUNT]) {
+        const uint8_t* p = payload.data() + sizeof(BlockSummary);
+        for (int c = 0; c < COLUMN_COUNT; c++) {
+            columns[c] = p;
+            p += summary.columnBytes[c];
+        }
+    }
+
+    // Reads just the time and state columns of a block
+    int DecodeTimeAndState(const BlockIndex& block, int64_t* time, uint8_t* state) {
+        using namespace ArchiveEncoding;
+        uint32_t bytes = block.summary.columnBytes[COLUMN_TIME];
+        int64_t stateOffset = block.offset + (int64_t)sizeof(BlockSummary);
+        for (int c = 0; c < COLUMN_STATE; c++) stateOffset += block.summary.columnBytes[c];
+
+        std::vector<uint8_t>& buffer = m_scratch;
+        buffer.resize(bytes + block.summary.columnBytes[COLUMN_STATE]);
+        if (!ReadAt(block.offset + (int64_t)sizeof(BlockSummary), buffer.data(), bytes) ||
+            !ReadAt(stateOffset, buffer.data() + bytes, block.summary.columnBytes[COLUMN_STATE])) {
+            return 0;
+        }
+        int count = (int)block.summary.count;
+        const uint8_t* p = buffer.data();
+        const uint8_t* end = buffer.data() + bytes;
+        int64_t delta = 0;
+        for (int i = 0; i < count; i++) {
+            if (i == 0) {
+                time[0] = GetZigzag(p, end);
+            } else {
+                delta = i == 1 ? GetZigzag(p, end) : delta + GetZigzag(p, end);
+                time[i] = time[i - 1] + delta;
+            }
+        }
+        p = end;
+        end = buffer.data() + buffer.size();
+        for (int i = 0; i < count;) {
+            uint8_t value = (uint8_t)GetVarint(p, end);
+            uint64_t run = GetVarint(p, end);
+            if (run == 0 || value >= EMOTIONAL_STATE_COUNT) break;
+            for (uint64_t r = 0; r < run && i < count; r++) state[i++] = value;
+        }
+        return count;
+    }
+
+    static void ClipStates(const int64_t* time, const uint8_t* state, int count, int64_t fromMs, int64_t toMs,
+                           uint64_t (&durations)[EMOTIONAL_STATE_COUNT]) {
+        for (int i = 0; i < count; i++) {
+            int64_t start = time[i] > fromMs ? time[i] : fromMs;
+            int64_t end = time[i] + SampleSpan(time, count, i);
+            if (end > toMs) end = toMs;
+            if (end > start) durations[state[i]] += (uint64_t)(end - start);
+        }
+    }
+
+    void Accumulate(Rollup& rollup, RollupLevel level, const HistoryRecord& sample) {
+        int64_t span = ROLLUP_SPAN_MS[level];
+        int64_t start = sample.timeMs - ((sample.timeMs % span) + span) % span;
+        if (rollup.count && rollup.startMs != start) {
+            Finish(rollup, level);
+        }
+        if (!rollup.count) {
+            rollup = Rollup{ start, 0, 0xFFFF, 0, 0xFFFF, 0, 0.0f, 0.0f, 127, -1, 0, (uint8_t)level };
+            std::memset(m_stateCounts[level], 0, sizeof(m_stateCounts[level]));
+        }
+        rollup.count++;
+        if (sample.cpu < rollup.cpuMin) rollup.cpuMin = sample.cpu;
+        if (sample.cpu > rollup.cpuMax) rollup.cpuMax = sample.cpu;
+        if (sample.memory < rollup.memoryMin) rollup.memoryMin = sample.memory;
+        if (sample.memory > rollup.memoryMax) rollup.memoryMax = sample.memory;
+        if (sample.battery < rollup.batteryMin) rollup.batteryMin = sample.battery;
+        if (sample.battery > rollup.batteryMax) rollup.batteryMax = sample.battery;
+        rollup.cpuAvg += ((float)sample.cpu - rollup.cpuAvg) / (float)rollup.count;
+        rollup.memoryAvg += ((float)sample.memory - rollup.memoryAvg) / (float)rollup.count;
+        m_stateCounts[level][sample.state < EMOTIONAL_STATE_COUNT ? sample.state : 0]++;
+    }
+
+    void Finish(Rollup& rollup, RollupLevel level) {
+        int dominant = 0;
+        for (int s = 1; s < EMOTIONAL_STATE_COUNT; s++) {
+            if (m_stateCounts[level][s] > m_stateCounts[level][dominant]) dominant = s;
+        }
+        rollup.state = (uint8_t)dominant;
+        m_finished[level].push_back(rollup);
+        rollup.count = 0;
+    }
+
+    FILE* m_file = nullptr;
+    bool m_readOnly = false;
+    int64_t m_fileEnd = 0;
+    std::vector<BlockIndex> m_blocks;
+    std::vector<Rollup> m_rollups[ROLLUP_LEVELS];    // Written to the file
+    std::vector<Rollup> m_finished[ROLLUP_LEVELS];   // Complete, written with the next block
+    Rollup m_open[ROLLUP_LEVELS] = {};               // Still accumulating
+    uint32_t m_stateCounts[ROLLUP_LEVELS][EMOTIONAL_STATE_COUNT] = {};
+    std::vector<uint8_t> m_scratch;
+
+    // Samples not yet sealed into a block
+    int m_count = 0;
+    int64_t m_time[BLOCK_SAMPLES];
+    uint16_t m_cpu[BLOCK_SAMPLES];
+    uint16_t m_memory[BLOCK_SAMPLES];
+    int8_t m_battery[BLOCK_SAMPLES];
+    uint8_t m_state[BLOCK_SAMPLES];
+};
@@ -0,0 +1,226 @@
+#pragma once
+
+// Fixed-size on-disk ring of metric and state history, written through a memory map.
+//
+// The file is a 64-byte header followed by `capacity` 32-byte records. Record n (its
+// 1-based sequence number) always lives in slot (n - 1) % capacity, and carries a
+// checksum over its own bytes. Appending is a struct copy into mapped memory: no
+// allocation, no syscall and no flush; the OS writes pages back on its own schedule
+// and the data survives a crash of the app.
+//
+// Nothing in the file needs to be consistent across a crash. The header's next
+// sequence is only a hint; opening the file scans for the highest valid record and
+// resumes after it. A record torn by power loss (or caught mid-write by a reader)
+// fails its checksum and is skipped, as is one whose sequence doesn't belong in its
+// slot.
+//
+// Readers: tools/history_dump.cpp.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Why a record was written
+enum HistoryFlags {
+    HISTORY_SAMPLE = 1 << 0,          // Periodic metric sample
+    HISTORY_STATE_CHANGE = 1 << 1,    // The emotional state changed with this record
+    HISTORY_DEVICE_CHANGE = 1 << 2,   // Device connected/disconnected (SURPRISED)
+    HISTORY_APP_ERROR = 1 << 3,       // Application error event (GRIMACE)
+    HISTORY_RULES_RELOADED = 1 << 4,  // rules.conf was reloaded
+    HISTORY_STARTED = 1 << 5          // First record after the app started
+};
+
+const char HISTORY_MAGIC[8] = { 'E', 'T', 'M', 'H', 'I', 'S', 'T', '1' };
+const uint32_t HISTORY_VERSION = 1;
+const uint64_t HISTORY_DEFAULT_CAPACITY = 262144;   // 8 MiB, about 36 hours at 2 samples/s
+
+struct HistoryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t capacity;
+    uint64_t nextSequence;   // Hint only; recovered by scanning on open
+    uint8_t reserved[32];
+};
+
+struct HistoryRecord {
+    uint64_t sequence;       // 1-based, 0 = empty slot
+    int64_t timeMs;          // Unix time in milliseconds
+    uint16_t cpu;            // Hundredths of a percent
+    uint16_t memory;         // Hundredths of a percent
+    int8_t battery;          // Percent, -1 without a battery
+    uint8_t state;           // EmotionalState
+    uint16_t flags;          // HistoryFlags
+    uint16_t hottestCore;    // Hundredths of a percent
+    uint16_t saturatedCores;
+    uint32_t check;          // FNV-1a of the bytes above
+};
+
+static_assert(sizeof(HistoryHeader) == 64, "history header layout is part of the file format");
+static_assert(sizeof(HistoryRecord) == 32, "history record layout is part of the file format");
+
+inline uint32_t HistoryChecksum(const HistoryRecord& record) {
+    const uint8_t* bytes = (const uint8_t*)&record;
+    uint32_t hash = 2166136261u;
+    for (std::size_t i = 0; i < offsetof(HistoryRecord, check); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+inline bool HistoryRecordValid(const HistoryRecord& record, uint64_t slot, uint64_t capacity) {
+    return record.sequence != 0 && (record.sequence - 1) % capacity == slot && record.check == HistoryChecksum(record);
+}
+
+// Highest valid sequence in the ring, 0 if it's empty
+inline uint64_t HistoryLastSequence(const HistoryRecord* records, uint64_t capacity) {
+    uint64_t last = 0;
+    for (uint64_t slot = 0; slot < capacity; slot++) {
+        if (HistoryRecordValid(records[slot], slot, capacity) && records[slot].sequence > last) {
+            last = records[slot].sequence;
+        }
+    }
+    return last;
+}
+
+// Calls visit(const HistoryRecord&) for every valid record, oldest first
+template <typename Visit>
+void ForEachHistoryRecord(const HistoryRecord* records, uint64_t capacity, Visit visit) {
+    uint64_t last = HistoryLastSequence(records, capacity);
+    uint64_t first = last > capacity ? last - capacity + 1 : 1;
+    for (uint64_t sequence = first; sequence <= last && last != 0; sequence++) {
+        const HistoryRecord& record = records[(sequence - 1) % capacity];
+        if (record.sequence == sequence && record.check == HistoryChecksum(record)) {
+            visit(record);
+        }
+    }
+}
+
+class HistoryRing {
+public:
+    ~HistoryRing() { Close(); }
+
+    // Maps the file, creating or re-initializing it if it doesn't match `capacity`
+#ifdef _WIN32
+    bool Open(const wchar_t* path, uint64_t capacity = HISTORY_DEFAULT_CAPACITY) {
+#else
+    bool Open(const char* path, uint64_t capacity = HISTORY_DEFAULT_CAPACITY) {
+#endif
+        Close();
+        if (capacity == 0) {
+            return false;
+        }
+        m_size = sizeof(HistoryHeader) + capacity * sizeof(HistoryRecord);
+
+#ifdef _WIN32
+        m_file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL, NULL);
+        if (m_file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER existing = {};
+        GetFileSizeEx(m_file, &existing);
+        m_mapping = CreateFileMappingW(m_file, NULL, PAGE_READWRITE, (DWORD)(m_size >> 32), (DWORD)m_size, NULL);
+        m_view = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, (SIZE_T)m_size) : NULL;
+        uint64_t existingSize = (uint64_t)existing.QuadPart;
+#else
+        m_fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (m_fd < 0) {
+            return false;
+        }
+        struct stat info;
+        uint64_t existingSize = fstat(m_fd, &info) == 0 ? (uint64_t)info.st_size : 0;
+        if (existingSize != m_size && ftruncate(m_fd, (off_t)m_size) != 0) {
+            Close();
+            return false;
+        }
+        m_view = mmap(nullptr, (std::size_t)m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        if (m_view == MAP_FAILED) m_view = nullptr;
+#endif
+        if (!m_view) {
+            Close();
+            return false;
+        }
+
+        m_header = (HistoryHeader*)m_view;
+        m_records = (HistoryRecord*)((char*)m_view + sizeof(HistoryHeader));
+        if (existingSize != m_size || std::memcmp(m_header->magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC)) != 0 ||
+            m_header->version != HISTORY_VERSION || m_header->recordSize != sizeof(HistoryRecord) ||
+            m_header->capacity != capacity) {
+            std::memset(m_view, 0, (std::size_t)m_size);
+            std::memcpy(m_header->magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC));
+            m_header->version = HISTORY_VERSION;
+            m_header->recordSize = sizeof(HistoryRecord);
+            m_header->capacity = capacity;
+        }
+        m_capacity = capacity;
+        m_next = HistoryLastSequence(m_records, capacity) + 1;
+        m_header->nextSequence = m_next;
+        return true;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (m_view) UnmapViewOfFile(m_view);
+        if (m_mapping) CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+        m_mapping = NULL;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if (m_view) munmap(m_view, (std::size_t)m_size);
+        if (m_fd >= 0) close(m_fd);
+        m_fd = -1;
+#endif
+        m_view = nullptr;
+        m_header = nullptr;
+        m_records = nullptr;
+        m_capacity = 0;
+    }
+
+    bool IsOpen() const { return m_view != nullptr; }
+
+    // Stamps the sequence and checksum and copies the record into its slot
+    void Append(HistoryRecord record) {
+        if (!m_view) {
+            return;
+        }
+        record.sequence = m_next++;
+        record.check = HistoryChecksum(record);
+        m_records[(record.sequence - 1) % m_capacity] = record;
+        m_header->nextSequence = m_next;
+    }
+
+    const HistoryRecord* Records() const { return m_records; }
+    uint64_t Capacity() const { return m_capacity; }
+    uint64_t NextSequence() const { return m_next; }
+
+private:
+    void* m_view = nullptr;
+    HistoryHeader* m_header = nullptr;
+    HistoryRecord* m_records = nullptr;
+    uint64_t m_size = 0;
+    uint64_t m_capacity = 0;
+    uint64_t m_next = 1;
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = NULL;
+#else
+    int m_fd = -1;
+#endif
+};
+
+// Percent (0..100) to the record's hundredths encoding, clamped
+inline uint16_t HistoryPercent(double percent) {
+    if (!(percent > 0)) return 0;
+    if (percent >= 655.35) return 65535;
+    return (uint16_t)(percent * 100.0 + 0.5);
+}
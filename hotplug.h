@@ -0,0 +1,264 @@
+#pragma once
+
+// Device and display hotplug, debounced.
+//
+// Docking a laptop delivers dozens of arrival, removal and display-change
+// notifications within a second or two. HotplugDebouncer turns such a burst into
+// one SURPRISED (on its first device event) and one window reposition (once the
+// last display-related event has had time to settle). Like StateMachine it is pure
+// logic driven with the caller's clock, so the app runs it on the monitor thread and
+// tools/hotplug_replay.cpp runs it against synthetic bursts.
+//
+// On Linux, UeventListener is the event source: one thread reading kernel uevents
+// from a netlink socket into a fixed buffer and handing each add/remove (and DRM
+// change) to a handler. The Windows build feeds the debouncer from WM_DEVICECHANGE
+// and WM_DISPLAYCHANGE instead.
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __linux__
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+enum HotplugKind {
+    HOTPLUG_ARRIVAL,   // A device was connected
+    HOTPLUG_REMOVAL,   // A device was disconnected
+    HOTPLUG_DISPLAY,   // The display configuration changed
+    HOTPLUG_KIND_COUNT
+};
+
+struct HotplugEvent {
+    HotplugKind kind;
+    bool display;      // May have changed the monitor layout, so the window should move
+};
+
+const int HOTPLUG_QUIET_MS = 1000;        // A gap this long between events ends a burst
+const int HOTPLUG_MAX_DEFER_MS = 10000;   // A steady stream of events still repositions this often
+
+// How long after an event the display is settled enough to reposition. Arrivals take
+// longest: a new monitor has to finish initializing.
+const int HOTPLUG_SETTLE_MS[HOTPLUG_KIND_COUNT] = { 2000, 800, 1000 };
+
+struct HotplugStep {
+    bool surprise;     // First device event of a burst: show SURPRISED
+    bool reposition;   // The reposition deadline was armed or moved; reschedule at RepositionDeadline()
+};
+
+class HotplugDebouncer {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    HotplugStep Add(const HotplugEvent& event, TimePoint now) {
+        HotplugStep step = { false, false };
+        if (!m_started || now - m_lastEvent >= std::chrono::milliseconds(HOTPLUG_QUIET_MS)) {
+            m_started = true;
+            m_surprised = false;
+            m_bursts++;
+        }
+        m_lastEvent = now;
+        m_events++;
+
+        if (event.kind != HOTPLUG_DISPLAY && !m_surprised) {
+            m_surprised = true;
+            m_surprises++;
+            step.surprise = true;
+        }
+
+        if (event.display || event.kind == HOTPLUG_DISPLAY) {
+            TimePoint deadline = now + std::chrono::milliseconds(HOTPLUG_SETTLE_MS[event.kind]);
+            if (!m_repositionPending) {
+                m_repositionPending = true;
+                m_firstDeferred = now;
+                m_deadline = deadline;
+                step.reposition = true;
+            } else if (deadline > m_deadline) {
+                TimePoint latest = m_firstDeferred + std::chrono::milliseconds(HOTPLUG_MAX_DEFER_MS);
+                TimePoint moved = (std::min)(deadline, latest);
+                step.reposition = moved > m_deadline;
+                m_deadline = (std::max)(m_deadline, moved);
+            }
+        }
+        return step;
+    }
+
+    bool RepositionPending() const { return m_repositionPending; }
+    TimePoint RepositionDeadline() const { return m_deadline; }
+
+    // True once the pending reposition is due; the caller repositions and the next
+    // display event starts a new deferral
+    bool TakeReposition(TimePoint now) {
+        if (!m_repositionPending || now < m_deadline) {
+            return false;
+        }
+        m_repositionPending = false;
+        m_repositions++;
+        return true;
+    }
+
+    uint64_t Events() const { return m_events; }
+    uint64_t Bursts() const { return m_bursts; }
+    uint64_t Surprises() const { return m_surprises; }
+    uint64_t Repositions() const { return m_repositions; }
+
+private:
+    bool m_started = false;
+    TimePoint m_lastEvent;
+    bool m_surprised = false;          // This burst already showed SURPRISED
+    bool m_repositionPending = false;
+    TimePoint m_firstDeferred;         // First display event since the last reposition
+    TimePoint m_deadline;
+    uint64_t m_events = 0;
+    uint64_t m_bursts = 0;
+    uint64_t m_surprises = 0;
+    uint64_t m_repositions = 0;
+};
+
+#ifdef __linux__
+
+// Reads kernel uevents on one thread and passes add/remove (and DRM change) events
+// to the handler, which runs on that thread and should only hand the event over.
+class UeventListener {
+public:
+    typedef std::function<void(const HotplugEvent&)> Handler;
+
+    ~UeventListener() { Stop(); }
+
+    // Listens to the kernel's uevent multicast group
+    bool Start(Handler handler) {
+        Stop();
+        int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+        if (fd < 0) {
+            return false;
+        }
+        // Docking can queue hundreds of messages; a larger buffer makes overflow rare
+        int size = 1 << 20;
+        if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) != 0) {
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+        sockaddr_nl address = {};
+        address.nl_family = AF_NETLINK;
+        address.nl_groups = 1;   // Kernel events, not udev's rebroadcasts
+        if (bind(fd, (const sockaddr*)&address, sizeof(address)) != 0) {
+            close(fd);
+            return false;
+        }
+        return StartOn(fd, handler);
+    }
+
+    // Reads uevent-formatted datagrams from `fd` instead, taking ownership of it.
+    // For replaying captured or synthetic events.
+    bool StartOn(int fd, Handler handler) {
+        Stop();
+        if (pipe(m_stopPipe) != 0) {
+            close(fd);
+            return false;
+        }
+        m_fd = fd;
+        m_handler = handler;
+        m_thread = std::thread(&UeventListener::Run, this);
+        return true;
+    }
+
+    void Stop() {
+        if (m_stopPipe[1] >= 0) {
+            char byte = 0;
+            ssize_t written = write(m_stopPipe[1], &byte, 1);
+            (void)written;
+        }
+        if (m_thread.joinable()) m_thread.join();
+        for (int* fd : { &m_fd, &m_stopPipe[0], &m_stopPipe[1] }) {
+            if (*fd >= 0) close(*fd);
+            *fd = -1;
+        }
+    }
+
+    uint64_t Messages() const { return m_messages.load(std::memory_order_relaxed); }
+    uint64_t Overflows() const { return m_overflows.load(std::memory_order_relaxed); }
+
+    // Parses one kernel uevent ("add@/devices/...\0ACTION=add\0SUBSYSTEM=usb\0...").
+    // False for actions that don't change what's plugged in (bind, change, ...).
+    static bool Parse(const char* data, std::size_t length, HotplugEvent& event) {
+        const char* action = "";
+        const char* subsystem = "";
+        bool hotplug = false;
+        for (std::size_t i = 0; i < length;) {
+            const char* field = data + i;
+            std::size_t size = strnlen(field, length - i);
+            if (i + size == length) {
+                break;   // Unterminated last field: the message was cut off
+            }
+            if (size > 7 && std::memcmp(field, "ACTION=", 7) == 0) action = field + 7;
+            else if (size > 10 && std::memcmp(field, "SUBSYSTEM=", 10) == 0) subsystem = field + 10;
+            else if (size == 9 && std::memcmp(field, "HOTPLUG=1", 9) == 0) hotplug = true;
+            i += size + 1;
+        }
+        bool drm = std::strcmp(subsystem, "drm") == 0;
+        if (std::strcmp(action, "add") == 0) {
+            event.kind = HOTPLUG_ARRIVAL;
+        } else if (std::strcmp(action, "remove") == 0) {
+            event.kind = HOTPLUG_REMOVAL;
+        } else if (std::strcmp(action, "change") == 0 && drm && hotplug) {
+            event.kind = HOTPLUG_DISPLAY;   // A connector's monitor came or went
+        } else {
+            return false;
+        }
+        event.display = drm;
+        return true;
+    }
+
+private:
+    void Run() {
+        for (;;) {
+            pollfd fds[2] = { { m_fd, POLLIN, 0 }, { m_stopPipe[0], POLLIN, 0 } };
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (fds[1].revents) {
+                break;
+            }
+            ssize_t length = recv(m_fd, m_buffer, sizeof(m_buffer) - 1, MSG_DONTWAIT);
+            if (length < 0) {
+                if (errno == ENOBUFS) {
+                    // Messages were lost, so assume the worst: something, maybe a display, changed
+                    m_overflows.fetch_add(1, std::memory_order_relaxed);
+                    HotplugEvent lost = { HOTPLUG_ARRIVAL, true };
+                    m_handler(lost);
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EINTR) continue;
+                break;
+            }
+            if (length == 0) {
+                if (fds[0].revents & POLLHUP) break;   // Peer of a replay socket hung up
+                continue;
+            }
+            m_messages.fetch_add(1, std::memory_order_relaxed);
+            HotplugEvent event;
+            if (Parse(m_buffer, (std::size_t)length, event)) {
+                m_handler(event);
+            }
+        }
+    }
+
+    int m_fd = -1;
+    int m_stopPipe[2] = { -1, -1 };
+    Handler m_handler;
+    std::thread m_thread;
+    std::atomic<uint64_t> m_messages{ 0 };
+    std::atomic<uint64_t> m_overflows{ 0 };
+    char m_buffer[8192];   // Uevents are at most a few KiB
+};
+
+#endif
@@ -0,0 +1,264 @@
+#pragma once
+
+// Linux sampling backend for the same three metrics the Windows build reads from
+// PDH, GlobalMemoryStatusEx and GetSystemPowerStatus.
+//
+// All files are opened once in Open() and re-read with pread() into fixed buffers,
+// so a sample costs no heap allocations and one syscall per metric. The root
+// prefix lets a directory of fixture files stand in for /proc and /sys.
+
+#ifdef __linux__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "core_stats.h"
+
+class LinuxSampler {
+public:
+    explicit LinuxSampler(const char* root = "") {
+        std::snprintf(m_root, sizeof(m_root), "%s", root);
+    }
+
+    ~LinuxSampler() {
+        Close();
+    }
+
+    LinuxSampler(const LinuxSampler&) = delete;
+    LinuxSampler& operator=(const LinuxSampler&) = delete;
+
+    // Opens /proc/stat, /proc/meminfo and the first battery's capacity file.
+    // Returns false if the CPU or memory source is missing; a missing battery is fine.
+    bool Open() {
+        Close();
+        m_statFd = OpenUnderRoot("/proc/stat");
+        m_meminfoFd = OpenUnderRoot("/proc/meminfo");
+        m_batteryFd = OpenBattery();
+        return m_statFd >= 0 && m_meminfoFd >= 0;
+    }
+
+    void Close() {
+        if (m_statFd >= 0) close(m_statFd);
+        if (m_meminfoFd >= 0) close(m_meminfoFd);
+        if (m_batteryFd >= 0) close(m_batteryFd);
+        m_statFd = m_meminfoFd = m_batteryFd = -1;
+        m_hasPrevious = false;
+    }
+
+    // Percent of non-idle CPU time across all cores since the previous call
+    // (0 on the first call, like the first PDH sample). If `cores` is given, the
+    // per-core lines from the same read of /proc/stat are filled in too.
+    double GetCPUUsage(CoreSamples* cores = nullptr) {
+        int length = ReadFile(m_statFd);
+        if (length < 4 || std::memcmp(m_buffer, "cpu ", 4) != 0) {
+            return 0.0;
+        }
+        const char* end = m_buffer + length;
+
+        uint64_t busy = 0;
+        uint64_t total = 0;
+        const char* p = ParseCPUTimes(m_buffer + 4, end, busy, total);
+        double usage = Utilization(busy, total, m_previousBusy, m_previousTotal);
+
+        if (cores) {
+            cores->count = 0;
+            // "cpuN ..." lines follow the aggregate line; offline cores are simply absent
+            while (p && end - p > 3 && std::memcmp(p, "cpu", 3) == 0) {
+                uint64_t index = 0;
+                const char* fields = ParseU64(p + 3, end, index);
+                if (!fields || index >= (uint64_t)MAX_CORES) {
+                    break;
+                }
+                p = ParseCPUTimes(fields, end, busy, total);
+                cores->usage[cores->count++] = (float)Utilization(busy, total, m_previousCoreBusy[index], m_previousCoreTotal[index]);
+            }
+        }
+
+        m_hasPrevious = true;
+        return usage;
+    }
+
+    // Percent of physical memory in use, matching MEMORYSTATUSEX::dwMemoryLoad
+    double GetMemoryUsage() {
+        int length = ReadFile(m_meminfoFd);
+        if (length <= 0) {
+            return 0.0;
+        }
+
+        uint64_t totalKb = 0;
+        uint64_t availableKb = 0;
+        if (!FindField(m_buffer, m_buffer + length, "MemTotal:", totalKb) || totalKb == 0) {
+            return 0.0;
+        }
+        if (!FindField(m_buffer, m_buffer + length, "MemAvailable:", availableKb)) {
+            // Kernels before 3.14 don't report MemAvailable
+            uint64_t freeKb = 0, buffersKb = 0, cachedKb = 0;
+            FindField(m_buffer, m_buffer + length, "MemFree:", freeKb);
+            FindField(m_buffer, m_buffer + length, "Buffers:", buffersKb);
+            FindField(m_buffer, m_buffer + length, "Cached:", cachedKb);
+            availableKb = freeKb + buffersKb + cachedKb;
+        }
+        if (availableKb > totalKb) {
+            availableKb = totalKb;
+        }
+        return 100.0 * (double)(totalKb - availableKb) / (double)totalKb;
+    }
+
+    // Same contract as the Windows CheckBatteryStatus(): no battery reports 100%
+    void CheckBatteryStatus(int& batteryPercent, bool& hasBattery) {
+        int length = ReadFile(m_batteryFd);
+        uint64_t capacity = 0;
+        hasBattery = length > 0 && ParseU64(m_buffer, m_buffer + length, capacity) != nullptr;
+        if (hasBattery) {
+            batteryPercent = capacity > 100 ? 100 : (int)capacity; // Sanitize value
+        } else {
+            batteryPercent = 100; // Default for PCs without battery
+        }
+    }
+
+    // Skips spaces, then parses an unsigned decimal. Returns the position after the
+    // digits, or nullptr if there were none.
+    static const char* ParseU64(const char* p, const char* end, uint64_t& value) {
+        while (p < end && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        if (p == end || *p < '0' || *p > '9') {
+            return nullptr;
+        }
+        value = 0;
+        while (p < end && *p >= '0' && *p <= '9') {
+            value = value * 10 + (uint64_t)(*p - '0');
+            p++;
+        }
+        return p;
+    }
+
+private:
+    // Big enough for /proc/stat on a machine with MAX_CORES cores
+    static const std::size_t BUFFER_SIZE = 131072;
+
+    int OpenUnderRoot(const char* path) {
+        char fullPath[512];
+        std::snprintf(fullPath, sizeof(fullPath), "%s%s", m_root, path);
+        return open(fullPath, O_RDONLY | O_CLOEXEC);
+    }
+
+    // Picks the first power supply whose type is "Battery"
+    int OpenBattery() {
+        char directory[512];
+        std::snprintf(directory, sizeof(directory), "%s/sys/class/power_supply", m_root);
+        DIR* dir = opendir(directory);
+        if (!dir) {
+            return -1;
+        }
+
+        int fd = -1;
+        while (struct dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            char path[1024];
+            std::snprintf(path, sizeof(path), "%s/%s/type", directory, entry->d_name);
+            int typeFd = open(path, O_RDONLY | O_CLOEXEC);
+            if (typeFd < 0) {
+                continue;
+            }
+            char type[32] = {};
+            ssize_t length = pread(typeFd, type, sizeof(type) - 1, 0);
+            close(typeFd);
+            if (length >= 7 && std::memcmp(type, "Battery", 7) == 0) {
+                std::snprintf(path, sizeof(path), "%s/%s/capacity", directory, entry->d_name);
+                fd = open(path, O_RDONLY | O_CLOEXEC);
+                if (fd >= 0) {
+                    break;
+                }
+            }
+        }
+        closedir(dir);
+        return fd;
+    }
+
+    // Re-reads a whole pseudo-file from offset 0 into m_buffer
+    int ReadFile(int fd) {
+        if (fd < 0) {
+            return -1;
+        }
+        ssize_t length = pread(fd, m_buffer, BUFFER_SIZE - 1, 0);
+        if (length < 0) {
+            return -1;
+        }
+        m_buffer[length] = '\0';
+        return (int)length;
+    }
+
+    // Fields of a "cpu" line: user nice system idle iowait irq softirq steal ...
+    // Returns the start of the next line, or nullptr at the end of the buffer.
+    static const char* ParseCPUTimes(const char* p, const char* end, uint64_t& busy, uint64_t& total) {
+        uint64_t idle = 0;
+        total = 0;
+        // Only the first eight fields; guest time is already counted in user/nice
+        for (int field = 0; field < 8; field++) {
+            uint64_t value = 0;
+            const char* next = ParseU64(p, end, value);
+            if (!next) {
+                break;
+            }
+            p = next;
+            total += value;
+            if (field == 3 || field == 4) { // idle, iowait
+                idle += value;
+            }
+        }
+        busy = total - idle;
+        const char* newline = (const char*)std::memchr(p, '\n', (std::size_t)(end - p));
+        return newline ? newline + 1 : nullptr;
+    }
+
+    // Percent busy between the previous counters and now; updates the previous counters.
+    // Zero previous counters mean a core not seen before (hotplugged, or offline when
+    // sampling started): it reads 0% once, like the first sample, rather than its
+    // average since boot.
+    double Utilization(uint64_t busy, uint64_t total, uint64_t& previousBusy, uint64_t& previousTotal) {
+        double usage = 0.0;
+        if (m_hasPrevious && previousTotal > 0 && total > previousTotal && busy >= previousBusy) {
+            usage = 100.0 * (double)(busy - previousBusy) / (double)(total - previousTotal);
+        }
+        previousBusy = busy;
+        previousTotal = total;
+        return usage;
+    }
+
+    // Finds "Name:   1234 kB" and parses the number
+    static bool FindField(const char* begin, const char* end, const char* name, uint64_t& value) {
+        std::size_t nameLength = std::strlen(name);
+        const char* p = begin;
+        while (p + nameLength <= end) {
+            if (std::memcmp(p, name, nameLength) == 0) {
+                return ParseU64(p + nameLength, end, value) != nullptr;
+            }
+            const char* newline = (const char*)std::memchr(p, '\n', (std::size_t)(end - p));
+            if (!newline) {
+                break;
+            }
+            p = newline + 1;
+        }
+        return false;
+    }
+
+    char m_root[256];
+    int m_statFd = -1;
+    int m_meminfoFd = -1;
+    int m_batteryFd = -1;
+    bool m_hasPrevious = false;
+    uint64_t m_previousBusy = 0;
+    uint64_t m_previousTotal = 0;
+    uint64_t m_previousCoreBusy[MAX_CORES] = {};
+    uint64_t m_previousCoreTotal[MAX_CORES] = {};
+    char m_buffer[BUFFER_SIZE];
+};
+
+#endif // __linux__
@@ -0,0 +1,474 @@
+#pragma once
+
+// Error lines in log files as an event source: the Linux counterpart of the Windows
+// build's EvtSubscribe callback on the Application log.
+//
+// LogSource tails up to MAX_FILES files, or FIFOs standing in for the journal
+// (journalctl -f > fifo), on one thread. An inotify watch on each file's directory
+// says when to read; every read is as large as the file's buffer (1 MiB by default)
+// and LogMatcher scans the complete lines in it in place, over the whole buffer
+// rather than line by line, so nothing is allocated or copied per line. Only the
+// unfinished last line is moved to the front of the buffer for the next read. The
+// handler gets each matching line once, with the first pattern it contained, and
+// should hand it over as a STATE_EVENT_APP_ERROR (event_queue.h), whose arbiter
+// merges and rate limits floods.
+//
+// Rotation is followed by name: when the path turns into a different file (rename
+// and create), the old descriptor is read to its end first, then the new file from
+// its start. A file truncated in place (copytruncate) is read again from the start.
+// A path that doesn't exist yet is picked up when it appears. Lines already in a
+// file when it is added are skipped unless asked for.
+
+#ifdef __linux__
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <poll.h>
+#include <string>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Severity markers of syslog-style and application logs; case matters
+const char* const DEFAULT_LOG_PATTERNS[] = {
+    "error", "ERROR", "Error", "fatal", "FATAL", "panic", "segfault", "Traceback",
+};
+
+// Finds lines containing any of up to MAX_PATTERNS strings (two bytes or longer).
+//
+// Every pattern is anchored on one of its byte pairs, picked to be rare in log text
+// ("rr" in "error", "Tr" in "Traceback"). The scan compares 16 bytes at a time against
+// every anchor pair with GCC vector extensions (SSE2 on x86-64, NEON on ARM) and only
+// verifies the full pattern where a pair lines up, so the text is read once however
+// many patterns there are.
+class LogMatcher {
+public:
+    static const int MAX_PATTERNS = 16;
+
+    bool Add(const char* pattern) {
+        std::size_t length = std::strlen(pattern);
+        if (m_count == MAX_PATTERNS || length < 2) {
+            return false;
+        }
+        std::size_t anchor = 0;
+        for (std::size_t k = 1; k + 1 < length; k++) {
+            if (PairCost(pattern[k], pattern[k + 1]) < PairCost(pattern[anchor], pattern[anchor + 1])) anchor = k;
+        }
+        m_patterns[m_count] = pattern;
+        m_lengths[m_count] = length;
+        m_anchors[m_count] = anchor;
+        for (int i = 0; i < 16; i++) {
+            m_first[m_count][i] = (unsigned char)pattern[anchor];
+            m_second[m_count][i] = (unsigned char)pattern[anchor + 1];
+        }
+        m_count++;
+        return true;
+    }
+
+    int Patterns() const { return m_count; }
+    const char* Pattern(int index) const { return m_patterns[index]; }
+
+    // Calls onLine(pattern, line, length) for every line of [data, data + length)
+    // that contains a pattern, in order, once per line, with the first pattern (in
+    // Add() order) the line contains. The last line needn't end in '\n'. Returns the
+    // number of lines matched.
+    template <typename OnLine>
+    std::size_t Scan(const char* data, std::size_t length, OnLine onLine) const {
+        const unsigned char* text = (const unsigned char*)data;
+        std::size_t matched = 0;
+        std::size_t i = 0;
+        while (i + 1 < length) {
+            // Skip 64 bytes at a time while no anchor pair starts in them
+            while (i + 65 <= length && !AnyPair64(text + i)) {
+                i += 64;
+            }
+
+            // Positions in [i, i + 16) where some anchor pair starts, one bit per byte
+            uint32_t candidates = 0;
+            if (i + 17 <= length) {
+                Bytes16 hits = Pairs(text + i);
+                uint64_t words[2];
+                std::memcpy(words, &hits, 16);
+                if ((words[0] | words[1]) == 0) {
+                    i += 16;
+                    continue;
+                }
+                candidates = ByteMask(words[0]) | ByteMask(words[1]) << 8;
+            } else {
+                for (std::size_t j = i; j + 1 < length && j < i + 16; j++) {
+                    for (int p = 0; p < m_count; p++) {
+                        if (text[j] == m_first[p][0] && text[j + 1] == m_second[p][0]) candidates |= 1u << (j - i);
+                    }
+                }
+                if (candidates == 0) {
+                    break;
+                }
+            }
+
+            std::size_t next = i + 16;
+            while (candidates) {
+                std::size_t position = i + (std::size_t)__builtin_ctz(candidates);
+                candidates &= candidates - 1;
+                if (!MatchesAt(text, length, position)) {
+                    continue;
+                }
+                const char* hit = data + position;
+                const char* lineStart = (const char*)memrchr(data, '\n', position);
+                lineStart = lineStart ? lineStart + 1 : data;
+                const char* lineEnd = (const char*)std::memchr(hit, '\n', length - position);
+                lineEnd = lineEnd ? lineEnd : data + length;
+                onLine(FirstPattern(lineStart, lineEnd), lineStart, (std::size_t)(lineEnd - lineStart));
+                matched++;
+                next = (std::size_t)(lineEnd - data) + 1;
+                break;
+            }
+            i = next;
+        }
+        return matched;
+    }
+
+private:
+    typedef unsigned char Bytes16 __attribute__((vector_size(16)));
+
+    // 0xFF for each of the 16 positions at `text` where an anchor pair starts
+    Bytes16 Pairs(const unsigned char* text) const {
+        Bytes16 first, second;
+        std::memcpy(&first, text, 16);
+        std::memcpy(&second, text + 1, 16);
+        Bytes16 hits = {};
+        for (int p = 0; p < m_count; p++) {
+            hits |= (Bytes16)((first == m_first[p]) & (second == m_second[p]));
+        }
+        return hits;
+    }
+
+    // Whether an anchor pair starts anywhere in the 64 bytes at `text`. Patterns on
+    // the outside, so each anchor is loaded once and the text stays in registers.
+    bool AnyPair64(const unsigned char* text) const {
+        Bytes16 first[4], second[4];
+        std::memcpy(first, text, 64);
+        for (int b = 0; b < 4; b++) {
+            std::memcpy(&second[b], text + b * 16 + 1, 16);
+        }
+        Bytes16 hits = {};
+        Bytes16 hits1 = {}, hits2 = {}, hits3 = {};
+        for (int p = 0; p < m_count; p++) {
+            hits |= (Bytes16)((first[0] == m_first[p]) & (second[0] == m_second[p]));
+            hits1 |= (Bytes16)((first[1] == m_first[p]) & (second[1] == m_second[p]));
+            hits2 |= (Bytes16)((first[2] == m_first[p]) & (second[2] == m_second[p]));
+            hits3 |= (Bytes16)((first[3] == m_first[p]) & (second[3] == m_second[p]));
+        }
+        hits |= hits1 | hits2 | hits3;
+        uint64_t words[2];
+        std::memcpy(words, &hits, 16);
+        return (words[0] | words[1]) != 0;
+    }
+
+    // Rough rarity of a byte pair in log text: common English bigrams and lowercase
+    // letters are expensive, upper case and punctuation cheap
+    static int PairCost(char a, char b) {
+        static const char COMMON_BIGRAMS[] = "thheinerantrereonatenndtiesorteofedisitalarsttontngsehaasouiolevecomedehiriroicneeaace";
+        for (std::size_t k = 0; k + 1 < sizeof(COMMON_BIGRAMS) - 1; k += 2) {
+            if (COMMON_BIGRAMS[k] == a && COMMON_BIGRAMS[k + 1] == b) return 1000;
+        }
+        return ByteCost(a) * ByteCost(b);
+    }
+
+    static int ByteCost(char c) {
+        if (c == ' ' || std::strchr("etaoinsrhl", c)) return 10;
+        if (c >= 'a' && c <= 'z') return 5;
+        if (c >= '0' && c <= '9') return 4;
+        if (c >= 'A' && c <= 'Z') return 2;
+        return 3;
+    }
+
+    // One bit per nonzero byte of a comparison result (bytes are 0 or 0xFF)
+    static uint32_t ByteMask(uint64_t word) {
+        word &= 0x8080808080808080ull;
+        return (uint32_t)((word * 0x0002040810204081ull) >> 56);
+    }
+
+    // Some pattern whose anchor pair starts at `position` matches there
+    bool MatchesAt(const unsigned char* text, std::size_t length, std::size_t position) const {
+        for (int p = 0; p < m_count; p++) {
+            if (text[position] != m_first[p][0] || text[position + 1] != m_second[p][0]) continue;
+            if (position < m_anchors[p] || position - m_anchors[p] + m_lengths[p] > length) continue;
+            if (std::memcmp(text + position - m_anchors[p], m_patterns[p], m_lengths[p]) == 0) return true;
+        }
+        return false;
+    }
+
+    int FirstPattern(const char* lineStart, const char* lineEnd) const {
+        for (int p = 0; p < m_count; p++) {
+            if (memmem(lineStart, (std::size_t)(lineEnd - lineStart), m_patterns[p], m_lengths[p])) return p;
+        }
+        return 0;
+    }
+
+    const char* m_patterns[MAX_PATTERNS];
+    std::size_t m_lengths[MAX_PATTERNS];
+    std::size_t m_anchors[MAX_PATTERNS];   // Offset of the anchor pair in the pattern
+    Bytes16 m_first[MAX_PATTERNS];         // Anchor pair, splatted
+    Bytes16 m_second[MAX_PATTERNS];
+    int m_count = 0;
+};
+
+struct LogMatch {
+    int file;            // Index in AddFile() order
+    int pattern;         // Index in AddPattern() order
+    const char* line;    // Without the '\n'; only valid during the handler call
+    std::size_t length;
+};
+
+class LogSource {
+public:
+    static const int MAX_FILES = 8;
+    static const std::size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+    typedef std::function<void(const LogMatch&)> Handler;
+
+    explicit LogSource(std::size_t bufferSize = DEFAULT_BUFFER_SIZE) : m_bufferSize(bufferSize) {}
+    ~LogSource() { Close(); }
+
+    LogSource(const LogSource&) = delete;
+    LogSource& operator=(const LogSource&) = delete;
+
+    bool AddPattern(const char* pattern) { return m_matcher.Add(pattern); }
+
+    // A regular file or a FIFO. With fromStart, lines already in the file are scanned
+    // too. A missing file is fine; it is opened when it appears.
+    bool AddFile(const char* path, bool fromStart = false) {
+        if (m_count == MAX_FILES || m_thread.joinable()) {
+            return false;
+        }
+        File& file = m_files[m_count];
+        file.path = path;
+        std::size_t slash = file.path.find_last_of('/');
+        file.directory = slash == std::string::npos ? "." : slash == 0 ? "/" : file.path.substr(0, slash);
+        file.buffer.resize(m_bufferSize);
+        if (Open(file) && !fromStart && !file.fifo) {
+            file.offset = lseek(file.fd, 0, SEEK_END);
+        }
+        m_count++;
+        return true;
+    }
+
+    void Close() {
+        Stop();
+        for (int i = 0; i < m_count; i++) {
+            if (m_files[i].fd >= 0) close(m_files[i].fd);
+            m_files[i] = File();
+        }
+        m_count = 0;
+    }
+
+    // Starts the tailing thread; the handler runs on it
+    bool Start(Handler handler) {
+        Stop();
+        if (m_count == 0 || m_matcher.Patterns() == 0 || pipe(m_stopPipe) != 0) {
+            return false;
+        }
+        m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_inotify < 0) {
+            Stop();
+            return false;
+        }
+        for (int i = 0; i < m_count; i++) {
+            // Directory watches see writes to the file as well as renames and creates
+            // next to it, and survive the file being replaced. Watching the same
+            // directory twice returns the same descriptor, which is fine.
+            inotify_add_watch(m_inotify, m_files[i].directory.c_str(),
+                              IN_MODIFY | IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CLOSE_WRITE);
+        }
+        m_handler = handler;
+        m_thread = std::thread(&LogSource::Run, this);
+        return true;
+    }
+
+    void Stop() {
+        if (m_stopPipe[1] >= 0) {
+            char byte = 0;
+            ssize_t written = write(m_stopPipe[1], &byte, 1);
+            (void)written;
+        }
+        if (m_thread.joinable()) m_thread.join();
+        for (int* fd : { &m_inotify, &m_stopPipe[0], &m_stopPipe[1] }) {
+            if (*fd >= 0) close(*fd);
+            *fd = -1;
+        }
+    }
+
+    // Reads whatever is new in every file and reports it to `handler`. Run() does this
+    // on every wakeup; call it directly only while the thread isn't running.
+    void Poll(const Handler& handler) {
+        for (int i = 0; i < m_count; i++) {
+            PollFile(i, handler);
+        }
+    }
+
+    const LogMatcher& Matcher() const { return m_matcher; }
+    uint64_t Bytes() const { return m_bytes.load(std::memory_order_relaxed); }
+    uint64_t Matches() const { return m_matches.load(std::memory_order_relaxed); }
+    uint64_t Rotations() const { return m_rotations.load(std::memory_order_relaxed); }
+    uint64_t Truncations() const { return m_truncations.load(std::memory_order_relaxed); }
+
+private:
+    struct File {
+        std::string path;
+        std::string directory;
+        int fd = -1;
+        bool fifo = false;
+        dev_t device = 0;
+        ino_t inode = 0;
+        off_t offset = 0;          // Read so far, for spotting truncation
+        std::vector<char> buffer;  // Sized once in AddFile()
+        std::size_t carry = 0;     // Unfinished line at the front of buffer
+    };
+
+    bool Open(File& file) {
+        struct stat info;
+        if (stat(file.path.c_str(), &info) != 0) {
+            return false;
+        }
+        file.fifo = S_ISFIFO(info.st_mode);
+        // A FIFO opened read-write never reports end of file when its writers go
+        // away, so poll() doesn't spin on POLLHUP between journalctl restarts
+        file.fd = open(file.path.c_str(), (file.fifo ? O_RDWR : O_RDONLY) | O_NONBLOCK | O_CLOEXEC);
+        if (file.fd < 0) {
+            return false;
+        }
+        fstat(file.fd, &info);
+        file.device = info.st_dev;
+        file.inode = info.st_ino;
+        file.offset = 0;
+        file.carry = 0;
+        return true;
+    }
+
+    void PollFile(int index, const Handler& handler) {
+        File& file = m_files[index];
+        if (file.fd < 0) {
+            if (!Open(file)) return;
+        } else if (!file.fifo) {
+            struct stat info;
+            if (fstat(file.fd, &info) == 0 && info.st_size < file.offset) {
+                m_truncations.fetch_add(1, std::memory_order_relaxed);
+                lseek(file.fd, 0, SEEK_SET);
+                file.offset = 0;
+                file.carry = 0;
+            }
+        }
+        ReadAvailable(index, handler);
+        if (file.fifo) {
+            return;
+        }
+
+        // Renamed away and replaced: finish the old file (its last line may lack a
+        // newline), then start on the new one
+        struct stat info;
+        if (stat(file.path.c_str(), &info) == 0 && (info.st_ino != file.inode || info.st_dev != file.device)) {
+            Flush(index, handler);
+            close(file.fd);
+            file.fd = -1;
+            m_rotations.fetch_add(1, std::memory_order_relaxed);
+            if (Open(file)) {
+                ReadAvailable(index, handler);
+            }
+        }
+    }
+
+    void ReadAvailable(int index, const Handler& handler) {
+        File& file = m_files[index];
+        char* buffer = file.buffer.data();
+        for (;;) {
+            ssize_t length = read(file.fd, buffer + file.carry, file.buffer.size() - file.carry);
+            if (length < 0 && errno == EINTR) {
+                continue;
+            }
+            if (length <= 0) {
+                break;
+            }
+            m_bytes.fetch_add((uint64_t)length, std::memory_order_relaxed);
+            file.offset += length;
+            std::size_t filled = file.carry + (std::size_t)length;
+
+            // Scan up to the last newline; a line longer than the buffer is scanned
+            // in buffer-sized pieces
+            const char* lastNewline = (const char*)memrchr(buffer + file.carry, '\n', (std::size_t)length);
+            std::size_t complete = lastNewline ? (std::size_t)(lastNewline - buffer) + 1
+                                               : filled == file.buffer.size() ? filled : 0;
+            Scan(index, buffer, complete, handler);
+            file.carry = filled - complete;
+            if (file.carry > 0 && complete > 0) {
+                std::memmove(buffer, buffer + complete, file.carry);
+            }
+        }
+    }
+
+    // The unfinished last line, once no more of it will come
+    void Flush(int index, const Handler& handler) {
+        File& file = m_files[index];
+        Scan(index, file.buffer.data(), file.carry, handler);
+        file.carry = 0;
+    }
+
+    void Scan(int index, const char* data, std::size_t length, const Handler& handler) {
+        if (length == 0) {
+            return;
+        }
+        std::size_t matched = m_matcher.Scan(data, length, [&](int pattern, const char* line, std::size_t lineLength) {
+            handler(LogMatch{ index, pattern, line, lineLength });
+        });
+        m_matches.fetch_add(matched, std::memory_order_relaxed);
+    }
+
+    void Run() {
+        // A FIFO is polled directly (inotify says nothing about pipe writes); the
+        // timeout catches a directory that was missing when its watch was added
+        pollfd fds[MAX_FILES + 2];
+        int count = 0;
+        fds[count++] = { m_stopPipe[0], POLLIN, 0 };
+        fds[count++] = { m_inotify, POLLIN, 0 };
+        for (int i = 0; i < m_count; i++) {
+            if (m_files[i].fifo && m_files[i].fd >= 0) fds[count++] = { m_files[i].fd, POLLIN, 0 };
+        }
+        char events[4096] __attribute__((aligned(__alignof__(inotify_event))));
+
+        Poll(m_handler);
+        for (;;) {
+            int ready = poll(fds, count, 1000);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (fds[0].revents) {
+                break;
+            }
+            if (fds[1].revents) {
+                while (read(m_inotify, events, sizeof(events)) > 0) {}
+            }
+            Poll(m_handler);
+        }
+    }
+
+    LogMatcher m_matcher;
+    File m_files[MAX_FILES];
+    int m_count = 0;
+    std::size_t m_bufferSize;
+    int m_inotify = -1;
+    int m_stopPipe[2] = { -1, -1 };
+    Handler m_handler;
+    std::thread m_thread;
+    std::atomic<uint64_t> m_bytes{ 0 };
+    std::atomic<uint64_t> m_matches{ 0 };
+    std::atomic<uint64_t> m_rotations{ 0 };
+    std::atomic<uint64_t> m_truncations{ 0 };
+};
+
+#endif
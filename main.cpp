@@ -1,8 +1,10 @@
 #define UNICODE
 #define _UNICODE
+#include <winsock2.h> // Before windows.h, which would pull in the old winsock.h
 #include <windows.h>
 #include <gdiplus.h>
 #include <shlwapi.h>
+#include <ShellScalingApi.h>
 #include <string>
 #include <thread>
 #include <chrono>
@@ -15,7 +17,31 @@
 #include <winevt.h>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
+#include <algorithm>
+#include <memory>
 #include "resource.h"
+#include "timer_scheduler.h"
+#include "emotional_state.h"
+#include "state_snapshot.h"
+#include "core_stats.h"
+#include "state_rules.h"
+#include "rules_config.h"
+#include "state_machine.h"
+#include "history_ring.h"
+#include "history_archive.h"
+#include "metrics_exporter.h"
+#include "state_page.h"
+#include "self_profile.h"
+#include "event_trace.h"
+#include "hotplug.h"
+#include "event_queue.h"
+#include "adaptive_sampling.h"
+#include "frame_cache.h"
+#include "sprite_atlas.h"
+#include "sprite_palette.h"
+#include "sprite_scaler.h"
+#include "sprites_generated.h"
 
 #pragma comment(lib, "gdiplus.lib")
 #pragma comment(lib, "user32.lib")
@@ -24,6 +50,9 @@
 #pragma comment(lib, "pdh.lib")
 #pragma comment(lib, "wevtapi.lib")
 #pragma comment(lib, "shlwapi.lib")
+#pragma comment(lib, "shcore.lib")
+#pragma comment(lib, "ws2_32.lib")
+#pragma comment(lib, "psapi.lib")
 #pragma comment(lib, "ole32.lib") // Add this line for CreateStreamOnHGlobal
 
 using namespace Gdiplus;
@@ -33,30 +62,18 @@ using namespace Gdiplus;
 #define ID_TRAYICON 1
 #define ID_EXIT 1001
 #define ID_ALWAYS_ON_TOP 1002
+#define ID_SELF_PROFILE 1003
 
 // Window class name for message-only window
 #define WINDOW_CLASS_NAME TEXT("EmotionalTaskManager")
 
-// Enum for emotional states
-enum EmotionalState {
-    HAPPY,               // Default
-    PLEASED,             // Below thresholds after being above
-    NEUTRAL,             // Memory > 90%
-    GRIMACE,             // App error
-    GRIMACE_TWO_SWEAT,   // Memory > 95%
-    SURPRISED,           // Device connect/disconnect
-    ANGUISH,             // CPU > 50%
-    ANGUISH_VERY,        // CPU > 70%
-    ANGUISH_EXTREMELY,   // CPU > 90%
-    TIRED,               // Battery < 30%
-    TIRED_VERY,          // Battery < 20%
-    TIRED_EXTREMELY      // Battery < 10% 
-};
-
 // Global variables for window management
 HWND g_hwnd = NULL;
-int g_windowWidth = 200;
-int g_windowHeight = 200;
+std::atomic<int> g_windowWidth(200);  // Base sprite size times g_spriteScale
+std::atomic<int> g_windowHeight(200);
+int g_baseWidth = 200;                 // Sprite size at 96 DPI
+int g_baseHeight = 200;
+std::atomic<int> g_spriteScale(SCALE_ONE); // DPI scale of the monitor the window is on
 bool g_alwaysOnTop = true;
 NOTIFYICONDATAW nid = {0};
 HICON g_customTrayIcon = NULL; // For managing the lifecycle of the custom tray icon
@@ -64,34 +81,116 @@ HICON g_customTrayIcon = NULL; // For managing the lifecycle of the custom tray
 // Global variables for monitoring
 PDH_HQUERY cpuQuery;
 PDH_HCOUNTER cpuTotal;
+PDH_HCOUNTER cpuCores;
+std::vector<BYTE> g_coreCounterBuffer; // Grown on demand, reused across samples
 EVT_HANDLE g_hSubscription = NULL;
+
+// Metrics and state below are owned by the monitor thread. Other threads read
+// g_snapshot and hand events over through QueueStateEvent().
 double g_cpuUsage = 0.0;
 double g_memoryUsage = 0.0;
+CoreSamples g_coreSamples;
+CoreStats g_coreStats;
 int g_batteryPercent = 100;
 bool g_hasBattery = false;
+bool g_onBattery = false;    // Running on battery rather than AC power
 
 // Global variables for emotional state
-EmotionalState g_currentState = HAPPY;
 bool g_isBlinking = false;
-std::map<EmotionalState, Image*> g_images;
-std::map<EmotionalState, Image*> g_blinkImages;
-std::map<EmotionalState, int> g_blinkIntervals;  // In seconds
-std::map<EmotionalState, double> g_blinkDurations;  // In seconds
-bool g_wasAboveThreshold = false;
-bool g_temporaryState = false;
-std::chrono::steady_clock::time_point g_temporaryStateStartTime;
-std::chrono::seconds g_temporaryStateDuration(2); // Show temporary states for 2 seconds
+PaletteSpriteStore g_spriteStore;             // Every face, as palette indices
+int g_sprites[EMOTIONAL_STATE_COUNT];         // Atlas sprite per state
+int g_blinkSprites[EMOTIONAL_STATE_COUNT];    // Atlas blink sprite per state, -1 if it doesn't blink
+std::chrono::steady_clock::time_point g_lastBlinkTimes[EMOTIONAL_STATE_COUNT];
+
+// Paint resources, owned by the UI thread. Frames are composed once per
+// (state, blink) pair and only rebuilt when the size or display format changes.
+HDC g_frameDC = NULL;
+FrameCache<HBITMAP> g_frameCache;
+ScaledSpriteCache g_scaledSprites; // Owned by the UI thread, like the frame cache
+int g_frameScale = SCALE_ONE;      // Scale the cached frames were composed at
+FrameKeyTracker g_repaintTracker; // Owned by the monitor thread
 HMODULE hInst = GetModuleHandle(NULL);
 
-// Synchronization for state changes
-std::mutex g_stateMutex;
-std::condition_variable g_stateCV;
-bool g_stateChanged = false;
+// Lock-free view of the monitor thread's state for the UI and other readers
+SeqLock<SystemSnapshot> g_snapshot;
+uint64_t g_snapshotSequence = 0;
+uint64_t g_sampleCount = 0;                         // Monitor thread's own counters,
+std::chrono::nanoseconds g_monitorBusy(0);          // published with the snapshot
+uint64_t g_monitorWakeups = 0;
+
+// Optional Prometheus endpoint (--metrics-port N), serving g_snapshot
+MetricsExporter g_exporter;
+
+// The same snapshot in shared memory for other processes (state_page.h)
+StatePageWriter g_statePage;
+
+// What the monitor itself costs (self_profile.h). Off until --profile or the menu.
+SelfProfile g_profile;
+const std::chrono::seconds PROFILE_REPORT_INTERVAL(60);
+
+// Timeline of sampling, state and paint for chrome://tracing (event_trace.h). Off
+// unless started with --trace; written to trace.json next to the executable.
+EventTracer g_tracer;
+
+// Temporary-state events pushed by other threads. The monitor thread drains them
+// into g_eventArbiter, which merges, rate limits and orders them by priority.
+StateEventQueue<256> g_events;
+EventArbiter g_eventArbiter;
+
+// Device and display notifications not yet handled by the monitor thread, one bit
+// per (kind, display) pair; repeats collapse while the monitor is busy. The monitor
+// thread owns g_hotplug, which turns bursts into one SURPRISED and one reposition.
+std::atomic<unsigned> g_pendingHotplug(0);
+HotplugDebouncer g_hotplug;
+
+// Threshold rules. The monitor thread evaluates them through g_stateMachine; the
+// watcher thread parses rules.conf and hands the new set over through g_pendingRules.
+RuleSet g_defaultRules = MakeRuleSet(STATE_RULES);
+std::unique_ptr<RuleSet> g_loadedRules;  // Owned by the monitor thread once applied
+StateMachine g_stateMachine(&g_defaultRules);
+std::atomic<RuleSet*> g_pendingRules(nullptr);
+RuleFileWatcher g_rulesWatcher;
+std::wstring g_rulesPath;
+
+// On-disk history of samples and events, appended by the monitor thread
+HistoryRing g_history;
+HistoryArchive g_archive;   // Compressed long-term copy of the samples, with rollups
+uint16_t g_pendingHistoryFlags = HISTORY_STARTED; // Folded into the next record
+
+// Deadlines driven by the monitor thread
+enum SchedulerTimer {
+    TIMER_SAMPLE,            // Sample CPU, memory and battery
+    TIMER_BLINK_START,       // Swap to the blink image
+    TIMER_BLINK_END,         // Swap back to the normal image
+    TIMER_TEMPORARY_STATE,   // Temporary state (GRIMACE, SURPRISED, PLEASED) expires
+    TIMER_REPOSITION,        // Deferred window repositioning after a display change
+    TIMER_EVENT,             // Another thread requested a temporary state
+    TIMER_HOTPLUG,           // A device or display notification arrived
+    TIMER_RULES,             // The rules file was reloaded
+    TIMER_PROFILE_REPORT,    // Write the self profile report (while profiling is on)
+    TIMER_COUNT
+};
+TimerScheduler<TIMER_COUNT> g_scheduler;
+SamplingController g_sampling;                        // Picks the TIMER_SAMPLE interval
+std::chrono::steady_clock::time_point g_lastSampleTime;
 
 // Function prototypes
 LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
-void StartBlinkTimer();
 void MonitorSystem();
+void SampleSystem();
+void StartBlink();
+void EndBlink();
+void ScheduleNextBlink(EmotionalState state);
+void EnterTemporaryState(EmotionalState state);
+void DeferDisplayChange(std::chrono::milliseconds delay);
+void QueueStateEvent(StateEventType type);
+void ShowPendingEvent();
+void QueueHotplugEvent(HotplugEvent event);
+void HandleHotplugEvents();
+void PublishSnapshot();
+bool RequestRepaint();
+HBITMAP ComposeFrame(EmotionalState state, bool blink);
+void ResetFrameCache();
 void UpdateEmotionalState();
 void PlaceWindowOnSecondaryMonitor(HWND hwnd);
 void AddToSystemTray(HWND hwnd);
@@ -106,22 +205,20 @@ void ProcessWindowMessages();
 void LoadImages(ULONG_PTR gdiplusToken); // Modified prototype
 void DrawCurrentState();
 void HandleDisplayChange();
+void ApplyMonitorScale(HMONITOR monitor);
+void InitializeRules();
+void ReloadRules();
+std::wstring ExecutableDirectory();
+void RecordHistory(uint16_t flags);
+void SetSelfProfiling(bool enabled);
+void WriteProfileReport();
 
 // Callback for event log notifications
 DWORD WINAPI SubscriptionCallback(EVT_SUBSCRIBE_NOTIFY_ACTION action, PVOID context, EVT_HANDLE hEvent) {
     if (action == EvtSubscribeActionDeliver) {
         // Application error detected
-        {
-            std::lock_guard<std::mutex> lock(g_stateMutex);
-            g_temporaryState = true;
-            g_temporaryStateStartTime = std::chrono::steady_clock::now();
-            g_currentState = GRIMACE;
-            g_stateChanged = true;
-        }
-        g_stateCV.notify_one();
-        
         // We could extract more detailed information from the event if needed
-        InvalidateRect(g_hwnd, NULL, FALSE);
+        QueueStateEvent(STATE_EVENT_APP_ERROR);
     }
     
     return ERROR_SUCCESS;
@@ -133,9 +230,14 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     ULONG_PTR gdiplusToken;
     GdiplusStartup(&gdiplusToken, &gdiplusStartupInput, NULL);
 
+    // We scale the sprites ourselves, so opt out of Windows' blurry bitmap stretching
+    SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_PER_MONITOR_AWARE_V2);
+
     // Initialize PDH for CPU monitoring
     PdhOpenQuery(NULL, NULL, &cpuQuery);
     PdhAddCounter(cpuQuery, TEXT("\\Processor(_Total)\\% Processor Time"), NULL, &cpuTotal);
+    // "Processor Information" covers every processor group, unlike "Processor" (max 64 cores)
+    PdhAddCounter(cpuQuery, TEXT("\\Processor Information(*)\\% Processor Time"), NULL, &cpuCores);
     PdhCollectQueryData(cpuQuery);
 
     // Load images
@@ -207,26 +309,81 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
         OutputDebugStringW(L"Warning: Event log monitoring could not be initialized\n");
     }
 
+    // Load rules.conf (if present) and watch it for edits
+    InitializeRules();
+    
+    // Keep a history of samples and events next to the executable
+    if (!g_history.Open((ExecutableDirectory() + L"\\history.ring").c_str())) {
+        OutputDebugStringW(L"Warning: history.ring could not be opened, history will not be kept\n");
+    }
+    if (!g_archive.Open((ExecutableDirectory() + L"\\history.archive").c_str())) {
+        OutputDebugStringW(L"Warning: history.archive could not be opened, long-term history will not be kept\n");
+    }
+
+    // Publish the snapshot to status bars and prompts
+    if (!g_statePage.Open()) {
+        OutputDebugStringW(L"Warning: the shared state page could not be created, or another instance owns it\n");
+    }
+    
+    // Serve the snapshot to Prometheus if asked to: --metrics-port N (localhost only)
+    const char* portOption = lpCmdLine ? strstr(lpCmdLine, "--metrics-port") : NULL;
+    if (portOption) {
+        int port = atoi(portOption + strlen("--metrics-port"));
+        if (port <= 0 || port > 65535 || !g_exporter.StartTcp(&g_snapshot, (uint16_t)port)) {
+            OutputDebugStringW(L"Warning: the metrics endpoint could not be started\n");
+        }
+    }
+
+    // Measure our own overhead from the start if asked to: --profile
+    if (lpCmdLine && strstr(lpCmdLine, "--profile")) {
+        SetSelfProfiling(true);
+    }
+
+    // Record a timeline if asked to: --trace
+    if (lpCmdLine && strstr(lpCmdLine, "--trace")) {
+        if (g_tracer.Start((ExecutableDirectory() + L"\\trace.json").c_str())) {
+            g_tracer.RegisterThread("ui");
+        } else {
+            OutputDebugStringW(L"Warning: trace.json could not be opened, no trace will be recorded\n");
+        }
+    }
+
     // Make the window visible
     ShowWindow(g_hwnd, nCmdShow);
     UpdateWindow(g_hwnd);
 
-    // Start the blink timer in a separate thread
-    std::thread blinkThread(StartBlinkTimer);
-    blinkThread.detach();
-
-    // Start the monitoring thread
+    // Start the monitoring thread (sampling, blinking and deferred work all run on its scheduler)
     std::thread monitorThread(MonitorSystem);
-    monitorThread.detach();
 
     // Message loop
     MSG msg;
     while (GetMessage(&msg, NULL, 0, 0)) {
+        PROFILE_WAKEUP(g_profile, PROFILE_THREAD_UI);
         TranslateMessage(&msg);
         DispatchMessage(&msg);
     }
 
-    // Cleanup
+    // Cleanup. First the threads that call in from outside: the endpoint, the rules
+    // watcher and the event log subscription, whose callback queues events onto the
+    // monitor's scheduler. EvtClose waits for a callback that is running.
+    g_exporter.Stop();
+    g_rulesWatcher.Stop();
+    if (g_hSubscription) {
+        EvtClose(g_hSubscription);
+        g_hSubscription = NULL;
+    }
+    
+    // The monitor thread appends to the history; let it finish its current timer and exit
+    // before anything it writes to is closed. The window is gone by now, so nothing it
+    // does can wait on this thread.
+    g_scheduler.Stop();
+    monitorThread.join();
+    g_history.Close();
+    g_archive.Close();
+    g_statePage.Close();
+
+    // Every thread that records trace events has stopped or is this one
+    g_tracer.Stop();
     RemoveFromSystemTray(); // This will call Shell_NotifyIconW(NIM_DELETE, &nid)
     
     // Destroy the custom tray icon if it was loaded and not already cleaned up by WM_DESTROY
@@ -236,17 +393,6 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     }
 
     PdhCloseQuery(cpuQuery);
-    if (g_hSubscription) {
-        EvtClose(g_hSubscription);
-    }
-    
-    // Clean up images
-    for (auto& pair : g_images) {
-        delete pair.second;
-    }
-    for (auto& pair : g_blinkImages) {
-        delete pair.second;
-    }
     
     // Destroy the application icon if it was loaded (and not the default one from LoadIcon)
     // However, class icons are typically managed by the system, so explicit destruction here might not be necessary
@@ -260,7 +406,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     return (int)msg.wParam;
 }
 
-Gdiplus::Image* LoadGdiplusImageFromResource(int resourceId, const wchar_t* resourceType) {
+Gdiplus::Bitmap* LoadGdiplusImageFromResource(int resourceId, const wchar_t* resourceType) {
     HMODULE hModule = GetModuleHandle(NULL);
     HRSRC hRes = FindResource(hModule, MAKEINTRESOURCE(resourceId), resourceType);
     if (hRes == NULL) {
@@ -298,8 +444,8 @@ Gdiplus::Image* LoadGdiplusImageFromResource(int resourceId, const wchar_t* reso
             IStream* pStream = nullptr;
             if (CreateStreamOnHGlobal(hGlobal, TRUE, &pStream) == S_OK)
             {
-                // Gdiplus::Image takes ownership of the IStream
-                Gdiplus::Image* image = new Gdiplus::Image(pStream);
+                // Gdiplus::Bitmap takes ownership of the IStream
+                Gdiplus::Bitmap* image = new Gdiplus::Bitmap(pStream);
                 pStream->Release(); // Release our hold on it
                 
                 // Check if the image was created successfully from the stream
@@ -334,155 +480,191 @@ Gdiplus::Image* LoadGdiplusImageFromResource(int resourceId, const wchar_t* reso
     return nullptr;
 }
 
-void LoadImages(ULONG_PTR gdiplusToken) { // Modified signature
-    // Load all the emotion images
-    g_images[HAPPY] = LoadGdiplusImageFromResource(ID_IMAGE_HAPPY, RT_RCDATA);
-    g_images[PLEASED] = LoadGdiplusImageFromResource(ID_IMAGE_PLEASED, RT_RCDATA);
-    g_images[NEUTRAL] = LoadGdiplusImageFromResource(ID_IMAGE_NEUTRAL, RT_RCDATA);
-    g_images[GRIMACE] = LoadGdiplusImageFromResource(ID_IMAGE_GRIMACE, RT_RCDATA);
-    g_images[GRIMACE_TWO_SWEAT] = LoadGdiplusImageFromResource(ID_IMAGE_GRIMACE_TWO_SWEAT, RT_RCDATA);
-    g_images[SURPRISED] = LoadGdiplusImageFromResource(ID_IMAGE_SURPRISED, RT_RCDATA);
-    g_images[ANGUISH] = LoadGdiplusImageFromResource(ID_IMAGE_ANGUISH, RT_RCDATA);
-    g_images[ANGUISH_VERY] = LoadGdiplusImageFromResource(ID_IMAGE_ANGUISH_VERY, RT_RCDATA);
-    g_images[ANGUISH_EXTREMELY] = LoadGdiplusImageFromResource(ID_IMAGE_ANGUISH_EXTREMELY, RT_RCDATA);
-    g_images[TIRED] = LoadGdiplusImageFromResource(ID_IMAGE_TIRED, RT_RCDATA);
-    g_images[TIRED_VERY] = LoadGdiplusImageFromResource(ID_IMAGE_TIRED_VERY, RT_RCDATA);
-    g_images[TIRED_EXTREMELY] = LoadGdiplusImageFromResource(ID_IMAGE_TIRED_EXTREMELY, RT_RCDATA);
-
-    // Load all the blink images
-    g_blinkImages[HAPPY] = LoadGdiplusImageFromResource(ID_IMAGE_HAPPY_BLINK, RT_RCDATA);
-    g_blinkImages[PLEASED] = nullptr; // No blink for pleased
-    g_blinkImages[NEUTRAL] = LoadGdiplusImageFromResource(ID_IMAGE_NEUTRAL_BLINK, RT_RCDATA);
-    g_blinkImages[GRIMACE] = nullptr; // No blink for grimace
-    g_blinkImages[GRIMACE_TWO_SWEAT] = LoadGdiplusImageFromResource(ID_IMAGE_GRIMACE_TWO_SWEAT_BLINK, RT_RCDATA);
-    g_blinkImages[SURPRISED] = nullptr; // No blink for surprised
-    g_blinkImages[ANGUISH] = LoadGdiplusImageFromResource(ID_IMAGE_ANGUISH_BLINK, RT_RCDATA);
-    g_blinkImages[ANGUISH_VERY] = LoadGdiplusImageFromResource(ID_IMAGE_ANGUISH_VERY_BLINK, RT_RCDATA);
-    g_blinkImages[ANGUISH_EXTREMELY] = nullptr; // No blink for anguish_extremely
-    g_blinkImages[TIRED] = LoadGdiplusImageFromResource(ID_IMAGE_NEUTRAL_BLINK, RT_RCDATA); // Tired uses neutral_blink
-    g_blinkImages[TIRED_VERY] = LoadGdiplusImageFromResource(ID_IMAGE_TIRED_VERY_BLINK, RT_RCDATA);
-    g_blinkImages[TIRED_EXTREMELY] = nullptr; // No blink for tired_extremely
-
-    // ULONG_PTR token_; // This local uninitialized token was incorrect
+// Decodes the RCDATA PNGs with GDI+ into the atlas. Only used when the app is built
+// with ETM_DECODE_SPRITE_RESOURCES; the default build embeds pre-decoded sprites.
+void DecodeSpriteResources(ULONG_PTR gdiplusToken) {
+    struct SpriteSource {
+        EmotionalState state;
+        int imageId;
+        int blinkImageId;  // 0 = no blink for this state
+    };
+    const SpriteSource sources[] = {
+        { HAPPY,             ID_IMAGE_HAPPY,             ID_IMAGE_HAPPY_BLINK },
+        { PLEASED,           ID_IMAGE_PLEASED,           0 },
+        { NEUTRAL,           ID_IMAGE_NEUTRAL,           ID_IMAGE_NEUTRAL_BLINK },
+        { GRIMACE,           ID_IMAGE_GRIMACE,           0 },
+        { GRIMACE_TWO_SWEAT, ID_IMAGE_GRIMACE_TWO_SWEAT, ID_IMAGE_GRIMACE_TWO_SWEAT_BLINK },
+        { SURPRISED,         ID_IMAGE_SURPRISED,         0 },
+        { ANGUISH,           ID_IMAGE_ANGUISH,           ID_IMAGE_ANGUISH_BLINK },
+        { ANGUISH_VERY,      ID_IMAGE_ANGUISH_VERY,      ID_IMAGE_ANGUISH_VERY_BLINK },
+        { ANGUISH_EXTREMELY, ID_IMAGE_ANGUISH_EXTREMELY, 0 },
+        { TIRED,             ID_IMAGE_TIRED,             ID_IMAGE_NEUTRAL_BLINK }, // Tired uses neutral_blink
+        { TIRED_VERY,        ID_IMAGE_TIRED_VERY,        ID_IMAGE_TIRED_VERY_BLINK },
+        { TIRED_EXTREMELY,   ID_IMAGE_TIRED_EXTREMELY,   0 },
+    };
+    
+    // Decode each resource once and reserve its place in a staging atlas
+    SpriteAtlas atlas;
+    std::map<int, Gdiplus::Bitmap*> decoded;
+    std::map<int, int> spriteForResource;
+    auto reserve = [&](int resourceId) -> int {
+        if (resourceId == 0) {
+            return -1;
+        }
+        auto found = spriteForResource.find(resourceId);
+        if (found != spriteForResource.end()) {
+            return found->second;
+        }
+        int sprite = -1;
+        Gdiplus::Bitmap* bitmap = LoadGdiplusImageFromResource(resourceId, RT_RCDATA);
+        if (bitmap) {
+            sprite = atlas.AddSprite(bitmap->GetWidth(), bitmap->GetHeight());
+            decoded[sprite] = bitmap;
+        }
+        spriteForResource[resourceId] = sprite;
+        return sprite;
+    };
+    for (const SpriteSource& source : sources) {
+        g_sprites[source.state] = reserve(source.imageId);
+        g_blinkSprites[source.state] = reserve(source.blinkImageId);
+    }
+    
     // Critical check for default image
-    if (!g_images[HAPPY] || g_images[HAPPY]->GetLastStatus() != Ok) {
+    if (g_sprites[HAPPY] < 0) {
         MessageBoxW(NULL, L"Failed to load critical image resources (e.g., HAPPY state). The application cannot continue.", L"Resource Load Error", MB_ICONERROR | MB_OK);
-        // Post a quit message or exit directly if this is catastrophic
-        // For example, if called from WinMain before message loop, direct exit might be simpler.
-        // If in a thread or after message loop started, PostQuitMessage is better.
-        // Since this is in WinMain before the loop, we can consider exiting.
-        // For now, this message box will at least indicate the problem.
-        // To ensure termination if this happens before the message loop:
+        // Since this is in WinMain before the message loop, exit directly
         GdiplusShutdown(gdiplusToken); // Use the passed token
         exit(1); // Or handle more gracefully
     }
-
-
-    // Set blink intervals (in seconds)
-    for (int i = HAPPY; i <= TIRED_EXTREMELY; i++) {
-        g_blinkIntervals[(EmotionalState)i] = 4;
-        g_blinkDurations[(EmotionalState)i] = 0.1;
+    
+    // Convert every sprite to premultiplied BGRA straight into its atlas slot,
+    // then drop the GDI+ objects; painting never touches GDI+ again
+    atlas.Allocate();
+    for (auto& pair : decoded) {
+        const SpriteRect& spriteRect = atlas.Rect(pair.first);
+        Gdiplus::Rect rect(0, 0, spriteRect.width, spriteRect.height);
+        BitmapData data = {};
+        data.Width = spriteRect.width;
+        data.Height = spriteRect.height;
+        data.Stride = atlas.Stride() * (INT)sizeof(uint32_t);
+        data.PixelFormat = PixelFormat32bppPARGB;
+        data.Scan0 = atlas.SpritePixels(pair.first);
+        if (pair.second->LockBits(&rect, ImageLockModeRead | ImageLockModeUserInputBuf, PixelFormat32bppPARGB, &data) == Ok) {
+            pair.second->UnlockBits(&data);
+        } else {
+            OutputDebugStringW((L"Failed to convert sprite " + std::to_wstring(pair.first) + L"\n").c_str());
+        }
+        delete pair.second;
+        
+        // Palette-index it; ids come out in the same order as the atlas ids
+        g_spriteStore.Add(atlas.SpritePixels(pair.first), spriteRect.width, spriteRect.height, atlas.Stride());
     }
     
-    // Special case for tired_very
-    g_blinkIntervals[TIRED_VERY] = 6;
-    g_blinkDurations[TIRED_VERY] = 0.2;
-
-    // Get first valid image dimensions
-    for (auto& pair : g_images) {
-        if (pair.second && pair.second->GetLastStatus() == Ok) {
-            g_windowWidth = pair.second->GetWidth();
-            g_windowHeight = pair.second->GetHeight();
-            break;
+    // States whose image failed to load fall back to HAPPY
+    for (int i = HAPPY; i <= TIRED_EXTREMELY; i++) {
+        if (g_sprites[i] < 0) {
+            g_sprites[i] = g_sprites[HAPPY];
         }
     }
 }
 
+// Maps the sprites that tools/embed_sprites.py decoded at build time straight out of
+// the binary's read-only data: no resource lookup, heap copy or PNG decode
+void LoadEmbeddedSprites() {
+    g_spriteStore.AttachPalette(g_embeddedPalette, EMBEDDED_PALETTE_SIZE);
+    for (const EmbeddedSprite& sprite : g_embeddedSprites) {
+        g_spriteStore.AttachSprite(g_embeddedIndices + sprite.offset, sprite.width, sprite.height, sprite.bits, sprite.opaque);
+    }
+    for (int i = HAPPY; i <= TIRED_EXTREMELY; i++) {
+        g_sprites[i] = g_embeddedStateSprites[i];
+        g_blinkSprites[i] = g_embeddedBlinkSprites[i];
+    }
+}
+
+void LoadImages(ULONG_PTR gdiplusToken) { // Modified signature
+#ifdef ETM_DECODE_SPRITE_RESOURCES
+    DecodeSpriteResources(gdiplusToken);
+#else
+    LoadEmbeddedSprites();
+#endif
+
+    // Window size comes from the default image, scaled once the monitor is known
+    g_baseWidth = g_spriteStore.Width(g_sprites[HAPPY]);
+    g_baseHeight = g_spriteStore.Height(g_sprites[HAPPY]);
+    g_windowWidth = g_baseWidth;
+    g_windowHeight = g_baseHeight;
+}
+
 LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam) {
     switch (message) {
     case WM_PAINT:
     {
+        PROFILE_SCOPE(g_profile, PROFILE_PAINT);
+        TRACE_SCOPE(g_tracer, "paint");
         PAINTSTRUCT ps;
         HDC hdc = BeginPaint(hWnd, &ps);
         
-        // Create an in-memory DC for double buffering
-        HDC memDC = CreateCompatibleDC(hdc);
-        HBITMAP memBitmap = CreateCompatibleBitmap(hdc, g_windowWidth, g_windowHeight);
-        HBITMAP oldBitmap = (HBITMAP)SelectObject(memDC, memBitmap);
-        
-        // Fill background with magenta (which will be transparent)
-        HBRUSH magentaBrush = CreateSolidBrush(RGB(255, 0, 255));
-        RECT rect = { 0, 0, g_windowWidth, g_windowHeight };
-        FillRect(memDC, &rect, magentaBrush);
-        DeleteObject(magentaBrush);
-        
-        // Create Graphics object
-        Graphics graphics(memDC);
-        graphics.SetSmoothingMode(SmoothingModeAntiAlias);
+        // Persistent in-memory DC for double buffering
+        if (!g_frameDC) {
+            g_frameDC = CreateCompatibleDC(hdc);
+        }
         
         DrawCurrentState();
         
-        // Draw the appropriate image
-        if (g_isBlinking && g_blinkImages[g_currentState] && g_blinkImages[g_currentState]->GetLastStatus() == Ok) {
-            graphics.DrawImage(g_blinkImages[g_currentState], 0, 0);
-        } else if (g_images[g_currentState] && g_images[g_currentState]->GetLastStatus() == Ok) {
-            graphics.DrawImage(g_images[g_currentState], 0, 0);
+        // The window moved to a monitor with a different DPI: rescale and recompose
+        int scale = g_spriteScale.load();
+        if (scale != g_frameScale) {
+            ResetFrameCache();
+            g_scaledSprites.Retain(scale);
+            g_frameScale = scale;
         }
         
-        // Copy from memory DC to window DC
-        BitBlt(hdc, 0, 0, g_windowWidth, g_windowHeight, memDC, 0, 0, SRCCOPY);
+        // Pick the frame for the current state, composing it on first use
+        SystemSnapshot snapshot = g_snapshot.Load();
+        bool blink = snapshot.isBlinking && g_blinkSprites[snapshot.state] >= 0;
+        HBITMAP frame = g_frameCache.Acquire(snapshot.state, blink, [&](HBITMAP& bitmap) {
+            bitmap = ComposeFrame(snapshot.state, blink);
+        });
         
-        // Cleanup
-        SelectObject(memDC, oldBitmap);
-        DeleteObject(memBitmap);
-        DeleteDC(memDC);
+        // Copy from memory DC to window DC
+        HBITMAP oldBitmap = (HBITMAP)SelectObject(g_frameDC, frame);
+        BitBlt(hdc, 0, 0, ScaledExtent(g_baseWidth, g_frameScale), ScaledExtent(g_baseHeight, g_frameScale),
+               g_frameDC, 0, 0, SRCCOPY);
+        SelectObject(g_frameDC, oldBitmap);
         
         EndPaint(hWnd, &ps);
     }
     break;
     
     case WM_DISPLAYCHANGE:
-        {
-            // Monitor configuration has changed - delay handling to ensure Windows has updated
-            std::thread([=]() {
-                Sleep(1000); // Increased delay to ensure monitor info is fully updated
-                HandleDisplayChange();
-            }).detach();
-        }
-        return 0;
+        // Monitor configuration has changed - cached frames may no longer match the display format
+        ResetFrameCache();
+        InvalidateRect(hWnd, NULL, FALSE);
         
+        // Reposition once Windows has updated (and the rest of a docking burst is over)
+        QueueHotplugEvent({ HOTPLUG_DISPLAY, true });
+        return 0;
+
+    case WM_DPICHANGED:
+        // Scale setting changed or the window crossed onto a monitor with another DPI;
+        // repositioning picks up the new scale and resizes the window
+        DeferDisplayChange(std::chrono::milliseconds(0));
+        return 0;
+
     case WM_DEVICECHANGE:
     {
         switch (wParam) {
             case DBT_DEVICEARRIVAL:
             case DBT_DEVICEREMOVECOMPLETE:
             {
-                // Device connected or disconnected - show surprised face
-                {
-                    std::lock_guard<std::mutex> lock(g_stateMutex);
-                    g_temporaryState = true;
-                    g_temporaryStateStartTime = std::chrono::steady_clock::now();
-                    g_currentState = SURPRISED;
-                    g_stateChanged = true;
-                }
-                g_stateCV.notify_one();
-                InvalidateRect(g_hwnd, NULL, FALSE);
-                
-                // For display devices, check if we need to reposition the window
+                // Device connected or disconnected - the monitor thread shows the surprised
+                // face once per burst of these
                 DEV_BROADCAST_HDR* pHdr = (DEV_BROADCAST_HDR*)lParam;
                 
-                // Check if this is possibly a display device change
-                if (pHdr && (pHdr->dbch_devicetype == DBT_DEVTYP_DEVICEINTERFACE || 
-                             wParam == DBT_DEVICEARRIVAL)) {
-                    // Use a separate thread with longer delay for device connections
-                    // to ensure the system has fully recognized the new display
-                    std::thread([=]() {
-                        // Longer delay for device arrival to ensure display is fully initialized
-                        int delay = (wParam == DBT_DEVICEARRIVAL) ? 2000 : 800;
-                        Sleep(delay); 
-                        HandleDisplayChange();
-                    }).detach();
-                }
+                // Possibly a display device, so the window may need to move once it settles
+                bool display = pHdr && (pHdr->dbch_devicetype == DBT_DEVTYP_DEVICEINTERFACE ||
+                                        wParam == DBT_DEVICEARRIVAL);
+                QueueHotplugEvent({ wParam == DBT_DEVICEARRIVAL ? HOTPLUG_ARRIVAL : HOTPLUG_REMOVAL, display });
                 
                 return TRUE;
             }
@@ -535,11 +717,21 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
                 SetWindowPos(hWnd, HWND_NOTOPMOST, 0, 0, 0, 0, SWP_NOMOVE | SWP_NOSIZE);
             }
             return 0;
+            
+        case ID_SELF_PROFILE:
+            SetSelfProfiling(!g_profile.Enabled());
+            return 0;
         }
         break;
     
     case WM_DESTROY:
         RemoveFromSystemTray();
+        // Release the paint resources
+        ResetFrameCache();
+        if (g_frameDC) {
+            DeleteDC(g_frameDC);
+            g_frameDC = NULL;
+        }
         // Destroy the custom tray icon if it was loaded
         if (g_customTrayIcon) {
             DestroyIcon(g_customTrayIcon);
@@ -555,175 +747,418 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
     return 0;
 }
 
+// Builds the frame for a (state, blink) pair: magenta background plus the sprite.
+// Runs on the UI thread, only on a frame cache miss.
+HBITMAP ComposeFrame(EmotionalState state, bool blink) {
+    int width = ScaledExtent(g_baseWidth, g_frameScale);
+    int height = ScaledExtent(g_baseHeight, g_frameScale);
+    
+    BITMAPINFO info = {};
+    info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    info.bmiHeader.biWidth = width;
+    info.bmiHeader.biHeight = -height; // Top-down, same row order as the atlas
+    info.bmiHeader.biPlanes = 1;
+    info.bmiHeader.biBitCount = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+    
+    void* bits = NULL;
+    HBITMAP bitmap = CreateDIBSection(NULL, &info, DIB_RGB_COLORS, &bits, NULL, 0);
+    if (!bitmap || !bits) {
+        return bitmap;
+    }
+    
+    // Fill background with magenta (which will be transparent)
+    uint32_t* pixels = (uint32_t*)bits;
+    std::fill(pixels, pixels + (size_t)width * height, 0xFFFF00FFu);
+    
+    // Draw the appropriate sprite, pre-scaled for the monitor, if it fits the window
+    int sprite = blink ? g_blinkSprites[state] : g_sprites[state];
+    if (sprite < 0) {
+        return bitmap;
+    }
+    if (g_frameScale == SCALE_ONE) {
+        if (g_spriteStore.Width(sprite) <= width && g_spriteStore.Height(sprite) <= height) {
+            g_spriteStore.Draw(sprite, pixels, width);
+        }
+    } else {
+        const ScaledSpriteCache::Sprite& scaled = g_scaledSprites.Acquire(g_spriteStore, sprite, g_frameScale);
+        if (scaled.width <= width && scaled.height <= height) {
+            ScaledSpriteCache::Draw(scaled, pixels, width);
+        }
+    }
+    
+    return bitmap;
+}
+
+// Drops every cached frame; the next WM_PAINT composes them again at the current size
+void ResetFrameCache() {
+    g_frameCache.Invalidate([](HBITMAP& bitmap) {
+        DeleteObject(bitmap);
+    });
+}
+
 void DrawCurrentState() {
     // This function is called from WM_PAINT
     // The current state is determined in UpdateEmotionalState
     // No need to do anything here since painting happens in WndProc
 }
 
-void StartBlinkTimer() {
-    using namespace std::chrono;
+// Arms the blink deadline for the given state, or cancels it if the state has no blink image
+void ScheduleNextBlink(EmotionalState state) {
+    if (g_blinkSprites[state] < 0) {
+        g_scheduler.Cancel(TIMER_BLINK_START);
+        return;
+    }
+    g_scheduler.Schedule(TIMER_BLINK_START, g_lastBlinkTimes[state] + std::chrono::milliseconds(BLINK_TIMINGS[state].intervalMs));
+}
+
+// Copies the monitor thread's state into g_snapshot. Must be called on the monitor thread.
+void PublishSnapshot() {
+    SystemSnapshot snapshot;
+    snapshot.cpuUsage = g_cpuUsage;
+    snapshot.memoryUsage = g_memoryUsage;
+    snapshot.hottestCoreUsage = g_coreStats.max;
+    snapshot.saturatedCores = g_coreStats.aboveAnguishExtremely;
+    snapshot.batteryPercent = g_batteryPercent;
+    snapshot.hasBattery = g_hasBattery;
+    snapshot.isBlinking = g_isBlinking;
+    snapshot.state = g_stateMachine.State();
+    snapshot.sequence = ++g_snapshotSequence;
     
-    std::map<EmotionalState, steady_clock::time_point> lastBlinkTimes;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    snapshot.publishedMs = std::chrono::duration_cast<std::chrono::milliseconds>(now.time_since_epoch()).count();
+    for (int state = 0; state < EMOTIONAL_STATE_COUNT; state++) {
+        snapshot.stateMs[state] = g_stateMachine.TimeInState((EmotionalState)state, now);
+        snapshot.transitions[state] = g_stateMachine.Transitions((EmotionalState)state);
+    }
+    snapshot.samples = g_sampleCount;
+    snapshot.monitorBusyNs = (uint64_t)g_monitorBusy.count();
+    snapshot.monitorWakeups = g_monitorWakeups;
+    snapshot.samplingIntervalMs = (int)g_sampling.Interval().count();
+    g_snapshot.Store(snapshot);
     
-    // Initialize all blink times to now
-    steady_clock::time_point now = steady_clock::now();
-    for (int i = HAPPY; i <= TIRED_EXTREMELY; i++) {
-        lastBlinkTimes[(EmotionalState)i] = now;
+    StatePageData page = {};
+    page.sequence = snapshot.sequence;
+    page.timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    page.cpuUsage = snapshot.cpuUsage;
+    page.memoryUsage = snapshot.memoryUsage;
+    page.hottestCoreUsage = snapshot.hottestCoreUsage;
+    page.saturatedCores = snapshot.saturatedCores;
+    page.batteryPercent = snapshot.hasBattery ? snapshot.batteryPercent : -1;
+    page.state = (uint8_t)snapshot.state;
+    page.isBlinking = snapshot.isBlinking;
+    strncpy_s(page.stateName, EMOTIONAL_STATE_NAMES[snapshot.state], _TRUNCATE);
+    g_statePage.Publish(page);
+}
+
+// Invalidates the window only if the visible (state, blink) frame actually changed.
+// Runs on the monitor thread, after PublishSnapshot().
+bool RequestRepaint() {
+    PROFILE_SCOPE(g_profile, PROFILE_INVALIDATE);
+    bool blink = g_isBlinking && g_blinkSprites[g_stateMachine.State()] >= 0;
+    if (!g_repaintTracker.Changed(g_stateMachine.State(), blink)) {
+        return false;
     }
+    TRACE_SCOPE(g_tracer, "InvalidateRect");
+    InvalidateRect(g_hwnd, NULL, FALSE);
+    return true;
+}
+
+// Shows a temporary state (GRIMACE, SURPRISED, PLEASED) and arms its expiry deadline.
+// Runs on the monitor thread.
+void EnterTemporaryState(EmotionalState state) {
+    g_stateMachine.EnterTemporaryState(state, std::chrono::steady_clock::now());
+    g_scheduler.Schedule(TIMER_TEMPORARY_STATE, g_stateMachine.TemporaryDeadline());
+    ScheduleNextBlink(state);
+    PublishSnapshot();
+    RequestRepaint();
     
-    while (g_hwnd) {
-        // Get current time
-        now = steady_clock::now();
-        
-        // Get current state safely
-        EmotionalState currentState;
-        {
-            std::lock_guard<std::mutex> lock(g_stateMutex);
-            currentState = g_currentState;
-        }
-        
-        // Check if we have a blink image for this state
-        if (g_blinkImages[currentState] != nullptr) {
-            // Check if it's time to blink
-            auto interval = seconds(g_blinkIntervals[currentState]);
-            if (now - lastBlinkTimes[currentState] >= interval) {
-                // Time to blink
-                g_isBlinking = true;
-                
-                // Update the window
-                InvalidateRect(g_hwnd, NULL, FALSE);
-                UpdateWindow(g_hwnd);
-                
-                // Wait for blink duration
-                std::this_thread::sleep_for(duration<double>(g_blinkDurations[currentState]));
-                
-                // Return to normal
-                g_isBlinking = false;
-                
-                // Update the window
-                InvalidateRect(g_hwnd, NULL, FALSE);
-                UpdateWindow(g_hwnd);
-                
-                // Update last blink time
-                lastBlinkTimes[currentState] = steady_clock::now();
-            }
+    uint16_t cause = state == SURPRISED ? HISTORY_DEVICE_CHANGE : state == GRIMACE ? HISTORY_APP_ERROR : 0;
+    RecordHistory(HISTORY_STATE_CHANGE | cause);
+}
+
+// Safe to call from any thread and never blocks. Only the first event since the
+// monitor thread last drained the queue wakes it.
+void QueueStateEvent(StateEventType type) {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (g_events.Push(MakeStateEvent(type, now)) && g_events.ArmWake()) {
+        g_scheduler.Schedule(TIMER_EVENT, now);
+    }
+}
+
+// Shows the highest-priority pending event, unless a temporary state of higher
+// priority is still on screen. Runs on the monitor thread.
+void ShowPendingEvent() {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    int showing = -1;
+    if (g_stateMachine.InTemporaryState() && now < g_stateMachine.TemporaryDeadline()) {
+        showing = TemporaryStatePriority(g_stateMachine.State());
+    }
+    EmotionalState state = HAPPY;
+    if (g_eventArbiter.Next(now, showing, state)) {
+        EnterTemporaryState(state);
+    }
+}
+
+// Safe to call from any thread: hands a device or display notification to the
+// monitor thread, which debounces it
+void QueueHotplugEvent(HotplugEvent event) {
+    g_pendingHotplug.fetch_or(1u << (event.kind * 2 + (event.display ? 1 : 0)));
+    g_scheduler.Schedule(TIMER_HOTPLUG, std::chrono::steady_clock::now());
+}
+
+// Feeds the queued notifications to the debouncer and acts on what it decides.
+// Runs on the monitor thread.
+void HandleHotplugEvents() {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    unsigned pending = g_pendingHotplug.exchange(0);
+    bool surprise = false;
+    bool reposition = false;
+    for (int bit = 0; bit < HOTPLUG_KIND_COUNT * 2; bit++) {
+        if (pending & (1u << bit)) {
+            HotplugStep step = g_hotplug.Add({ (HotplugKind)(bit / 2), (bit & 1) != 0 }, now);
+            surprise |= step.surprise;
+            reposition |= step.reposition;
         }
-        
-        // Sleep for a short time before checking again
-        std::this_thread::sleep_for(milliseconds(50));
+    }
+    if (surprise) {
+        g_eventArbiter.Add(MakeStateEvent(STATE_EVENT_DEVICE_CHANGE, now));
+        ShowPendingEvent();
+    }
+    if (reposition) {
+        g_scheduler.ScheduleNoEarlier(TIMER_REPOSITION, g_hotplug.RepositionDeadline());
     }
 }
 
-void MonitorSystem() {
-    while (g_hwnd) {
+// Repositions the window once `delay` has passed. Bursts of requests collapse into a
+// single reposition at the latest requested deadline.
+void DeferDisplayChange(std::chrono::milliseconds delay) {
+    g_scheduler.ScheduleNoEarlier(TIMER_REPOSITION, std::chrono::steady_clock::now() + delay);
+}
+
+void StartBlink() {
+    TRACE_INSTANT(g_tracer, "blink on");
+    g_isBlinking = true;
+    PublishSnapshot();
+    
+    // Update the window
+    if (RequestRepaint()) {
+        UpdateWindow(g_hwnd);
+    }
+    
+    auto duration = std::chrono::milliseconds(BLINK_TIMINGS[g_stateMachine.State()].durationMs);
+    g_scheduler.Schedule(TIMER_BLINK_END, std::chrono::steady_clock::now() + duration);
+}
+
+void EndBlink() {
+    // Return to normal
+    TRACE_INSTANT(g_tracer, "blink off");
+    g_isBlinking = false;
+    PublishSnapshot();
+    
+    // Update the window
+    if (RequestRepaint()) {
+        UpdateWindow(g_hwnd);
+    }
+    
+    // Update last blink time and wait for the next one
+    g_lastBlinkTimes[g_stateMachine.State()] = std::chrono::steady_clock::now();
+    ScheduleNextBlink(g_stateMachine.State());
+}
+
+void SampleSystem() {
+    EmotionalState previousState = g_stateMachine.State();
+    g_sampleCount++;
+    
+    {
+        PROFILE_SCOPE(g_profile, PROFILE_SAMPLE);
+        
         // Update CPU usage
-        g_cpuUsage = GetCPUUsage();
+        {
+            TRACE_SCOPE(g_tracer, "GetCPUUsage");
+            g_cpuUsage = GetCPUUsage();
+        }
         
         // Update memory usage
         g_memoryUsage = GetMemoryUsage();
         
         // Update battery status
         CheckBatteryStatus();
-        
-        // Update emotional state based on system metrics
-        UpdateEmotionalState();
-        
-        // Sleep for a short time before checking again
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
-        
-        // Process any Windows messages (especially device change notifications)
-        ProcessWindowMessages();
     }
+    
+    // Smoothing is tuned for 500 ms samples; weight this one by the time it covers
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double periods = 1.0;
+    if (g_sampleCount > 1) {
+        periods = std::chrono::duration<double, std::milli>(now - g_lastSampleTime).count() / NOMINAL_SAMPLING_MS;
+        periods = (std::min)((std::max)(periods, 0.1), 20.0);
+    }
+    g_lastSampleTime = now;
+    
+    // Update emotional state based on system metrics
+    MetricValues metrics = MakeMetrics(g_cpuUsage, g_coreStats.aboveAnguishExtremely, g_hasBattery,
+                                       g_batteryPercent, g_memoryUsage);
+    g_stateMachine.SetMetrics(metrics, periods);
+    g_sampling.Update(metrics, g_stateMachine.Rules(), g_onBattery, now);
+    UpdateEmotionalState();
+    
+    RecordHistory(HISTORY_SAMPLE | (g_stateMachine.State() != previousState ? HISTORY_STATE_CHANGE : 0));
 }
 
-void UpdateEmotionalState() {
+// Single scheduler thread: sleeps until the next deadline and dispatches it.
+// Replaces the old 500 ms monitor loop and 50 ms blink polling loop.
+void MonitorSystem() {
     using namespace std::chrono;
     
-    // Lock for thread safety
-    std::unique_lock<std::mutex> lock(g_stateMutex);
-    
-    // First, check if we're in a temporary state
-    if (g_temporaryState) {
-        auto now = steady_clock::now();
-        if (now - g_temporaryStateStartTime >= g_temporaryStateDuration) {
-            g_temporaryState = false;
-            g_stateChanged = true;
-            // Will fall through to determine the real state
-        } else {
-            // We're still in temporary state, no need to update
-            return;
-        }
+    steady_clock::time_point now = steady_clock::now();
+    for (int i = HAPPY; i <= TIRED_EXTREMELY; i++) {
+        g_lastBlinkTimes[i] = now;
+    }
+    ScheduleNextBlink(g_stateMachine.State());
+    PublishSnapshot();
+    g_scheduler.Schedule(TIMER_SAMPLE, now);
+    if (g_tracer.Running()) {
+        g_tracer.RegisterThread("monitor");
     }
+    steady_clock::time_point nextSample = now;
     
-    // Track if we were over thresholds before
-    bool wasOverThresholdBefore = g_wasAboveThreshold;
-    bool isOverThresholdNow = false;
-    
-    // Determine the new state based on priorities
-    EmotionalState newState = HAPPY; // Default state
-    
-    // Check CPU usage (highest priority)
-    if (g_cpuUsage > 90.0) {
-        newState = ANGUISH_EXTREMELY;
-        isOverThresholdNow = true;
-    } else if (g_cpuUsage > 70.0) {
-        newState = ANGUISH_VERY;
-        isOverThresholdNow = true;
-    } else if (g_cpuUsage > 50.0) {
-        newState = ANGUISH;
-        isOverThresholdNow = true;
-    }
-    // If CPU is not high, check battery (second priority)
-    else if (g_hasBattery && g_batteryPercent < 10) {
-        newState = TIRED_EXTREMELY;
-        isOverThresholdNow = true;
-    } else if (g_hasBattery && g_batteryPercent < 20) {
-        newState = TIRED_VERY;
-        isOverThresholdNow = true;
-    } else if (g_hasBattery && g_batteryPercent < 30) {
-        newState = TIRED;
-        isOverThresholdNow = true;
-    }
-    // If CPU and battery are fine, check memory (third priority)
-    else if (g_memoryUsage > 95.0) {
-        newState = GRIMACE_TWO_SWEAT;
-        isOverThresholdNow = true;
-    } else if (g_memoryUsage > 90.0) {
-        newState = NEUTRAL;
-        isOverThresholdNow = true;
-    }
-    // Special case: if we were over threshold and now we're not, show pleased briefly
-    else if (wasOverThresholdBefore && !isOverThresholdNow) {
-        newState = PLEASED;
-        g_temporaryState = true;
-        g_temporaryStateStartTime = steady_clock::now();
-    }
-    
-    // Update threshold tracker
-    g_wasAboveThreshold = isOverThresholdNow;
-    
-    // Update state if it changed
-    if (newState != g_currentState) {
-        g_currentState = newState;
-        g_stateChanged = true;
+    while (g_hwnd) {
+        int timer = g_scheduler.WaitNext();
+        if (timer < 0) {
+            break;
+        }
+        steady_clock::time_point wokeAt = steady_clock::now();
+        g_monitorWakeups++;
+        PROFILE_WAKEUP(g_profile, PROFILE_THREAD_MONITOR);
+        
+        switch (timer) {
+        case TIMER_SAMPLE:
+            SampleSystem();
+            
+            // Keep the cadence SampleSystem() picked, but don't try to catch up after a stall
+            nextSample = (std::max)(nextSample + g_sampling.Interval(), steady_clock::now());
+            g_scheduler.Schedule(TIMER_SAMPLE, nextSample);
+            
+            // Process any Windows messages (especially device change notifications)
+            ProcessWindowMessages();
+            break;
+            
+        case TIMER_BLINK_START:
+            StartBlink();
+            break;
+            
+        case TIMER_BLINK_END:
+            EndBlink();
+            break;
+            
+        case TIMER_TEMPORARY_STATE:
+            // Expire the temporary state right away instead of waiting for the next sample,
+            // then show any event that was waiting behind it
+            UpdateEmotionalState();
+            if (g_eventArbiter.HasPending()) {
+                ShowPendingEvent();
+            }
+            break;
+            
+        case TIMER_REPOSITION:
+            // The timer never fires before the debouncer's deadline, so this always clears it
+            g_hotplug.TakeReposition(steady_clock::now());
+            HandleDisplayChange();
+            break;
+            
+        case TIMER_HOTPLUG:
+            HandleHotplugEvents();
+            break;
+            
+        case TIMER_EVENT:
+        {
+            g_events.Disarm();
+            StateEvent event;
+            while (g_events.Pop(event)) {
+                g_eventArbiter.Add(event);
+            }
+            ShowPendingEvent();
+            break;
+        }
+            
+        case TIMER_RULES:
+        {
+            // Switch tables first, then free the old one; nothing else holds it. A save
+            // that didn't change the rules keeps dwell and hysteresis state as it is.
+            RuleSet* rules = g_pendingRules.exchange(nullptr);
+            if (rules && *rules == *g_stateMachine.Rules()) {
+                delete rules;
+            } else if (rules) {
+                g_stateMachine.SetRules(rules);
+                g_loadedRules.reset(rules);
+                g_pendingHistoryFlags |= HISTORY_RULES_RELOADED;
+                UpdateEmotionalState();
+            }
+            break;
+        }
+            
+        case TIMER_PROFILE_REPORT:
+            WriteProfileReport();
+            if (g_profile.Enabled()) {
+                g_scheduler.Schedule(TIMER_PROFILE_REPORT, steady_clock::now() + PROFILE_REPORT_INTERVAL);
+            }
+            break;
+        }
         
-        // Redraw the window
-        InvalidateRect(g_hwnd, NULL, FALSE);
+        g_monitorBusy += steady_clock::now() - wokeAt;
+    }
+}
+
+// Runs the state machine at the current time and acts on the result: arms the
+// temporary state expiry, moves blinking to the new state and repaints
+void UpdateEmotionalState() {
+    TRACE_SCOPE(g_tracer, "UpdateEmotionalState");
+    StateStep step;
+    {
+        PROFILE_SCOPE(g_profile, PROFILE_EVALUATE);
+        step = g_stateMachine.Update(std::chrono::steady_clock::now());
+    }
+    if (step.temporaryStarted) {
+        g_scheduler.Schedule(TIMER_TEMPORARY_STATE, g_stateMachine.TemporaryDeadline());
+    }
+    if (step.changed) {
+        ScheduleNextBlink(g_stateMachine.State());
     }
     
-    // Notify waiting threads if state changed
-    if (g_stateChanged) {
-        g_stateChanged = false;
-        lock.unlock();
-        g_stateCV.notify_one();
+    // Publish before redrawing so WM_PAINT sees the new state
+    PublishSnapshot();
+    if (step.changed) {
+        RequestRepaint();
     }
 }
 
 double GetCPUUsage() {
     PDH_FMT_COUNTERVALUE counterVal;
-    PdhCollectQueryData(cpuQuery);
+    PdhCollectQueryData(cpuQuery); // Collects the total and every core in one pass
     PdhGetFormattedCounterValue(cpuTotal, PDH_FMT_DOUBLE, NULL, &counterVal);
+    
+    // Per-core values into g_coreSamples, skipping the "_Total" instances
+    g_coreSamples.count = 0;
+    DWORD bufferSize = (DWORD)g_coreCounterBuffer.size();
+    DWORD itemCount = 0;
+    PDH_FMT_COUNTERVALUE_ITEM_W* items = (PDH_FMT_COUNTERVALUE_ITEM_W*)g_coreCounterBuffer.data();
+    PDH_STATUS status = PdhGetFormattedCounterArrayW(cpuCores, PDH_FMT_DOUBLE, &bufferSize, &itemCount, items);
+    if (status == PDH_MORE_DATA) {
+        g_coreCounterBuffer.resize(bufferSize);
+        items = (PDH_FMT_COUNTERVALUE_ITEM_W*)g_coreCounterBuffer.data();
+        status = PdhGetFormattedCounterArrayW(cpuCores, PDH_FMT_DOUBLE, &bufferSize, &itemCount, items);
+    }
+    if (status == ERROR_SUCCESS) {
+        for (DWORD i = 0; i < itemCount && g_coreSamples.count < MAX_CORES; i++) {
+            if (wcsstr(items[i].szName, L"_Total") != NULL) {
+                continue;
+            }
+            g_coreSamples.usage[g_coreSamples.count++] = (float)items[i].FmtValue.doubleValue;
+        }
+    }
+    g_coreStats = AggregateCores(g_coreSamples.usage, g_coreSamples.count);
+    
     return counterVal.doubleValue;
 }
 
@@ -741,6 +1176,7 @@ void CheckBatteryStatus() {
     if (GetSystemPowerStatus(&powerStatus)) {
         // Check if system has a battery
         g_hasBattery = (powerStatus.BatteryFlag != 128); // 128 means no battery
+        g_onBattery = g_hasBattery && powerStatus.ACLineStatus == 0; // 0 means offline
         
         if (g_hasBattery) {
             g_batteryPercent = powerStatus.BatteryLifePercent;
@@ -769,6 +1205,7 @@ HMENU CreateContextMenu() {
         flags |= MF_CHECKED;
     }
     AppendMenuW(hMenu, flags, ID_ALWAYS_ON_TOP, L"Always On Top");
+    AppendMenuW(hMenu, MF_STRING | (g_profile.Enabled() ? MF_CHECKED : 0), ID_SELF_PROFILE, L"Self Profiling");
     
     // Add separator and Exit option
     AppendMenuW(hMenu, MF_SEPARATOR, 0, NULL);
@@ -931,14 +1368,120 @@ void PlaceWindowOnSecondaryMonitor(HWND hwnd) {
         monitorRect = monitorInfo.rcWork;
     }
     
+    // Size the window for the monitor's DPI before placing it
+    ApplyMonitorScale(hMonitor);
+    int width = g_windowWidth;
+    int height = g_windowHeight;
+    
     // Calculate position at the bottom right corner of the selected monitor
-    int x = monitorRect.right - g_windowWidth;
-    int y = monitorRect.bottom - g_windowHeight;
+    int x = monitorRect.right - width;
+    int y = monitorRect.bottom - height;
     
     // Move the window (keep appropriate z-order based on g_alwaysOnTop setting)
     HWND insertAfter = g_alwaysOnTop ? HWND_TOPMOST : HWND_NOTOPMOST;
     
     // Set window position with proper flags to ensure it's correctly positioned
-    SetWindowPos(hwnd, insertAfter, x, y, g_windowWidth, g_windowHeight, 
+    SetWindowPos(hwnd, insertAfter, x, y, width, height, 
                  SWP_SHOWWINDOW | SWP_NOCOPYBITS);
 }
+
+// Picks the sprite scale for the monitor's DPI. WM_PAINT notices the new scale and
+// rebuilds the scaled sprites and frames once; nothing is rescaled per frame.
+void ApplyMonitorScale(HMONITOR monitor) {
+    UINT dpiX = 96;
+    UINT dpiY = 96;
+    if (!monitor || FAILED(GetDpiForMonitor(monitor, MDT_EFFECTIVE_DPI, &dpiX, &dpiY))) {
+        dpiX = 96;
+    }
+    
+    int scale = ScaleForDpi((int)dpiX);
+    g_windowWidth = ScaledExtent(g_baseWidth, scale);
+    g_windowHeight = ScaledExtent(g_baseHeight, scale);
+    g_spriteScale = scale;
+}
+
+// Rules live in rules.conf next to the executable; without one the built-in table applies
+void InitializeRules() {
+    g_rulesPath = ExecutableDirectory() + L"\\rules.conf";
+    
+    // The monitor thread hasn't started yet, so the first set can be installed directly
+    std::unique_ptr<RuleSet> rules(new RuleSet);
+    std::string error;
+    if (LoadRulesFile(g_rulesPath, *rules, &error)) {
+        g_stateMachine.SetRules(rules.get());
+        g_loadedRules = std::move(rules);
+    } else {
+        OutputDebugStringA(("Using built-in rules: " + error + "\n").c_str());
+    }
+    
+    if (!g_rulesWatcher.Start(g_rulesPath, ReloadRules)) {
+        OutputDebugStringW(L"Warning: rules.conf will not be reloaded on change\n");
+    }
+}
+
+// Runs on the watcher thread. Parsing happens here; the monitor thread only swaps a pointer.
+void ReloadRules() {
+    std::unique_ptr<RuleSet> rules(new RuleSet);
+    std::string error;
+    if (!LoadRulesFile(g_rulesPath, *rules, &error)) {
+        OutputDebugStringA(("Keeping current rules: " + error + "\n").c_str());
+        return;
+    }
+    
+    // A set the monitor thread hasn't picked up yet is simply replaced
+    delete g_pendingRules.exchange(rules.release());
+    g_scheduler.Schedule(TIMER_RULES, std::chrono::steady_clock::now());
+}
+
+std::wstring ExecutableDirectory() {
+    wchar_t exePath[MAX_PATH];
+    DWORD length = GetModuleFileNameW(NULL, exePath, MAX_PATH);
+    if (length == 0 || length == MAX_PATH) {
+        return L".";
+    }
+    PathRemoveFileSpecW(exePath);
+    return exePath;
+}
+
+// Appends the current metrics and state to the history ring, and periodic samples to
+// the archive. Monitor thread only; the ring append is a copy into mapped memory, the
+// archive writes a block every BLOCK_SAMPLES samples.
+void RecordHistory(uint16_t flags) {
+    HistoryRecord record = {};
+    record.timeMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    record.cpu = HistoryPercent(g_cpuUsage);
+    record.memory = HistoryPercent(g_memoryUsage);
+    record.battery = g_hasBattery ? (int8_t)g_batteryPercent : -1;
+    record.state = (uint8_t)g_stateMachine.State();
+    record.flags = flags | g_pendingHistoryFlags;
+    record.hottestCore = HistoryPercent(g_coreStats.max);
+    record.saturatedCores = (uint16_t)g_coreStats.aboveAnguishExtremely;
+    g_history.Append(record);
+    if (flags & HISTORY_SAMPLE) {
+        g_archive.Append(record);
+    }
+    g_pendingHistoryFlags = 0;
+}
+
+// Starts or stops measuring our own overhead. Either way a report follows: every
+// PROFILE_REPORT_INTERVAL while on, and a last one right away when turned off.
+void SetSelfProfiling(bool enabled) {
+    g_profile.SetEnabled(enabled);
+    auto now = std::chrono::steady_clock::now();
+    g_scheduler.Schedule(TIMER_PROFILE_REPORT, enabled ? now + PROFILE_REPORT_INTERVAL : now);
+}
+
+// Writes the self profile to the debugger and to profile.txt next to the executable.
+// Monitor thread.
+void WriteProfileReport() {
+    std::string report;
+    g_profile.Report(report);
+    OutputDebugStringA(report.c_str());
+    
+    FILE* file = _wfopen((ExecutableDirectory() + L"\\profile.txt").c_str(), L"wb");
+    if (file) {
+        fwrite(report.data(), 1, report.size(), file);
+        fclose(file);
+    }
+}
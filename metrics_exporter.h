@@ -0,0 +1,441 @@
+#pragma once
+
+// Optional Prometheus text-format endpoint for the numbers the face reacts to.
+//
+// One exporter thread accepts connections on 127.0.0.1:<port> (or, on Linux, a Unix
+// domain socket), reads the request and answers with the current SystemSnapshot as
+// gauges and counters: metrics, current state, time in and transitions into each
+// state, and the monitor thread's own overhead. The snapshot comes from the seqlock,
+// so a scrape never blocks or slows the monitor thread, and the response is rendered
+// into buffers reused across scrapes. Up to MAX_CLIENTS connections are multiplexed
+// with poll() on non-blocking sockets, so a client that connects and sends nothing
+// (or dribbles its request) holds a slot, not the thread; each is answered as soon
+// as its headers arrive, or closed CLIENT_TIMEOUT_MS after it connected.
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include "emotional_state.h"
+#include "state_snapshot.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET ExporterSocket;
+typedef WSAPOLLFD ExporterPollFd;
+const ExporterSocket NO_EXPORTER_SOCKET = INVALID_SOCKET;
+#else
+#include <arpa/inet.h>
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+typedef int ExporterSocket;
+typedef pollfd ExporterPollFd;
+const ExporterSocket NO_EXPORTER_SOCKET = -1;
+#endif
+
+class MetricsExporter {
+public:
+    static const int MAX_CLIENTS = 16;            // More wait in the listen backlog
+    static const int CLIENT_TIMEOUT_MS = 1000;    // From connect to the end of the response
+
+    ~MetricsExporter() { Stop(); }
+
+    // Serves scrapes on 127.0.0.1:port from `source`, which must outlive the exporter
+    bool StartTcp(const SeqLock<SystemSnapshot>* source, uint16_t port) {
+        Stop();
+#ifdef _WIN32
+        WSADATA data;
+        if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+            return false;
+        }
+        m_winsock = true;
+#endif
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return Listen(source, AF_INET, (const sockaddr*)&address, sizeof(address));
+    }
+
+#ifndef _WIN32
+    // Serves scrapes on a Unix domain socket, replacing a stale socket file
+    bool StartUnix(const SeqLock<SystemSnapshot>* source, const char* path) {
+        Stop();
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (std::strlen(path) >= sizeof(address.sun_path)) {
+            return false;
+        }
+        std::strcpy(address.sun_path, path);
+        unlink(path);
+        if (!Listen(source, AF_UNIX, (const sockaddr*)&address, sizeof(address))) {
+            return false;
+        }
+        m_unixPath = path;
+        return true;
+    }
+#endif
+
+    void Stop() {
+        m_stopping = true;
+#ifdef _WIN32
+        // WSAPoll has no stop pipe to watch; a connection to ourselves wakes it
+        if (m_thread.joinable()) {
+            ExporterSocket wake = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in address = {};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(m_port);
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (wake != NO_EXPORTER_SOCKET) connect(wake, (const sockaddr*)&address, sizeof(address));
+            m_thread.join();
+            if (wake != NO_EXPORTER_SOCKET) closesocket(wake);
+        }
+        if (m_listener != NO_EXPORTER_SOCKET) closesocket(m_listener);
+        if (m_winsock) WSACleanup();
+        m_winsock = false;
+#else
+        if (m_stopPipe[1] >= 0) {
+            char byte = 0;
+            ssize_t written = write(m_stopPipe[1], &byte, 1);
+            (void)written;
+        }
+        if (m_thread.joinable()) m_thread.join();
+        for (int* fd : { &m_listener, &m_stopPipe[0], &m_stopPipe[1] }) {
+            if (*fd >= 0) close(*fd);
+            *fd = -1;
+        }
+        if (!m_unixPath.empty()) unlink(m_unixPath.c_str());
+        m_unixPath.clear();
+#endif
+        m_listener = NO_EXPORTER_SOCKET;
+        m_port = 0;
+        m_stopping = false;
+    }
+
+    uint64_t Scrapes() const { return m_scrapes.load(std::memory_order_relaxed); }
+
+    // The TCP port listened on, which StartTcp(source, 0) leaves to the system
+    uint16_t Port() const { return m_port; }
+
+    // Renders the exposition text for `snapshot` as of `nowMs` (steady_clock ms).
+    // Time in the current state is extended from the publish up to now.
+    void Render(const SystemSnapshot& snapshot, int64_t nowMs, std::string& out) const {
+        out.clear();
+        Gauge(out, "etm_cpu_usage_percent", "Total CPU usage.", snapshot.cpuUsage);
+        Gauge(out, "etm_memory_usage_percent", "Physical memory in use.", snapshot.memoryUsage);
+        Gauge(out, "etm_hottest_core_percent", "Usage of the busiest core.", snapshot.hottestCoreUsage);
+        Gauge(out, "etm_saturated_cores", "Cores above the ANGUISH_EXTREMELY threshold.", snapshot.saturatedCores);
+        if (snapshot.hasBattery) {
+            Gauge(out, "etm_battery_percent", "Battery charge.", snapshot.batteryPercent);
+        }
+
+        Header(out, "etm_state", "1 for the state the face shows, 0 for the others.", "gauge");
+        for (int s = 0; s < EMOTIONAL_STATE_COUNT; s++) {
+            Append(out, "etm_state{state=\"%s\"} %d\n", EMOTIONAL_STATE_NAMES[s], s == snapshot.state ? 1 : 0);
+        }
+        Header(out, "etm_state_seconds_total", "Time spent in each state.", "counter");
+        for (int s = 0; s < EMOTIONAL_STATE_COUNT; s++) {
+            uint64_t ms = snapshot.stateMs[s];
+            if (s == snapshot.state && nowMs > snapshot.publishedMs) {
+                ms += (uint64_t)(nowMs - snapshot.publishedMs);
+            }
+            Append(out, "etm_state_seconds_total{state=\"%s\"} %.3f\n", EMOTIONAL_STATE_NAMES[s], ms / 1000.0);
+        }
+        Header(out, "etm_state_transitions_total", "Times each state was entered.", "counter");
+        for (int s = 0; s < EMOTIONAL_STATE_COUNT; s++) {
+            Append(out, "etm_state_transitions_total{state=\"%s\"} %llu\n", EMOTIONAL_STATE_NAMES[s],
+                   (unsigned long long)snapshot.transitions[s]);
+        }
+
+        Counter(out, "etm_samples_total", "Metric samples taken.", snapshot.samples);
+        Header(out, "etm_monitor_busy_seconds_total", "Time the monitor thread spent handling timers.", "counter");
+        Append(out, "etm_monitor_busy_seconds_total %.6f\n", snapshot.monitorBusyNs / 1e9);
+        Counter(out, "etm_monitor_wakeups_total", "Timers the monitor thread handled.", snapshot.monitorWakeups);
+        Gauge(out, "etm_sampling_interval_seconds", "Interval until the next metric sample.", snapshot.samplingIntervalMs / 1000.0);
+        Counter(out, "etm_snapshots_total", "State snapshots published.", snapshot.sequence);
+        Counter(out, "etm_scrapes_total", "Scrapes served by this endpoint.", Scrapes());
+    }
+
+private:
+    struct Client {
+        ExporterSocket socket;
+        int64_t deadlineMs;
+        int length;
+        char request[2048];
+    };
+
+    static int64_t NowMs() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void CloseSocket(ExporterSocket socket) {
+#ifdef _WIN32
+        closesocket(socket);
+#else
+        close(socket);
+#endif
+    }
+
+    static bool SetNonBlocking(ExporterSocket socket) {
+#ifdef _WIN32
+        u_long on = 1;
+        return ioctlsocket(socket, FIONBIO, &on) == 0;
+#else
+        int flags = fcntl(socket, F_GETFL, 0);
+        return flags >= 0 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+    }
+
+    static bool WouldBlock() {
+#ifdef _WIN32
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+    }
+
+    bool Listen(const SeqLock<SystemSnapshot>* source, int family, const sockaddr* address, int length) {
+        m_source = source;
+        m_listener = socket(family, SOCK_STREAM, 0);
+        if (m_listener == NO_EXPORTER_SOCKET) {
+            Stop();
+            return false;
+        }
+        if (family == AF_INET) {
+            int on = 1;
+#ifdef _WIN32
+            // SO_REUSEADDR on Windows would let another process bind the port over us
+            setsockopt(m_listener, SOL_SOCKET, SO_EXCLUSIVEADDRUSE, (const char*)&on, sizeof(on));
+#else
+            setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+#endif
+        }
+        if (bind(m_listener, address, length) != 0 || listen(m_listener, 16) != 0 || !SetNonBlocking(m_listener)) {
+            Stop();
+            return false;
+        }
+        if (family == AF_INET) {
+            sockaddr_in bound = {};
+            socklen_t boundLength = sizeof(bound);
+            if (getsockname(m_listener, (sockaddr*)&bound, &boundLength) == 0) m_port = ntohs(bound.sin_port);
+        }
+#ifndef _WIN32
+        if (pipe(m_stopPipe) != 0) {
+            Stop();
+            return false;
+        }
+#endif
+        m_response.reserve(8192);
+        m_thread = std::thread(&MetricsExporter::Run, this);
+        return true;
+    }
+
+    void Run() {
+        for (;;) {
+            // Clients first, then the listener while there is a free slot, then the stop pipe
+            ExporterPollFd fds[MAX_CLIENTS + 2];
+            int count = 0;
+            int64_t nowMs = NowMs();
+            int timeoutMs = -1;
+            for (int i = 0; i < m_clientCount; i++) {
+                fds[count].fd = m_clients[i].socket;
+                fds[count].events = POLLIN;
+                fds[count].revents = 0;
+                count++;
+                int64_t left = m_clients[i].deadlineMs - nowMs;
+                left = left < 0 ? 0 : left;
+                if (timeoutMs < 0 || left < timeoutMs) timeoutMs = (int)left;
+            }
+            int listening = -1;
+            if (m_clientCount < MAX_CLIENTS) {
+                listening = count;
+                fds[count].fd = m_listener;
+                fds[count].events = POLLIN;
+                fds[count].revents = 0;
+                count++;
+            }
+#ifdef _WIN32
+            if (WSAPoll(fds, (ULONG)count, timeoutMs) == SOCKET_ERROR || m_stopping) {
+                break;
+            }
+#else
+            fds[count].fd = m_stopPipe[0];
+            fds[count].events = POLLIN;
+            fds[count].revents = 0;
+            if (poll(fds, (nfds_t)(count + 1), timeoutMs) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (fds[count].revents) {
+                break;
+            }
+#endif
+
+            // Walk down so removing a client doesn't move one not yet looked at
+            nowMs = NowMs();
+            for (int i = m_clientCount - 1; i >= 0; i--) {
+                Client& client = m_clients[i];
+                bool done = false;
+                if (fds[i].revents) {
+                    int read = Read(client);
+                    if (read > 0) Serve(client);
+                    done = read != 0;
+                }
+                if (done || nowMs >= client.deadlineMs) {
+                    CloseSocket(client.socket);
+                    client = m_clients[--m_clientCount];
+                }
+            }
+            if (listening >= 0 && (fds[listening].revents & POLLIN)) {
+                Accept(nowMs);
+            }
+        }
+        for (int i = 0; i < m_clientCount; i++) {
+            CloseSocket(m_clients[i].socket);
+        }
+        m_clientCount = 0;
+    }
+
+    void Accept(int64_t nowMs) {
+        while (m_clientCount < MAX_CLIENTS) {
+            ExporterSocket socket = accept(m_listener, nullptr, nullptr);
+            if (socket == NO_EXPORTER_SOCKET) {
+                return;
+            }
+            if (!SetNonBlocking(socket)) {
+                CloseSocket(socket);
+                continue;
+            }
+            Client& client = m_clients[m_clientCount++];
+            client.socket = socket;
+            client.deadlineMs = nowMs + CLIENT_TIMEOUT_MS;
+            client.length = 0;
+        }
+    }
+
+    // 1 when the request is complete (headers ended, buffer full or the client is done
+    // sending), 0 to wait for more, -1 to drop the client. Only the request line matters.
+    static int Read(Client& client) {
+        for (;;) {
+            int space = (int)sizeof(client.request) - 1 - client.length;
+            if (space <= 0) {
+                return 1;
+            }
+            int read = (int)recv(client.socket, client.request + client.length, space, 0);
+            if (read < 0) {
+                return WouldBlock() ? 0 : -1;
+            }
+            if (read == 0) {
+                return client.length > 0 ? 1 : -1;
+            }
+            client.length += read;
+            client.request[client.length] = '\0';
+            if (std::strstr(client.request, "\r\n\r\n") || std::strstr(client.request, "\n\n")) {
+                return 1;
+            }
+        }
+    }
+
+    void Serve(Client& client) {
+        client.request[client.length] = '\0';
+        const char* request = client.request;
+        const char* status = "200 OK";
+        if (std::strncmp(request, "GET ", 4) != 0) {
+            status = "405 Method Not Allowed";
+            m_body = "only GET is supported\n";
+        } else if (std::strncmp(request + 4, "/metrics ", 9) != 0 && std::strncmp(request + 4, "/ ", 2) != 0) {
+            status = "404 Not Found";
+            m_body = "try /metrics\n";
+        } else {
+            m_scrapes.fetch_add(1, std::memory_order_relaxed);
+            Render(m_source->Load(), NowMs(), m_body);
+        }
+
+        m_response.clear();
+        Append(m_response, "HTTP/1.1 %s\r\nContent-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                           "Content-Length: %zu\r\nConnection: close\r\n\r\n", status, m_body.size());
+        m_response += m_body;
+        SendAll(client, m_response.data(), m_response.size());
+    }
+
+    // The response is a few KB and normally fits the socket's send buffer in one go; a
+    // client that stops reading can hold the thread until its deadline at most
+    static void SendAll(const Client& client, const char* data, std::size_t size) {
+#ifdef _WIN32
+        const int flags = 0;
+#else
+        const int flags = MSG_NOSIGNAL;   // A scraper hanging up must not SIGPIPE the app
+#endif
+        while (size > 0) {
+            int sent = (int)send(client.socket, data, (int)size, flags);
+            if (sent < 0 && WouldBlock()) {
+                int64_t left = client.deadlineMs - NowMs();
+                ExporterPollFd fd = { client.socket, POLLOUT, 0 };
+#ifdef _WIN32
+                if (left <= 0 || WSAPoll(&fd, 1, (int)left) <= 0) return;
+#else
+                if (left <= 0 || poll(&fd, 1, (int)left) <= 0) return;
+#endif
+                continue;
+            }
+            if (sent <= 0) {
+                return;
+            }
+            data += sent;
+            size -= (std::size_t)sent;
+        }
+    }
+
+    static void Append(std::string& out, const char* format, ...) {
+        char line[256];
+        va_list args;
+        va_start(args, format);
+        int length = std::vsnprintf(line, sizeof(line), format, args);
+        va_end(args);
+        if (length > 0) {
+            out.append(line, length < (int)sizeof(line) ? (std::size_t)length : sizeof(line) - 1);
+        }
+    }
+
+    static void Header(std::string& out, const char* name, const char* help, const char* type) {
+        Append(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+    }
+
+    static void Gauge(std::string& out, const char* name, const char* help, double value) {
+        Header(out, name, help, "gauge");
+        Append(out, "%s %.6g\n", name, value);
+    }
+
+    static void Counter(std::string& out, const char* name, const char* help, uint64_t value) {
+        Header(out, name, help, "counter");
+        Append(out, "%s %llu\n", name, (unsigned long long)value);
+    }
+
+    const SeqLock<SystemSnapshot>* m_source = nullptr;
+    ExporterSocket m_listener = NO_EXPORTER_SOCKET;
+    std::thread m_thread;
+    std::atomic<bool> m_stopping{ false };
+    std::atomic<uint64_t> m_scrapes{ 0 };
+    uint16_t m_port = 0;
+    Client m_clients[MAX_CLIENTS];
+    int m_clientCount = 0;
+    std::string m_body;         // Reused across scrapes, so rendering stops allocating
+    std::string m_response;
+#ifdef _WIN32
+    bool m_winsock = false;
+#else
+    int m_stopPipe[2] = { -1, -1 };
+    std::string m_unixPath;
+#endif
+};
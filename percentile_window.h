@@ -0,0 +1,172 @@
+#pragma once
+
+// Sliding-window percentiles (p50/p95/p99...) over a time window, in fixed memory.
+//
+// Values are binned into a histogram over [0, range]. The window is cut into SLICES
+// time slices, each with its own bin weights; the running total is the sum of the
+// live slices. Inserting adds the sample's weight to one bin in the current slice
+// and in the total. The weight is the time the sample stands for, in steps of
+// 1/WEIGHT_UNITS of a nominal sample period (0.1 ms of the nominal 500 ms, so a
+// sample taken at 1 kHz keeps its exact weight). A percentile is then a share of
+// the window's time and not of its samples: a burst sampled fast doesn't outvote
+// the idle minutes sampled slowly around it. When time moves past a slice, that
+// slice is subtracted from the total and reused, so expiry costs one pass over the
+// bins per slice (amortized O(1) per sample at any sampling rate). A query walks
+// coarse block counts, then the bins of one block.
+//
+// Accuracy is bounded by the bin width (range / BINS) and by the window edge moving
+// in steps of window / SLICES: the live slices hold every sample of the last
+// SLICES - 1 slices and nothing older than the window, so only the samples at the
+// old end of the window, older than SLICES - 1 slices, may or may not be counted.
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+class PercentileWindow {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    static const int BINS = 256;
+    static const int BLOCK = 16;                 // Bins per coarse block
+    static const int BLOCKS = BINS / BLOCK;
+    static const int SLICES = 30;
+    static const int WEIGHT_UNITS = 5000;        // Per sample period
+
+    // A sample's weight as stored: at least one unit (0.1 ms)
+    static uint32_t WeightUnits(double periods) {
+        double units = periods * WEIGHT_UNITS + 0.5;
+        return units < 1 ? 1 : units > 1e6 ? 1000000u : (uint32_t)units;
+    }
+
+    PercentileWindow() { Reset(); }
+
+    PercentileWindow(double range, std::chrono::milliseconds window) {
+        Configure(range, window);
+    }
+
+    void Configure(double range, std::chrono::milliseconds window) {
+        m_range = range > 0 ? range : 1.0;
+        m_window = window.count() > 0 ? window : std::chrono::milliseconds(1);
+        m_slice = m_window / SLICES;
+        if (m_slice.count() == 0) m_slice = std::chrono::milliseconds(1);
+        Reset();
+    }
+
+    void Reset() {
+        std::memset(m_slices, 0, sizeof(m_slices));
+        std::memset(m_sliceCounts, 0, sizeof(m_sliceCounts));
+        std::memset(m_sliceWeights, 0, sizeof(m_sliceWeights));
+        std::memset(m_total, 0, sizeof(m_total));
+        std::memset(m_blocks, 0, sizeof(m_blocks));
+        m_count = 0;
+        m_weight = 0;
+        m_current = 0;
+        m_started = false;
+    }
+
+    // NaN samples are ignored; values outside [0, range] land in the end bins.
+    // `periods`: how many nominal sample periods the sample stands for.
+    void Insert(double value, TimePoint now, double periods = 1.0) {
+        Advance(now);
+        if (std::isnan(value)) {
+            return;
+        }
+        int bin = Bin(value);
+        uint32_t weight = WeightUnits(periods);
+        m_slices[m_current][bin] += weight;
+        m_sliceCounts[m_current]++;
+        m_sliceWeights[m_current] += weight;
+        m_total[bin] += weight;
+        m_blocks[bin / BLOCK] += weight;
+        m_count++;
+        m_weight += weight;
+    }
+
+    // Drops slices that fell out of the window without inserting anything
+    void Advance(TimePoint now) {
+        if (!m_started) {
+            m_sliceStart = now;
+            m_started = true;
+            return;
+        }
+        // A long gap expires everything; no need to step slice by slice
+        if (now - m_sliceStart >= m_window) {
+            Reset();
+            m_sliceStart = now;
+            m_started = true;
+            return;
+        }
+        while (now - m_sliceStart >= m_slice) {
+            m_sliceStart += m_slice;
+            m_current = (m_current + 1) % SLICES;
+            Expire(m_current);
+        }
+    }
+
+    // Value at percentile p (0..100), reported at the bin centre; NaN when empty
+    double Quantile(double p) const {
+        if (m_count == 0) {
+            return std::nan("");
+        }
+        // Rank of the weight unit we want, 1-based: nearest-rank definition
+        uint64_t rank = (uint64_t)std::ceil(p / 100.0 * (double)m_weight);
+        if (rank < 1) rank = 1;
+        if (rank > m_weight) rank = m_weight;
+
+        uint64_t seen = 0;
+        int block = 0;
+        while (seen + m_blocks[block] < rank) {
+            seen += m_blocks[block++];
+        }
+        int bin = block * BLOCK;
+        while (seen + m_total[bin] < rank) {
+            seen += m_total[bin++];
+        }
+        return (bin + 0.5) * m_range / BINS;
+    }
+
+    uint64_t Count() const { return m_count; }      // Samples in the live slices
+    uint64_t Weight() const { return m_weight; }    // Their weight, in WEIGHT_UNITS
+    std::chrono::milliseconds Window() const { return m_window; }
+    double Range() const { return m_range; }
+
+private:
+    int Bin(double value) const {
+        int bin = (int)(value / m_range * BINS);
+        if (bin < 0) return 0;
+        if (bin >= BINS) return BINS - 1;
+        return bin;
+    }
+
+    void Expire(int slice) {
+        if (m_sliceCounts[slice] == 0) {
+            return;
+        }
+        for (int bin = 0; bin < BINS; bin++) {
+            uint32_t weight = m_slices[slice][bin];
+            m_total[bin] -= weight;
+            m_blocks[bin / BLOCK] -= weight;
+        }
+        m_count -= m_sliceCounts[slice];
+        m_weight -= m_sliceWeights[slice];
+        m_sliceCounts[slice] = 0;
+        m_sliceWeights[slice] = 0;
+        std::memset(m_slices[slice], 0, sizeof(m_slices[slice]));
+    }
+
+    double m_range = 100.0;
+    std::chrono::milliseconds m_window{ 60000 };
+    std::chrono::milliseconds m_slice{ 2000 };
+    TimePoint m_sliceStart;
+    bool m_started = false;
+    int m_current = 0;
+    uint64_t m_count = 0;
+    uint64_t m_weight = 0;
+    uint32_t m_slices[SLICES][BINS];        // Weight per bin
+    uint32_t m_sliceCounts[SLICES];
+    uint64_t m_sliceWeights[SLICES];
+    uint64_t m_total[BINS];
+    uint64_t m_blocks[BLOCKS];
+};
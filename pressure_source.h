@@ -0,0 +1,330 @@
+#pragma once
+
+// Linux pressure stall information (PSI) as an event source, so a memory or CPU
+// stall wakes the sampler right away instead of waiting for the next periodic tick.
+//
+// Each PressureTrigger is registered with the kernel by writing
+// "some|full <stall us> <window us>" to /proc/pressure/<resource>; the kernel then
+// signals POLLPRI on that descriptor when the tasks stalled for at least `stall`
+// microseconds within any `window`, at most once per window. One thread polls all the
+// descriptors and calls the handler, which should only hand the event over (the app
+// schedules an immediate sample).
+//
+// When a trigger can't be registered (a fixture root, a kernel without PSI triggers,
+// or an unprivileged process asking for a window that isn't a multiple of 2 s), the
+// same trigger is evaluated by reading the "total=" stall counter every fallback
+// interval. Like LinuxSampler, files are re-read with pread() into a fixed buffer and
+// the root prefix lets a directory of fixture files stand in for /proc.
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <fcntl.h>
+#include <functional>
+#include <poll.h>
+#include <thread>
+#include <unistd.h>
+#include "linux_sampler.h"
+
+enum PressureResource { PRESSURE_CPU, PRESSURE_MEMORY, PRESSURE_IO, PRESSURE_RESOURCE_COUNT };
+
+const char* const PRESSURE_RESOURCE_NAMES[PRESSURE_RESOURCE_COUNT] = { "cpu", "memory", "io" };
+
+struct PressureLine {
+    double avg10;        // Percent of time stalled, over the last 10 s
+    double avg60;
+    double avg300;
+    uint64_t totalUs;    // Stall time since boot
+};
+
+struct PressureReading {
+    PressureLine some;   // At least one task stalled
+    PressureLine full;   // Every non-idle task stalled (absent for cpu on older kernels)
+};
+
+struct PressureTrigger {
+    PressureResource resource;
+    bool full;
+    uint32_t stallUs;
+    uint32_t windowUs;   // 500 ms to 10 s; unprivileged processes need a multiple of 2 s
+};
+
+// Defaults: tens of milliseconds of memory stall per second is already felt as jank;
+// CPU contention has to be more sustained to matter
+const PressureTrigger DEFAULT_PRESSURE_TRIGGERS[] = {
+    { PRESSURE_MEMORY, false, 100000, 2000000 },
+    { PRESSURE_CPU,    false, 500000, 2000000 },
+    { PRESSURE_IO,     true,  200000, 2000000 },
+};
+
+struct PressureEvent {
+    int trigger;                 // Index into the triggers passed to Open()
+    bool kernel;                 // Signalled by a kernel trigger, not the fallback poll
+    PressureReading reading;     // Of the trigger's resource, read right after the signal
+};
+
+class PressureSource {
+public:
+    static const int MAX_TRIGGERS = 8;
+    typedef std::function<void(const PressureEvent&)> Handler;
+
+    explicit PressureSource(const char* root = "") {
+        std::snprintf(m_root, sizeof(m_root), "%s", root);
+    }
+
+    ~PressureSource() { Close(); }
+
+    PressureSource(const PressureSource&) = delete;
+    PressureSource& operator=(const PressureSource&) = delete;
+
+    // Registers the triggers. Returns false only if none of them has a source at all
+    // (no /proc/pressure); a trigger the kernel refuses falls back to polling every
+    // `fallbackMs`.
+    bool Open(const PressureTrigger* triggers, int count, int fallbackMs = 250) {
+        Close();
+        m_fallbackMs = fallbackMs;
+        bool fixture = m_root[0] != '\0';
+        for (int i = 0; i < count && i < MAX_TRIGGERS; i++) {
+            Slot& slot = m_slots[m_count];
+            slot.trigger = triggers[i];
+            slot.fd = fixture ? -1 : RegisterTrigger(triggers[i]);
+            slot.kernel = slot.fd >= 0;
+            if (!slot.kernel) {
+                slot.fd = OpenUnderRoot(triggers[i].resource, O_RDONLY);
+                if (slot.fd < 0) {
+                    continue;
+                }
+            }
+            m_count++;
+        }
+        return m_count > 0;
+    }
+
+    void Close() {
+        Stop();
+        for (int i = 0; i < m_count; i++) {
+            if (m_slots[i].fd >= 0) close(m_slots[i].fd);
+            m_slots[i] = Slot();
+        }
+        m_count = 0;
+    }
+
+    // Starts the watching thread
+    bool Start(Handler handler) {
+        Stop();
+        if (m_count == 0 || pipe(m_stopPipe) != 0) {
+            return false;
+        }
+        m_handler = handler;
+        for (int i = 0; i < m_count; i++) {
+            ResetFallback(m_slots[i], std::chrono::steady_clock::now());
+        }
+        m_thread = std::thread(&PressureSource::Run, this);
+        return true;
+    }
+
+    void Stop() {
+        if (m_stopPipe[1] >= 0) {
+            char byte = 0;
+            ssize_t written = write(m_stopPipe[1], &byte, 1);
+            (void)written;
+        }
+        if (m_thread.joinable()) m_thread.join();
+        for (int* fd : { &m_stopPipe[0], &m_stopPipe[1] }) {
+            if (*fd >= 0) close(*fd);
+            *fd = -1;
+        }
+    }
+
+    int Triggers() const { return m_count; }
+    bool KernelTrigger(int trigger) const { return m_slots[trigger].kernel; }
+
+    // Reads the current pressure of a trigger's resource through its descriptor
+    bool Read(int trigger, PressureReading& reading) {
+        ssize_t length = pread(m_slots[trigger].fd, m_buffer, sizeof(m_buffer) - 1, 0);
+        if (length <= 0) {
+            return false;
+        }
+        m_buffer[length] = '\0';
+        return Parse(m_buffer, m_buffer + length, reading);
+    }
+
+    // Parses the two lines of a /proc/pressure file (NUL-terminated at `end`); `full`
+    // is zero when missing
+    static bool Parse(const char* p, const char* end, PressureReading& reading) {
+        reading = PressureReading();
+        bool some = false;
+        while (p < end) {
+            const char* eol = (const char*)std::memchr(p, '\n', end - p);
+            if (!eol) eol = end;
+            PressureLine* line = nullptr;
+            if (eol - p > 5 && std::memcmp(p, "some ", 5) == 0) {
+                line = &reading.some;
+                some = true;
+            } else if (eol - p > 5 && std::memcmp(p, "full ", 5) == 0) {
+                line = &reading.full;
+            }
+            if (line && !ParseLine(p + 5, eol, *line)) {
+                return false;
+            }
+            p = eol + 1;
+        }
+        return some;
+    }
+
+private:
+    struct Slot {
+        PressureTrigger trigger = {};
+        int fd = -1;
+        bool kernel = false;
+        // Fallback: stall totals at the last few polls, oldest first, covering one window
+        static const int HISTORY = 128;
+        uint64_t totals[HISTORY] = {};
+        int64_t timesMs[HISTORY] = {};
+        int size = 0;
+    };
+
+    int OpenUnderRoot(PressureResource resource, int flags) {
+        char path[512];
+        std::snprintf(path, sizeof(path), "%s/proc/pressure/%s", m_root, PRESSURE_RESOURCE_NAMES[resource]);
+        return open(path, flags | O_CLOEXEC);
+    }
+
+    int RegisterTrigger(const PressureTrigger& trigger) {
+        int fd = OpenUnderRoot(trigger.resource, O_RDWR | O_NONBLOCK);
+        if (fd < 0) {
+            return -1;
+        }
+        char spec[64];
+        int length = std::snprintf(spec, sizeof(spec), "%s %u %u", trigger.full ? "full" : "some",
+                                   trigger.stallUs, trigger.windowUs);
+        // The kernel wants the terminating NUL too
+        if (write(fd, spec, (std::size_t)length + 1) < 0) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    static bool ParseLine(const char* p, const char* end, PressureLine& line) {
+        // "avg10=0.12 avg60=0.05 avg300=0.01 total=123456"
+        double* averages[3] = { &line.avg10, &line.avg60, &line.avg300 };
+        const char* keys[3] = { "avg10=", "avg60=", "avg300=" };
+        for (int i = 0; i < 3; i++) {
+            const char* key = std::strstr(p, keys[i]);
+            if (!key || key >= end) {
+                return false;
+            }
+            *averages[i] = std::strtod(key + std::strlen(keys[i]), nullptr);
+        }
+        const char* total = std::strstr(p, "total=");
+        return total && total < end && LinuxSampler::ParseU64(total + 6, end, line.totalUs);
+    }
+
+    static int64_t Milliseconds(std::chrono::steady_clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count();
+    }
+
+    void ResetFallback(Slot& slot, std::chrono::steady_clock::time_point now) {
+        slot.size = 0;
+        PressureReading reading;
+        if (!slot.kernel && Read((int)(&slot - m_slots), reading)) {
+            slot.totals[0] = slot.trigger.full ? reading.full.totalUs : reading.some.totalUs;
+            slot.timesMs[0] = Milliseconds(now);
+            slot.size = 1;
+        }
+    }
+
+    // Fallback evaluation of a trigger: did the stall counter grow by `stall` within
+    // the last `window`? Fires at most once per window, like the kernel's.
+    bool PollFallback(Slot& slot, std::chrono::steady_clock::time_point now, PressureReading& reading) {
+        if (!Read((int)(&slot - m_slots), reading)) {
+            return false;
+        }
+        uint64_t total = slot.trigger.full ? reading.full.totalUs : reading.some.totalUs;
+        int64_t nowMs = Milliseconds(now);
+        int64_t windowMs = slot.trigger.windowUs / 1000;
+        // Drop samples that fell out of the window, keeping one at or before its start
+        int drop = 0;
+        while (drop + 1 < slot.size && slot.timesMs[drop + 1] <= nowMs - windowMs) drop++;
+        if (drop > 0 || slot.size == Slot::HISTORY) {
+            if (drop == 0) drop = 1;
+            std::memmove(slot.totals, slot.totals + drop, (slot.size - drop) * sizeof(slot.totals[0]));
+            std::memmove(slot.timesMs, slot.timesMs + drop, (slot.size - drop) * sizeof(slot.timesMs[0]));
+            slot.size -= drop;
+        }
+        bool fired = slot.size > 0 && total >= slot.totals[0] + slot.trigger.stallUs;
+        if (fired) {
+            slot.size = 0;   // The next window starts now
+        }
+        slot.totals[slot.size] = total;
+        slot.timesMs[slot.size] = nowMs;
+        slot.size++;
+        return fired;
+    }
+
+    void Run() {
+        pollfd fds[MAX_TRIGGERS + 1];
+        bool fallback = false;
+        for (int i = 0; i < m_count; i++) {
+            fds[i] = { m_slots[i].kernel ? m_slots[i].fd : -1, POLLPRI, 0 };
+            fallback |= !m_slots[i].kernel;
+        }
+        fds[m_count] = { m_stopPipe[0], POLLIN, 0 };
+        std::chrono::steady_clock::time_point nextPoll = std::chrono::steady_clock::now();
+
+        for (;;) {
+            int timeout = -1;
+            if (fallback) {
+                int64_t remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    nextPoll - std::chrono::steady_clock::now()).count();
+                timeout = remaining > 0 ? (int)remaining : 0;
+            }
+            int ready = poll(fds, m_count + 1, timeout);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (fds[m_count].revents) {
+                break;
+            }
+            PressureEvent event;
+            for (int i = 0; i < m_count; i++) {
+                if (fds[i].revents & POLLERR) {
+                    fds[i].fd = -1;   // The monitored cgroup went away; stop watching it
+                } else if (fds[i].revents & POLLPRI) {
+                    event.trigger = i;
+                    event.kernel = true;
+                    if (Read(i, event.reading)) m_handler(event);
+                }
+            }
+            if (fallback && std::chrono::steady_clock::now() >= nextPoll) {
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                for (int i = 0; i < m_count; i++) {
+                    if (!m_slots[i].kernel && PollFallback(m_slots[i], now, event.reading)) {
+                        event.trigger = i;
+                        event.kernel = false;
+                        m_handler(event);
+                    }
+                }
+                nextPoll = now + std::chrono::milliseconds(m_fallbackMs);
+            }
+        }
+    }
+
+    char m_root[256];
+    Slot m_slots[MAX_TRIGGERS];
+    int m_count = 0;
+    int m_fallbackMs = 250;
+    int m_stopPipe[2] = { -1, -1 };
+    Handler m_handler;
+    std::thread m_thread;
+    char m_buffer[512];   // Read() runs only on the watching thread once started
+};
+
+#endif
@@ -0,0 +1,410 @@
+#pragma once
+
+// Threshold rules loaded from a text file and reloaded when it changes.
+//
+// One rule per line, '#' starts a comment:
+//
+//     # metric          op  threshold  state              priority  [dwell_ms [band]]
+//     cpu               >   90         ANGUISH_EXTREMELY  10        0          5
+//     saturated_cores   >   0          ANGUISH            40        1500
+//     battery           <   10         TIRED_EXTREMELY    50
+//
+// A metric can be suffixed with a percentile and window to test e.g. the CPU p95 over
+// the last minute instead of the latest sample:
+//
+//     cpu.p95@60s       >   70         ANGUISH_VERY       15
+//
+// Windows are given in ms, s or m; at most MAX_PERCENTILE_WINDOWS distinct
+// metric/window pairs per file.
+//
+// plus optional smoothing and hold-time settings (defaults in state_rules.h):
+//
+//     filter cpu ewma 0.3        # or: median 5, none
+//     hold 1500                  # ms a state stays up before a lower-priority one replaces it
+//
+// Rules are ordered by priority (lowest number first, file order breaks ties) and
+// compiled into a flat RuleSet (state_rules.h). A file with any bad line is rejected
+// as a whole so a half-edited file never takes effect.
+//
+// RuleFileWatcher runs a thread that waits for the file's directory to change
+// (inotify on Linux, ReadDirectoryChangesW on Windows) and calls back when an entry
+// with the rules file's name changed; watching the directory catches editors that
+// save by writing a new file and renaming it.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include "emotional_state.h"
+#include "state_rules.h"
+
+#ifdef _WIN32
+#include <windows.h>
+typedef std::wstring RulePath;
+#else
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+typedef std::string RulePath;
+#endif
+
+const char* const RULE_METRIC_NAMES[METRIC_COUNT] = { "cpu", "saturated_cores", "battery", "memory" };
+
+namespace RulesConfigDetail {
+
+inline const char* NextToken(const char*& p, const char* end, std::size_t& length) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+    const char* start = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r') p++;
+    length = (std::size_t)(p - start);
+    return start;
+}
+
+inline bool TokenIs(const char* token, std::size_t length, const char* name) {
+    return std::strlen(name) == length && std::strncmp(token, name, length) == 0;
+}
+
+inline bool ParseNumber(const char* token, std::size_t length, double& value) {
+    char buffer[64];
+    if (length == 0 || length >= sizeof(buffer)) return false;
+    std::memcpy(buffer, token, length);
+    buffer[length] = '\0';
+    char* end = nullptr;
+    value = std::strtod(buffer, &end);
+    return *end == '\0';
+}
+
+inline int FindMetric(const char* token, std::size_t length) {
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        if (TokenIs(token, length, RULE_METRIC_NAMES[i])) return i;
+    }
+    return -1;
+}
+
+// "cpu", or "cpu.p95@60s" for the 95th percentile over the last 60 seconds
+inline bool ParseMetricSpec(const char* token, std::size_t length, StateRule& rule) {
+    const char* end = token + length;
+    const char* dot = (const char*)std::memchr(token, '.', length);
+    int metric = FindMetric(token, (std::size_t)((dot ? dot : end) - token));
+    if (metric < 0) return false;
+    rule.metric = (RuleMetric)metric;
+    if (!dot) return true;
+
+    const char* at = (const char*)std::memchr(dot, '@', (std::size_t)(end - dot));
+    if (!at || dot[1] != 'p') return false;
+    if (!ParseNumber(dot + 2, (std::size_t)(at - dot - 2), rule.percentile)) return false;
+    if (rule.percentile <= 0 || rule.percentile > 100) return false;
+
+    const char* unit = at + 1;
+    while (unit < end && ((*unit >= '0' && *unit <= '9') || *unit == '.')) unit++;
+    double window = 0;
+    if (!ParseNumber(at + 1, (std::size_t)(unit - at - 1), window)) return false;
+    if (TokenIs(unit, (std::size_t)(end - unit), "m")) {
+        window *= 60000;
+    } else if (TokenIs(unit, (std::size_t)(end - unit), "s")) {
+        window *= 1000;
+    } else if (!TokenIs(unit, (std::size_t)(end - unit), "ms")) {
+        return false;
+    }
+    rule.windowMs = (int)window;
+    return rule.windowMs > 0;
+}
+
+} // namespace RulesConfigDetail
+
+// Parses rules text into `rules`. On failure returns false, leaves `rules` untouched
+// and describes the first problem in `error`.
+inline bool ParseRules(const char* text, std::size_t size, RuleSet& rules, std::string* error = nullptr) {
+    using namespace RulesConfigDetail;
+
+    RuleSet parsed;
+    int priorities[MAX_RULES];
+    int windows = 0;
+    const char* p = text;
+    const char* end = text + size;
+    int lineNumber = 0;
+    while (p < end) {
+        const char* lineEnd = (const char*)std::memchr(p, '\n', (std::size_t)(end - p));
+        if (!lineEnd) lineEnd = end;
+        lineNumber++;
+        const char* comment = (const char*)std::memchr(p, '#', (std::size_t)(lineEnd - p));
+        const char* contentEnd = comment ? comment : lineEnd;
+
+        const char* tokens[8];
+        std::size_t lengths[8];
+        int count = 0;
+        const char* q = p;
+        while (count < 8) {
+            tokens[count] = NextToken(q, contentEnd, lengths[count]);
+            if (lengths[count] == 0) break;
+            count++;
+        }
+        p = lineEnd + 1;
+        if (count == 0) continue;
+
+        auto fail = [&](const char* what) {
+            if (error) *error = "line " + std::to_string(lineNumber) + ": " + what;
+            return false;
+        };
+        if (TokenIs(tokens[0], lengths[0], "hold")) {
+            double hold = 0;
+            if (count != 2 || !ParseNumber(tokens[1], lengths[1], hold) || hold < 0) return fail("expected: hold ms");
+            parsed.holdMs = (int)hold;
+            continue;
+        }
+        if (TokenIs(tokens[0], lengths[0], "filter")) {
+            int metric = count >= 3 ? FindMetric(tokens[1], lengths[1]) : -1;
+            if (metric < 0) return fail("expected: filter metric none|ewma alpha|median n");
+            double value = 0;
+            if (count == 3 && TokenIs(tokens[2], lengths[2], "none")) {
+                parsed.filters[metric] = NoFilter();
+            } else if (count == 4 && TokenIs(tokens[2], lengths[2], "ewma") && ParseNumber(tokens[3], lengths[3], value) &&
+                       value > 0 && value <= 1) {
+                parsed.filters[metric] = EwmaFilter(value);
+            } else if (count == 4 && TokenIs(tokens[2], lengths[2], "median") && ParseNumber(tokens[3], lengths[3], value) &&
+                       value >= 1 && value <= MAX_MEDIAN_WINDOW) {
+                parsed.filters[metric] = MedianFilter((int)value);
+            } else {
+                return fail("expected: filter metric none|ewma alpha|median n");
+            }
+            continue;
+        }
+
+        if (count < 5 || count > 7) return fail("expected: metric op threshold state priority [dwell_ms [band]]");
+        if (parsed.count == MAX_RULES) return fail("too many rules");
+
+        StateRule rule = {};
+        if (!ParseMetricSpec(tokens[0], lengths[0], rule)) return fail("unknown metric, or bad .pNN@window suffix");
+        if (rule.percentile > 0) {
+            bool shared = false;
+            for (int i = 0; i < parsed.count; i++) {
+                shared |= parsed.rules[i].metric == rule.metric && parsed.rules[i].windowMs == rule.windowMs &&
+                          parsed.rules[i].percentile > 0;
+            }
+            if (!shared && ++windows > MAX_PERCENTILE_WINDOWS) return fail("too many percentile windows");
+        }
+
+        if (TokenIs(tokens[1], lengths[1], ">")) {
+            rule.compare = RULE_ABOVE;
+        } else if (TokenIs(tokens[1], lengths[1], "<")) {
+            rule.compare = RULE_BELOW;
+        } else {
+            return fail("comparator must be > or <");
+        }
+
+        if (!ParseNumber(tokens[2], lengths[2], rule.threshold)) return fail("bad threshold");
+
+        int state = -1;
+        for (int i = 0; i < EMOTIONAL_STATE_COUNT; i++) {
+            if (TokenIs(tokens[3], lengths[3], EMOTIONAL_STATE_NAMES[i])) state = i;
+        }
+        if (state < 0) return fail("unknown state");
+        rule.state = (EmotionalState)state;
+
+        double priority = 0;
+        double dwell = 0;
+        if (!ParseNumber(tokens[4], lengths[4], priority)) return fail("bad priority");
+        if (count >= 6 && (!ParseNumber(tokens[5], lengths[5], dwell) || dwell < 0)) return fail("bad dwell time");
+        if (count == 7 && (!ParseNumber(tokens[6], lengths[6], rule.band) || rule.band < 0)) return fail("bad band");
+        rule.dwellMs = (int)dwell;
+
+        // Insertion keeps equal priorities in file order
+        int at = parsed.count;
+        while (at > 0 && priorities[at - 1] > (int)priority) {
+            parsed.rules[at] = parsed.rules[at - 1];
+            priorities[at] = priorities[at - 1];
+            at--;
+        }
+        parsed.rules[at] = rule;
+        priorities[at] = (int)priority;
+        parsed.count++;
+    }
+
+    rules = parsed;
+    return true;
+}
+
+inline bool LoadRulesFile(const RulePath& path, RuleSet& rules, std::string* error = nullptr) {
+#ifdef _WIN32
+    FILE* file = _wfopen(path.c_str(), L"rb");
+#else
+    FILE* file = std::fopen(path.c_str(), "rb");
+#endif
+    if (!file) {
+        if (error) *error = "cannot open rules file";
+        return false;
+    }
+    std::string text;
+    char buffer[4096];
+    std::size_t read;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, read);
+    }
+    std::fclose(file);
+    return ParseRules(text.data(), text.size(), rules, error);
+}
+
+class RuleFileWatcher {
+public:
+    ~RuleFileWatcher() { Stop(); }
+
+    // Calls onChange (on the watcher thread) whenever the file may have changed
+    bool Start(const RulePath& path, std::function<void()> onChange) {
+        Stop();
+        m_onChange = onChange;
+        SplitPath(path);
+#ifdef _WIN32
+        m_directoryHandle = CreateFileW(m_directory.c_str(), FILE_LIST_DIRECTORY,
+                                        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                                        FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+        m_overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        m_stop = CreateEventW(NULL, TRUE, FALSE, NULL);
+        if (m_directoryHandle == INVALID_HANDLE_VALUE || !m_overlapped.hEvent || !m_stop || !Watch()) {
+            Stop();
+            return false;
+        }
+#elif defined(__linux__)
+        m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_inotify < 0 || pipe(m_stopPipe) != 0) {
+            Stop();
+            return false;
+        }
+        if (inotify_add_watch(m_inotify, m_directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+            Stop();
+            return false;
+        }
+#else
+        return false;
+#endif
+        m_thread = std::thread(&RuleFileWatcher::Run, this);
+        return true;
+    }
+
+    void Stop() {
+#ifdef _WIN32
+        if (m_stop) SetEvent(m_stop);
+        if (m_thread.joinable()) m_thread.join();
+        if (m_directoryHandle != INVALID_HANDLE_VALUE) {
+            // The buffer must stay put until the cancelled read has completed
+            DWORD bytes;
+            if (CancelIoEx(m_directoryHandle, &m_overlapped) || GetLastError() != ERROR_NOT_FOUND) {
+                GetOverlappedResult(m_directoryHandle, &m_overlapped, &bytes, TRUE);
+            }
+            CloseHandle(m_directoryHandle);
+        }
+        if (m_overlapped.hEvent) CloseHandle(m_overlapped.hEvent);
+        if (m_stop) CloseHandle(m_stop);
+        m_directoryHandle = INVALID_HANDLE_VALUE;
+        m_overlapped = OVERLAPPED();
+        m_stop = NULL;
+#elif defined(__linux__)
+        if (m_stopPipe[1] >= 0) {
+            char byte = 0;
+            ssize_t written = write(m_stopPipe[1], &byte, 1);
+            (void)written;
+        }
+        if (m_thread.joinable()) m_thread.join();
+        for (int* fd : { &m_inotify, &m_stopPipe[0], &m_stopPipe[1] }) {
+            if (*fd >= 0) close(*fd);
+            *fd = -1;
+        }
+#endif
+    }
+
+private:
+    void SplitPath(const RulePath& path) {
+#ifdef _WIN32
+        std::size_t slash = path.find_last_of(L"\\/");
+        m_directory = slash == RulePath::npos ? RulePath(L".") : path.substr(0, slash);
+#else
+        std::size_t slash = path.find_last_of('/');
+        m_directory = slash == RulePath::npos ? RulePath(".") : path.substr(0, slash);
+#endif
+        m_name = slash == RulePath::npos ? path : path.substr(slash + 1);
+    }
+
+    void Run() {
+#ifdef _WIN32
+        HANDLE handles[2] = { m_stop, m_overlapped.hEvent };
+        while (WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1) {
+            DWORD bytes = 0;
+            if (!GetOverlappedResult(m_directoryHandle, &m_overlapped, &bytes, FALSE)) {
+                break;
+            }
+            // Zero bytes means the buffer overflowed and the names are lost: reload to be safe
+            bool changed = bytes == 0;
+            for (DWORD offset = 0; bytes > 0;) {
+                const FILE_NOTIFY_INFORMATION* info = (const FILE_NOTIFY_INFORMATION*)(m_buffer + offset);
+                changed |= CompareStringOrdinal(info->FileName, (int)(info->FileNameLength / sizeof(WCHAR)),
+                                                m_name.c_str(), (int)m_name.size(), TRUE) == CSTR_EQUAL;
+                if (info->NextEntryOffset == 0) break;
+                offset += info->NextEntryOffset;
+            }
+            // Re-arm before calling back so a save during the reload isn't missed
+            if (!Watch()) {
+                break;
+            }
+            if (changed) {
+                // Let the writer finish first
+                Sleep(100);
+                m_onChange();
+            }
+        }
+#elif defined(__linux__)
+        alignas(inotify_event) char buffer[4096];
+        pollfd fds[2] = { { m_inotify, POLLIN, 0 }, { m_stopPipe[0], POLLIN, 0 } };
+        for (;;) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            if (fds[1].revents) {
+                break;
+            }
+            if (!(fds[0].revents & POLLIN)) {
+                continue;
+            }
+            bool changed = false;
+            ssize_t length;
+            while ((length = read(m_inotify, buffer, sizeof(buffer))) > 0) {
+                for (char* p = buffer; p < buffer + length;) {
+                    inotify_event* event = (inotify_event*)p;
+                    changed |= event->len && m_name == event->name;
+                    p += sizeof(inotify_event) + event->len;
+                }
+            }
+            if (changed) {
+                m_onChange();
+            }
+        }
+#endif
+    }
+
+#ifdef _WIN32
+    bool Watch() {
+        ResetEvent(m_overlapped.hEvent);
+        return ReadDirectoryChangesW(m_directoryHandle, m_buffer, sizeof(m_buffer), FALSE,
+                                     FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME, NULL, &m_overlapped,
+                                     NULL) != 0;
+    }
+#endif
+
+    std::function<void()> m_onChange;
+    RulePath m_directory;
+    RulePath m_name;
+    std::thread m_thread;
+#ifdef _WIN32
+    HANDLE m_directoryHandle = INVALID_HANDLE_VALUE;
+    OVERLAPPED m_overlapped = OVERLAPPED();
+    HANDLE m_stop = NULL;
+    alignas(DWORD) BYTE m_buffer[4096];   // FILE_NOTIFY_INFORMATION records
+#else
+    int m_inotify = -1;
+    int m_stopPipe[2] = { -1, -1 };
+#endif
+};
@@ -0,0 +1,300 @@
+#pragma once
+
+// What the monitor costs the machine it's watching: latency histograms for each
+// stage of the sample -> evaluate -> invalidate -> paint pipeline, thread wakeup
+// counts, and the process's own CPU time and resident memory.
+//
+// Two switches. Building with ETM_PROFILING=0 compiles PROFILE_SCOPE and
+// PROFILE_WAKEUP away entirely. Otherwise profiling is off at runtime until
+// SetEnabled(true), and a scope costs one relaxed load and a branch; when on, it's
+// two clock reads and a few relaxed stores.
+//
+// Each stage and each wakeup counter has a single writing thread (paint is the UI
+// thread, everything else the monitor thread), so recording uses plain relaxed
+// stores rather than read-modify-write atomics. That writer is also the only one
+// that clears them: turning profiling on just bumps a generation, and the writer
+// resets its stage or counter when it next records and sees the generation moved.
+// Report() can run on any thread, and shows a stage not yet reset as empty.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <intrin.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#ifndef ETM_PROFILING
+#define ETM_PROFILING 1
+#endif
+
+enum ProfileStage {
+    PROFILE_SAMPLE,       // Read CPU, memory and battery
+    PROFILE_EVALUATE,     // Run the state machine
+    PROFILE_INVALIDATE,   // Ask for a repaint
+    PROFILE_PAINT,        // WM_PAINT: compose (on a cache miss) and blit
+    PROFILE_STAGE_COUNT
+};
+
+enum ProfileThread { PROFILE_THREAD_MONITOR, PROFILE_THREAD_UI, PROFILE_THREAD_COUNT };
+
+const char* const PROFILE_STAGE_NAMES[PROFILE_STAGE_COUNT] = { "sample", "evaluate", "invalidate", "paint" };
+const char* const PROFILE_THREAD_NAMES[PROFILE_THREAD_COUNT] = { "monitor", "ui" };
+
+// Log-linear histogram of nanosecond latencies: 8 buckets per power of two, so any
+// quantile is within 12.5%. Single writer.
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKETS = 8;
+    static const int BUCKETS = (64 - 2) * SUB_BUCKETS;
+
+    void Record(uint64_t ns) {
+        Bump(m_counts[Bucket(ns)], 1);
+        Bump(m_count, 1);
+        Bump(m_totalNs, ns);
+        if (ns > m_maxNs.load(std::memory_order_relaxed)) {
+            m_maxNs.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    void Reset() {
+        for (std::atomic<uint64_t>& count : m_counts) count.store(0, std::memory_order_relaxed);
+        m_count.store(0, std::memory_order_relaxed);
+        m_totalNs.store(0, std::memory_order_relaxed);
+        m_maxNs.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t Count() const { return m_count.load(std::memory_order_relaxed); }
+    uint64_t TotalNs() const { return m_totalNs.load(std::memory_order_relaxed); }
+    uint64_t MaxNs() const { return m_maxNs.load(std::memory_order_relaxed); }
+
+    // Upper bound of the bucket holding percentile p (0..100); 0 when empty
+    uint64_t QuantileNs(double p) const {
+        uint64_t total = 0;
+        uint64_t counts[BUCKETS];
+        for (int i = 0; i < BUCKETS; i++) {
+            counts[i] = m_counts[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        uint64_t rank = (uint64_t)(p / 100.0 * (double)total + 0.5);
+        if (rank < 1) rank = 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank && counts[i]) {
+                return UpperBound(i);
+            }
+        }
+        return 0;
+    }
+
+    static int Bucket(uint64_t ns) {
+        if (ns < SUB_BUCKETS) {
+            return (int)ns;
+        }
+#ifdef _MSC_VER
+        unsigned long highest;
+        _BitScanReverse64(&highest, ns);
+        int exponent = (int)highest;
+#else
+        int exponent = 63 - __builtin_clzll(ns);
+#endif
+        int sub = (int)((ns >> (exponent - 3)) & (SUB_BUCKETS - 1));
+        return (exponent - 2) * SUB_BUCKETS + sub;
+    }
+
+    static uint64_t UpperBound(int bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return (uint64_t)bucket;
+        }
+        int exponent = bucket / SUB_BUCKETS + 2;
+        uint64_t sub = (uint64_t)(bucket % SUB_BUCKETS);
+        return ((SUB_BUCKETS + sub + 1) << (exponent - 3)) - 1;
+    }
+
+private:
+    static void Bump(std::atomic<uint64_t>& value, uint64_t amount) {
+        value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> m_counts[BUCKETS] = {};
+    std::atomic<uint64_t> m_count{ 0 };
+    std::atomic<uint64_t> m_totalNs{ 0 };
+    std::atomic<uint64_t> m_maxNs{ 0 };
+};
+
+struct ProcessUsage {
+    double cpuSeconds;    // User plus kernel time of the whole process
+    uint64_t rssBytes;    // Resident set (working set on Windows)
+};
+
+inline ProcessUsage ReadProcessUsage() {
+    ProcessUsage usage = { 0.0, 0 };
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) {
+        uint64_t ticks = ((uint64_t)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) +
+                         ((uint64_t)user.dwHighDateTime << 32 | user.dwLowDateTime);
+        usage.cpuSeconds = ticks / 1e7;
+    }
+    PROCESS_MEMORY_COUNTERS memory = {};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &memory, sizeof(memory))) {
+        usage.rssBytes = memory.WorkingSetSize;
+    }
+#else
+    rusage self = {};
+    if (getrusage(RUSAGE_SELF, &self) == 0) {
+        usage.cpuSeconds = self.ru_utime.tv_sec + self.ru_stime.tv_sec +
+                           (self.ru_utime.tv_usec + self.ru_stime.tv_usec) / 1e6;
+    }
+    // statm: total and resident pages
+    int fd = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        char text[128];
+        ssize_t length = read(fd, text, sizeof(text) - 1);
+        close(fd);
+        unsigned long long pages = 0;
+        unsigned long long resident = 0;
+        if (length > 0) {
+            text[length] = '\0';
+            if (std::sscanf(text, "%llu %llu", &pages, &resident) == 2) {
+                usage.rssBytes = resident * (uint64_t)sysconf(_SC_PAGESIZE);
+            }
+        }
+    }
+#endif
+    return usage;
+}
+
+class SelfProfile {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    bool Enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+    // Turning profiling on starts a fresh measurement period
+    void SetEnabled(bool enabled) {
+        if (enabled && !Enabled()) {
+            m_sinceTicks.store(Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+            m_cpuAtStart.store(ReadProcessUsage().cpuSeconds, std::memory_order_relaxed);
+            m_generation.fetch_add(1, std::memory_order_release);
+        }
+        m_enabled.store(enabled, std::memory_order_relaxed);
+    }
+
+    // Only from the stage's own thread
+    void Record(ProfileStage stage, Clock::duration elapsed) {
+        Renew(m_stageGenerations[stage], [this, stage] { m_stages[stage].Reset(); });
+        m_stages[stage].Record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    // Only from `thread` itself
+    void Wakeup(ProfileThread thread) {
+        if (Enabled()) {
+            std::atomic<uint64_t>& wakeups = m_wakeups[thread];
+            Renew(m_wakeupGenerations[thread], [&wakeups] { wakeups.store(0, std::memory_order_relaxed); });
+            wakeups.store(wakeups.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+    }
+
+    // The stage as of the current period: empty until its writer has caught up
+    const LatencyHistogram& Stage(ProfileStage stage) const {
+        static const LatencyHistogram empty;
+        return Current(m_stageGenerations[stage]) ? m_stages[stage] : empty;
+    }
+
+    uint64_t Wakeups(ProfileThread thread) const {
+        return Current(m_wakeupGenerations[thread]) ? m_wakeups[thread].load(std::memory_order_relaxed) : 0;
+    }
+
+    // Plain-text report of the period since profiling was enabled
+    void Report(std::string& out) const {
+        char line[256];
+        Clock::time_point since{ Clock::duration(m_sinceTicks.load(std::memory_order_relaxed)) };
+        double seconds = std::chrono::duration<double>(Clock::now() - since).count();
+        ProcessUsage usage = ReadProcessUsage();
+        double cpu = usage.cpuSeconds - m_cpuAtStart.load(std::memory_order_relaxed);
+        std::snprintf(line, sizeof(line), "self profile over %.1f s%s\n", seconds, Enabled() ? "" : " (stopped)");
+        out += line;
+        std::snprintf(line, sizeof(line), "  process cpu %.3f s (%.3f%% of one core), rss %.1f MiB\n", cpu,
+                      seconds > 0 ? cpu / seconds * 100.0 : 0.0, usage.rssBytes / 1048576.0);
+        out += line;
+        for (int thread = 0; thread < PROFILE_THREAD_COUNT; thread++) {
+            uint64_t wakeups = Wakeups((ProfileThread)thread);
+            std::snprintf(line, sizeof(line), "  %-8s thread wakeups %llu (%.2f/s)\n", PROFILE_THREAD_NAMES[thread],
+                          (unsigned long long)wakeups, seconds > 0 ? wakeups / seconds : 0.0);
+            out += line;
+        }
+        out += "  stage          count      p50 us    p99 us    max us    total ms\n";
+        for (int stage = 0; stage < PROFILE_STAGE_COUNT; stage++) {
+            const LatencyHistogram& histogram = Stage((ProfileStage)stage);
+            std::snprintf(line, sizeof(line), "  %-12s %7llu %11.1f %9.1f %9.1f %11.3f\n", PROFILE_STAGE_NAMES[stage],
+                          (unsigned long long)histogram.Count(), histogram.QuantileNs(50) / 1e3,
+                          histogram.QuantileNs(99) / 1e3, histogram.MaxNs() / 1e3, histogram.TotalNs() / 1e6);
+            out += line;
+        }
+    }
+
+private:
+    // Runs `reset` and catches `seen` up if a new period started since the last record
+    template <typename Reset>
+    void Renew(std::atomic<uint32_t>& seen, Reset reset) {
+        uint32_t generation = m_generation.load(std::memory_order_acquire);
+        if (seen.load(std::memory_order_relaxed) != generation) {
+            reset();
+            seen.store(generation, std::memory_order_release);
+        }
+    }
+
+    bool Current(const std::atomic<uint32_t>& seen) const {
+        return seen.load(std::memory_order_acquire) == m_generation.load(std::memory_order_relaxed);
+    }
+
+    std::atomic<bool> m_enabled{ false };
+    std::atomic<uint32_t> m_generation{ 0 };      // Bumped each time profiling is turned on
+    LatencyHistogram m_stages[PROFILE_STAGE_COUNT];
+    std::atomic<uint32_t> m_stageGenerations[PROFILE_STAGE_COUNT] = {};
+    std::atomic<uint64_t> m_wakeups[PROFILE_THREAD_COUNT] = {};
+    std::atomic<uint32_t> m_wakeupGenerations[PROFILE_THREAD_COUNT] = {};
+    std::atomic<Clock::rep> m_sinceTicks{ 0 };    // Start of the period, set by whoever toggles
+    std::atomic<double> m_cpuAtStart{ 0.0 };
+};
+
+// Times the rest of the enclosing block into one stage, if profiling is on
+class ProfileScope {
+public:
+    ProfileScope(SelfProfile& profile, ProfileStage stage)
+        : m_profile(profile.Enabled() ? &profile : nullptr), m_stage(stage) {
+        if (m_profile) m_start = SelfProfile::Clock::now();
+    }
+
+    ~ProfileScope() {
+        if (m_profile) m_profile->Record(m_stage, SelfProfile::Clock::now() - m_start);
+    }
+
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    SelfProfile* m_profile;
+    ProfileStage m_stage;
+    SelfProfile::Clock::time_point m_start;
+};
+
+#if ETM_PROFILING
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(profile, stage) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(profile, stage)
+#define PROFILE_WAKEUP(profile, thread) (profile).Wakeup(thread)
+#else
+#define PROFILE_SCOPE(profile, stage) ((void)0)
+#define PROFILE_WAKEUP(profile, thread) ((void)0)
+#endif
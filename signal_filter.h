@@ -0,0 +1,128 @@
+#pragma once
+
+// Per-metric smoothing applied between sampling and rule evaluation.
+//
+// A single 500 ms CPU sample is noisy; without smoothing, a load hovering around a
+// threshold flips the face every sample. Each metric gets an EWMA, a median over the
+// last N sample periods, or nothing. Missing metrics (NaN) pass straight through and
+// reset the filter, so a battery that comes back starts fresh.
+//
+// Both filters work in nominal 500 ms sample periods. A sample that stands for a
+// shorter or longer period (the sampling interval adapts, see adaptive_sampling.h)
+// passes its length in periods, so the EWMA's time constant and the median's window
+// stay the same in seconds: the median weighs each sample by its periods and clips
+// the oldest one at the window's edge.
+
+#include <cmath>
+
+enum FilterKind {
+    FILTER_NONE,
+    FILTER_EWMA,     // value += alpha * (sample - value)
+    FILTER_MEDIAN    // Median over the last `window` sample periods
+};
+
+const int MAX_MEDIAN_WINDOW = 15;
+const int MAX_MEDIAN_SAMPLES = 160;   // MAX_MEDIAN_WINDOW periods of samples 0.1 periods apart, the shortest passed
+
+struct FilterConfig {
+    FilterKind kind;
+    double alpha;   // EWMA weight of the newest sample, (0, 1]
+    int window;     // Median window in sample periods, 1..MAX_MEDIAN_WINDOW
+};
+
+constexpr FilterConfig NoFilter() { return FilterConfig{ FILTER_NONE, 1.0, 1 }; }
+constexpr FilterConfig EwmaFilter(double alpha) { return FilterConfig{ FILTER_EWMA, alpha, 1 }; }
+constexpr FilterConfig MedianFilter(int window) { return FilterConfig{ FILTER_MEDIAN, 1.0, window }; }
+
+inline bool operator==(const FilterConfig& a, const FilterConfig& b) {
+    return a.kind == b.kind && a.alpha == b.alpha && a.window == b.window;
+}
+
+class MetricFilter {
+public:
+    // Keeps the current state if the config is unchanged (e.g. a rules reload)
+    void Configure(const FilterConfig& config) {
+        if (config == m_config) {
+            return;
+        }
+        m_config = config;
+        if (m_config.window < 1) m_config.window = 1;
+        if (m_config.window > MAX_MEDIAN_WINDOW) m_config.window = MAX_MEDIAN_WINDOW;
+        Reset();
+    }
+
+    void Reset() {
+        m_count = 0;
+        m_next = 0;
+    }
+
+    // `periods`: how many nominal sample periods this sample covers
+    double Update(double sample, double periods = 1.0) {
+        if (std::isnan(sample)) {
+            Reset();
+            return sample;
+        }
+
+        switch (m_config.kind) {
+        case FILTER_EWMA:
+        {
+            double alpha = periods == 1.0 ? m_config.alpha : 1.0 - std::pow(1.0 - m_config.alpha, periods);
+            m_value = m_count ? m_value + alpha * (sample - m_value) : sample;
+            m_count = 1;
+            return m_value;
+        }
+
+        case FILTER_MEDIAN:
+        {
+            m_history[m_next] = Sample{ sample, periods > 0 ? periods : 1.0 };
+            m_next = (m_next + 1) % MAX_MEDIAN_SAMPLES;
+            if (m_count < MAX_MEDIAN_SAMPLES) m_count++;
+
+            // Newest first until the window is covered, insertion sorted by value
+            double values[MAX_MEDIAN_SAMPLES];
+            double weights[MAX_MEDIAN_SAMPLES];
+            double left = m_config.window;
+            int used = 0;
+            while (used < m_count && left > 1e-9) {
+                const Sample& next = m_history[(m_next - 1 - used + MAX_MEDIAN_SAMPLES) % MAX_MEDIAN_SAMPLES];
+                double weight = next.periods < left ? next.periods : left;
+                left -= weight;
+                int at = used++;
+                while (at > 0 && values[at - 1] > next.value) {
+                    values[at] = values[at - 1];
+                    weights[at] = weights[at - 1];
+                    at--;
+                }
+                values[at] = next.value;
+                weights[at] = weight;
+            }
+            m_count = used;   // Anything older has left the window for good
+
+            // Weighted median; with equal weights, the usual one (the middle pair averaged)
+            double half = (m_config.window - left) / 2;
+            double seen = 0;
+            for (int i = 0; i < used - 1; i++) {
+                seen += weights[i];
+                if (seen > half + 1e-9) return values[i];
+                if (seen > half - 1e-9) return 0.5 * (values[i] + values[i + 1]);
+            }
+            return values[used - 1];
+        }
+
+        default:
+            return sample;
+        }
+    }
+
+private:
+    struct Sample {
+        double value;
+        double periods;
+    };
+
+    FilterConfig m_config = NoFilter();
+    double m_value = 0.0;
+    Sample m_history[MAX_MEDIAN_SAMPLES];   // Ring, newest at m_next - 1
+    int m_count = 0;
+    int m_next = 0;
+};
@@ -0,0 +1,148 @@
+#pragma once
+
+// One contiguous premultiplied-BGRA buffer holding every face sprite.
+//
+// Sprites are laid out first (AddSprite), the buffer is allocated once (Allocate),
+// then each sprite's pixels are written in place (SpritePixels) by whatever decoder
+// the platform has. Every sprite starts on a 16-byte boundary and rows share one
+// stride, so drawing an opaque sprite is a plain row-by-row copy.
+//
+// The app uses it as the staging buffer for the GDI+ decode path before sprites are
+// palette-indexed into a PaletteSpriteStore (sprite_palette.h).
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Premultiplied source-over of one BGRA pixel
+inline uint32_t BlendOver(uint32_t src, uint32_t dst) {
+    uint32_t inverse = 255 - (src >> 24);
+    if (inverse == 0) return src;
+    uint32_t rb = (((dst & 0x00FF00FF) * inverse + 0x00800080) >> 8) & 0x00FF00FF;
+    uint32_t ag = ((((dst >> 8) & 0x00FF00FF) * inverse + 0x00800080)) & 0xFF00FF00;
+    return src + rb + ag;
+}
+
+struct SpriteRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+class SpriteAtlas {
+public:
+    // Sprites per shelf row; the faces are all the same size, so this keeps the atlas squarish
+    static const int SPRITES_PER_ROW = 4;
+
+    // Reserves space for a width x height sprite and returns its id
+    int AddSprite(int width, int height) {
+        SpriteRect rect;
+        rect.width = width;
+        rect.height = height;
+        m_rects.push_back(rect);
+        m_opaque.push_back(false);
+        return (int)m_rects.size() - 1;
+    }
+
+    // Lays out the sprites on shelves and allocates the pixel buffer
+    void Allocate() {
+        int x = 0;
+        int y = 0;
+        int shelfHeight = 0;
+        int column = 0;
+        m_width = 0;
+        for (SpriteRect& rect : m_rects) {
+            if (column == SPRITES_PER_ROW) {
+                x = 0;
+                y += shelfHeight;
+                shelfHeight = 0;
+                column = 0;
+            }
+            rect.x = x;
+            rect.y = y;
+            x += AlignedWidth(rect.width);
+            if (x > m_width) m_width = x;
+            if (rect.height > shelfHeight) shelfHeight = rect.height;
+            column++;
+        }
+        m_height = y + shelfHeight;
+        m_pixels.assign((std::size_t)m_width * m_height, 0);
+    }
+
+    // Top-left pixel of a sprite inside the atlas; rows are Stride() pixels apart
+    uint32_t* SpritePixels(int id) {
+        const SpriteRect& rect = m_rects[id];
+        return m_pixels.data() + (std::size_t)rect.y * m_width + rect.x;
+    }
+
+    const uint32_t* SpritePixels(int id) const {
+        const SpriteRect& rect = m_rects[id];
+        return m_pixels.data() + (std::size_t)rect.y * m_width + rect.x;
+    }
+
+    // Call once a sprite's pixels are written; opaque sprites are drawn with memcpy
+    void FinishSprite(int id) {
+        const SpriteRect& rect = m_rects[id];
+        const uint32_t* row = SpritePixels(id);
+        bool opaque = true;
+        for (int y = 0; y < rect.height && opaque; y++, row += m_width) {
+            for (int x = 0; x < rect.width; x++) {
+                if ((row[x] >> 24) != 0xFF) {
+                    opaque = false;
+                    break;
+                }
+            }
+        }
+        m_opaque[id] = opaque;
+    }
+
+    // Draws a sprite into a 32-bit BGRA destination. Opaque sprites are copied; others
+    // are composited source-over (premultiplied) onto what is already there.
+    void Draw(int id, uint32_t* dst, int dstStride, int dx, int dy) const {
+        const SpriteRect& rect = m_rects[id];
+        const uint32_t* src = SpritePixels(id);
+        uint32_t* out = dst + (std::size_t)dy * dstStride + dx;
+        for (int y = 0; y < rect.height; y++, src += m_width, out += dstStride) {
+            if (m_opaque[id]) {
+                std::memcpy(out, src, (std::size_t)rect.width * sizeof(uint32_t));
+                continue;
+            }
+            for (int x = 0; x < rect.width; x++) {
+                out[x] = BlendOver(src[x], out[x]);
+            }
+        }
+    }
+
+    const SpriteRect& Rect(int id) const { return m_rects[id]; }
+    int SpriteCount() const { return (int)m_rects.size(); }
+    int Width() const { return m_width; }
+    int Height() const { return m_height; }
+    int Stride() const { return m_width; }
+    const uint32_t* Pixels() const { return m_pixels.data(); }
+    bool IsOpaque(int id) const { return m_opaque[id]; }
+    std::size_t SizeInBytes() const { return m_pixels.size() * sizeof(uint32_t); }
+
+    // Converts straight-alpha BGRA to premultiplied
+    static uint32_t Premultiply(uint32_t pixel) {
+        uint32_t a = pixel >> 24;
+        if (a == 0xFF) return pixel;
+        uint32_t b = ((pixel & 0xFF) * a + 127) / 255;
+        uint32_t g = (((pixel >> 8) & 0xFF) * a + 127) / 255;
+        uint32_t r = (((pixel >> 16) & 0xFF) * a + 127) / 255;
+        return (a << 24) | (r << 16) | (g << 8) | b;
+    }
+
+private:
+    // Widths rounded up to 4 pixels so every sprite starts 16-byte aligned
+    static int AlignedWidth(int width) {
+        return (width + 3) & ~3;
+    }
+
+    std::vector<SpriteRect> m_rects;
+    std::vector<bool> m_opaque;
+    std::vector<uint32_t> m_pixels;
+    int m_width = 0;
+    int m_height = 0;
+};
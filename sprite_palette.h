@@ -0,0 +1,355 @@
+#pragma once
+
+// Compact sprite store: every sprite is a plane of 4- or 8-bit indices into one
+// shared premultiplied-BGRA palette, and identical planes are stored once.
+//
+// The faces are two-colour pixel art, so a 48x32 face costs 768 bytes instead of
+// 6 KiB as BGRA. Sprites are expanded back to BGRA on demand (a frame cache miss)
+// with a vectorized lookup. 4-bit planes load both pixels of a packed byte from a
+// pair table with SSE2, which every x64 build has, and use SSSE3 byte shuffles when
+// built with them. 8-bit planes store four looked-up pixels at a time with SSE2, or
+// use an AVX2 gather. Everything else is a scalar loop. Sprites with more than 256
+// colours fall back to a plain 32-bit plane.
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+#include "sprite_atlas.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PALETTE_SSE2 1
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define PALETTE_AVX2 1
+#endif
+#if defined(__SSSE3__) || defined(__AVX2__)
+#include <tmmintrin.h>
+#define PALETTE_SSSE3 1
+#endif
+
+namespace PaletteKernels {
+
+// The first 16 palette entries laid out for ExpandRow4(): split into B, G, R and A
+// byte planes for the SSSE3 shuffle, and as the two pixels of every packed byte
+// (low nibble in the low half) for the SSE2 loads.
+struct Row4Tables {
+    uint8_t channels[4][16];
+    uint64_t pairs[256];
+
+    void Build(const uint32_t* palette, std::size_t count) {
+        uint32_t entries[16] = {};
+        for (std::size_t i = 0; i < count && i < 16; i++) {
+            entries[i] = palette[i];
+        }
+        for (int i = 0; i < 16; i++) {
+            for (int channel = 0; channel < 4; channel++) {
+                channels[channel][i] = (uint8_t)(entries[i] >> (8 * channel));
+            }
+        }
+        for (int byte = 0; byte < 256; byte++) {
+            pairs[byte] = entries[byte & 0x0F] | (uint64_t)entries[byte >> 4] << 32;
+        }
+    }
+};
+
+// out[x] = palette[indices[x]]
+inline void ExpandRow8(const uint8_t* indices, int count, const uint32_t* palette, uint32_t* out) {
+    int x = 0;
+#ifdef PALETTE_AVX2
+    for (; x + 8 <= count; x += 8) {
+        __m256i lanes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(indices + x)));
+        __m256i pixels = _mm256_i32gather_epi32((const int*)palette, lanes, 4);
+        _mm256_storeu_si256((__m256i*)(out + x), pixels);
+    }
+#endif
+#ifdef PALETTE_SSE2
+    for (; x + 4 <= count; x += 4) {
+        __m128i pixels = _mm_set_epi32((int)palette[indices[x + 3]], (int)palette[indices[x + 2]],
+                                       (int)palette[indices[x + 1]], (int)palette[indices[x]]);
+        _mm_storeu_si128((__m128i*)(out + x), pixels);
+    }
+#endif
+    for (; x < count; x++) {
+        out[x] = palette[indices[x]];
+    }
+}
+
+// Same for two pixels per byte (low nibble first), with `tables` built from `palette`
+inline void ExpandRow4(const uint8_t* packed, int count, const uint32_t* palette,
+                       const Row4Tables& tables, uint32_t* out) {
+    int x = 0;
+#ifdef PALETTE_SSSE3
+    const __m128i nibbleMask = _mm_set1_epi8(0x0F);
+    const __m128i blue = _mm_loadu_si128((const __m128i*)tables.channels[0]);
+    const __m128i green = _mm_loadu_si128((const __m128i*)tables.channels[1]);
+    const __m128i red = _mm_loadu_si128((const __m128i*)tables.channels[2]);
+    const __m128i alpha = _mm_loadu_si128((const __m128i*)tables.channels[3]);
+    for (; x + 16 <= count; x += 16) {
+        // 8 bytes -> 16 indices in pixel order
+        __m128i bytes = _mm_loadl_epi64((const __m128i*)(packed + x / 2));
+        __m128i even = _mm_and_si128(bytes, nibbleMask);
+        __m128i odd = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibbleMask);
+        __m128i index = _mm_unpacklo_epi8(even, odd);
+
+        // Look up each channel, then interleave back to B,G,R,A per pixel
+        __m128i b = _mm_shuffle_epi8(blue, index);
+        __m128i g = _mm_shuffle_epi8(green, index);
+        __m128i r = _mm_shuffle_epi8(red, index);
+        __m128i a = _mm_shuffle_epi8(alpha, index);
+        __m128i bgLow = _mm_unpacklo_epi8(b, g);
+        __m128i bgHigh = _mm_unpackhi_epi8(b, g);
+        __m128i raLow = _mm_unpacklo_epi8(r, a);
+        __m128i raHigh = _mm_unpackhi_epi8(r, a);
+        _mm_storeu_si128((__m128i*)(out + x), _mm_unpacklo_epi16(bgLow, raLow));
+        _mm_storeu_si128((__m128i*)(out + x + 4), _mm_unpackhi_epi16(bgLow, raLow));
+        _mm_storeu_si128((__m128i*)(out + x + 8), _mm_unpacklo_epi16(bgHigh, raHigh));
+        _mm_storeu_si128((__m128i*)(out + x + 12), _mm_unpackhi_epi16(bgHigh, raHigh));
+    }
+#endif
+#ifdef PALETTE_SSE2
+    // Four pixels from two packed bytes (x stays even)
+    for (; x + 4 <= count; x += 4) {
+        const uint8_t* bytes = packed + x / 2;
+        __m128i first = _mm_loadl_epi64((const __m128i*)&tables.pairs[bytes[0]]);
+        __m128i second = _mm_loadl_epi64((const __m128i*)&tables.pairs[bytes[1]]);
+        _mm_storeu_si128((__m128i*)(out + x), _mm_unpacklo_epi64(first, second));
+    }
+#else
+    (void)tables;
+#endif
+    for (; x < count; x++) {
+        uint8_t byte = packed[x / 2];
+        out[x] = palette[(x & 1) ? (byte >> 4) : (byte & 0x0F)];
+    }
+}
+
+} // namespace PaletteKernels
+
+class PaletteSpriteStore {
+public:
+    static const int MAX_COLOURS = 256;
+
+    PaletteSpriteStore() {
+        m_row4.Build(nullptr, 0);
+    }
+
+    // Adds a premultiplied BGRA sprite (copied), reusing an identical plane if one
+    // exists. Returns the sprite id.
+    int Add(const uint32_t* pixels, int width, int height, int stride) {
+        // Colours not in the palette yet; if they don't fit, keep this sprite as 32-bit
+        std::vector<uint32_t> newColours;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                uint32_t colour = pixels[(std::size_t)y * stride + x];
+                if (m_paletteIndex.find(colour) == m_paletteIndex.end() &&
+                    std::find(newColours.begin(), newColours.end(), colour) == newColours.end()) {
+                    newColours.push_back(colour);
+                    if (PaletteSize() + newColours.size() > (std::size_t)MAX_COLOURS) break;
+                }
+            }
+        }
+
+        Sprite sprite;
+        sprite.width = width;
+        sprite.height = height;
+        sprite.opaque = true;
+        std::vector<uint8_t> plane;
+        if (PaletteSize() + newColours.size() <= (std::size_t)MAX_COLOURS) {
+            for (uint32_t colour : newColours) {
+                AddColour(colour);
+            }
+            int maxIndex = 0;
+            for (int y = 0; y < height; y++) {
+                for (int x = 0; x < width; x++) {
+                    int index = m_paletteIndex[pixels[(std::size_t)y * stride + x]];
+                    if (index > maxIndex) maxIndex = index;
+                }
+            }
+            sprite.bits = maxIndex < 16 ? 4 : 8;
+            sprite.rowBytes = sprite.bits == 4 ? (width + 1) / 2 : width;
+            plane.assign((std::size_t)sprite.rowBytes * height, 0);
+            for (int y = 0; y < height; y++) {
+                uint8_t* row = plane.data() + (std::size_t)y * sprite.rowBytes;
+                for (int x = 0; x < width; x++) {
+                    uint32_t colour = pixels[(std::size_t)y * stride + x];
+                    uint8_t index = (uint8_t)m_paletteIndex[colour];
+                    if ((colour >> 24) != 0xFF) sprite.opaque = false;
+                    if (sprite.bits == 8) {
+                        row[x] = index;
+                    } else {
+                        row[x / 2] |= (uint8_t)((x & 1) ? (index << 4) : index);
+                    }
+                }
+            }
+        } else {
+            sprite.bits = 32;
+            sprite.rowBytes = width * (int)sizeof(uint32_t);
+            plane.resize((std::size_t)sprite.rowBytes * height);
+            for (int y = 0; y < height; y++) {
+                std::memcpy(plane.data() + (std::size_t)y * sprite.rowBytes, pixels + (std::size_t)y * stride, (std::size_t)sprite.rowBytes);
+                for (int x = 0; x < width && sprite.opaque; x++) {
+                    if ((pixels[(std::size_t)y * stride + x] >> 24) != 0xFF) sprite.opaque = false;
+                }
+            }
+        }
+
+        sprite.offset = StorePlane(plane, sprite);
+        m_sprites.push_back(sprite);
+        return (int)m_sprites.size() - 1;
+    }
+
+    // Uses a palette that lives in read-only data (sprites_generated.h); nothing is copied
+    void AttachPalette(const uint32_t* palette, int count) {
+        m_externalPalette = palette;
+        m_externalPaletteSize = count;
+        UpdateRow4Tables();
+    }
+
+    // Registers a sprite whose index plane lives in read-only data
+    int AttachSprite(const uint8_t* plane, int width, int height, int bits, bool opaque) {
+        Sprite sprite;
+        sprite.width = width;
+        sprite.height = height;
+        sprite.bits = bits;
+        sprite.rowBytes = bits == 4 ? (width + 1) / 2 : (bits == 8 ? width : width * (int)sizeof(uint32_t));
+        sprite.opaque = opaque;
+        sprite.external = plane;
+        m_sprites.push_back(sprite);
+        return (int)m_sprites.size() - 1;
+    }
+
+    // Writes the sprite as premultiplied BGRA, replacing what was there
+    void Expand(int id, uint32_t* dst, int dstStride) const {
+        const Sprite& sprite = m_sprites[id];
+        const uint8_t* row = Plane(sprite);
+        for (int y = 0; y < sprite.height; y++, row += sprite.rowBytes, dst += dstStride) {
+            ExpandRow(sprite, row, dst);
+        }
+    }
+
+    // Composites the sprite onto dst (a copy for opaque sprites)
+    void Draw(int id, uint32_t* dst, int dstStride) const {
+        const Sprite& sprite = m_sprites[id];
+        if (sprite.opaque) {
+            Expand(id, dst, dstStride);
+            return;
+        }
+        std::vector<uint32_t> line((std::size_t)sprite.width);
+        const uint8_t* row = Plane(sprite);
+        for (int y = 0; y < sprite.height; y++, row += sprite.rowBytes, dst += dstStride) {
+            ExpandRow(sprite, row, line.data());
+            for (int x = 0; x < sprite.width; x++) {
+                dst[x] = BlendOver(line[x], dst[x]);
+            }
+        }
+    }
+
+    int Width(int id) const { return m_sprites[id].width; }
+    int Height(int id) const { return m_sprites[id].height; }
+    int Bits(int id) const { return m_sprites[id].bits; }
+    bool IsOpaque(int id) const { return m_sprites[id].opaque; }
+    int SpriteCount() const { return (int)m_sprites.size(); }
+    int UniquePlanes() const { return (int)UniquePlaneSprites().size(); }
+    std::size_t PaletteSize() const {
+        return m_externalPalette ? (std::size_t)m_externalPaletteSize : m_palette.size();
+    }
+
+    // Bytes of palette, index planes and sprite records, whether owned or attached
+    std::size_t FootprintBytes() const {
+        std::size_t bytes = PaletteSize() * sizeof(uint32_t) + m_sprites.size() * sizeof(Sprite);
+        for (int id : UniquePlaneSprites()) {
+            bytes += (std::size_t)m_sprites[id].rowBytes * m_sprites[id].height;
+        }
+        return bytes;
+    }
+
+private:
+    struct Sprite {
+        int width = 0;
+        int height = 0;
+        int bits = 8;                       // 4, 8, or 32 (raw BGRA)
+        int rowBytes = 0;
+        bool opaque = true;
+        std::size_t offset = 0;             // Into m_indexData
+        const uint8_t* external = nullptr;  // Attached read-only plane
+    };
+
+    // One sprite per distinct plane (shared planes have the same address)
+    std::vector<int> UniquePlaneSprites() const {
+        std::vector<int> unique;
+        for (int id = 0; id < (int)m_sprites.size(); id++) {
+            bool shared = false;
+            for (int other : unique) {
+                shared |= Plane(m_sprites[other]) == Plane(m_sprites[id]);
+            }
+            if (!shared) unique.push_back(id);
+        }
+        return unique;
+    }
+
+    const uint32_t* Palette() const {
+        return m_externalPalette ? m_externalPalette : m_palette.data();
+    }
+
+    const uint8_t* Plane(const Sprite& sprite) const {
+        return sprite.external ? sprite.external : m_indexData.data() + sprite.offset;
+    }
+
+    void ExpandRow(const Sprite& sprite, const uint8_t* row, uint32_t* out) const {
+        if (sprite.bits == 4) {
+            PaletteKernels::ExpandRow4(row, sprite.width, Palette(), m_row4, out);
+        } else if (sprite.bits == 8) {
+            PaletteKernels::ExpandRow8(row, sprite.width, Palette(), out);
+        } else {
+            std::memcpy(out, row, (std::size_t)sprite.rowBytes);
+        }
+    }
+
+    void AddColour(uint32_t colour) {
+        int index = (int)m_palette.size();
+        m_palette.push_back(colour);
+        m_paletteIndex[colour] = index;
+        UpdateRow4Tables();
+    }
+
+    // Lays out the first 16 palette entries for ExpandRow4
+    void UpdateRow4Tables() {
+        m_row4.Build(Palette(), PaletteSize());
+    }
+
+    // Stores the plane unless an identical one exists; returns its offset
+    std::size_t StorePlane(const std::vector<uint8_t>& plane, const Sprite& sprite) {
+        uint64_t hash = 1469598103934665603ull; // FNV-1a
+        for (uint8_t byte : plane) {
+            hash = (hash ^ byte) * 1099511628211ull;
+        }
+        hash ^= (uint64_t)sprite.bits << 56 ^ (uint64_t)sprite.width << 32 ^ (uint64_t)sprite.height;
+
+        auto range = m_planes.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            const Sprite& stored = m_sprites[it->second];
+            if (stored.width == sprite.width && stored.height == sprite.height && stored.bits == sprite.bits &&
+                std::memcmp(m_indexData.data() + stored.offset, plane.data(), plane.size()) == 0) {
+                return stored.offset;
+            }
+        }
+        std::size_t offset = m_indexData.size();
+        m_indexData.insert(m_indexData.end(), plane.begin(), plane.end());
+        m_planes.emplace(hash, m_sprites.size()); // Id the caller is about to push
+        return offset;
+    }
+
+    std::vector<Sprite> m_sprites;
+    std::vector<uint8_t> m_indexData;                          // Owned planes, back to back
+    std::unordered_multimap<uint64_t, std::size_t> m_planes;  // Plane hash -> first sprite using it
+    std::vector<uint32_t> m_palette;
+    std::unordered_map<uint32_t, int> m_paletteIndex;
+    const uint32_t* m_externalPalette = nullptr;
+    int m_externalPaletteSize = 0;
+    PaletteKernels::Row4Tables m_row4;
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+// Pre-scaled copies of the face sprites for HiDPI monitors.
+//
+// Scales are 8.8 fixed point (SCALE_ONE = 1.0x), so 120 DPI is 320 and 144 DPI is 384.
+// Sprites are scaled nearest-neighbour, which keeps the pixel-art edges hard at any
+// factor, and only when a (sprite, scale) pair is first drawn after a DPI change;
+// painting a cached copy is a plain copy or blend. Scales the window has moved away
+// from are evicted, and the cache as a whole is held under a byte budget.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "sprite_atlas.h"
+#include "sprite_palette.h"
+
+const int SCALE_SHIFT = 8;
+const int SCALE_ONE = 1 << SCALE_SHIFT;
+
+// Size of a base-size extent at the given scale (never less than one pixel)
+inline int ScaledExtent(int extent, int scale) {
+    int scaled = (int)(((int64_t)extent * scale + SCALE_ONE / 2) >> SCALE_SHIFT);
+    return scaled > 0 ? scaled : 1;
+}
+
+// Scale for a monitor DPI, relative to the 96 DPI the sprites were drawn for
+inline int ScaleForDpi(int dpi) {
+    return dpi > 0 ? (dpi * SCALE_ONE + 48) / 96 : SCALE_ONE;
+}
+
+// Nearest-neighbour resize of a 32-bit image. Each destination pixel takes the source
+// pixel under its centre. Whole-number factors replicate pixels without a lookup, and
+// destination rows that map to the same source row are copied from the row above.
+inline void ScaleNearest(const uint32_t* src, int srcWidth, int srcHeight, int srcStride,
+                         uint32_t* dst, int dstWidth, int dstHeight, int dstStride) {
+    std::vector<int> columns;
+    int factor = dstWidth % srcWidth == 0 ? dstWidth / srcWidth : 0;
+    if (!factor) {
+        columns.resize((std::size_t)dstWidth);
+        for (int x = 0; x < dstWidth; x++) {
+            columns[x] = (int)(((int64_t)(2 * x + 1) * srcWidth) / (2 * (int64_t)dstWidth));
+        }
+    }
+
+    int previous = -1;
+    uint32_t* out = dst;
+    for (int y = 0; y < dstHeight; y++, out += dstStride) {
+        int sy = (int)(((int64_t)(2 * y + 1) * srcHeight) / (2 * (int64_t)dstHeight));
+        if (sy == previous) {
+            std::memcpy(out, out - dstStride, (std::size_t)dstWidth * sizeof(uint32_t));
+            continue;
+        }
+        previous = sy;
+
+        const uint32_t* row = src + (std::size_t)sy * srcStride;
+        if (factor) {
+            uint32_t* px = out;
+            for (int x = 0; x < srcWidth; x++) {
+                for (int k = 0; k < factor; k++) {
+                    *px++ = row[x];
+                }
+            }
+        } else {
+            for (int x = 0; x < dstWidth; x++) {
+                out[x] = row[columns[x]];
+            }
+        }
+    }
+}
+
+class ScaledSpriteCache {
+public:
+    // Default budget fits every face at 4x (48x32 sprites, 18 of them) with room to spare
+    static const std::size_t DEFAULT_BUDGET = 2 * 1024 * 1024;
+
+    struct Sprite {
+        int id = -1;
+        int scale = 0;
+        int width = 0;
+        int height = 0;
+        bool opaque = true;
+        unsigned long lastUse = 0;
+        std::vector<uint32_t> pixels;   // Premultiplied BGRA, rows are `width` apart
+    };
+
+    explicit ScaledSpriteCache(std::size_t budget = DEFAULT_BUDGET) : m_budget(budget) {}
+
+    // Returns the sprite at the given scale, scaling it from the store on a miss
+    const Sprite& Acquire(const PaletteSpriteStore& store, int id, int scale) {
+        m_clock++;
+        for (Sprite& sprite : m_sprites) {
+            if (sprite.id == id && sprite.scale == scale) {
+                sprite.lastUse = m_clock;
+                return sprite;
+            }
+        }
+
+        Sprite sprite;
+        sprite.id = id;
+        sprite.scale = scale;
+        sprite.width = ScaledExtent(store.Width(id), scale);
+        sprite.height = ScaledExtent(store.Height(id), scale);
+        sprite.opaque = store.IsOpaque(id);
+        sprite.lastUse = m_clock;
+        sprite.pixels.resize((std::size_t)sprite.width * sprite.height);
+
+        std::vector<uint32_t> base((std::size_t)store.Width(id) * store.Height(id));
+        store.Expand(id, base.data(), store.Width(id));
+        ScaleNearest(base.data(), store.Width(id), store.Height(id), store.Width(id),
+                     sprite.pixels.data(), sprite.width, sprite.height, sprite.width);
+        m_scaled++;
+
+        EvictFor(BytesOf(sprite));
+        m_bytes += BytesOf(sprite);
+        m_sprites.push_back(std::move(sprite));
+        return m_sprites.back();
+    }
+
+    // Drops every sprite not at `scale` (the window moved to a different DPI)
+    void Retain(int scale) {
+        for (std::size_t i = 0; i < m_sprites.size();) {
+            if (m_sprites[i].scale != scale) {
+                Remove(i);
+            } else {
+                i++;
+            }
+        }
+    }
+
+    void Clear() {
+        m_sprites.clear();
+        m_bytes = 0;
+    }
+
+    // Composites a scaled sprite onto dst (a copy for opaque sprites)
+    static void Draw(const Sprite& sprite, uint32_t* dst, int dstStride) {
+        const uint32_t* src = sprite.pixels.data();
+        for (int y = 0; y < sprite.height; y++, src += sprite.width, dst += dstStride) {
+            if (sprite.opaque) {
+                std::memcpy(dst, src, (std::size_t)sprite.width * sizeof(uint32_t));
+                continue;
+            }
+            for (int x = 0; x < sprite.width; x++) {
+                dst[x] = BlendOver(src[x], dst[x]);
+            }
+        }
+    }
+
+    int Count() const { return (int)m_sprites.size(); }
+    std::size_t Bytes() const { return m_bytes; }
+    unsigned long Scaled() const { return m_scaled; }
+
+private:
+    static std::size_t BytesOf(const Sprite& sprite) {
+        return sprite.pixels.size() * sizeof(uint32_t);
+    }
+
+    // Evicts least recently used sprites until `incoming` more bytes fit the budget (a
+    // single sprite larger than the budget is still kept, since it is about to be drawn)
+    void EvictFor(std::size_t incoming) {
+        while (!m_sprites.empty() && m_bytes + incoming > m_budget) {
+            std::size_t oldest = 0;
+            for (std::size_t i = 1; i < m_sprites.size(); i++) {
+                if (m_sprites[i].lastUse < m_sprites[oldest].lastUse) oldest = i;
+            }
+            Remove(oldest);
+        }
+    }
+
+    void Remove(std::size_t index) {
+        m_bytes -= BytesOf(m_sprites[index]);
+        m_sprites[index] = std::move(m_sprites.back());
+        m_sprites.pop_back();
+    }
+
+    std::vector<Sprite> m_sprites;
+    std::size_t m_budget;
+    std::size_t m_bytes = 0;
+    unsigned long m_clock = 0;
+    unsigned long m_scaled = 0;
+};
@@ -0,0 +1,135 @@
+#pragma once
+
+// The emotional state machine: threshold rules (state_rules.h) plus the temporary
+// states on top of them. SURPRISED and GRIMACE are entered on events; PLEASED is
+// shown when load drops back under every threshold. A temporary state holds for
+// TEMPORARY_STATE_MS, and rule evaluation is paused while it shows.
+//
+// Pure logic with no clock and no metric source of its own: the caller passes the
+// time and the metrics, and acts on what changed (blink, repaint, history, timers).
+// It also keeps the time spent in each state and how often each was entered.
+// The app drives it from the monitor thread with steady_clock and live samples;
+// tools/state_replay.cpp drives it from a trace with a simulated clock.
+
+#include <chrono>
+#include <cstdint>
+#include "emotional_state.h"
+#include "state_rules.h"
+
+const int TEMPORARY_STATE_MS = 2000;
+
+struct StateStep {
+    bool changed;            // The shown state is different from before the call
+    bool temporaryStarted;   // A temporary state began; expire it at TemporaryDeadline()
+};
+
+class StateMachine {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    explicit StateMachine(const RuleSet* rules = nullptr) : m_evaluator(rules) {}
+
+    void SetRules(const RuleSet* rules) { m_evaluator.SetRules(rules); }
+    const RuleSet* Rules() const { return m_evaluator.Rules(); }
+
+    // A new sample for the next Update(); nothing is evaluated yet. `periods` is how many
+    // nominal 500 ms sample periods it covers, so smoothing keeps its time constant
+    // when the sampling interval changes.
+    void SetMetrics(const MetricValues& metrics, double periods = 1.0) {
+        m_metrics = metrics;
+        m_periods = periods;
+        m_newSample = true;
+    }
+
+    // Re-evaluates the rules with the latest metrics, unless a temporary state is
+    // still showing. Also what expires a temporary state once its deadline passes.
+    // A sample is smoothed and windowed once, by the first Update() after SetMetrics();
+    // later calls only match the rules again.
+    StateStep Update(TimePoint now) {
+        StateStep step = { false, false };
+        if (m_newSample) {
+            m_evaluator.AddSample(m_metrics, now, m_periods);
+            m_newSample = false;
+        }
+        if (m_temporary) {
+            if (now < m_temporaryDeadline) {
+                return step;
+            }
+            m_temporary = false;
+        }
+
+        RuleResult result = m_evaluator.Match(now);
+        EmotionalState state = result.state;
+
+        // Load just dropped under every threshold: show PLEASED briefly
+        if (m_wasOverThreshold && !result.overThreshold) {
+            state = PLEASED;
+            StartTemporary(now);
+            step.temporaryStarted = true;
+        }
+        m_wasOverThreshold = result.overThreshold;
+
+        step.changed = state != m_state;
+        Enter(state, now);
+        return step;
+    }
+
+    // Shows an event state (SURPRISED, GRIMACE) until TemporaryDeadline()
+    StateStep EnterTemporaryState(EmotionalState state, TimePoint now) {
+        StateStep step = { state != m_state, true };
+        Enter(state, now);
+        StartTemporary(now);
+        return step;
+    }
+
+    EmotionalState State() const { return m_state; }
+    bool InTemporaryState() const { return m_temporary; }
+    TimePoint TemporaryDeadline() const { return m_temporaryDeadline; }
+    const MetricValues& Metrics() const { return m_metrics; }
+    const RuleEvaluator& Evaluator() const { return m_evaluator; }
+
+    // Milliseconds spent in `state` up to `now` (counting from the first call)
+    uint64_t TimeInState(EmotionalState state, TimePoint now) const {
+        uint64_t ms = m_stateMs[state];
+        if (state == m_state && m_started && now > m_since) {
+            ms += (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(now - m_since).count();
+        }
+        return ms;
+    }
+
+    // Times `state` was entered from a different one
+    uint64_t Transitions(EmotionalState state) const { return m_transitions[state]; }
+
+private:
+    void Enter(EmotionalState state, TimePoint now) {
+        if (!m_started) {
+            m_since = now;
+            m_started = true;
+        }
+        if (state == m_state) {
+            return;
+        }
+        m_stateMs[m_state] = TimeInState(m_state, now);
+        m_transitions[state]++;
+        m_state = state;
+        m_since = now;
+    }
+
+    void StartTemporary(TimePoint now) {
+        m_temporary = true;
+        m_temporaryDeadline = now + std::chrono::milliseconds(TEMPORARY_STATE_MS);
+    }
+
+    RuleEvaluator m_evaluator;
+    MetricValues m_metrics = MakeMetrics(0.0, 0, false, 100, 0.0);
+    double m_periods = 1.0;
+    bool m_newSample = false;       // m_metrics hasn't been through the filters yet
+    EmotionalState m_state = HAPPY;
+    bool m_wasOverThreshold = false;
+    bool m_temporary = false;
+    TimePoint m_temporaryDeadline;
+    bool m_started = false;         // m_since is meaningful
+    TimePoint m_since;              // When the time in m_state was last charged
+    uint64_t m_stateMs[EMOTIONAL_STATE_COUNT] = {};
+    uint64_t m_transitions[EMOTIONAL_STATE_COUNT] = {};
+};
@@ -0,0 +1,274 @@
+#pragma once
+
+// The current mood and metrics in a named shared-memory page, for status bars and
+// shell prompts that can't afford a socket round trip per render.
+//
+// The page is a small header and a seqlock: a sequence number that is odd while the
+// monitor is writing, followed by the StatePageData words. The monitor publishes
+// into it alongside g_snapshot; a reader maps the page once and from then on reads
+// with plain loads and no syscalls, retrying if it raced a write. Unlike the
+// in-process SeqLock, a read gives up after a bounded number of tries, so a writer
+// that died mid-update can't hang every prompt on the machine.
+//
+// Only one process publishes under a name. The writer refuses a page that already
+// exists rather than writing into an object someone else created (another instance,
+// or a squatter who got there first); on POSIX, where a name outlives a crashed
+// writer, a page left behind by a writer that is gone is replaced.
+//
+// This header is the whole reader library: copy it next to a tool and use
+// StatePageReader. It depends on nothing else in the tree. The layout is versioned;
+// add fields at the end of StatePageData and bump STATE_PAGE_VERSION.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+#define STATE_PAGE_NAME L"Local\\EmotionalTaskManagerState"
+typedef const wchar_t* StatePageName;
+#else
+#define STATE_PAGE_NAME "/emotional-task-manager"
+typedef const char* StatePageName;
+#endif
+
+const char STATE_PAGE_MAGIC[8] = { 'E', 'T', 'M', 'P', 'A', 'G', 'E', '1' };
+const uint32_t STATE_PAGE_VERSION = 1;
+
+struct StatePageData {
+    uint64_t sequence;         // Snapshot sequence, bumped on every publish
+    int64_t timeMs;            // Unix time of the publish, in milliseconds
+    double cpuUsage;           // Percent
+    double memoryUsage;        // Percent
+    float hottestCoreUsage;    // Percent
+    int32_t saturatedCores;
+    int32_t batteryPercent;    // -1 without a battery
+    uint8_t state;             // EmotionalState
+    uint8_t isBlinking;
+    uint8_t reserved[2];
+    char stateName[24];        // EMOTIONAL_STATE_NAMES[state], NUL-terminated
+};
+
+struct StatePageLayout {
+    static const std::size_t WORDS = (sizeof(StatePageData) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    char magic[8];
+    uint32_t version;
+    uint32_t dataSize;                    // sizeof(StatePageData) of the writer
+    std::atomic<uint32_t> sequence;       // Odd while a write is in progress
+    uint32_t writerPid;                   // Process that created the page
+    std::atomic<uint64_t> words[WORDS];   // StatePageData
+};
+
+static_assert(sizeof(StatePageData) == 72, "state page data layout is shared with other processes");
+static_assert(offsetof(StatePageLayout, words) == 24, "state page layout is shared with other processes");
+static_assert(ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2, "the page needs address-free atomics");
+
+// Maps the page read-only. Open() is the only call that makes syscalls.
+class StatePageReader {
+public:
+    ~StatePageReader() { Close(); }
+
+    bool Open(StatePageName name = STATE_PAGE_NAME) {
+        Close();
+#ifdef _WIN32
+        m_mapping = OpenFileMappingW(FILE_MAP_READ, FALSE, name);
+        m_view = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, sizeof(StatePageLayout)) : NULL;
+#else
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && (std::size_t)info.st_size >= sizeof(StatePageLayout)) {
+            m_view = mmap(nullptr, sizeof(StatePageLayout), PROT_READ, MAP_SHARED, fd, 0);
+            if (m_view == MAP_FAILED) m_view = nullptr;
+        }
+        close(fd);
+#endif
+        m_page = (const StatePageLayout*)m_view;
+        if (!m_page || std::memcmp(m_page->magic, STATE_PAGE_MAGIC, sizeof(STATE_PAGE_MAGIC)) != 0 ||
+            m_page->version != STATE_PAGE_VERSION || m_page->dataSize < sizeof(StatePageData)) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void Close() {
+#ifdef _WIN32
+        if (m_view) UnmapViewOfFile(m_view);
+        if (m_mapping) CloseHandle(m_mapping);
+        m_mapping = NULL;
+#else
+        if (m_view) munmap(m_view, sizeof(StatePageLayout));
+#endif
+        m_view = nullptr;
+        m_page = nullptr;
+    }
+
+    bool IsOpen() const { return m_page != nullptr; }
+
+    // Copies a consistent snapshot; false if the page isn't open or kept changing
+    // (or stayed mid-write) for `tries` attempts
+    bool Read(StatePageData& data, int tries = 1000) const {
+        if (!m_page) {
+            return false;
+        }
+        uint64_t words[StatePageLayout::WORDS];
+        for (int attempt = 0; attempt < tries; attempt++) {
+            uint32_t before = m_page->sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+            for (std::size_t i = 0; i < StatePageLayout::WORDS; i++) {
+                words[i] = m_page->words[i].load(std::memory_order_acquire);
+            }
+            if (m_page->sequence.load(std::memory_order_relaxed) == before) {
+                std::memcpy(&data, words, sizeof(StatePageData));
+                data.stateName[sizeof(data.stateName) - 1] = '\0';
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    void* m_view = nullptr;
+    const StatePageLayout* m_page = nullptr;
+#ifdef _WIN32
+    HANDLE m_mapping = NULL;
+#endif
+};
+
+// Creates the page and publishes into it. Single writer.
+class StatePageWriter {
+public:
+    ~StatePageWriter() { Close(); }
+
+    bool Open(StatePageName name = STATE_PAGE_NAME) {
+        Close();
+#ifdef _WIN32
+        m_mapping = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, sizeof(StatePageLayout), name);
+        if (m_mapping && GetLastError() == ERROR_ALREADY_EXISTS) {
+            Close();
+            return false;
+        }
+        m_view = m_mapping ? MapViewOfFile(m_mapping, FILE_MAP_WRITE, 0, 0, sizeof(StatePageLayout)) : NULL;
+#else
+        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd < 0 && errno == EEXIST && RemoveAbandoned(name)) {
+            fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+        }
+        if (fd < 0) {
+            return false;
+        }
+        if (ftruncate(fd, sizeof(StatePageLayout)) == 0) {
+            m_view = mmap(nullptr, sizeof(StatePageLayout), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            if (m_view == MAP_FAILED) m_view = nullptr;
+        }
+        close(fd);
+        m_name = name;
+#endif
+        if (!m_view) {
+            Close();
+            return false;
+        }
+
+        // The magic goes in last, so a reader never accepts a half-initialized page
+        m_page = (StatePageLayout*)m_view;
+        std::memset(m_page->magic, 0, sizeof(m_page->magic));
+        m_page->version = STATE_PAGE_VERSION;
+        m_page->dataSize = sizeof(StatePageData);
+#ifdef _WIN32
+        m_page->writerPid = GetCurrentProcessId();
+#else
+        m_page->writerPid = (uint32_t)getpid();
+#endif
+        m_page->sequence.store(0, std::memory_order_relaxed);
+        for (std::size_t i = 0; i < StatePageLayout::WORDS; i++) {
+            m_page->words[i].store(0, std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(m_page->magic, STATE_PAGE_MAGIC, sizeof(STATE_PAGE_MAGIC));
+        return true;
+    }
+
+    // On Linux the name goes away with the writer; readers that already mapped the
+    // page keep it, frozen at the last publish
+    void Close() {
+#ifdef _WIN32
+        if (m_view) UnmapViewOfFile(m_view);
+        if (m_mapping) CloseHandle(m_mapping);
+        m_mapping = NULL;
+#else
+        if (m_view) munmap(m_view, sizeof(StatePageLayout));
+        if (m_name) shm_unlink(m_name);
+        m_name = nullptr;
+#endif
+        m_view = nullptr;
+        m_page = nullptr;
+    }
+
+    bool IsOpen() const { return m_page != nullptr; }
+
+    void Publish(const StatePageData& data) {
+        if (!m_page) {
+            return;
+        }
+        uint64_t words[StatePageLayout::WORDS] = {};
+        std::memcpy(words, &data, sizeof(StatePageData));
+
+        uint32_t seq = m_page->sequence.load(std::memory_order_relaxed);
+        m_page->sequence.store(seq + 1, std::memory_order_relaxed);   // Odd: write in progress
+        for (std::size_t i = 0; i < StatePageLayout::WORDS; i++) {
+            m_page->words[i].store(words[i], std::memory_order_release);
+        }
+        m_page->sequence.store(seq + 2, std::memory_order_release);
+    }
+
+private:
+#ifndef _WIN32
+    // Unlinks a page of ours whose writer has exited without closing it. A page from
+    // another user, one still being set up, or one whose writer is alive stays.
+    static bool RemoveAbandoned(StatePageName name) {
+        int fd = shm_open(name, O_RDONLY, 0);
+        if (fd < 0) {
+            return false;
+        }
+        bool abandoned = false;
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_uid == geteuid() && (std::size_t)info.st_size >= sizeof(StatePageLayout)) {
+            void* view = mmap(nullptr, sizeof(StatePageLayout), PROT_READ, MAP_SHARED, fd, 0);
+            if (view != MAP_FAILED) {
+                const StatePageLayout* page = (const StatePageLayout*)view;
+                pid_t pid = (pid_t)page->writerPid;
+                abandoned = std::memcmp(page->magic, STATE_PAGE_MAGIC, sizeof(STATE_PAGE_MAGIC)) == 0 && pid > 0 &&
+                            kill(pid, 0) != 0 && errno == ESRCH;
+                munmap(view, sizeof(StatePageLayout));
+            }
+        }
+        close(fd);
+        return abandoned && shm_unlink(name) == 0;
+    }
+#endif
+
+    void* m_view = nullptr;
+    StatePageLayout* m_page = nullptr;
+#ifdef _WIN32
+    HANDLE m_mapping = NULL;
+#else
+    const char* m_name = nullptr;
+#endif
+};
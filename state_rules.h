@@ -0,0 +1,353 @@
+#pragma once
+
+// Threshold rules that pick the emotional state, as data instead of an if/else chain.
+//
+// Rules are checked in table order and the first match wins, so CPU outranks battery
+// and battery outranks memory. Evaluation walks the whole table without early exits
+// and never allocates. A metric the machine doesn't have (battery on a desktop) is
+// NaN, which no comparison matches. Blink timing sits in the same header as dense
+// per-state arrays.
+//
+// STATE_RULES is the compiled-in default; rules_config.h loads a replacement RuleSet
+// from a file at runtime.
+//
+// RuleEvaluator adds the stateful parts that keep the face from flapping: metrics are
+// smoothed (signal_filter.h), a matched rule only lets go once its metric is a band
+// past the threshold, and a state is shown for a minimum hold time before it can be
+// replaced by a lower-priority one. Escalations always apply at once.
+//
+// A rule can also test a percentile of a metric over a time window ("CPU p95 over
+// the last minute above 70") instead of the current value; the evaluator keeps one
+// PercentileWindow (percentile_window.h) per distinct metric and window.
+
+#include <chrono>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "emotional_state.h"
+#include "signal_filter.h"
+#include "percentile_window.h"
+
+// Fixed-size array indexed directly by an enum value
+template <typename T, typename Enum, int N>
+struct EnumArray {
+    T values[N];
+
+    constexpr T& operator[](Enum key) { return values[(int)key]; }
+    constexpr const T& operator[](Enum key) const { return values[(int)key]; }
+    static constexpr int size() { return N; }
+};
+
+template <typename T>
+using StateArray = EnumArray<T, EmotionalState, EMOTIONAL_STATE_COUNT>;
+
+enum RuleMetric {
+    METRIC_CPU,              // Total CPU percent
+    METRIC_SATURATED_CORES,  // Cores above CORE_THRESHOLD_ANGUISH_EXTREMELY
+    METRIC_BATTERY,          // Battery percent, NaN without a battery
+    METRIC_MEMORY,           // Memory load percent
+    METRIC_COUNT
+};
+
+enum RuleCompare {
+    RULE_ABOVE,  // metric > threshold
+    RULE_BELOW   // metric < threshold
+};
+
+struct StateRule {
+    EmotionalState state;
+    RuleMetric metric;
+    RuleCompare compare;
+    double threshold;
+    int dwellMs;        // Must match continuously this long before it applies (0 = at once)
+    double band;        // Once matched, keeps matching until the metric is this far back past the threshold
+    double percentile = 0;  // Test this percentile over windowMs instead of the current value (0 = current)
+    int windowMs = 0;
+};
+
+struct MetricValues {
+    double values[METRIC_COUNT];
+
+    constexpr double operator[](RuleMetric metric) const { return values[(int)metric]; }
+};
+
+constexpr double METRIC_MISSING = std::numeric_limits<double>::quiet_NaN();
+
+// Histogram range per RuleMetric for percentile windows
+constexpr double METRIC_RANGES[METRIC_COUNT] = { 100.0, 256.0, 100.0, 100.0 };
+
+constexpr MetricValues MakeMetrics(double cpu, int saturatedCores, bool hasBattery, int batteryPercent,
+                                   double memory) {
+    return MetricValues{ { cpu, (double)saturatedCores, hasBattery ? (double)batteryPercent : METRIC_MISSING, memory } };
+}
+
+// Highest priority first: state, metric, comparator, threshold, dwell ms, hysteresis band
+constexpr StateRule STATE_RULES[] = {
+    { ANGUISH_EXTREMELY, METRIC_CPU,             RULE_ABOVE, 90.0, 0, 5.0 },
+    { ANGUISH_VERY,      METRIC_CPU,             RULE_ABOVE, 70.0, 0, 5.0 },
+    { ANGUISH,           METRIC_CPU,             RULE_ABOVE, 50.0, 0, 5.0 },
+    { ANGUISH,           METRIC_SATURATED_CORES, RULE_ABOVE, 0.0,  0, 0.0 },   // One pinned core is enough
+    { TIRED_EXTREMELY,   METRIC_BATTERY,         RULE_BELOW, 10.0, 0, 2.0 },
+    { TIRED_VERY,        METRIC_BATTERY,         RULE_BELOW, 20.0, 0, 2.0 },
+    { TIRED,             METRIC_BATTERY,         RULE_BELOW, 30.0, 0, 2.0 },
+    { GRIMACE_TWO_SWEAT, METRIC_MEMORY,          RULE_ABOVE, 95.0, 0, 1.0 },
+    { NEUTRAL,           METRIC_MEMORY,          RULE_ABOVE, 90.0, 0, 1.0 },
+};
+
+constexpr bool RuleMatches(const StateRule& rule, double value) {
+    return rule.compare == RULE_ABOVE ? value > rule.threshold : value < rule.threshold;
+}
+
+constexpr bool RuleMatches(const StateRule& rule, const MetricValues& metrics) {
+    return RuleMatches(rule, metrics[rule.metric]);
+}
+
+// Exit test for a rule that already matched: the threshold moved back by the band
+constexpr bool RuleHolds(const StateRule& rule, double value) {
+    return rule.compare == RULE_ABOVE ? value > rule.threshold - rule.band : value < rule.threshold + rule.band;
+}
+
+// Index of the first matching rule, or -1 if the metrics are all within limits
+constexpr int FirstMatchingRule(const StateRule* rules, int count, const MetricValues& metrics) {
+    int first = -1;
+    for (int i = count - 1; i >= 0; i--) {
+        first = RuleMatches(rules[i], metrics) ? i : first;
+    }
+    return first;
+}
+
+struct RuleResult {
+    EmotionalState state;   // HAPPY when no rule matched
+    bool overThreshold;     // Some rule matched (leaving this state shows PLEASED)
+};
+
+template <std::size_t N>
+constexpr RuleResult EvaluateRules(const StateRule (&rules)[N], const MetricValues& metrics) {
+    int rule = FirstMatchingRule(rules, (int)N, metrics);
+    return RuleResult{ rule >= 0 ? rules[rule].state : HAPPY, rule >= 0 };
+}
+
+// Priority is data: the same metrics under the compiled-in table
+static_assert(EvaluateRules(STATE_RULES, MakeMetrics(95, 0, true, 5, 99)).state == ANGUISH_EXTREMELY, "CPU outranks battery and memory");
+static_assert(EvaluateRules(STATE_RULES, MakeMetrics(10, 1, true, 5, 99)).state == ANGUISH, "a saturated core counts as ANGUISH");
+static_assert(EvaluateRules(STATE_RULES, MakeMetrics(10, 0, true, 15, 99)).state == TIRED_VERY, "battery outranks memory");
+static_assert(EvaluateRules(STATE_RULES, MakeMetrics(10, 0, false, 5, 92)).state == NEUTRAL, "no battery, no TIRED");
+static_assert(!EvaluateRules(STATE_RULES, MakeMetrics(50, 0, true, 30, 90)).overThreshold, "thresholds are strict");
+
+const int MAX_RULES = 64;
+const int MAX_PERCENTILE_WINDOWS = 8;   // Distinct (metric, window) pairs per rule set
+
+// Smoothing per RuleMetric: CPU is averaged over roughly three samples, core counts take
+// the median over three sample periods (1.5 s) to drop short spikes; battery and memory
+// move slowly
+constexpr FilterConfig DEFAULT_FILTERS[METRIC_COUNT] = {
+    EwmaFilter(0.3), MedianFilter(3), NoFilter(), NoFilter()
+};
+
+// Minimum time a state is shown before a lower-priority state may replace it
+const int DEFAULT_HOLD_MS = 1500;
+
+// A flat rule table that can be built at runtime (see rules_config.h)
+struct RuleSet {
+    RuleSet() {
+        for (int i = 0; i < METRIC_COUNT; i++) {
+            filters[i] = DEFAULT_FILTERS[i];
+        }
+    }
+
+    int count = 0;
+    StateRule rules[MAX_RULES];
+    FilterConfig filters[METRIC_COUNT];
+    int holdMs = DEFAULT_HOLD_MS;
+};
+
+inline bool operator==(const StateRule& a, const StateRule& b) {
+    return a.state == b.state && a.metric == b.metric && a.compare == b.compare && a.threshold == b.threshold &&
+           a.dwellMs == b.dwellMs && a.band == b.band && a.percentile == b.percentile && a.windowMs == b.windowMs;
+}
+
+// Same rules, filters and hold time; a reload that parses to an equal set changes nothing
+inline bool operator==(const RuleSet& a, const RuleSet& b) {
+    if (a.count != b.count || a.holdMs != b.holdMs) return false;
+    for (int i = 0; i < a.count; i++) {
+        if (!(a.rules[i] == b.rules[i])) return false;
+    }
+    for (int i = 0; i < METRIC_COUNT; i++) {
+        if (!(a.filters[i] == b.filters[i])) return false;
+    }
+    return true;
+}
+
+template <std::size_t N>
+RuleSet MakeRuleSet(const StateRule (&rules)[N]) {
+    static_assert(N <= MAX_RULES, "too many rules");
+    RuleSet set;
+    for (std::size_t i = 0; i < N; i++) {
+        set.rules[set.count++] = rules[i];
+    }
+    return set;
+}
+
+// Evaluates a RuleSet: smooths the metrics, then applies dwell times, hysteresis
+// bands and the hold time. Owned by the thread that evaluates; the rule set it points
+// to must outlive it or be replaced through SetRules().
+class RuleEvaluator {
+public:
+    typedef std::chrono::steady_clock::time_point TimePoint;
+
+    explicit RuleEvaluator(const RuleSet* rules = nullptr) { SetRules(rules); }
+
+    // Switches tables. Dwell and hysteresis restart since rule indices no longer line
+    // up; filters and percentile windows keep their history unless their config changed.
+    void SetRules(const RuleSet* rules) {
+        m_rules = rules;
+        for (int i = 0; i < MAX_RULES; i++) {
+            m_matching[i] = false;
+        }
+        m_current = -1;
+        for (int i = 0; i < METRIC_COUNT; i++) {
+            m_filters[i].Configure(rules ? rules->filters[i] : NoFilter());
+        }
+        AssignWindows();
+    }
+
+    const RuleSet* Rules() const { return m_rules; }
+
+    // Metrics as the rules last saw them, after smoothing
+    const MetricValues& Conditioned() const { return m_conditioned; }
+
+    // Feeds a new sample through the filters and into the percentile windows, once per
+    // sample. `periods`: sample length in nominal sample periods, for the filters.
+    void AddSample(const MetricValues& raw, TimePoint now, double periods = 1.0) {
+        for (int i = 0; i < METRIC_COUNT; i++) {
+            m_conditioned.values[i] = m_filters[i].Update(raw.values[i], periods);
+        }
+
+        // Percentiles are taken over the raw samples, each weighted by the time it covers;
+        // the window does its own smoothing
+        for (Window& window : m_windows) {
+            window.values->Insert(raw[window.metric], now, periods);
+        }
+    }
+
+    // Matches the rules against the last sample. Runs again without a new sample when
+    // a temporary state expires or the rules are swapped.
+    RuleResult Match(TimePoint now) {
+        const MetricValues& metrics = m_conditioned;
+        for (Window& window : m_windows) {
+            window.values->Advance(now);
+        }
+
+        int first = -1;
+        int count = m_rules ? m_rules->count : 0;
+        for (int i = count - 1; i >= 0; i--) {
+            const StateRule& rule = m_rules->rules[i];
+            double value = rule.percentile > 0 ? m_windows[m_ruleWindow[i]].values->Quantile(rule.percentile)
+                                               : metrics[rule.metric];
+            bool match = m_matching[i] ? RuleHolds(rule, value) : RuleMatches(rule, value);
+            if (match && !m_matching[i]) {
+                m_since[i] = now;
+            }
+            m_matching[i] = match;
+            bool settled = rule.dwellMs == 0 || now - m_since[i] >= std::chrono::milliseconds(rule.dwellMs);
+            first = match && settled ? i : first;
+        }
+
+        // Higher priority (lower index) wins at once; anything else waits out the hold
+        bool demotion = m_current >= 0 && (first < 0 || first > m_current);
+        if (demotion && now - m_enteredAt < std::chrono::milliseconds(m_rules->holdMs)) {
+            first = m_current;
+        }
+        if (first != m_current) {
+            if (first < 0 || m_current < 0 || m_rules->rules[first].state != m_rules->rules[m_current].state) {
+                m_enteredAt = now;
+            }
+            m_current = first;
+        }
+        return RuleResult{ first >= 0 ? m_rules->rules[first].state : HAPPY, first >= 0 };
+    }
+
+    RuleResult Evaluate(const MetricValues& raw, TimePoint now, double periods = 1.0) {
+        AddSample(raw, now, periods);
+        return Match(now);
+    }
+
+    // Percentile of a metric over a window, if some rule in the set tracks it
+    double Percentile(RuleMetric metric, int windowMs, double percentile) const {
+        for (const Window& window : m_windows) {
+            if (window.metric == metric && window.windowMs == windowMs) {
+                return window.values->Quantile(percentile);
+            }
+        }
+        return METRIC_MISSING;
+    }
+
+private:
+    struct Window {
+        RuleMetric metric;
+        int windowMs;
+        std::unique_ptr<PercentileWindow> values;
+    };
+
+    // One window per distinct (metric, window) in the rules, reusing existing ones.
+    // Only runs on a rules swap; evaluation itself never allocates.
+    void AssignWindows() {
+        std::vector<Window> windows;
+        int count = m_rules ? m_rules->count : 0;
+        for (int i = 0; i < count; i++) {
+            const StateRule& rule = m_rules->rules[i];
+            m_ruleWindow[i] = -1;
+            if (rule.percentile <= 0) {
+                continue;
+            }
+            for (int w = 0; w < (int)windows.size(); w++) {
+                if (windows[w].metric == rule.metric && windows[w].windowMs == rule.windowMs) {
+                    m_ruleWindow[i] = w;
+                }
+            }
+            if (m_ruleWindow[i] >= 0) {
+                continue;
+            }
+            Window window = { rule.metric, rule.windowMs, nullptr };
+            for (Window& old : m_windows) {
+                if (old.values && old.metric == rule.metric && old.windowMs == rule.windowMs) {
+                    window.values = std::move(old.values);
+                }
+            }
+            if (!window.values) {
+                window.values.reset(new PercentileWindow(METRIC_RANGES[rule.metric], std::chrono::milliseconds(rule.windowMs)));
+            }
+            m_ruleWindow[i] = (int)windows.size();
+            windows.push_back(std::move(window));
+        }
+        m_windows = std::move(windows);
+    }
+
+    const RuleSet* m_rules = nullptr;
+    std::vector<Window> m_windows;
+    int m_ruleWindow[MAX_RULES];        // Index into m_windows for percentile rules
+    MetricFilter m_filters[METRIC_COUNT];
+    // Nothing matches before the first sample
+    MetricValues m_conditioned = { { METRIC_MISSING, METRIC_MISSING, METRIC_MISSING, METRIC_MISSING } };
+    bool m_matching[MAX_RULES];
+    TimePoint m_since[MAX_RULES];
+    int m_current = -1;         // Rule behind the last result, -1 for none
+    TimePoint m_enteredAt;      // When the last result's state was entered
+};
+
+struct BlinkTiming {
+    int intervalMs;   // Time between blinks
+    int durationMs;   // How long the eyes stay shut
+};
+
+constexpr StateArray<BlinkTiming> MakeBlinkTimings() {
+    StateArray<BlinkTiming> timings = {};
+    for (int i = 0; i < EMOTIONAL_STATE_COUNT; i++) {
+        timings[(EmotionalState)i] = BlinkTiming{ 4000, 100 };
+    }
+    timings[TIRED_VERY] = BlinkTiming{ 6000, 200 };  // Slow, heavy blinks
+    return timings;
+}
+
+constexpr StateArray<BlinkTiming> BLINK_TIMINGS = MakeBlinkTimings();
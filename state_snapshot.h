@@ -0,0 +1,83 @@
+#pragma once
+
+// Versioned snapshot of everything the face reacts to, published through a seqlock.
+//
+// The monitor thread is the only writer, so Store() is wait-free. Readers (WM_PAINT,
+// the metrics exporter, anything else that wants the current mood) never take a
+// lock; they retry only if they raced a store, which is a few dozen word copies.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "emotional_state.h"
+
+struct SystemSnapshot {
+    double cpuUsage = 0.0;
+    double memoryUsage = 0.0;
+    float hottestCoreUsage = 0.0f;
+    int saturatedCores = 0;      // Cores above the ANGUISH_EXTREMELY threshold
+    int batteryPercent = 100;
+    bool hasBattery = false;
+    bool isBlinking = false;
+    EmotionalState state = HAPPY;
+    uint64_t sequence = 0;       // Bumped on every publish
+    int64_t publishedMs = 0;     // steady_clock time of the publish, in ms
+    uint64_t stateMs[EMOTIONAL_STATE_COUNT] = {};       // Time in each state up to publishedMs
+    uint64_t transitions[EMOTIONAL_STATE_COUNT] = {};   // Times each state was entered
+    uint64_t samples = 0;        // Metric samples taken
+    uint64_t monitorBusyNs = 0;  // Time the monitor thread spent handling its timers
+    uint64_t monitorWakeups = 0; // Timers the monitor thread handled
+    int samplingIntervalMs = 0;  // Interval the adaptive sampler chose last
+};
+
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock payload must be trivially copyable");
+
+public:
+    SeqLock() {
+        Store(T());
+    }
+
+    // Single writer only
+    void Store(const T& value) {
+        uint64_t words[WORDS] = {};
+        std::memcpy(words, &value, sizeof(T));
+
+        uint32_t seq = m_sequence.load(std::memory_order_relaxed);
+        m_sequence.store(seq + 1, std::memory_order_relaxed);   // Odd: write in progress
+        // Release stores (free on x86) keep the odd sequence visible to any reader that
+        // sees a new word, without relying on fences ThreadSanitizer can't model
+        for (std::size_t i = 0; i < WORDS; i++) {
+            m_words[i].store(words[i], std::memory_order_release);
+        }
+        m_sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    T Load() const {
+        uint64_t words[WORDS];
+        for (;;) {
+            uint32_t before = m_sequence.load(std::memory_order_acquire);
+            if (before & 1) {
+                continue;
+            }
+            for (std::size_t i = 0; i < WORDS; i++) {
+                words[i] = m_words[i].load(std::memory_order_acquire);
+            }
+            if (m_sequence.load(std::memory_order_relaxed) == before) {
+                break;
+            }
+        }
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+private:
+    static const std::size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint32_t> m_sequence{0};
+    std::atomic<uint64_t> m_words[WORDS];
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+// Deadline-driven timer scheduler.
+//
+// Every periodic or one-shot job in the app (sampling, blink start/end,
+// temporary-state expiry, deferred window repositioning) is a fixed timer slot
+// with an absolute deadline. The slots live in an indexed binary min-heap so
+// the owning thread can sleep exactly until the earliest deadline instead of
+// polling. Nothing in here depends on Win32, so it can be driven by a simulated
+// clock through PopDue()/NextDeadline().
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+
+template <std::size_t N, typename Clock = std::chrono::steady_clock>
+class TimerScheduler {
+public:
+    using TimePoint = typename Clock::time_point;
+
+    TimerScheduler() {
+        for (std::size_t i = 0; i < N; i++) {
+            m_pos[i] = NOT_ARMED;
+        }
+    }
+
+    // Arms the timer, replacing any deadline it already had
+    void Schedule(int id, TimePoint deadline) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            SetDeadline(id, deadline);
+        }
+        m_cv.notify_one();
+    }
+
+    // Arms the timer, but never moves an armed deadline earlier. Used to
+    // collapse bursts of "do this after a delay" requests into one firing.
+    void ScheduleNoEarlier(int id, TimePoint deadline) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_pos[id] != NOT_ARMED && m_deadline[id] >= deadline) {
+                return;
+            }
+            SetDeadline(id, deadline);
+        }
+        m_cv.notify_one();
+    }
+
+    void Cancel(int id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Remove(id);
+    }
+
+    bool IsArmed(int id) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_pos[id] != NOT_ARMED;
+    }
+
+    // Earliest armed deadline, if any
+    bool NextDeadline(TimePoint& deadline) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_size == 0) {
+            return false;
+        }
+        deadline = m_deadline[m_heap[0]];
+        return true;
+    }
+
+    // Disarms and returns the earliest timer whose deadline is at or before
+    // `now`, or -1 if none is due
+    int PopDue(TimePoint now) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return PopDueLocked(now);
+    }
+
+    // Blocks until the earliest timer is due and returns its id (disarmed).
+    // Returns -1 once Stop() has been called.
+    int WaitNext() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            if (m_stopped) {
+                return -1;
+            }
+            if (m_size == 0) {
+                m_cv.wait(lock);
+                continue;
+            }
+            int id = PopDueLocked(Clock::now());
+            if (id >= 0) {
+                return id;
+            }
+            // Schedule()/Stop() notify, so an earlier deadline wakes us up too
+            m_cv.wait_until(lock, m_deadline[m_heap[0]]);
+        }
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopped = true;
+        }
+        m_cv.notify_all();
+    }
+
+private:
+    static const std::size_t NOT_ARMED = static_cast<std::size_t>(-1);
+
+    int PopDueLocked(TimePoint now) {
+        if (m_size == 0 || m_deadline[m_heap[0]] > now) {
+            return -1;
+        }
+        int id = m_heap[0];
+        Remove(id);
+        return id;
+    }
+
+    void SetDeadline(int id, TimePoint deadline) {
+        m_deadline[id] = deadline;
+        if (m_pos[id] == NOT_ARMED) {
+            m_pos[id] = m_size;
+            m_heap[m_size++] = id;
+        }
+        SiftUp(m_pos[id]);
+        SiftDown(m_pos[id]);
+    }
+
+    void Remove(int id) {
+        std::size_t i = m_pos[id];
+        if (i == NOT_ARMED) {
+            return;
+        }
+        m_pos[id] = NOT_ARMED;
+        m_size--;
+        if (i == m_size) {
+            return;
+        }
+        // Move the last entry into the hole and restore heap order
+        int moved = m_heap[m_size];
+        m_heap[i] = moved;
+        m_pos[moved] = i;
+        SiftUp(i);
+        SiftDown(m_pos[moved]);
+    }
+
+    bool Less(std::size_t a, std::size_t b) const {
+        return m_deadline[m_heap[a]] < m_deadline[m_heap[b]];
+    }
+
+    void Swap(std::size_t a, std::size_t b) {
+        int tmp = m_heap[a];
+        m_heap[a] = m_heap[b];
+        m_heap[b] = tmp;
+        m_pos[m_heap[a]] = a;
+        m_pos[m_heap[b]] = b;
+    }
+
+    void SiftUp(std::size_t i) {
+        while (i > 0) {
+            std::size_t parent = (i - 1) / 2;
+            if (!Less(i, parent)) {
+                break;
+            }
+            Swap(i, parent);
+            i = parent;
+        }
+    }
+
+    void SiftDown(std::size_t i) {
+        for (;;) {
+            std::size_t left = 2 * i + 1;
+            std::size_t right = left + 1;
+            std::size_t smallest = i;
+            if (left < m_size && Less(left, smallest)) smallest = left;
+            if (right < m_size && Less(right, smallest)) smallest = right;
+            if (smallest == i) {
+                break;
+            }
+            Swap(i, smallest);
+            i = smallest;
+        }
+    }
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_stopped = false;
+    std::size_t m_size = 0;
+    int m_heap[N];               // Armed timer ids, heap-ordered by deadline
+    std::size_t m_pos[N];        // Position of each id in m_heap, or NOT_ARMED
+    TimePoint m_deadline[N];
+};
@@ -0,0 +1,186 @@
+// Ingest and query benchmark for the history archive (history_archive.h), checked
+// against a plain in-memory copy of the samples.
+//
+// Usage: archive_bench [--days N] [--seed S]
+//
+// Build: cl /EHsc /O2 /nologo /Fearchive_bench.exe tools\archive_bench.cpp
+//        g++ -O2 -std=c++14 -o archive_bench tools/archive_bench.cpp
+//
+// Writes N days (default 30) of samples at a jittery 500 ms cadence, with the machine
+// asleep now and then, to archive_bench.archive in the current directory, and
+// deletes it after. It reports the append cost, the file size per sample against
+// the ring's 32-byte records, and how long reopening (indexing the chunks) takes.
+// Then it checks, on the reopened file:
+//   - ForEachSample() gives back every sample as appended,
+//   - TimeInState() over random 1 hour, 1 day, 7 day and whole-range windows equals
+//     the time computed from the samples (each covers the time to the next sample in
+//     its block, capped at ARCHIVE_MAX_SAMPLE_GAP_MS), and its cost per query,
+//   - there is one block per ARCHIVE_SEAL_MS of samples, so a crash loses a minute
+//     at most.
+// Exits with 1 if any check fails.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "../history_archive.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const char* const ARCHIVE_FILE = "archive_bench.archive";
+
+static bool Check(bool condition, const char* what) {
+    if (!condition) std::printf("  FAIL: %s\n", what);
+    return condition;
+}
+
+static std::vector<HistoryRecord> Generate(double days, unsigned seed) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> jitter(-60, 60);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::normal_distribution<double> noise(0, 1);
+    std::vector<HistoryRecord> samples;
+    int64_t timeMs = 1700000000000LL;
+    int64_t endMs = timeMs + (int64_t)(days * 86400000.0);
+    double cpu = 20, memory = 50, battery = 100;
+    int state = HAPPY;
+    while (timeMs < endMs) {
+        HistoryRecord sample = {};
+        sample.timeMs = timeMs;
+        cpu = std::min(100.0, std::max(0.0, cpu + 3 * noise(random)));
+        memory = std::min(100.0, std::max(0.0, memory + 0.2 * noise(random)));
+        battery = battery <= 5 ? 100 : battery - 0.001;
+        sample.cpu = HistoryPercent(cpu);
+        sample.memory = HistoryPercent(memory);
+        sample.battery = (int8_t)battery;
+        if (uniform(random) < 0.01) state = (int)(uniform(random) * EMOTIONAL_STATE_COUNT);
+        sample.state = (uint8_t)state;
+        sample.flags = HISTORY_SAMPLE;
+        samples.push_back(sample);
+
+        // Asleep for 5 s to 20 minutes about three times a day
+        timeMs += uniform(random) < 0.00002 ? 5000 + (int64_t)(uniform(random) * 1195000) : 500 + jitter(random);
+    }
+    return samples;
+}
+
+// The archive's block boundaries, from the sealing rule
+static std::vector<std::size_t> BlockStarts(const std::vector<HistoryRecord>& samples) {
+    std::vector<std::size_t> starts;
+    for (std::size_t i = 0; i < samples.size(); i++) {
+        if (starts.empty() || i - starts.back() == (std::size_t)HistoryArchive::BLOCK_SAMPLES ||
+            samples[i].timeMs - samples[starts.back()].timeMs >= ARCHIVE_SEAL_MS) {
+            starts.push_back(i);
+        }
+    }
+    return starts;
+}
+
+// Time per state in [fromMs, toMs), sample by sample
+static void ReferenceTimeInState(const std::vector<HistoryRecord>& samples, const std::vector<std::size_t>& starts,
+                                 int64_t fromMs, int64_t toMs, uint64_t (&durations)[EMOTIONAL_STATE_COUNT]) {
+    for (std::size_t b = 0; b < starts.size(); b++) {
+        std::size_t first = starts[b];
+        std::size_t end = b + 1 < starts.size() ? starts[b + 1] : samples.size();
+        if (samples[first].timeMs >= toMs || samples[end - 1].timeMs + ARCHIVE_MAX_SAMPLE_GAP_MS <= fromMs) continue;
+        for (std::size_t i = first; i < end; i++) {
+            int64_t span = i + 1 < end ? samples[i + 1].timeMs - samples[i].timeMs
+                                       : (i > first ? samples[i].timeMs - samples[i - 1].timeMs : 0);
+            span = std::min(span, ARCHIVE_MAX_SAMPLE_GAP_MS);
+            int64_t start = std::max(samples[i].timeMs, fromMs);
+            int64_t stop = std::min(samples[i].timeMs + span, toMs);
+            if (stop > start) durations[samples[i].state] += (uint64_t)(stop - start);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    double days = 30;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--days") == 0 && i + 1 < argc) {
+            days = std::max(0.01, std::atof(argv[++i]));
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            std::fprintf(stderr, "usage: %s [--days N] [--seed S]\n", argv[0]);
+            return 2;
+        }
+    }
+    std::vector<HistoryRecord> samples = Generate(days, seed);
+    std::vector<std::size_t> starts = BlockStarts(samples);
+
+    std::remove(ARCHIVE_FILE);
+    HistoryArchive archive;
+    if (!archive.Open(ARCHIVE_FILE)) {
+        std::fprintf(stderr, "can't create %s\n", ARCHIVE_FILE);
+        return 1;
+    }
+    Clock::time_point start = Clock::now();
+    for (const HistoryRecord& sample : samples) archive.Append(sample);
+    archive.Close();
+    double appendNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / samples.size();
+
+    start = Clock::now();
+    bool ok = Check(archive.Open(ARCHIVE_FILE), "can't reopen the archive");
+    double openMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    int64_t bytes = archive.FileBytes();
+    std::printf("%.0f days, %zu samples: %.0f ns per append, %d blocks, %.2f bytes per sample (ring: %zu), "
+                "reopened in %.1f ms\n", days, samples.size(), appendNs, archive.BlockCount(),
+                (double)bytes / samples.size(), sizeof(HistoryRecord), openMs);
+    ok &= Check(archive.BlockCount() == (int)starts.size(), "blocks weren't sealed every minute");
+
+    // Every sample back, in order
+    std::size_t next = 0;
+    int mismatches = 0;
+    start = Clock::now();
+    archive.ForEachSample(INT64_MIN, INT64_MAX, [&](const HistoryRecord& record) {
+        const HistoryRecord* expected = next < samples.size() ? &samples[next] : nullptr;
+        mismatches += !expected || record.timeMs != expected->timeMs || record.cpu != expected->cpu ||
+                      record.memory != expected->memory || record.battery != expected->battery ||
+                      record.state != expected->state;
+        next++;
+    });
+    double scanMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    ok &= Check(mismatches == 0 && next == samples.size(), "decoded samples differ from the appended ones");
+    std::printf("decoding all samples: %.1f ms (%.1f ns per sample)\n", scanMs, scanMs * 1e6 / samples.size());
+
+    // Time in state over random windows
+    std::mt19937 random(seed);
+    const int64_t firstMs = samples.front().timeMs;
+    const int64_t lastMs = samples.back().timeMs;
+    const struct {
+        const char* name;
+        int64_t spanMs;
+    } windows[] = { { "1 hour", 3600000 }, { "1 day", 86400000 }, { "7 days", 7 * 86400000LL }, { "all", 0 } };
+    for (const auto& window : windows) {
+        int64_t span = window.spanMs ? std::min(window.spanMs, lastMs - firstMs) : lastMs - firstMs + 60000;
+        const int QUERIES = 20;
+        double queryUs = 0;
+        int wrong = 0;
+        for (int q = 0; q < QUERIES; q++) {
+            int64_t from = window.spanMs ? firstMs + (int64_t)(random() % (uint64_t)(lastMs - firstMs - span + 1))
+                                         : firstMs - 30000;
+            uint64_t got[EMOTIONAL_STATE_COUNT] = {};
+            uint64_t want[EMOTIONAL_STATE_COUNT] = {};
+            start = Clock::now();
+            archive.TimeInState(from, from + span, got);
+            queryUs += std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+            ReferenceTimeInState(samples, starts, from, from + span, want);
+            wrong += std::memcmp(got, want, sizeof(got)) != 0;
+        }
+        std::printf("time in state over %-6s: %8.1f us per query\n", window.name, queryUs / QUERIES);
+        if (wrong) {
+            std::printf("  FAIL: %d of %d queries over %s differ from the samples\n", wrong, QUERIES, window.name);
+            ok = false;
+        }
+    }
+
+    archive.Close();
+    std::remove(ARCHIVE_FILE);
+    std::printf("archive checks: %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,130 @@
+// Checks and benchmarks the per-core aggregation kernel (core_stats.h).
+//
+// Usage: core_stats_bench [--iterations N]
+//
+// Build: cl /EHsc /O2 /nologo /Fecore_stats_bench.exe tools\core_stats_bench.cpp
+//        g++ -O2 -std=c++14 -o core_stats_bench tools/core_stats_bench.cpp
+//
+// For every core count from 0 to 512 and several usage patterns (all idle, all
+// saturated, values exactly on the thresholds, random), AggregateCores() must match
+// a plain scalar loop: identical max and threshold counts, and a mean within float
+// rounding of the serial sum. It then times both for 8 to 512 cores, in ns per call.
+// Without SSE2 both paths are the scalar loop, which the output says.
+// Exits with 1 if any result differs.
+
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include "../core_stats.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// The reference: what AggregateCores() computed before it was vectorized
+static CoreStats AggregateScalar(const float* usage, int count) {
+    CoreStats stats;
+    if (count <= 0) {
+        return stats;
+    }
+    float sum = 0.0f;
+    for (int i = 0; i < count; i++) {
+        float v = usage[i];
+        sum += v;
+        if (v > stats.max) stats.max = v;
+        stats.aboveAnguish += v > CORE_THRESHOLD_ANGUISH;
+        stats.aboveAnguishVery += v > CORE_THRESHOLD_ANGUISH_VERY;
+        stats.aboveAnguishExtremely += v > CORE_THRESHOLD_ANGUISH_EXTREMELY;
+    }
+    stats.mean = sum / (float)count;
+    return stats;
+}
+
+enum Pattern { PATTERN_IDLE, PATTERN_SATURATED, PATTERN_THRESHOLDS, PATTERN_RANDOM, PATTERN_COUNT };
+const char* const PATTERN_NAMES[PATTERN_COUNT] = { "idle", "saturated", "thresholds", "random" };
+
+static void Fill(CoreSamples& samples, int count, Pattern pattern, std::mt19937& random) {
+    const float ON_THRESHOLDS[] = { CORE_THRESHOLD_ANGUISH, CORE_THRESHOLD_ANGUISH_VERY, CORE_THRESHOLD_ANGUISH_EXTREMELY,
+                                    std::nextafter(CORE_THRESHOLD_ANGUISH, 100.0f), 100.0f, 0.0f };
+    std::uniform_real_distribution<float> percent(0.0f, 100.0f);
+    samples.count = count;
+    for (int i = 0; i < count; i++) {
+        switch (pattern) {
+        case PATTERN_IDLE: samples.usage[i] = 0.0f; break;
+        case PATTERN_SATURATED: samples.usage[i] = 100.0f; break;
+        case PATTERN_THRESHOLDS: samples.usage[i] = ON_THRESHOLDS[i % 6]; break;
+        default: samples.usage[i] = percent(random); break;
+        }
+    }
+}
+
+static bool Equivalent(const CoreStats& a, const CoreStats& b, int count) {
+    // Four partial sums round differently from one serial sum; bound the difference by
+    // the worst-case error of summing `count` values of at most 100
+    float tolerance = (float)(count + 1) * FLT_EPSILON * 100.0f;
+    return a.max == b.max && a.aboveAnguish == b.aboveAnguish && a.aboveAnguishVery == b.aboveAnguishVery &&
+           a.aboveAnguishExtremely == b.aboveAnguishExtremely && std::fabs(a.mean - b.mean) <= tolerance;
+}
+
+template <typename Aggregate>
+static double TimeNs(const CoreSamples& samples, int iterations, Aggregate aggregate) {
+    float sink = 0.0f;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < iterations; i++) {
+        CoreStats stats = aggregate(samples.usage, samples.count);
+        sink += stats.mean + (float)stats.aboveAnguish;
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+    return sink < 0.0f ? 0.0 : ns;
+}
+
+int main(int argc, char** argv) {
+    int iterations = 200000;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = (std::max)(1, std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr, "usage: %s [--iterations N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    static CoreSamples samples;
+    std::mt19937 random(1234);
+    int mismatches = 0;
+    for (int count = 0; count <= 512; count++) {
+        for (int pattern = 0; pattern < PATTERN_COUNT; pattern++) {
+            Fill(samples, count, (Pattern)pattern, random);
+            CoreStats simd = AggregateCores(samples.usage, count);
+            CoreStats scalar = AggregateScalar(samples.usage, count);
+            if (!Equivalent(simd, scalar, count)) {
+                if (mismatches++ < 10) {
+                    std::printf("  MISMATCH %d cores, %s: mean %.6f/%.6f max %.2f/%.2f above %d/%d %d/%d %d/%d\n", count,
+                                PATTERN_NAMES[pattern], simd.mean, scalar.mean, simd.max, scalar.max, simd.aboveAnguish,
+                                scalar.aboveAnguish, simd.aboveAnguishVery, scalar.aboveAnguishVery,
+                                simd.aboveAnguishExtremely, scalar.aboveAnguishExtremely);
+                }
+            }
+        }
+    }
+#ifdef CORE_STATS_SSE2
+    const char* kernel = "SSE2";
+#else
+    const char* kernel = "scalar (no SSE2)";
+#endif
+    std::printf("equivalence, 0-512 cores x %d patterns, %s vs scalar: %s\n", (int)PATTERN_COUNT, kernel,
+                mismatches ? "FAILED" : "ok");
+
+    std::printf("%8s %12s %12s %9s\n", "cores", "kernel ns", "scalar ns", "speedup");
+    for (int count = 8; count <= 512; count *= 2) {
+        Fill(samples, count, PATTERN_RANDOM, random);
+        int scaled = (std::max)(1000, iterations * 8 / count);
+        double simd = TimeNs(samples, scaled, AggregateCores);
+        double scalar = TimeNs(samples, scaled, AggregateScalar);
+        std::printf("%8d %12.1f %12.1f %8.2fx\n", count, simd, scalar, scalar / simd);
+    }
+    return mismatches ? 1 : 0;
+}
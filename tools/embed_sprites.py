@@ -0,0 +1,250 @@
+#!/usr/bin/env python3
+"""Decodes the face PNGs at build time and writes sprites_generated.h.
+
+The header holds a shared premultiplied-BGRA palette, one 4- or 8-bit index
+plane per distinct sprite (identical sprites share a plane), and per-EmotionalState
+sprite tables, so the app can map its sprites straight out of the binary's
+read-only data (see PaletteSpriteStore) instead of decoding RCDATA resources at
+startup. Sprites with more than 256 colours are stored as raw 32-bit planes.
+
+Resource IDs and file names come from resource.h and app.rc, and the state
+order from emotional_state.h, so adding a face only means adding it there.
+
+Usage: python tools/embed_sprites.py [repo root] [output header]
+"""
+
+import os
+import re
+import struct
+import sys
+import zlib
+
+MAX_COLOURS = 256  # Matches PaletteSpriteStore::MAX_COLOURS
+
+# States that borrow another state's blink image
+BLINK_OVERRIDES = {
+    "TIRED": "ID_IMAGE_NEUTRAL_BLINK",
+}
+
+
+def decode_png(path):
+    """Returns (width, height, pixels) with pixels as straight-alpha 0xAARRGGBB ints."""
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:8] != b"\x89PNG\r\n\x1a\n":
+        raise ValueError(f"{path}: not a PNG")
+
+    pos = 8
+    idat = b""
+    palette = []
+    transparency = b""
+    width = height = bit_depth = color_type = interlace = None
+    while pos < len(data):
+        length, kind = struct.unpack(">I4s", data[pos:pos + 8])
+        body = data[pos + 8:pos + 8 + length]
+        pos += 12 + length
+        if kind == b"IHDR":
+            width, height, bit_depth, color_type, _, _, interlace = struct.unpack(">IIBBBBB", body)
+        elif kind == b"PLTE":
+            palette = [tuple(body[i:i + 3]) for i in range(0, len(body), 3)]
+        elif kind == b"tRNS":
+            transparency = body
+        elif kind == b"IDAT":
+            idat += body
+        elif kind == b"IEND":
+            break
+
+    if bit_depth != 8 or interlace != 0:
+        raise ValueError(f"{path}: only 8-bit non-interlaced PNGs are supported")
+    channels = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4}[color_type]
+
+    raw = zlib.decompress(idat)
+    stride = width * channels
+    rows = []
+    previous = bytearray(stride)
+    offset = 0
+    for _ in range(height):
+        filter_type = raw[offset]
+        line = bytearray(raw[offset + 1:offset + 1 + stride])
+        offset += 1 + stride
+        for i in range(stride):
+            left = line[i - channels] if i >= channels else 0
+            up = previous[i]
+            upper_left = previous[i - channels] if i >= channels else 0
+            if filter_type == 1:
+                line[i] = (line[i] + left) & 0xFF
+            elif filter_type == 2:
+                line[i] = (line[i] + up) & 0xFF
+            elif filter_type == 3:
+                line[i] = (line[i] + ((left + up) >> 1)) & 0xFF
+            elif filter_type == 4:
+                p = left + up - upper_left
+                pa, pb, pc = abs(p - left), abs(p - up), abs(p - upper_left)
+                predictor = left if pa <= pb and pa <= pc else (up if pb <= pc else upper_left)
+                line[i] = (line[i] + predictor) & 0xFF
+        rows.append(line)
+        previous = line
+
+    pixels = []
+    for line in rows:
+        for x in range(width):
+            px = line[x * channels:(x + 1) * channels]
+            if color_type == 0:
+                r = g = b = px[0]
+                a = 0 if len(transparency) >= 2 and px[0] == transparency[1] else 255
+            elif color_type == 2:
+                r, g, b = px
+                a = 255
+                if len(transparency) >= 6 and bytes((0, r, 0, g, 0, b)) == transparency[:6]:
+                    a = 0
+            elif color_type == 3:
+                r, g, b = palette[px[0]]
+                a = transparency[px[0]] if px[0] < len(transparency) else 255
+            elif color_type == 4:
+                r = g = b = px[0]
+                a = px[1]
+            else:
+                r, g, b, a = px
+            pixels.append((a << 24) | (r << 16) | (g << 8) | b)
+    return width, height, pixels
+
+
+def premultiply(pixel):
+    a = pixel >> 24
+    if a == 255:
+        return pixel
+    r = (((pixel >> 16) & 0xFF) * a + 127) // 255
+    g = (((pixel >> 8) & 0xFF) * a + 127) // 255
+    b = ((pixel & 0xFF) * a + 127) // 255
+    return (a << 24) | (r << 16) | (g << 8) | b
+
+
+def read_states(root):
+    with open(os.path.join(root, "emotional_state.h")) as f:
+        text = f.read()
+    body = re.search(r"enum EmotionalState \{(.*?)\};", text, re.S).group(1)
+    return re.findall(r"^\s*([A-Z_]+),?", body, re.M)
+
+
+def read_resources(root):
+    with open(os.path.join(root, "app.rc")) as f:
+        text = f.read()
+    return dict(re.findall(r"^(ID_IMAGE_[A-Z_]+)\s+RCDATA\s+\"([^\"]+)\"", text, re.M))
+
+
+def main():
+    root = sys.argv[1] if len(sys.argv) > 1 else os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    output = sys.argv[2] if len(sys.argv) > 2 else os.path.join(root, "sprites_generated.h")
+
+    states = read_states(root)
+    resources = read_resources(root)
+
+    # Same mapping LoadImages() uses for the resource path
+    state_images = []
+    for state in states:
+        image = "ID_IMAGE_" + state
+        blink = BLINK_OVERRIDES.get(state, "ID_IMAGE_" + state + "_BLINK")
+        state_images.append((state, image, blink if blink in resources else None))
+
+    # Decode each referenced resource once, in first-use order
+    order = []
+    for _, image, blink in state_images:
+        for resource in (image, blink):
+            if resource and resource not in order:
+                order.append(resource)
+    sprites = [(resource,) + decode_png(os.path.join(root, resources[resource])) for resource in order]
+
+    # Shared palette in first-use order, then one index plane per sprite
+    palette = []
+    palette_index = {}
+    planes = []  # (bits, bytes, opaque) per sprite
+    for _, width, height, pixels in sprites:
+        colours = [premultiply(p) for p in pixels]
+        new = [c for c in dict.fromkeys(colours) if c not in palette_index]
+        opaque = all((c >> 24) == 255 for c in colours)
+        if len(palette) + len(new) > MAX_COLOURS:
+            data = b"".join(struct.pack("<I", c) for c in colours)
+            planes.append((32, data, opaque))
+            continue
+        for colour in new:
+            palette_index[colour] = len(palette)
+            palette.append(colour)
+        indices = [palette_index[c] for c in colours]
+        if max(indices) < 16:
+            row_bytes = (width + 1) // 2
+            data = bytearray(row_bytes * height)
+            for y in range(height):
+                for x in range(width):
+                    value = indices[y * width + x]
+                    data[y * row_bytes + x // 2] |= (value << 4) if x & 1 else value
+            planes.append((4, bytes(data), opaque))
+        else:
+            planes.append((8, bytes(indices), opaque))
+
+    # Identical planes are stored once
+    index_data = bytearray()
+    offsets = []
+    stored = {}
+    for (_, width, _, _), (bits, data, _) in zip(sprites, planes):
+        key = (bits, width, data)
+        if key not in stored:
+            stored[key] = len(index_data)
+            index_data += data
+        offsets.append(stored[key])
+
+    index = {resource: i for i, resource in enumerate(order)}
+    out = []
+    out.append("// Generated by tools/embed_sprites.py from img/*.png - do not edit.")
+    out.append("#pragma once")
+    out.append("")
+    out.append("#include <cstdint>")
+    out.append("#include \"emotional_state.h\"")
+    out.append("#include \"resource.h\"")
+    out.append("")
+    out.append(f"// {len(palette)} colours, {len(index_data)} bytes of index planes for {len(sprites)} sprites")
+    out.append(f"const int EMBEDDED_PALETTE_SIZE = {max(len(palette), 1)};")
+    out.append(f"const int EMBEDDED_SPRITE_COUNT = {len(sprites)};")
+    out.append(f"const int EMBEDDED_INDEX_BYTES = {max(len(index_data), 1)};")
+    out.append("")
+    out.append("struct EmbeddedSprite {")
+    out.append("    int resourceId;")
+    out.append("    int width, height;")
+    out.append("    int bits;       // 4 or 8 = palette indices, 32 = raw BGRA")
+    out.append("    int offset;     // Into g_embeddedIndices")
+    out.append("    bool opaque;")
+    out.append("};")
+    out.append("")
+    out.append("constexpr EmbeddedSprite g_embeddedSprites[EMBEDDED_SPRITE_COUNT] = {")
+    for (resource, width, height, _), (bits, _, is_opaque), offset in zip(sprites, planes, offsets):
+        out.append(f"    {{ {resource}, {width}, {height}, {bits}, {offset}, {'true' if is_opaque else 'false'} }},")
+    out.append("};")
+    out.append("")
+    out.append("// Sprite index per EmotionalState")
+    out.append("constexpr int g_embeddedStateSprites[EMOTIONAL_STATE_COUNT] = {")
+    for state, image, _ in state_images:
+        out.append(f"    {index[image]}, // {state}")
+    out.append("};")
+    out.append("")
+    out.append("// Blink sprite index per EmotionalState, -1 if the state doesn't blink")
+    out.append("constexpr int g_embeddedBlinkSprites[EMOTIONAL_STATE_COUNT] = {")
+    for state, _, blink in state_images:
+        out.append(f"    {index[blink] if blink else -1}, // {state}")
+    out.append("};")
+    out.append("")
+    out.append("// Premultiplied BGRA (0xAARRGGBB)")
+    out.append("alignas(16) constexpr uint32_t g_embeddedPalette[EMBEDDED_PALETTE_SIZE] = {")
+    out.append("    " + ", ".join(f"0x{p:08X}" for p in palette or [0]) + ",")
+    out.append("};")
+    out.append("")
+    out.append("// Index planes; 4-bit planes hold two pixels per byte, low nibble first")
+    out.append("alignas(16) constexpr uint8_t g_embeddedIndices[EMBEDDED_INDEX_BYTES] = {")
+    for i in range(0, max(len(index_data), 1), 16):
+        out.append("    " + ", ".join(f"0x{b:02X}" for b in (index_data or b"\0")[i:i + 16]) + ",")
+    out.append("};")
+
+    with open(output, "w", newline="\n") as f:
+        f.write("\n".join(out) + "\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,223 @@
+// Stress test and benchmark for the temporary-state event queue (event_queue.h).
+//
+// Usage: event_queue_stress [--producers N] [--events N] [--bench]
+//
+// Build: cl /EHsc /O2 /nologo /Feevent_queue_stress.exe tools\event_queue_stress.cpp
+//        g++ -O2 -std=c++14 -pthread -o event_queue_stress tools/event_queue_stress.cpp
+//        (add -fsanitize=thread to check the memory ordering)
+//
+// The stress run starts N producer threads (default 16) that each push --events
+// events (default 200000) into a StateEventQueue while a consumer drains it the way
+// the monitor thread does: asleep in a TimerScheduler until a producer's ArmWake()
+// says it must be woken. Every event carries its producer and sequence number in the
+// timestamp. It runs twice, once with producers retrying when the queue is full (every
+// event must arrive exactly once, in order per producer) and once dropping them
+// (received + dropped must equal pushed). A lost wakeup shows up as events left in
+// the queue while the consumer sleeps. It then checks EventArbiter's merging, rate
+// limiting and priority ordering on a simulated clock.
+//
+// --bench measures events per second for 1 to 16 producers, and how many consumer
+// wakeups that took.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "../event_queue.h"
+#include "../timer_scheduler.h"
+
+typedef std::chrono::steady_clock Clock;
+
+const int PRODUCER_SHIFT = 40;
+
+static StateEvent Encode(int producer, uint64_t sequence) {
+    StateEvent event = MakeStateEvent((StateEventType)(sequence % STATE_EVENT_TYPE_COUNT), Clock::time_point());
+    event.time = Clock::time_point(std::chrono::nanoseconds(((int64_t)producer << PRODUCER_SHIFT) | (int64_t)sequence));
+    return event;
+}
+
+struct RunResult {
+    uint64_t pushed = 0;
+    uint64_t received = 0;
+    uint64_t dropped = 0;     // Failed pushes, retried or not
+    uint64_t wakeups = 0;
+    uint64_t disorders = 0;   // Events out of order (or repeated) for their producer
+    bool lostWakeup = false;
+    double seconds = 0;
+};
+
+static RunResult Run(int producers, uint64_t events, bool retry) {
+    StateEventQueue<256> queue;
+    TimerScheduler<2> scheduler;   // Only timer 0 is used
+    std::vector<uint64_t> nextSequence((std::size_t)producers, 0);
+    std::atomic<uint64_t> received{ 0 };
+    RunResult result;
+
+    std::thread consumer([&] {
+        while (scheduler.WaitNext() >= 0) {
+            result.wakeups++;
+            queue.Disarm();
+            StateEvent event;
+            while (queue.Pop(event)) {
+                int64_t ticks = event.time.time_since_epoch().count();
+                int producer = (int)(ticks >> PRODUCER_SHIFT);
+                uint64_t sequence = (uint64_t)ticks & ((1ull << PRODUCER_SHIFT) - 1);
+                if (producer >= producers || sequence < nextSequence[producer] ||
+                    event.type != sequence % STATE_EVENT_TYPE_COUNT) {
+                    result.disorders++;
+                } else {
+                    nextSequence[producer] = sequence + 1;
+                }
+                received.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    });
+
+    std::atomic<int> ready{ 0 };
+    std::atomic<bool> go{ false };
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&, p] {
+            ready++;
+            while (!go.load()) {}
+            for (uint64_t i = 0; i < events; i++) {
+                StateEvent event = Encode(p, i);
+                while (!queue.Push(event) && retry) {
+                    std::this_thread::yield();
+                }
+                if (queue.ArmWake()) {
+                    scheduler.Schedule(0, Clock::now());
+                }
+            }
+        });
+    }
+    while (ready.load() < producers) {}
+    Clock::time_point start = Clock::now();
+    go = true;
+    for (std::thread& thread : threads) thread.join();
+
+    result.pushed = (uint64_t)producers * events;
+    result.dropped = queue.Dropped();
+    // Everything pushed must reach the consumer without another wakeup
+    Clock::time_point limit = Clock::now() + std::chrono::seconds(2);
+    while (received.load() + (retry ? 0 : result.dropped) < result.pushed && Clock::now() < limit) {
+        std::this_thread::yield();
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    result.lostWakeup = received.load() + (retry ? 0 : result.dropped) < result.pushed;
+    scheduler.Stop();
+    consumer.join();
+    result.received = received.load();
+    return result;
+}
+
+static bool Check(bool condition, const char* what) {
+    if (!condition) std::printf("  FAIL: %s\n", what);
+    return condition;
+}
+
+// EventArbiter on a simulated clock
+static bool CheckArbiter() {
+    bool ok = true;
+    Clock::time_point t0;
+    auto at = [&](int ms) { return t0 + std::chrono::milliseconds(ms); };
+    EmotionalState state = HAPPY;
+
+    {
+        // A burst of errors merges into one GRIMACE
+        EventArbiter arbiter;
+        for (int i = 0; i < 1000; i++) arbiter.Add(MakeStateEvent(STATE_EVENT_APP_ERROR, at(i / 10)));
+        ok &= Check(arbiter.Next(at(100), -1, state) && state == GRIMACE, "burst shows GRIMACE");
+        ok &= Check(arbiter.Merged() == 999 && !arbiter.HasPending(), "burst merged into one");
+    }
+    {
+        // A flood keeps showing GRIMACE, once per rate limit period
+        EventArbiter arbiter;
+        int shown = 0;
+        for (int ms = 0; ms < 10000; ms += 50) {
+            arbiter.Add(MakeStateEvent(STATE_EVENT_APP_ERROR, at(ms)));
+            shown += arbiter.Next(at(ms), -1, state);
+        }
+        ok &= Check(shown == 10000 / TEMPORARY_STATE_MS, "flood rate limited to one per period");
+    }
+    {
+        // GRIMACE waits behind SURPRISED, then shows if it is still fresh
+        EventArbiter arbiter;
+        arbiter.Add(MakeStateEvent(STATE_EVENT_DEVICE_CHANGE, at(0)));
+        ok &= Check(arbiter.Next(at(0), -1, state) && state == SURPRISED, "SURPRISED shows");
+        arbiter.Add(MakeStateEvent(STATE_EVENT_APP_ERROR, at(500)));
+        ok &= Check(!arbiter.Next(at(500), TemporaryStatePriority(SURPRISED), state), "GRIMACE can't replace SURPRISED");
+        ok &= Check(arbiter.Next(at(2000), -1, state) && state == GRIMACE, "GRIMACE shows once SURPRISED expires");
+    }
+    {
+        // ... but is forgotten if it went stale meanwhile
+        EventArbiter arbiter;
+        arbiter.Add(MakeStateEvent(STATE_EVENT_APP_ERROR, at(0)));
+        ok &= Check(!arbiter.Next(at(100), TemporaryStatePriority(SURPRISED), state), "GRIMACE deferred");
+        ok &= Check(!arbiter.Next(at(100 + TEMPORARY_STATE_MS), -1, state) && arbiter.Expired() == 1, "stale GRIMACE dropped");
+    }
+    {
+        // SURPRISED replaces GRIMACE and PLEASED; the higher priority wins a tie
+        EventArbiter arbiter;
+        arbiter.Add(MakeStateEvent(STATE_EVENT_DEVICE_CHANGE, at(0)));
+        ok &= Check(arbiter.Next(at(0), TemporaryStatePriority(GRIMACE), state) && state == SURPRISED, "SURPRISED replaces GRIMACE");
+        arbiter.Add(MakeStateEvent(STATE_EVENT_APP_ERROR, at(10)));
+        ok &= Check(arbiter.Next(at(10), TemporaryStatePriority(PLEASED), state) && state == GRIMACE, "GRIMACE replaces PLEASED");
+        arbiter.Add(MakeStateEvent(STATE_EVENT_APP_ERROR, at(3000)));
+        arbiter.Add(MakeStateEvent(STATE_EVENT_DEVICE_CHANGE, at(3000)));
+        ok &= Check(arbiter.Next(at(3000), -1, state) && state == SURPRISED, "SURPRISED first");
+        ok &= Check(!arbiter.Next(at(3000), TemporaryStatePriority(SURPRISED), state) && arbiter.HasPending(), "GRIMACE queued behind it");
+    }
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    int producers = 16;
+    uint64_t events = 200000;
+    bool bench = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--producers") == 0 && i + 1 < argc) {
+            producers = (std::max)(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--events") == 0 && i + 1 < argc) {
+            events = (std::max)(1ull, std::strtoull(argv[++i], nullptr, 10));
+        } else if (std::strcmp(argv[i], "--bench") == 0) {
+            bench = true;
+        } else {
+            std::fprintf(stderr, "usage: %s [--producers N] [--events N] [--bench]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (bench) {
+        std::printf("%9s %14s %12s %14s\n", "producers", "events/s", "wakeups", "events/wakeup");
+        for (int p = 1; p <= 16; p *= 2) {
+            RunResult result = Run(p, events, true);
+            std::printf("%9d %14.0f %12llu %14.1f\n", p, result.received / result.seconds,
+                        (unsigned long long)result.wakeups, result.received / (double)(std::max)(result.wakeups, (uint64_t)1));
+        }
+        return 0;
+    }
+
+    bool ok = true;
+    for (int retry = 1; retry >= 0; retry--) {
+        RunResult result = Run(producers, events, retry != 0);
+        std::printf("%s: %d producers, %llu pushed, %llu received, %llu full, %llu wakeups, %.2f s\n",
+                    retry ? "retry when full" : "drop when full", producers, (unsigned long long)result.pushed,
+                    (unsigned long long)result.received, (unsigned long long)result.dropped,
+                    (unsigned long long)result.wakeups, result.seconds);
+        ok &= Check(!result.lostWakeup, "events left behind while the consumer slept");
+        ok &= Check(result.disorders == 0, "events repeated or out of order");
+        if (retry) {
+            ok &= Check(result.received == result.pushed, "events lost");
+        } else {
+            ok &= Check(result.received + result.dropped == result.pushed, "received + dropped != pushed");
+        }
+    }
+    bool arbiter = CheckArbiter();
+    std::printf("arbiter: %s\n", arbiter ? "ok" : "FAILED");
+    return ok && arbiter ? 0 : 1;
+}
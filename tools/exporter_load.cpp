@@ -0,0 +1,290 @@
+// Concurrent scrape load for the metrics endpoint (metrics_exporter.h), with clients
+// that connect and then stall.
+//
+// Usage: exporter_load [--scrapers N] [--idle N] [--seconds N]
+//
+// Build: cl /EHsc /O2 /nologo /Feexporter_load.exe tools\exporter_load.cpp ws2_32.lib
+//        g++ -O2 -std=c++14 -pthread -o exporter_load tools/exporter_load.cpp
+//
+// Starts an exporter on a free localhost port over a SeqLock that a publisher thread
+// stores a snapshot into every millisecond. For --seconds (default 3):
+//   - N scraper threads (default 4) GET /metrics back to back; each response must be
+//     a 200 whose etm_samples_total never goes backwards for that scraper,
+//   - N idle threads (default 8) connect and send nothing, and two more send a
+//     request one byte every 200 ms; the exporter must close each of them about
+//     CLIENT_TIMEOUT_MS after it connected, and they connect again at once.
+// Together they must fit in MAX_CLIENTS; past that, connections wait in the listen
+// backlog for a slot by design. An idle client must not hold up anyone else's
+// scrape, so the slowest scrape has to stay well under CLIENT_TIMEOUT_MS. Prints
+// scrapes per second and the latency percentiles.
+//
+// Next to the exporter, a TimerScheduler fires every CADENCE_MS on its own thread,
+// as the monitor thread's sampling timer does, and records how late each firing
+// was: first for --seconds with the exporter idle, then during the load. The p99
+// lateness under load may be at most LATENESS_SLACK_MS worse than idle, or serving
+// scrapes is delaying the sampling. Exits with 1 if any check fails.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../metrics_exporter.h"
+#include "../timer_scheduler.h"
+
+typedef std::chrono::steady_clock Clock;
+
+const int CADENCE_MS = 10;
+const double LATENESS_SLACK_MS = 5.0;   // 5% of the fastest sampling interval
+
+static bool Check(bool condition, const char* what) {
+    if (!condition) std::printf("  FAIL: %s\n", what);
+    return condition;
+}
+
+static ExporterSocket Connect(uint16_t port) {
+    ExporterSocket client = socket(AF_INET, SOCK_STREAM, 0);
+    if (client == NO_EXPORTER_SOCKET) return client;
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(client, (const sockaddr*)&address, sizeof(address)) != 0) {
+#ifdef _WIN32
+        closesocket(client);
+#else
+        close(client);
+#endif
+        return NO_EXPORTER_SOCKET;
+    }
+    return client;
+}
+
+static void Close(ExporterSocket client) {
+#ifdef _WIN32
+    closesocket(client);
+#else
+    close(client);
+#endif
+}
+
+static bool Send(ExporterSocket client, const char* data, std::size_t size) {
+#ifdef _WIN32
+    const int flags = 0;
+#else
+    const int flags = MSG_NOSIGNAL;
+#endif
+    return send(client, data, (int)size, flags) == (int)size;
+}
+
+// Everything up to the server closing, or nothing on error
+static std::string ReceiveAll(ExporterSocket client) {
+    std::string response;
+    char buffer[4096];
+    int read;
+    while ((read = (int)recv(client, buffer, sizeof(buffer), 0)) > 0) response.append(buffer, (std::size_t)read);
+    return read == 0 ? response : std::string();
+}
+
+static void SetReceiveTimeout(ExporterSocket client, int ms) {
+#ifdef _WIN32
+    DWORD timeout = (DWORD)ms;
+#else
+    timeval timeout = { ms / 1000, (ms % 1000) * 1000 };
+#endif
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+}
+
+struct Results {
+    std::vector<double> latenciesMs;
+    long long failures = 0;       // No response, not a 200, or no etm_samples_total
+    long long backwards = 0;      // etm_samples_total lower than this scraper saw before
+};
+
+static void Scrape(uint16_t port, const std::atomic<bool>& stop, Results& results) {
+    static const char REQUEST[] = "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    unsigned long long lastSamples = 0;
+    while (!stop.load()) {
+        Clock::time_point start = Clock::now();
+        ExporterSocket client = Connect(port);
+        if (client == NO_EXPORTER_SOCKET) {
+            results.failures++;
+            continue;
+        }
+        SetReceiveTimeout(client, 5000);
+        std::string response = Send(client, REQUEST, sizeof(REQUEST) - 1) ? ReceiveAll(client) : std::string();
+        Close(client);
+        results.latenciesMs.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+
+        const char* samples = std::strstr(response.c_str(), "\netm_samples_total ");
+        if (response.compare(0, 15, "HTTP/1.1 200 OK") != 0 || !samples) {
+            results.failures++;
+            continue;
+        }
+        unsigned long long value = std::strtoull(samples + 19, nullptr, 10);
+        results.backwards += value < lastSamples;
+        lastSamples = value;
+    }
+}
+
+// Connects and sends nothing, or `dribble` a byte at a time, until the exporter hangs up
+static void Stall(uint16_t port, bool dribble, const std::atomic<bool>& stop, std::vector<double>& heldMs) {
+    static const char REQUEST[] = "GET /metrics HTTP/1.1\r\n\r\n";
+    while (!stop.load()) {
+        Clock::time_point start = Clock::now();
+        ExporterSocket client = Connect(port);
+        if (client == NO_EXPORTER_SOCKET) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+        char byte;
+        if (dribble) {
+            SetReceiveTimeout(client, 200);
+            for (std::size_t i = 0; i < sizeof(REQUEST) - 2; i++) {
+                Send(client, REQUEST + i, 1);
+                if (recv(client, &byte, 1, 0) >= 0) break;   // Closed (0) or, wrongly, answered
+            }
+        } else {
+            SetReceiveTimeout(client, 5000);
+            recv(client, &byte, 1, 0);
+        }
+        heldMs.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+        Close(client);
+    }
+}
+
+// Fires a timer every CADENCE_MS until `stop`; how late each firing was, in ms
+static void FollowCadence(const std::atomic<bool>& stop, std::vector<double>& latenessMs) {
+    TimerScheduler<2> scheduler;   // Only timer 0 is used
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(CADENCE_MS);
+    scheduler.Schedule(0, deadline);
+    while (!stop.load() && scheduler.WaitNext() == 0) {
+        Clock::time_point now = Clock::now();
+        latenessMs.push_back(std::chrono::duration<double, std::milli>(now - deadline).count());
+        // Fixed cadence: a late firing doesn't move the next deadline, a missed one is skipped
+        do {
+            deadline += std::chrono::milliseconds(CADENCE_MS);
+        } while (deadline <= now);
+        scheduler.Schedule(0, deadline);
+    }
+}
+
+static double Percentile(std::vector<double>& values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, (std::size_t)(p / 100.0 * (double)values.size()))];
+}
+
+int main(int argc, char** argv) {
+    int scrapers = 4, idle = 8;
+    double seconds = 3;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--scrapers") == 0 && i + 1 < argc) {
+            scrapers = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--idle") == 0 && i + 1 < argc) {
+            idle = std::max(0, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = std::max(0.5, std::atof(argv[++i]));
+        } else {
+            std::fprintf(stderr, "usage: %s [--scrapers N] [--idle N] [--seconds N]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (scrapers + idle + 2 > MetricsExporter::MAX_CLIENTS) {
+        std::fprintf(stderr, "%s: scrapers + idle + 2 must fit the exporter's %d client slots\n", argv[0],
+                     MetricsExporter::MAX_CLIENTS);
+        return 2;
+    }
+#ifdef _WIN32
+    WSADATA data;
+    WSAStartup(MAKEWORD(2, 2), &data);
+#endif
+
+    SeqLock<SystemSnapshot> snapshots;
+    MetricsExporter exporter;
+    if (!exporter.StartTcp(&snapshots, 0)) {
+        std::fprintf(stderr, "can't start the exporter\n");
+        return 1;
+    }
+    uint16_t port = exporter.Port();
+    std::atomic<bool> stop(false);
+    std::thread publisher([&] {
+        SystemSnapshot snapshot;
+        while (!stop.load()) {
+            snapshot.sequence++;
+            snapshot.samples = snapshot.sequence;
+            snapshot.state = (EmotionalState)(snapshot.sequence % EMOTIONAL_STATE_COUNT);
+            snapshots.Store(snapshot);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+
+    // The cadence with the exporter idle, then under load
+    std::vector<double> idleLateness, loadLateness;
+    std::atomic<bool> stopCadence(false);
+    std::thread cadence(FollowCadence, std::cref(stopCadence), std::ref(idleLateness));
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stopCadence = true;
+    cadence.join();
+    cadence = std::thread(FollowCadence, std::cref(stop), std::ref(loadLateness));
+
+    std::vector<Results> results((std::size_t)scrapers);
+    std::vector<std::vector<double>> held((std::size_t)idle + 2);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < idle + 2; i++) {
+        threads.emplace_back(Stall, port, i >= idle, std::cref(stop), std::ref(held[(std::size_t)i]));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));   // Let the stalled clients take their slots
+    for (int i = 0; i < scrapers; i++) {
+        threads.emplace_back(Scrape, port, std::cref(stop), std::ref(results[(std::size_t)i]));
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (std::thread& thread : threads) thread.join();
+    publisher.join();
+    cadence.join();
+    uint64_t served = exporter.Scrapes();
+    exporter.Stop();
+
+    std::vector<double> latencies;
+    long long failures = 0, backwards = 0;
+    for (Results& result : results) {
+        latencies.insert(latencies.end(), result.latenciesMs.begin(), result.latenciesMs.end());
+        failures += result.failures;
+        backwards += result.backwards;
+    }
+    std::vector<double> stalls;
+    for (std::vector<double>& times : held) stalls.insert(stalls.end(), times.begin(), times.end());
+
+    long long scrapes = (long long)latencies.size();
+    double p50 = Percentile(latencies, 50), p99 = Percentile(latencies, 99), slowest = Percentile(latencies, 100);
+    std::printf("%d scrapers, %d idle and 2 dribbling clients, %.1f s: %lld scrapes (%.0f/s), %lld failed\n", scrapers,
+                idle, seconds, scrapes, scrapes / seconds, failures);
+    std::printf("scrape latency: p50 %.2f ms, p99 %.2f ms, max %.2f ms\n", p50, p99, slowest);
+    double shortest = Percentile(stalls, 0), longest = Percentile(stalls, 100);
+    std::printf("stalled clients: %zu closed after %.0f..%.0f ms (timeout %d ms)\n", stalls.size(), shortest, longest,
+                MetricsExporter::CLIENT_TIMEOUT_MS);
+
+    double idleP99 = Percentile(idleLateness, 99), loadP99 = Percentile(loadLateness, 99);
+    std::printf("%d ms cadence lateness: idle p50 %.2f ms, p99 %.2f ms, max %.2f ms; under load p50 %.2f ms, "
+                "p99 %.2f ms, max %.2f ms\n", CADENCE_MS, Percentile(idleLateness, 50), idleP99,
+                Percentile(idleLateness, 100), Percentile(loadLateness, 50), loadP99, Percentile(loadLateness, 100));
+
+    bool ok = Check(scrapes > 0 && failures == 0, "a scrape failed");
+    ok &= Check(backwards == 0, "etm_samples_total went backwards");
+    ok &= Check((uint64_t)scrapes <= served, "the exporter counted fewer scrapes than were answered");
+    ok &= Check(slowest < MetricsExporter::CLIENT_TIMEOUT_MS / 4.0, "a stalled client held up a scrape");
+    ok &= Check(!stalls.empty() && shortest >= MetricsExporter::CLIENT_TIMEOUT_MS * 0.9 &&
+                longest < MetricsExporter::CLIENT_TIMEOUT_MS + 500.0, "stalled clients weren't closed at the timeout");
+    ok &= Check(!idleLateness.empty() && !loadLateness.empty() && loadP99 <= idleP99 + LATENESS_SLACK_MS,
+                "the cadence fell behind under load");
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    std::printf("exporter load: %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
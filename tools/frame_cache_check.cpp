@@ -0,0 +1,174 @@
+// Tests FrameCache and FrameKeyTracker (frame_cache.h) with a plain pixel-buffer
+// surface, the way a headless build would use them.
+//
+// Usage: frame_cache_check [--paints N]
+//
+// Build: cl /EHsc /O2 /nologo /Feframe_cache_check.exe tools\frame_cache_check.cpp
+//        g++ -O2 -std=c++14 -o frame_cache_check tools/frame_cache_check.cpp
+//
+// Replays --paints repaints (default 100000) of a random walk over states and blinks,
+// changing the frame size (a DPI change) every 10000 paints. Every paint blits the
+// cached frame into a window buffer that must equal a frame composed from scratch,
+// so a stale frame surviving an invalidation shows up as a pixel mismatch. It checks
+// one composite per (state, blink) pair per size, one blit per paint, that
+// Invalidate() releases exactly the frames that were built, and that FrameKeyTracker
+// skips repeated pairs until Reset(). Then it times a paint with the cache against
+// composing every time. Exits with 1 if any check fails.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "../frame_cache.h"
+
+typedef std::chrono::steady_clock Clock;
+
+struct PixelBuffer {
+    uint32_t* pixels = nullptr;
+    int width = 0;
+    int height = 0;
+};
+
+// Background fill plus a "sprite" whose pixels depend on the state, blink and size
+static void Compose(PixelBuffer& frame, EmotionalState state, bool blink, int size) {
+    frame.width = frame.height = size;
+    frame.pixels = new uint32_t[(std::size_t)size * size];
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            bool inSprite = x >= size / 8 && x < size * 7 / 8 && y >= size / 8 && y < size * 7 / 8;
+            uint32_t sprite = 0xFF000000u | ((uint32_t)state << 16) | ((uint32_t)blink << 8) | (uint32_t)((x ^ y) & 0xFF);
+            frame.pixels[y * size + x] = inSprite ? sprite : 0xFF202020u;
+        }
+    }
+}
+
+static void Release(PixelBuffer& frame) {
+    delete[] frame.pixels;
+}
+
+static void Blit(std::vector<uint32_t>& window, const PixelBuffer& frame) {
+    window.assign(frame.pixels, frame.pixels + (std::size_t)frame.width * frame.height);
+}
+
+static bool Check(bool condition, const char* what) {
+    if (!condition) std::printf("  FAIL: %s\n", what);
+    return condition;
+}
+
+struct Paint {
+    EmotionalState state;
+    bool blink;
+};
+
+// A random walk: states change rarely, blinks come and go
+static std::vector<Paint> MakePaints(int count) {
+    std::mt19937 random(42);
+    std::vector<Paint> paints;
+    Paint paint = { HAPPY, false };
+    for (int i = 0; i < count; i++) {
+        if (random() % 50 == 0) paint.state = (EmotionalState)(random() % EMOTIONAL_STATE_COUNT);
+        if (random() % 8 == 0) paint.blink = !paint.blink;
+        paints.push_back(paint);
+    }
+    return paints;
+}
+
+int main(int argc, char** argv) {
+    int count = 100000;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--paints") == 0 && i + 1 < argc) {
+            count = (std::max)(1, std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr, "usage: %s [--paints N]\n", argv[0]);
+            return 2;
+        }
+    }
+    std::vector<Paint> paints = MakePaints(count);
+    const int SIZES[] = { 64, 80, 96, 128 };   // 100%, 125%, 150%, 200%
+
+    bool ok = true;
+    FrameCache<PixelBuffer> cache;
+    FrameKeyTracker tracker;
+    std::vector<uint32_t> window;
+    bool built[EMOTIONAL_STATE_COUNT][2] = {};
+    unsigned long expectedComposites = 0;
+    unsigned long released = 0;
+    unsigned long mismatches = 0;
+    unsigned long badReleases = 0;
+    unsigned long repaints = 0;
+    int size = SIZES[0];
+    for (int i = 0; i < count; i++) {
+        if (i > 0 && i % 10000 == 0) {
+            // DPI change: every built frame is released once, and nothing else
+            unsigned long builtCount = 0;
+            for (auto& pair : built) builtCount += pair[0] + pair[1];
+            unsigned long before = released;
+            cache.Invalidate([&](PixelBuffer& frame) {
+                Release(frame);
+                released++;
+            });
+            badReleases += released - before != builtCount;
+            std::memset(built, 0, sizeof(built));
+            size = SIZES[(i / 10000) % 4];
+            tracker.Reset();
+        }
+
+        const Paint& paint = paints[(std::size_t)i];
+        if (!tracker.Changed(paint.state, paint.blink)) {
+            continue;   // The app skips InvalidateRect: nothing is painted
+        }
+        repaints++;
+        if (!built[paint.state][paint.blink]) {
+            built[paint.state][paint.blink] = true;
+            expectedComposites++;
+        }
+        Blit(window, cache.Acquire(paint.state, paint.blink, [&](PixelBuffer& frame) {
+            Compose(frame, paint.state, paint.blink, size);
+        }));
+
+        PixelBuffer fresh;
+        Compose(fresh, paint.state, paint.blink, size);
+        mismatches += window.size() != (std::size_t)size * size ||
+                      std::memcmp(window.data(), fresh.pixels, window.size() * sizeof(uint32_t)) != 0;
+        Release(fresh);
+    }
+    cache.Invalidate([&](PixelBuffer& frame) { Release(frame); });
+
+    std::printf("%d paint requests: %lu repaints, %lu skipped, %lu composites, %lu blits, %lu frames released\n", count,
+                repaints, tracker.Skipped(), cache.Composites(), cache.Blits(), released);
+    ok &= Check(mismatches == 0, "a blitted frame differs from a fresh composite");
+    ok &= Check(badReleases == 0, "Invalidate() released a frame that wasn't built, or missed one");
+    ok &= Check(cache.Composites() == expectedComposites, "more than one composite per pair and size");
+    ok &= Check(cache.Blits() == repaints, "blits don't match repaints");
+    ok &= Check(repaints + tracker.Skipped() == (unsigned long)count, "tracker skipped a changed pair");
+
+    // A paint with the cache against composing every time, at 150%
+    const int ROUNDS = 20000;
+    FrameCache<PixelBuffer> timed;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < ROUNDS; i++) {
+        const Paint& paint = paints[(std::size_t)i % paints.size()];
+        Blit(window, timed.Acquire(paint.state, paint.blink, [&](PixelBuffer& frame) {
+            Compose(frame, paint.state, paint.blink, 96);
+        }));
+    }
+    double cachedNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / ROUNDS;
+    timed.Invalidate([](PixelBuffer& frame) { Release(frame); });
+    start = Clock::now();
+    for (int i = 0; i < ROUNDS; i++) {
+        const Paint& paint = paints[(std::size_t)i % paints.size()];
+        PixelBuffer frame;
+        Compose(frame, paint.state, paint.blink, 96);
+        Blit(window, frame);
+        Release(frame);
+    }
+    double composedNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / ROUNDS;
+    std::printf("paint at 96x96: cached %.0f ns, composed every time %.0f ns\n", cachedNs, composedNs);
+
+    std::printf("%s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
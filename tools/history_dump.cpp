@@ -0,0 +1,150 @@
+// Prints the records in a history ring (history_ring.h), oldest first, or the time
+// spent in each state according to the long-term archive (history_archive.h).
+//
+// Usage: history_dump [--csv] [--last N] [history.ring]
+//        history_dump --archive [--days N] [history.archive]
+//
+// Build: cl /EHsc /nologo /Fehistory_dump.exe tools\history_dump.cpp
+//        g++ -O2 -std=c++14 -o history_dump tools/history_dump.cpp
+//
+// The file is read with plain stdio, so it can be dumped while the app is writing
+// to it; a record caught mid-write fails its checksum and is left out. With
+// --archive it prints the hours spent in each state over the last N days (default
+// 7), from the archive's blocks sealed so far.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+#include "../emotional_state.h"
+#include "../history_archive.h"
+#include "../history_ring.h"
+
+static void FormatFlags(uint16_t flags, char* out, std::size_t size) {
+    static const char* const names[] = { "sample", "state", "device", "app-error", "rules", "started" };
+    out[0] = '\0';
+    for (int bit = 0; bit < 6; bit++) {
+        if (flags & (1 << bit)) {
+            if (out[0]) std::strncat(out, "|", size - std::strlen(out) - 1);
+            std::strncat(out, names[bit], size - std::strlen(out) - 1);
+        }
+    }
+}
+
+static void FormatTime(int64_t timeMs, char* out, std::size_t size) {
+    std::time_t seconds = (std::time_t)(timeMs / 1000);
+    std::tm utc = {};
+#ifdef _WIN32
+    gmtime_s(&utc, &seconds);
+#else
+    gmtime_r(&seconds, &utc);
+#endif
+    std::size_t length = std::strftime(out, size, "%Y-%m-%dT%H:%M:%S", &utc);
+    std::snprintf(out + length, size - length, ".%03dZ", (int)(timeMs % 1000));
+}
+
+// Time in each state over the last `days`, answered from the block summaries
+static int DumpTimeInState(const char* path, double days) {
+    HistoryArchive archive;
+    if (!archive.OpenForReading(path)) {
+        std::fprintf(stderr, "%s: cannot open\n", path);
+        return 1;
+    }
+    int64_t toMs = (int64_t)std::time(nullptr) * 1000;
+    int64_t fromMs = toMs - (int64_t)(days * 86400000.0);
+    uint64_t durations[EMOTIONAL_STATE_COUNT] = {};
+    archive.TimeInState(fromMs, toMs, durations);
+    uint64_t total = 0;
+    for (uint64_t ms : durations) total += ms;
+
+    char from[40];
+    FormatTime(fromMs, from, sizeof(from));
+    std::printf("time in state since %s (%d blocks, %lld bytes)\n", from, archive.BlockCount(),
+                (long long)archive.FileBytes());
+    for (int state = 0; state < EMOTIONAL_STATE_COUNT; state++) {
+        if (!durations[state]) continue;
+        std::printf("  %-18s %9.2f h  %5.1f%%\n", EMOTIONAL_STATE_NAMES[state], durations[state] / 3600000.0,
+                    100.0 * durations[state] / total);
+    }
+    std::printf("  %-18s %9.2f h\n", "total", total / 3600000.0);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    const char* path = nullptr;
+    bool csv = false;
+    bool archive = false;
+    double days = 7;
+    uint64_t last = 0;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--csv") == 0) {
+            csv = true;
+        } else if (std::strcmp(argv[i], "--last") == 0 && i + 1 < argc) {
+            last = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--archive") == 0) {
+            archive = true;
+        } else if (std::strcmp(argv[i], "--days") == 0 && i + 1 < argc) {
+            days = std::atof(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            std::fprintf(stderr, "usage: %s [--csv] [--last N] [history.ring]\n"
+                                 "       %s --archive [--days N] [history.archive]\n", argv[0], argv[0]);
+            return 2;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (archive) {
+        return DumpTimeInState(path ? path : "history.archive", days);
+    }
+    if (!path) {
+        path = "history.ring";
+    }
+
+    FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        std::fprintf(stderr, "%s: cannot open\n", path);
+        return 1;
+    }
+    HistoryHeader header;
+    if (std::fread(&header, sizeof(header), 1, file) != 1 ||
+        std::memcmp(header.magic, HISTORY_MAGIC, sizeof(HISTORY_MAGIC)) != 0 ||
+        header.version != HISTORY_VERSION || header.recordSize != sizeof(HistoryRecord) || header.capacity == 0) {
+        std::fprintf(stderr, "%s: not a history ring\n", path);
+        std::fclose(file);
+        return 1;
+    }
+    std::vector<HistoryRecord> records((std::size_t)header.capacity);
+    std::size_t read = std::fread(records.data(), sizeof(HistoryRecord), records.size(), file);
+    std::fclose(file);
+    if (read != records.size()) {
+        std::fprintf(stderr, "%s: truncated (%zu of %llu records)\n", path, read, (unsigned long long)header.capacity);
+        return 1;
+    }
+
+    uint64_t newest = HistoryLastSequence(records.data(), header.capacity);
+    uint64_t from = last && newest > last ? newest - last + 1 : 0;
+
+    if (csv) {
+        std::printf("sequence,time,cpu,memory,battery,state,hottest_core,saturated_cores,flags\n");
+    }
+    ForEachHistoryRecord(records.data(), header.capacity, [&](const HistoryRecord& record) {
+        if (record.sequence < from) {
+            return;
+        }
+        char time[40];
+        char flags[64];
+        FormatTime(record.timeMs, time, sizeof(time));
+        FormatFlags(record.flags, flags, sizeof(flags));
+        const char* state = record.state < EMOTIONAL_STATE_COUNT ? EMOTIONAL_STATE_NAMES[record.state] : "?";
+        if (csv) {
+            std::printf("%llu,%s,%.2f,%.2f,%d,%s,%.2f,%u,%s\n", (unsigned long long)record.sequence, time,
+                        record.cpu / 100.0, record.memory / 100.0, record.battery, state, record.hottestCore / 100.0,
+                        record.saturatedCores, flags);
+        } else {
+            std::printf("%8llu  %s  cpu %6.2f%%  mem %6.2f%%  bat %4d  %-18s %s\n", (unsigned long long)record.sequence,
+                        time, record.cpu / 100.0, record.memory / 100.0, record.battery, state, flags);
+        }
+    });
+    return 0;
+}
@@ -0,0 +1,237 @@
+// Checks the history ring (history_ring.h): wrap-around, torn records, reopening, a
+// reader racing the writer, and append throughput.
+//
+// Usage: history_ring_check [--appends N]
+//
+// Build: cl /EHsc /O2 /nologo /Fehistory_ring_check.exe tools\history_ring_check.cpp
+//        g++ -O2 -std=c++14 -pthread -o history_ring_check tools/history_ring_check.cpp
+//
+// Works on history_ring_check.ring in the current directory and deletes it after.
+// Every record's fields are derived from its sequence number, so a record that is
+// visited but doesn't match its sequence is a record the checksum let through.
+//   - wrap: 3.5 capacities of appends leave exactly the newest capacity records,
+//     oldest first, and reopening resumes the sequence after the newest one,
+//   - torn: records half overwritten by their successors, a zeroed record and a bad
+//     header hint are skipped or ignored, and a torn newest record is rewritten,
+//   - a reader copying the file while the writer appends never sees a bad record,
+//   - N appends (default 20000000) into a default-size ring, in ns per append, and
+//     a full scan of it.
+// Exits with 1 if any check fails.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "../history_ring.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const char* const RING_FILE = "history_ring_check.ring";
+#ifdef _WIN32
+static const wchar_t* const RING_PATH = L"history_ring_check.ring";
+#else
+static const char* const RING_PATH = "history_ring_check.ring";
+#endif
+
+static bool Check(bool condition, const char* what) {
+    if (!condition) std::printf("  FAIL: %s\n", what);
+    return condition;
+}
+
+static HistoryRecord MakeRecord(uint64_t sequence) {
+    HistoryRecord record = {};
+    record.timeMs = 1700000000000LL + (int64_t)sequence * 500;
+    record.cpu = (uint16_t)(sequence * 7 % 10001);
+    record.memory = (uint16_t)(sequence * 13 % 10001);
+    record.battery = (int8_t)(sequence % 102) - 1;
+    record.state = (uint8_t)(sequence % 12);
+    record.flags = HISTORY_SAMPLE;
+    record.hottestCore = (uint16_t)(sequence * 3 % 10001);
+    record.saturatedCores = (uint16_t)(sequence % 5);
+    return record;
+}
+
+static bool Matches(const HistoryRecord& record) {
+    HistoryRecord expected = MakeRecord(record.sequence);
+    return record.timeMs == expected.timeMs && record.cpu == expected.cpu && record.memory == expected.memory &&
+           record.battery == expected.battery && record.state == expected.state && record.flags == expected.flags &&
+           record.hottestCore == expected.hottestCore && record.saturatedCores == expected.saturatedCores;
+}
+
+static void AppendRecords(HistoryRing& ring, uint64_t count) {
+    for (uint64_t i = 0; i < count; i++) {
+        ring.Append(MakeRecord(ring.NextSequence()));
+    }
+}
+
+// Sequences visited, in order, with every visited record checked against its sequence
+static std::vector<uint64_t> Visit(const HistoryRecord* records, uint64_t capacity, int& bad) {
+    std::vector<uint64_t> sequences;
+    ForEachHistoryRecord(records, capacity, [&](const HistoryRecord& record) {
+        sequences.push_back(record.sequence);
+        bad += !Matches(record);
+    });
+    return sequences;
+}
+
+static bool Consecutive(const std::vector<uint64_t>& sequences, uint64_t first, uint64_t last) {
+    if (sequences.size() != last - first + 1) return false;
+    for (std::size_t i = 0; i < sequences.size(); i++) {
+        if (sequences[i] != first + i) return false;
+    }
+    return true;
+}
+
+static bool CheckWrap() {
+    const uint64_t capacity = 1000;
+    std::remove(RING_FILE);
+    HistoryRing ring;
+    if (!Check(ring.Open(RING_PATH, capacity), "can't create the ring")) return false;
+    int bad = 0;
+    bool ok = Check(Visit(ring.Records(), capacity, bad).empty(), "a new ring isn't empty");
+    AppendRecords(ring, 999);
+    ok &= Check(Consecutive(Visit(ring.Records(), capacity, bad), 1, 999), "one short of full: not records 1..999");
+    AppendRecords(ring, 2501);
+    ok &= Check(Consecutive(Visit(ring.Records(), capacity, bad), 2501, 3500), "after wrapping: not records 2501..3500");
+    ring.Close();
+
+    ok &= Check(ring.Open(RING_PATH, capacity) && ring.NextSequence() == 3501, "reopening didn't resume at 3501");
+    AppendRecords(ring, 10);
+    ok &= Check(Consecutive(Visit(ring.Records(), capacity, bad), 2511, 3510), "after reopening: not records 2511..3510");
+    ring.Close();
+
+    ok &= Check(ring.Open(RING_PATH, capacity / 2) && ring.NextSequence() == 1 &&
+                Visit(ring.Records(), capacity / 2, bad).empty(), "a capacity change didn't start a new ring");
+    ring.Close();
+    ok &= Check(bad == 0, "a visited record doesn't match its sequence");
+    std::printf("wrap: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static bool CheckTorn() {
+    const uint64_t capacity = 64;
+    std::remove(RING_FILE);
+    HistoryRing ring;
+    if (!Check(ring.Open(RING_PATH, capacity), "can't create the ring")) return false;
+    AppendRecords(ring, 200);   // Slots hold 137..200
+
+    // Records 150 and 151 caught half way through being overwritten by their successors
+    // (from either end, so 151 keeps its sequence and only the checksum tells), 160 zeroed
+    HistoryRecord* records = const_cast<HistoryRecord*>(ring.Records());
+    const std::size_t half = sizeof(HistoryRecord) / 2;
+    for (uint64_t sequence : { 150, 151 }) {
+        HistoryRecord next = MakeRecord(sequence + capacity);
+        next.sequence = sequence + capacity;
+        next.check = HistoryChecksum(next);
+        std::size_t from = sequence == 150 ? 0 : half;
+        std::memcpy((char*)&records[(sequence - 1) % capacity] + from, (const char*)&next + from, half);
+    }
+    std::memset(&records[(160 - 1) % capacity], 0, sizeof(HistoryRecord));
+    int bad = 0;
+    std::vector<uint64_t> seen = Visit(records, capacity, bad);
+    bool ok = Check(seen.size() == 61 && seen.front() == 137 && seen.back() == 200, "torn records weren't skipped");
+    for (uint64_t sequence : seen) {
+        ok &= Check(sequence != 150 && sequence != 151 && sequence != 160, "a torn record was visited");
+    }
+
+    // The newest record torn by a crash, and a header hint that is wrong
+    records[(200 - 1) % capacity].cpu ^= 1;
+    ring.Close();
+    FILE* file = std::fopen(RING_FILE, "r+b");
+    HistoryHeader header;
+    ok &= Check(file && std::fread(&header, sizeof(header), 1, file) == 1, "can't read the header");
+    if (file) {
+        header.nextSequence = 5;
+        std::fseek(file, 0, SEEK_SET);
+        std::fwrite(&header, sizeof(header), 1, file);
+        std::fclose(file);
+    }
+    ok &= Check(ring.Open(RING_PATH, capacity) && ring.NextSequence() == 200, "reopening didn't resume after 199");
+    AppendRecords(ring, 1);
+    seen = Visit(ring.Records(), capacity, bad);
+    ok &= Check(!seen.empty() && seen.back() == 200, "the torn newest record wasn't rewritten");
+    ring.Close();
+    ok &= Check(bad == 0, "a visited record doesn't match its sequence");
+    std::printf("torn records: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// history_dump reads the file while the app appends to the mapping
+static bool CheckConcurrentReader() {
+    const uint64_t capacity = 4096;
+    std::remove(RING_FILE);
+    HistoryRing ring;
+    if (!Check(ring.Open(RING_PATH, capacity), "can't create the ring")) return false;
+    std::atomic<bool> stop(false);
+    std::thread writer([&] {
+        while (!stop.load(std::memory_order_relaxed)) AppendRecords(ring, 64);
+    });
+
+    const std::size_t size = sizeof(HistoryHeader) + capacity * sizeof(HistoryRecord);
+    std::vector<char> copy(size);
+    int bad = 0, reads = 0;
+    long long visited = 0, skipped = 0;
+    Clock::time_point end = Clock::now() + std::chrono::seconds(1);
+    while (Clock::now() < end) {
+        FILE* file = std::fopen(RING_FILE, "rb");
+        if (!file) continue;
+        std::size_t read = std::fread(copy.data(), 1, size, file);
+        std::fclose(file);
+        if (read != size) continue;
+        reads++;
+        const HistoryRecord* records = (const HistoryRecord*)(copy.data() + sizeof(HistoryHeader));
+        std::vector<uint64_t> seen = Visit(records, capacity, bad);
+        visited += (long long)seen.size();
+        if (!seen.empty()) skipped += (long long)(std::min<uint64_t>(seen.back(), capacity) - seen.size());
+    }
+    stop = true;
+    writer.join();
+    uint64_t appended = ring.NextSequence() - 1;
+    ring.Close();
+    bool ok = Check(bad == 0, "the reader saw a record that doesn't match its sequence");
+    ok &= Check(reads > 0 && visited > 0, "the reader never got a copy");
+    std::printf("reader racing the writer: %d copies, %lld records visited, %lld skipped as torn or stale, "
+                "%llu appended: %s\n", reads, visited, skipped, (unsigned long long)appended, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static bool Throughput(uint64_t appends) {
+    std::remove(RING_FILE);
+    HistoryRing ring;
+    if (!Check(ring.Open(RING_PATH), "can't create the ring")) return false;
+    Clock::time_point start = Clock::now();
+    AppendRecords(ring, appends);
+    double appendNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (double)appends;
+    start = Clock::now();
+    int bad = 0;
+    std::size_t visited = Visit(ring.Records(), ring.Capacity(), bad).size();
+    double scanMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    ring.Close();
+    std::printf("%llu appends: %.1f ns each (%.0fM records/s); scanning %zu records: %.1f ms\n",
+                (unsigned long long)appends, appendNs, 1000.0 / appendNs, visited, scanMs);
+    return Check(bad == 0 && visited == (std::size_t)std::min<uint64_t>(appends, HISTORY_DEFAULT_CAPACITY),
+                 "the full ring doesn't hold the newest records");
+}
+
+int main(int argc, char** argv) {
+    uint64_t appends = 20000000;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--appends") == 0 && i + 1 < argc) {
+            appends = std::strtoull(argv[++i], nullptr, 10);
+            if (appends == 0) appends = 1;
+        } else {
+            std::fprintf(stderr, "usage: %s [--appends N]\n", argv[0]);
+            return 2;
+        }
+    }
+    bool ok = CheckWrap();
+    ok &= CheckTorn();
+    ok &= CheckConcurrentReader();
+    ok &= Throughput(appends);
+    std::remove(RING_FILE);
+    std::printf("history ring checks: %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
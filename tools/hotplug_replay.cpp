@@ -0,0 +1,292 @@
+// Pushes bursts of synthetic device notifications through the hotplug debouncer
+// (hotplug.h) and checks that each burst costs one SURPRISED and one reposition.
+//
+// Usage: hotplug_replay [--burst N] [--seed S]
+//        hotplug_replay --listen SECONDS         (Linux: print live kernel uevents)
+//
+// Build: cl /EHsc /O2 /nologo /Fehotplug_replay.exe tools\hotplug_replay.cpp
+//        g++ -O2 -std=c++14 -pthread -o hotplug_replay tools/hotplug_replay.cpp
+//
+// Three checks run on a simulated clock and scheduler, like the app's monitor
+// thread: a burst of N events (default 500) spread over a couple of seconds, two
+// bursts separated by a quiet gap, and a stream that never goes quiet (which must
+// still reposition every HOTPLUG_MAX_DEFER_MS). On Linux a fourth check replays the
+// burst as uevent messages through UeventListener and a real monitor thread, and
+// watches the process's thread count while it does. Exits with 1 if any check fails.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include "../hotplug.h"
+#include "../timer_scheduler.h"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/socket.h>
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+enum ReplayTimer { REPLAY_HOTPLUG, REPLAY_REPOSITION, REPLAY_TIMER_COUNT };
+
+struct ReplayResult {
+    uint64_t surprises = 0;
+    uint64_t repositions = 0;
+    uint64_t wakeups = 0;
+};
+
+// What the app's monitor thread does with TIMER_HOTPLUG and TIMER_REPOSITION
+class HotplugPipeline {
+public:
+    void Queue(const HotplugEvent& event, Clock::time_point now) {
+        m_pending.fetch_or(1u << (event.kind * 2 + (event.display ? 1 : 0)));
+        m_scheduler.Schedule(REPLAY_HOTPLUG, now);
+    }
+
+    void Handle(int timer, Clock::time_point now) {
+        m_result.wakeups++;
+        if (timer == REPLAY_REPOSITION) {
+            if (!m_debouncer.TakeReposition(now)) {
+                std::printf("  reposition timer fired before the debouncer's deadline\n");
+            }
+            m_result.repositions++;
+            return;
+        }
+        unsigned pending = m_pending.exchange(0);
+        bool reposition = false;
+        for (int bit = 0; bit < HOTPLUG_KIND_COUNT * 2; bit++) {
+            if (pending & (1u << bit)) {
+                HotplugStep step = m_debouncer.Add({ (HotplugKind)(bit / 2), (bit & 1) != 0 }, now);
+                m_result.surprises += step.surprise;
+                reposition |= step.reposition;
+            }
+        }
+        if (reposition) {
+            m_scheduler.ScheduleNoEarlier(REPLAY_REPOSITION, m_debouncer.RepositionDeadline());
+        }
+    }
+
+    // Runs every timer due by `now`
+    void RunUntil(Clock::time_point now) {
+        for (;;) {
+            Clock::time_point deadline;
+            if (!m_scheduler.NextDeadline(deadline) || deadline > now) {
+                return;
+            }
+            Handle(m_scheduler.PopDue(deadline), deadline);
+        }
+    }
+
+    TimerScheduler<REPLAY_TIMER_COUNT>& Scheduler() { return m_scheduler; }
+    const ReplayResult& Result() const { return m_result; }
+
+private:
+    std::atomic<unsigned> m_pending{ 0 };
+    TimerScheduler<REPLAY_TIMER_COUNT> m_scheduler;
+    HotplugDebouncer m_debouncer;
+    ReplayResult m_result;
+};
+
+static HotplugEvent RandomEvent(std::mt19937& random) {
+    HotplugEvent event;
+    int roll = (int)(random() % 10);
+    event.kind = roll < 5 ? HOTPLUG_ARRIVAL : roll < 8 ? HOTPLUG_REMOVAL : HOTPLUG_DISPLAY;
+    event.display = event.kind == HOTPLUG_DISPLAY || random() % 4 == 0;
+    return event;
+}
+
+// `count` events at most `maxGapMs` apart, starting at `now`; returns the time of the last
+static Clock::time_point Burst(HotplugPipeline& pipeline, std::mt19937& random, int count, int maxGapMs,
+                               Clock::time_point now) {
+    for (int i = 0; i < count; i++) {
+        now += std::chrono::microseconds(random() % (maxGapMs * 1000 + 1));
+        pipeline.RunUntil(now);
+        pipeline.Queue(RandomEvent(random), now);
+        pipeline.RunUntil(now);
+    }
+    return now;
+}
+
+static bool Check(const char* name, const ReplayResult& result, uint64_t surprises, uint64_t repositionsMin,
+                  uint64_t repositionsMax) {
+    bool ok = result.surprises == surprises && result.repositions >= repositionsMin &&
+              result.repositions <= repositionsMax;
+    std::printf("%-34s %s  surprises %llu, repositions %llu, monitor wakeups %llu\n", name, ok ? "ok  " : "FAIL",
+                (unsigned long long)result.surprises, (unsigned long long)result.repositions,
+                (unsigned long long)result.wakeups);
+    return ok;
+}
+
+#ifdef __linux__
+
+static int ThreadCount() {
+    int count = 0;
+    DIR* tasks = opendir("/proc/self/task");
+    if (!tasks) {
+        return -1;
+    }
+    while (dirent* entry = readdir(tasks)) {
+        if (entry->d_name[0] != '.') count++;
+    }
+    closedir(tasks);
+    return count;
+}
+
+// The burst as uevent datagrams through UeventListener into a monitor thread
+static bool LiveBurst(int count, std::mt19937& random) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) != 0) {
+        std::printf("%-34s skipped (no socketpair)\n", "live burst through the listener");
+        return true;
+    }
+    int baseline = ThreadCount();
+    HotplugPipeline pipeline;
+    std::thread monitor([&pipeline] {
+        for (;;) {
+            int timer = pipeline.Scheduler().WaitNext();
+            if (timer < 0) break;
+            pipeline.Handle(timer, Clock::now());
+        }
+    });
+    UeventListener listener;
+    listener.StartOn(fds[0], [&pipeline](const HotplugEvent& event) { pipeline.Queue(event, Clock::now()); });
+
+    int maxThreads = 0;
+    char message[512];
+    for (int i = 0; i < count; i++) {
+        HotplugEvent event = RandomEvent(random);
+        const char* action = event.kind == HOTPLUG_REMOVAL ? "remove" : event.kind == HOTPLUG_ARRIVAL ? "add" : "change";
+        const char* subsystem = event.display ? "drm" : "usb";
+        int length = std::snprintf(message, sizeof(message),
+                                   "%s@/devices/pci0000:00/usb1/1-%d%cACTION=%s%cDEVPATH=/devices/pci0000:00/usb1/1-%d%c"
+                                   "SUBSYSTEM=%s%cHOTPLUG=1%cSEQNUM=%d%c",
+                                   action, i, 0, action, 0, i, 0, subsystem, 0, 0, 1000 + i, 0);
+        if (send(fds[1], message, (std::size_t)length, MSG_NOSIGNAL) != length) {
+            break;
+        }
+        if (i % 50 == 0) {
+            maxThreads = (std::max)(maxThreads, ThreadCount());
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    // Wait out the settle delay, then give the reposition a little slack
+    Clock::time_point giveUp = Clock::now() + std::chrono::milliseconds(HOTPLUG_SETTLE_MS[HOTPLUG_ARRIVAL] + 2000);
+    while (Clock::now() < giveUp && (listener.Messages() < (uint64_t)count || pipeline.Scheduler().IsArmed(REPLAY_REPOSITION) ||
+                                     pipeline.Scheduler().IsArmed(REPLAY_HOTPLUG))) {
+        maxThreads = (std::max)(maxThreads, ThreadCount());
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    close(fds[1]);
+    listener.Stop();
+    pipeline.Scheduler().Stop();
+    monitor.join();
+
+    std::printf("  %llu messages read; threads %d before, at most %d during\n",
+                (unsigned long long)listener.Messages(), baseline, maxThreads);
+    bool ok = Check("live burst through the listener", pipeline.Result(), 1, 1, 1);
+    if (listener.Messages() != (uint64_t)count || maxThreads > baseline + 2) {
+        std::printf("%-34s FAIL  expected %d messages and at most %d threads\n", "", count, baseline + 2);
+        ok = false;
+    }
+    return ok;
+}
+
+static int Listen(int seconds) {
+    HotplugDebouncer debouncer;
+    Clock::time_point start = Clock::now();
+    UeventListener listener;
+    std::atomic<int> events{ 0 };
+    if (!listener.Start([&](const HotplugEvent& event) {
+            static const char* const KINDS[HOTPLUG_KIND_COUNT] = { "arrival", "removal", "display" };
+            HotplugStep step = debouncer.Add(event, Clock::now());   // Only this thread touches it
+            std::printf("%8.3f  %-8s%s%s%s\n", std::chrono::duration<double>(Clock::now() - start).count(),
+                        KINDS[event.kind], event.display ? " display" : "", step.surprise ? "  -> SURPRISED" : "",
+                        step.reposition ? "  -> reposition armed" : "");
+            std::fflush(stdout);
+            events++;
+        })) {
+        std::fprintf(stderr, "cannot open the kernel uevent socket\n");
+        return 1;
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    listener.Stop();
+    std::printf("%d events, %llu messages, %llu overflows\n", events.load(),
+                (unsigned long long)listener.Messages(), (unsigned long long)listener.Overflows());
+    return 0;
+}
+
+#endif
+
+int main(int argc, char** argv) {
+    int burst = 500;
+    uint32_t seed = 1;
+    int listenSeconds = 0;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--burst") == 0 && i + 1 < argc) {
+            burst = (std::max)(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--listen") == 0 && i + 1 < argc) {
+            listenSeconds = (std::max)(1, std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr, "usage: %s [--burst N] [--seed S] | --listen SECONDS\n", argv[0]);
+            return 2;
+        }
+    }
+#ifdef __linux__
+    if (listenSeconds) {
+        return Listen(listenSeconds);
+    }
+#else
+    if (listenSeconds) {
+        std::fprintf(stderr, "--listen needs Linux\n");
+        return 2;
+    }
+#endif
+
+    std::mt19937 random(seed);
+    bool ok = true;
+    // The burst stays within a few seconds whatever its size, like a dock
+    int gapMs = (std::max)(1, (std::min)(20, 3000 / burst));
+    Clock::time_point origin = Clock::time_point() + std::chrono::hours(1);
+    const std::chrono::seconds settle(30);
+    char name[64];
+
+    {
+        HotplugPipeline pipeline;
+        Clock::time_point end = Burst(pipeline, random, burst, gapMs, origin);
+        pipeline.RunUntil(end + settle);
+        std::snprintf(name, sizeof(name), "burst of %d", burst);
+        ok &= Check(name, pipeline.Result(), 1, 1, 1);
+    }
+    {
+        HotplugPipeline pipeline;
+        Clock::time_point end = Burst(pipeline, random, burst, gapMs, origin);
+        end = Burst(pipeline, random, burst, gapMs, end + std::chrono::seconds(5));
+        pipeline.RunUntil(end + settle);
+        ok &= Check("two bursts 5 s apart", pipeline.Result(), 2, 2, 2);
+    }
+    {
+        // An event every 500 ms for a minute: one burst, but the window still moves
+        HotplugPipeline pipeline;
+        Clock::time_point now = origin;
+        for (int i = 0; i < 120; i++) {
+            now += std::chrono::milliseconds(500);
+            pipeline.RunUntil(now);
+            pipeline.Queue({ HOTPLUG_DISPLAY, true }, now);
+        }
+        pipeline.RunUntil(now + settle);
+        uint64_t expected = 60 * 1000 / HOTPLUG_MAX_DEFER_MS;
+        ok &= Check("stream that never goes quiet", pipeline.Result(), 0, expected, expected + 1);
+    }
+#ifdef __linux__
+    ok &= LiveBurst(burst, random);
+#endif
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,353 @@
+// Tails log files for error lines through LogSource (log_source.h), tests it against
+// rotating files, and benchmarks the matcher.
+//
+// Usage: log_tail [--pattern P]... [--from-start] file...
+//        log_tail --test
+//        log_tail --bench [--mb N]
+//
+// The first form prints every matching line of the files (or FIFOs) until killed,
+// with the default patterns unless --pattern is given, and marks the ones that would
+// make the face show GRIMACE after the app's merging and rate limiting.
+//
+// --test compares LogMatcher with a plain line-by-line search on random text, then
+// runs LogSource's thread against a temporary directory: appends, a line
+// written in two pieces, rename-and-create rotation with the old file still being
+// written, copytruncate, a file that appears after the start, and a FIFO whose
+// writer comes and goes. Each error line must be reported exactly once and nothing
+// else at all.
+//
+// --bench generates N MB (default 512) of syslog-style text with one error line in
+// 2000 and measures LogMatcher over it in memory, a per-line std::string baseline,
+// and LogSource reading it from a file in the page cache.
+//
+// Build: g++ -O2 -std=c++14 -pthread -o log_tail tools/log_tail.cpp
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include "../event_queue.h"
+#include "../log_source.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static void AddPatterns(LogSource& source, const std::vector<const char*>& patterns) {
+    if (patterns.empty()) {
+        for (const char* pattern : DEFAULT_LOG_PATTERNS) source.AddPattern(pattern);
+    }
+    for (const char* pattern : patterns) source.AddPattern(pattern);
+}
+
+static int Tail(const std::vector<const char*>& files, const std::vector<const char*>& patterns, bool fromStart) {
+    LogSource source;
+    AddPatterns(source, patterns);
+    for (const char* file : files) source.AddFile(file, fromStart);
+    // The handler is the only thread here, so it can run the app's arbiter itself
+    EventArbiter arbiter;
+    if (!source.Start([&](const LogMatch& match) {
+            Clock::time_point now = Clock::now();
+            arbiter.Add(MakeStateEvent(STATE_EVENT_APP_ERROR, now));
+            EmotionalState state = HAPPY;
+            bool shown = arbiter.Next(now, -1, state);
+            std::printf("%s [%s] %.*s%s%s\n", files[match.file], source.Matcher().Pattern(match.pattern),
+                        (int)match.length, match.line, shown ? "  -> " : "", shown ? EMOTIONAL_STATE_NAMES[state] : "");
+            std::fflush(stdout);
+        })) {
+        std::fprintf(stderr, "cannot watch the files\n");
+        return 1;
+    }
+    for (;;) pause();
+}
+
+// Collects what the handler reports, for the tests
+class Collector {
+public:
+    void Add(const LogMatch& match) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_lines.emplace_back(match.line, match.length);
+        m_changed.notify_all();
+    }
+
+    // Waits until `count` lines arrived, then a little longer for any extra
+    std::vector<std::string> Wait(std::size_t count) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait_for(lock, std::chrono::seconds(3), [&] { return m_lines.size() >= count; });
+        lock.unlock();
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        lock.lock();
+        std::vector<std::string> lines;
+        lines.swap(m_lines);
+        return lines;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::vector<std::string> m_lines;
+};
+
+static bool Expect(const char* name, std::vector<std::string> got, std::vector<std::string> expected) {
+    std::sort(got.begin(), got.end());
+    std::sort(expected.begin(), expected.end());
+    bool ok = got == expected;
+    std::printf("%-34s %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok) {
+        for (const std::string& line : got) std::printf("    got:      %s\n", line.c_str());
+        for (const std::string& line : expected) std::printf("    expected: %s\n", line.c_str());
+    }
+    return ok;
+}
+
+static void Append(FILE* file, const char* text) {
+    std::fputs(text, file);
+    std::fflush(file);
+}
+
+// Lets the tailing thread catch up between steps that must not be merged
+static void Settle() { std::this_thread::sleep_for(std::chrono::milliseconds(100)); }
+
+// LogMatcher against a line-at-a-time search on random text full of near misses,
+// with the patterns at every offset and the buffer ending anywhere
+static bool CheckMatcher() {
+    LogMatcher matcher;
+    for (const char* pattern : DEFAULT_LOG_PATTERNS) matcher.Add(pattern);
+    static const char* const PIECES[] = { "error", "Error", "rror", "err", "ERRO", "FATAL", "fata", "panic", "pani",
+                                          "segfault", "Traceback", "Trace", "x", "yz", " ", "\n", "\n\n" };
+    std::mt19937 random(3);
+    for (int round = 0; round < 20000; round++) {
+        std::string text;
+        int pieces = (int)(random() % 40);
+        for (int i = 0; i < pieces; i++) text += PIECES[random() % (sizeof(PIECES) / sizeof(PIECES[0]))];
+
+        std::vector<std::string> expected;
+        std::size_t start = 0;
+        while (start <= text.size()) {
+            std::size_t end = text.find('\n', start);
+            if (end == std::string::npos) end = text.size();
+            std::string line = text.substr(start, end - start);
+            for (const char* pattern : DEFAULT_LOG_PATTERNS) {
+                if (line.find(pattern) != std::string::npos) {
+                    expected.push_back(line + "|" + pattern);
+                    break;
+                }
+            }
+            start = end + 1;
+        }
+        std::vector<std::string> got;
+        matcher.Scan(text.data(), text.size(), [&](int pattern, const char* line, std::size_t length) {
+            got.push_back(std::string(line, length) + "|" + matcher.Pattern(pattern));
+        });
+        if (got != expected) {
+            std::printf("%-34s FAILED on \"%s\"\n", "matcher against line search", text.c_str());
+            return false;
+        }
+    }
+    std::printf("%-34s ok\n", "matcher against line search");
+    return true;
+}
+
+static int Test() {
+    char pattern[] = "/tmp/log_tail.XXXXXX";
+    if (!mkdtemp(pattern)) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    std::string dir = pattern;
+    std::string log = dir + "/app.log";
+    std::string rotated = dir + "/app.log.1";
+    std::string late = dir + "/late.log";
+    std::string copied = dir + "/copy.log";
+    std::string fifo = dir + "/journal";
+
+    FILE* writer = std::fopen(log.c_str(), "w");
+    Append(writer, "old ERROR before the start, skipped\n");
+    FILE* copyWriter = std::fopen(copied.c_str(), "w");
+    Append(copyWriter, "copy: startup\n");
+    mkfifo(fifo.c_str(), 0600);
+
+    LogSource source(4096);   // Small, so long lines and multi-read batches happen
+    for (const char* p : DEFAULT_LOG_PATTERNS) source.AddPattern(p);
+    source.AddFile(log.c_str());
+    source.AddFile(late.c_str());
+    source.AddFile(copied.c_str());
+    source.AddFile(fifo.c_str());
+    Collector collector;
+    source.Start([&](const LogMatch& match) { collector.Add(match); });
+    Settle();
+    bool ok = CheckMatcher();
+
+    Append(writer, "info: fine\nwarning: disk 80% full\nkernel: segfault at 0 ip 0\napp: fatal: out of memory\n");
+    ok &= Expect("append", collector.Wait(2), { "kernel: segfault at 0 ip 0", "app: fatal: out of memory" });
+
+    Append(writer, "sshd: ERR");
+    Settle();
+    Append(writer, "OR split across writes\n");
+    ok &= Expect("line in two writes", collector.Wait(1), { "sshd: ERROR split across writes" });
+
+    std::string longLine = "long " + std::string(10000, 'x') + " Traceback at the end";
+    Append(writer, (longLine + "\n").c_str());
+    std::vector<std::string> got = collector.Wait(1);
+    // Scanned in buffer-sized pieces, so only the piece with the hit comes back
+    ok &= Expect("line longer than the buffer", std::vector<std::string>(got.size(), "x"), { "x" });
+
+    // logrotate without copytruncate: rename, keep writing the old file for a while,
+    // then create the new one
+    std::rename(log.c_str(), rotated.c_str());
+    Append(writer, "after rename: Error in the old file\nno newline at the end: panic");
+    Settle();
+    std::fclose(writer);
+    writer = std::fopen(log.c_str(), "w");
+    Append(writer, "new file: ERROR one\nnew file: fine\n");
+    ok &= Expect("rename and create", collector.Wait(3),
+                 { "after rename: Error in the old file", "no newline at the end: panic", "new file: ERROR one" });
+    Append(writer, "new file: FATAL two\n");
+    ok &= Expect("append after rotation", collector.Wait(1), { "new file: FATAL two" });
+
+    // copytruncate: the file is copied elsewhere and truncated in place
+    Append(copyWriter, "copy: error before the truncate\n");
+    collector.Wait(1);
+    if (truncate(copied.c_str(), 0) != 0) std::perror("truncate");
+    std::fclose(copyWriter);
+    Settle();
+    copyWriter = std::fopen(copied.c_str(), "a");
+    Append(copyWriter, "copy: ERROR after\n");
+    ok &= Expect("copytruncate", collector.Wait(1), { "copy: ERROR after" });
+
+    FILE* lateWriter = std::fopen(late.c_str(), "w");
+    Append(lateWriter, "late: error from the first line\n");
+    ok &= Expect("file created after the start", collector.Wait(1), { "late: error from the first line" });
+
+    for (int round = 0; round < 2; round++) {
+        FILE* fifoWriter = std::fopen(fifo.c_str(), "w");
+        Append(fifoWriter, round == 0 ? "journal: error one\njournal: ok\n" : "journal: Error two\n");
+        std::fclose(fifoWriter);
+        ok &= Expect(round == 0 ? "fifo" : "fifo after the writer came back", collector.Wait(1),
+                     { round == 0 ? "journal: error one" : "journal: Error two" });
+    }
+
+    std::printf("%llu bytes, %llu matches, %llu rotations, %llu truncations\n",
+                (unsigned long long)source.Bytes(), (unsigned long long)source.Matches(),
+                (unsigned long long)source.Rotations(), (unsigned long long)source.Truncations());
+    source.Close();
+    std::fclose(writer);
+    std::fclose(copyWriter);
+    std::fclose(lateWriter);
+    for (const std::string& path : { log, rotated, late, copied, fifo }) std::remove(path.c_str());
+    rmdir(dir.c_str());
+    return ok ? 0 : 1;
+}
+
+static std::string GenerateLog(std::size_t bytes) {
+    static const char* const PROCESSES[] = { "systemd[1]", "kernel", "sshd[812]", "NetworkManager[604]", "cron[77]" };
+    static const char* const MESSAGES[] = {
+        "Started Session 42 of user alice.",
+        "wlan0: associated with access point, signal strength -54 dBm",
+        "Accepted publickey for alice from 10.0.0.7 port 51234 ssh2",
+        "pam_unix(cron:session): session opened for user root by (uid=0)",
+        "Finished Daily apt upgrade and clean activities.",
+    };
+    std::mt19937 random(1);
+    std::string text;
+    text.reserve(bytes + 256);
+    char line[256];
+    for (uint64_t i = 0; text.size() < bytes; i++) {
+        int length = std::snprintf(line, sizeof(line), "Oct 17 12:%02d:%02d host %s: %s\n", (int)(i / 60 % 60),
+                                   (int)(i % 60), PROCESSES[random() % 5],
+                                   random() % 2000 == 0 ? "I/O error, dev sda, sector 123456" : MESSAGES[random() % 5]);
+        text.append(line, (std::size_t)length);
+    }
+    return text;
+}
+
+static int Bench(std::size_t megabytes) {
+    std::string text = GenerateLog(megabytes << 20);
+    double gigabytes = text.size() / 1e9;
+    LogMatcher matcher;
+    for (const char* pattern : DEFAULT_LOG_PATTERNS) matcher.Add(pattern);
+
+    std::size_t matched = 0;
+    Clock::time_point start = Clock::now();
+    const int ROUNDS = 3;
+    for (int round = 0; round < ROUNDS; round++) {
+        matched = matcher.Scan(text.data(), text.size(), [](int, const char*, std::size_t) {});
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count() / ROUNDS;
+    std::printf("%-28s %7.2f GB/s  (%zu lines matched, %d patterns)\n", "LogMatcher, in memory", gigabytes / seconds,
+                matched, matcher.Patterns());
+
+    // What a line-at-a-time reader would do
+    start = Clock::now();
+    std::size_t baseline = 0;
+    std::size_t position = 0;
+    while (position < text.size()) {
+        std::size_t end = text.find('\n', position);
+        std::string line = text.substr(position, end - position);
+        for (const char* pattern : DEFAULT_LOG_PATTERNS) {
+            if (line.find(pattern) != std::string::npos) {
+                baseline++;
+                break;
+            }
+        }
+        position = end + 1;
+    }
+    seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::printf("%-28s %7.2f GB/s  (%zu lines matched)\n", "per-line std::string", gigabytes / seconds, baseline);
+
+    // Through LogSource from a file that is already in the page cache
+    char path[] = "/tmp/log_tail_bench.XXXXXX";
+    int fd = mkstemp(path);
+    bool written = fd >= 0 && write(fd, text.data(), text.size()) == (ssize_t)text.size();
+    if (fd >= 0) close(fd);
+    if (written) {
+        LogSource source;
+        for (const char* pattern : DEFAULT_LOG_PATTERNS) source.AddPattern(pattern);
+        source.AddFile(path, true);
+        start = Clock::now();
+        source.Poll([](const LogMatch&) {});
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::printf("%-28s %7.2f GB/s  (%llu lines matched, 1 MiB reads)\n", "LogSource, page cache",
+                    source.Bytes() / 1e9 / seconds, (unsigned long long)source.Matches());
+    }
+    std::remove(path);
+    return matched == baseline ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    std::vector<const char*> files;
+    std::vector<const char*> patterns;
+    bool fromStart = false;
+    std::size_t megabytes = 512;
+    enum { TAIL, TEST, BENCH } mode = TAIL;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--pattern") == 0 && i + 1 < argc) {
+            patterns.push_back(argv[++i]);
+        } else if (std::strcmp(argv[i], "--from-start") == 0) {
+            fromStart = true;
+        } else if (std::strcmp(argv[i], "--test") == 0) {
+            mode = TEST;
+        } else if (std::strcmp(argv[i], "--bench") == 0) {
+            mode = BENCH;
+        } else if (std::strcmp(argv[i], "--mb") == 0 && i + 1 < argc) {
+            megabytes = (std::size_t)(std::max)(1, std::atoi(argv[++i]));
+        } else if (argv[i][0] != '-') {
+            files.push_back(argv[i]);
+        } else {
+            files.clear();
+            break;
+        }
+    }
+    if (mode == TEST) return Test();
+    if (mode == BENCH) return Bench(megabytes);
+    if (files.empty()) {
+        std::fprintf(stderr, "usage: %s [--pattern P]... [--from-start] file... | --test | --bench [--mb N]\n", argv[0]);
+        return 2;
+    }
+    return Tail(files, patterns, fromStart);
+}
@@ -0,0 +1,304 @@
+// Accuracy check for PercentileWindow (percentile_window.h) against an exact sort.
+//
+// Usage: percentile_check [--samples N] [--fast-samples N] [--seed S]
+//
+// Build: cl /EHsc /O2 /nologo /Fepercentile_check.exe tools\percentile_check.cpp
+//        g++ -O2 -std=c++14 -o percentile_check tools/percentile_check.cpp
+//
+// Streams values per distribution (uniform, normal, bimodal, spiky) into 10 s and
+// 60 s windows at two cadences: --samples (default 100000) at an irregular 50 ms to
+// 3 s, asking after every sample, and --fast-samples (default 3000000) at 1 kHz,
+// asking after every 4999th. Each sample is weighted by the time since the previous
+// one. The answers for p1, p50, p90, p95, p99 and p100 are compared with an exact
+// weighted nearest-rank percentile of the samples, two ways:
+//   - against the samples in the window's live slices, where the only error left
+//     is binning: within half a bin width (range / BINS / 2),
+//   - against the exact sliding window, whose edge PercentileWindow moves a slice at
+//     a time. Only samples older than SLICES - 1 slices may be missing, so with E
+//     their weight and W the window's, the answer must lie within half a bin of the
+//     window's values at ranks p * (W - E) and p * W + E.
+// The errors against the exact sliding window are reported too. A last check feeds
+// a 95% burst sampled every 100 ms, and one sampled at 1 kHz, between idle minutes
+// sampled every 2 s: weighted by time, neither burst may reach the median.
+//
+// Then it checks through RuleEvaluator that matching the rules again without a new
+// sample (a temporary state expiring, a rules reload) doesn't insert the last sample
+// again, and times Insert() and Quantile().
+// Exits with 1 if any check fails.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <vector>
+#include "../percentile_window.h"
+#include "../state_rules.h"
+
+typedef std::chrono::steady_clock Clock;
+typedef PercentileWindow::TimePoint TimePoint;
+
+static const double PERCENTILES[] = { 1, 50, 90, 95, 99, 100 };
+
+static bool Check(bool condition, const char* what) {
+    if (!condition) std::printf("  FAIL: %s\n", what);
+    return condition;
+}
+
+static TimePoint At(long long ms) {
+    return TimePoint(std::chrono::milliseconds(ms));
+}
+
+struct Sample {
+    long long ms;
+    double value;
+    uint32_t weight;   // PercentileWindow::WeightUnits of its periods
+
+    bool operator<(const Sample& other) const { return value < other.value; }
+};
+
+// Exact weighted nearest-rank percentiles over a set of samples
+class ExactRanks {
+public:
+    // Takes the samples over. If they all weigh the same, nth_element finds each rank;
+    // otherwise they are sorted once.
+    ExactRanks(std::vector<Sample>& samples, bool sameWeight) : m_samples(samples), m_sameWeight(sameWeight) {
+        for (const Sample& sample : m_samples) m_total += sample.weight;
+        if (!m_sameWeight) std::sort(m_samples.begin(), m_samples.end());
+    }
+
+    uint64_t Total() const { return m_total; }
+
+    // The rank of percentile p (0..100), 1-based, as PercentileWindow::Quantile() takes it
+    uint64_t Rank(double p) const {
+        uint64_t rank = (uint64_t)std::ceil(p / 100.0 * (double)m_total);
+        return std::min(m_total, std::max((uint64_t)1, rank));
+    }
+
+    // The value holding weight unit `rank`; the set must not be empty
+    double At(uint64_t rank) {
+        rank = std::min(m_total, std::max((uint64_t)1, rank));
+        if (m_sameWeight) {
+            uint64_t weight = m_samples.front().weight;
+            auto nth = m_samples.begin() + (std::ptrdiff_t)((rank + weight - 1) / weight - 1);
+            std::nth_element(m_samples.begin(), nth, m_samples.end());
+            return nth->value;
+        }
+        uint64_t seen = 0;
+        for (const Sample& sample : m_samples) {
+            seen += sample.weight;
+            if (seen >= rank) return sample.value;
+        }
+        return m_samples.back().value;
+    }
+
+private:
+    std::vector<Sample>& m_samples;
+    bool m_sameWeight;
+    uint64_t m_total = 0;
+};
+
+// Nominal 500 ms sample periods in a gap
+static double Periods(long long gapMs) {
+    return gapMs / 500.0;
+}
+
+struct Cadence {
+    const char* name;
+    int minGapMs, maxGapMs;
+    long long samples;
+    int askEvery;          // Compare the answers after every Nth sample
+};
+
+struct Errors {
+    double sliced = 0;     // Worst error against the samples in the live slices
+    double sliding = 0;    // Worst error against the exact sliding window
+    double slidingSum = 0;
+    double beyondEdge = 0; // Worst distance outside the window-edge bound
+    long long answers = 0;
+};
+
+// One distribution into one window. Slices are counted from the first sample, as the
+// window counts them, so the reference knows which samples it still holds.
+template <typename Draw>
+static Errors Stream(Draw draw, const Cadence& cadence, int windowMs, unsigned seed) {
+    std::mt19937 random(seed);
+    std::uniform_int_distribution<int> gap(cadence.minGapMs, cadence.maxGapMs);
+    const bool sameWeight = cadence.minGapMs == cadence.maxGapMs;
+    const double halfBin = 100.0 / PercentileWindow::BINS / 2;
+    PercentileWindow window(100.0, std::chrono::milliseconds(windowMs));
+    const long long sliceMs = std::max(1, windowMs / PercentileWindow::SLICES);
+    const long long keptMs = (PercentileWindow::SLICES - 1) * sliceMs;   // Always in the live slices
+    std::deque<Sample> sliding;
+    std::vector<Sample> inSlices, inWindow;
+    Errors errors;
+    long long origin = 0, ms = 0;
+    for (long long i = 0; i < cadence.samples; i++) {
+        long long gapMs = gap(random);
+        ms += gapMs;
+        if (i == 0) origin = ms;
+        double periods = Periods(gapMs);
+        double value = std::min(100.0, std::max(0.0, draw(random)));
+        window.Insert(value, At(ms), periods);
+        sliding.push_back(Sample{ ms, value, PercentileWindow::WeightUnits(periods) });
+        while (sliding.front().ms <= ms - windowMs) sliding.pop_front();
+        if ((i + 1) % cadence.askEvery != 0) continue;
+
+        long long current = (ms - origin) / sliceMs;
+        uint64_t edge = 0;
+        inSlices.clear();
+        inWindow.clear();
+        for (const Sample& sample : sliding) {
+            inWindow.push_back(sample);
+            if ((sample.ms - origin) / sliceMs > current - PercentileWindow::SLICES) inSlices.push_back(sample);
+            if (sample.ms <= ms - keptMs) edge += sample.weight;
+        }
+        ExactRanks slices(inSlices, sameWeight), exact(inWindow, sameWeight);
+        for (double p : PERCENTILES) {
+            double answer = window.Quantile(p);
+            errors.sliced = std::max(errors.sliced, std::fabs(answer - slices.At(slices.Rank(p))));
+            double error = std::fabs(answer - exact.At(exact.Rank(p)));
+            errors.sliding = std::max(errors.sliding, error);
+            errors.slidingSum += error;
+            errors.answers++;
+
+            uint64_t total = exact.Total();
+            uint64_t lowRank = (uint64_t)std::ceil(p / 100.0 * (double)(total - std::min(edge, total)));
+            double low = exact.At(lowRank) - halfBin, high = exact.At(exact.Rank(p) + edge) + halfBin;
+            errors.beyondEdge = std::max(errors.beyondEdge, std::max(low - answer, answer - high));
+        }
+    }
+    return errors;
+}
+
+// A high sample followed by many re-matches must count once
+static bool CheckRematch() {
+    RuleSet rules;
+    StateRule rule = {};
+    rule.state = ANGUISH_VERY;
+    rule.metric = METRIC_CPU;
+    rule.compare = RULE_ABOVE;
+    rule.threshold = 70;
+    rule.percentile = 95;
+    rule.windowMs = 60000;
+    rules.rules[rules.count++] = rule;
+    RuleEvaluator evaluator(&rules);
+
+    long long ms = 0;
+    evaluator.AddSample(MakeMetrics(90, 0, false, 0, 0), At(ms));
+    for (int i = 0; i < 200; i++) evaluator.Match(At(ms += 10));
+    for (int i = 0; i < 40; i++) {
+        evaluator.AddSample(MakeMetrics(10, 0, false, 0, 0), At(ms += 500));
+        evaluator.Match(At(ms));
+    }
+    // 41 samples, one of them high: p95 is the 39th smallest, a low one
+    double p95 = evaluator.Percentile(METRIC_CPU, 60000, 95);
+    bool ok = Check(p95 < 15, "matching again inserted the last sample again");
+    ok &= Check(!evaluator.Match(At(ms)).overThreshold, "the p95 rule matched on a single high sample");
+    std::printf("1 high and 40 low samples with 200 re-matches in between: p95 %.1f\n", p95);
+    return ok;
+}
+
+// Ten seconds at 95% sampled every `burstMs` inside a minute otherwise idle at 5%,
+// sampled every 2 s: most of the samples, but a sixth of the time
+static bool CheckCadence(int burstMs) {
+    PercentileWindow window(100.0, std::chrono::milliseconds(60000));
+    long long ms = 0;
+    for (int i = 0; i < 12; i++) window.Insert(5, At(ms += 2000), Periods(2000));
+    for (int i = 0; i < 10000 / burstMs; i++) window.Insert(95, At(ms += burstMs), Periods(burstMs));
+    for (int i = 0; i < 13; i++) window.Insert(5, At(ms += 2000), Periods(2000));
+    double p50 = window.Quantile(50), p80 = window.Quantile(80), p90 = window.Quantile(90);
+    bool ok = Check(p50 < 10 && p80 < 10, "a burst sampled fast outvoted the idle time around it");
+    ok &= Check(p90 > 90, "the burst's sixth of the time didn't reach p90");
+    std::printf("10 s burst at %d ms in a minute idle at 2 s (%llu samples): p50 %.1f, p80 %.1f, p90 %.1f\n",
+                burstMs, (unsigned long long)window.Count(), p50, p80, p90);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    Cadence cadences[] = {
+        { "50ms-3s", 50, 3000, 100000, 1 },
+        { "1 kHz", 1, 1, 3000000, 4999 },
+    };
+    unsigned seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            cadences[0].samples = std::max(1LL, std::atoll(argv[++i]));
+        } else if (std::strcmp(argv[i], "--fast-samples") == 0 && i + 1 < argc) {
+            cadences[1].samples = std::max(1LL, std::atoll(argv[++i]));
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (unsigned)std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            std::fprintf(stderr, "usage: %s [--samples N] [--fast-samples N] [--seed S]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    const double bound = 100.0 / PercentileWindow::BINS / 2;
+    struct {
+        const char* name;
+        double (*draw)(std::mt19937&);
+    } const distributions[] = {
+        { "uniform", [](std::mt19937& r) { return std::uniform_real_distribution<double>(0, 100)(r); } },
+        { "normal", [](std::mt19937& r) { return std::normal_distribution<double>(50, 15)(r); } },
+        { "bimodal", [](std::mt19937& r) {
+              return std::uniform_real_distribution<double>(0, 1)(r) < 0.7 ? std::normal_distribution<double>(20, 5)(r)
+                                                                           : std::normal_distribution<double>(85, 3)(r);
+          } },
+        { "spiky", [](std::mt19937& r) {
+              return std::uniform_real_distribution<double>(0, 1)(r) < 0.03 ? 100.0
+                                                                            : std::uniform_real_distribution<double>(2, 8)(r);
+          } },
+    };
+
+    bool ok = true;
+    std::printf("%-8s %-8s %7s %9s %16s %18s %18s %12s\n", "values", "cadence", "window", "samples", "max error/slices",
+                "max error/sliding", "mean error/sliding", "beyond edge");
+    for (const Cadence& cadence : cadences) {
+        for (const auto& distribution : distributions) {
+            for (int windowMs : { 10000, 60000 }) {
+                Errors errors = Stream(distribution.draw, cadence, windowMs, seed);
+                std::printf("%-8s %-8s %6ds %9lld %16.3f %18.3f %18.3f %12.3f\n", distribution.name, cadence.name,
+                            windowMs / 1000, cadence.samples, errors.sliced, errors.sliding,
+                            errors.slidingSum / errors.answers, std::max(0.0, errors.beyondEdge));
+                if (errors.sliced > bound + 1e-9) {
+                    std::printf("  FAIL: %s at %s in %d s: off by %.3f, more than half a bin (%.3f)\n",
+                                distribution.name, cadence.name, windowMs / 1000, errors.sliced, bound);
+                    ok = false;
+                }
+                if (errors.beyondEdge > 1e-9) {
+                    std::printf("  FAIL: %s at %s in %d s: %.3f outside what the window edge allows\n",
+                                distribution.name, cadence.name, windowMs / 1000, errors.beyondEdge);
+                    ok = false;
+                }
+            }
+        }
+    }
+    ok &= CheckRematch();
+    ok &= CheckCadence(100);
+    ok &= CheckCadence(1);
+
+    // Cost per call at the app's cadence and at 1 kHz
+    PercentileWindow window(100.0, std::chrono::milliseconds(60000));
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<double> value(0, 100);
+    const int CALLS = 2000000;
+    double sink = 0;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < CALLS; i++) window.Insert(value(random), At(i * 500LL));
+    double insertNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / CALLS;
+    start = Clock::now();
+    for (int i = 0; i < CALLS; i++) sink += window.Quantile(PERCENTILES[i % 6]);
+    double quantileNs = sink == -1 ? 0 : std::chrono::duration<double, std::nano>(Clock::now() - start).count() / CALLS;
+    window.Reset();
+    start = Clock::now();
+    for (int i = 0; i < CALLS; i++) window.Insert(value(random), At(i), Periods(1));
+    double fastInsertNs = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / CALLS;
+    std::printf("Insert %.1f ns (%.1f ns at 1 kHz), Quantile %.1f ns\n", insertNs, fastInsertNs, quantileNs);
+
+    std::printf("percentile checks (bound %.3f): %s\n", bound, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,365 @@
+#pragma once
+
+// Minimal portable PNG reader for the sprite tools, so the sprite pipeline can be
+// checked without GDI+. It reads what tools/embed_sprites.py reads: 8-bit,
+// non-interlaced greyscale, RGB, palette, grey+alpha and RGBA images, with tRNS.
+// Pixels come out as straight-alpha 0xAARRGGBB, like the script's decode_png().
+//
+// Inflate is a plain canonical-Huffman decoder (RFC 1951); no zlib needed.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace PngReader {
+
+class Inflater {
+public:
+    Inflater(const uint8_t* data, std::size_t size) : m_data(data), m_size(size) {}
+
+    // Decompresses a zlib stream; false on malformed input
+    bool Zlib(std::vector<uint8_t>& out) {
+        if (m_size < 2 || (m_data[0] & 0x0F) != 8 || ((m_data[0] << 8) | m_data[1]) % 31 != 0) {
+            return false;
+        }
+        m_position = 2;
+        bool last = false;
+        while (!last) {
+            last = Bits(1) != 0;
+            int type = Bits(2);
+            bool ok = type == 0 ? Stored(out) : type == 1 ? Fixed(out) : type == 2 ? Dynamic(out) : false;
+            if (!ok || m_overrun) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    struct Huffman {
+        uint16_t counts[16];
+        uint16_t symbols[288];
+    };
+
+    int Bits(int count) {
+        int value = 0;
+        for (int i = 0; i < count; i++) {
+            if (m_bitCount == 0) {
+                if (m_position >= m_size) {
+                    m_overrun = true;
+                    return 0;
+                }
+                m_bitBuffer = m_data[m_position++];
+                m_bitCount = 8;
+            }
+            value |= (int)(m_bitBuffer & 1) << i;
+            m_bitBuffer >>= 1;
+            m_bitCount--;
+        }
+        return value;
+    }
+
+    static void Build(Huffman& table, const uint8_t* lengths, int count) {
+        std::memset(table.counts, 0, sizeof(table.counts));
+        for (int i = 0; i < count; i++) table.counts[lengths[i]]++;
+        table.counts[0] = 0;
+        uint16_t offsets[16] = {};
+        for (int i = 1; i < 16; i++) offsets[i] = (uint16_t)(offsets[i - 1] + table.counts[i - 1]);
+        for (int i = 0; i < count; i++) {
+            if (lengths[i]) table.symbols[offsets[lengths[i]]++] = (uint16_t)i;
+        }
+    }
+
+    int Decode(const Huffman& table) {
+        int code = 0;
+        int first = 0;
+        int index = 0;
+        for (int length = 1; length < 16; length++) {
+            code |= Bits(1);
+            int count = table.counts[length];
+            if (code - first < count) {
+                return table.symbols[index + code - first];
+            }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+            if (m_overrun) break;
+        }
+        m_overrun = true;
+        return 0;
+    }
+
+    bool Stored(std::vector<uint8_t>& out) {
+        m_bitCount = 0;   // Skip to the byte boundary
+        if (m_position + 4 > m_size) return false;
+        unsigned length = m_data[m_position] | (m_data[m_position + 1] << 8);
+        unsigned complement = m_data[m_position + 2] | (m_data[m_position + 3] << 8);
+        m_position += 4;
+        if ((length ^ 0xFFFF) != complement || m_position + length > m_size) return false;
+        out.insert(out.end(), m_data + m_position, m_data + m_position + length);
+        m_position += length;
+        return true;
+    }
+
+    bool Fixed(std::vector<uint8_t>& out) {
+        uint8_t lengths[320];
+        int i = 0;
+        for (; i < 144; i++) lengths[i] = 8;
+        for (; i < 256; i++) lengths[i] = 9;
+        for (; i < 280; i++) lengths[i] = 7;
+        for (; i < 288; i++) lengths[i] = 8;
+        for (; i < 320; i++) lengths[i] = 5;
+        Huffman literals, distances;
+        Build(literals, lengths, 288);
+        Build(distances, lengths + 288, 30);
+        return Codes(out, literals, distances);
+    }
+
+    bool Dynamic(std::vector<uint8_t>& out) {
+        static const uint8_t ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+        int literalCount = Bits(5) + 257;
+        int distanceCount = Bits(5) + 1;
+        int codeCount = Bits(4) + 4;
+        if (literalCount > 286 || distanceCount > 30) return false;
+        uint8_t lengths[320] = {};
+        for (int i = 0; i < codeCount; i++) lengths[ORDER[i]] = (uint8_t)Bits(3);
+        Huffman codeLengths;
+        Build(codeLengths, lengths, 19);
+
+        std::memset(lengths, 0, sizeof(lengths));
+        for (int i = 0; i < literalCount + distanceCount && !m_overrun;) {
+            int symbol = Decode(codeLengths);
+            if (symbol < 16) {
+                lengths[i++] = (uint8_t)symbol;
+                continue;
+            }
+            int repeat;
+            uint8_t value = 0;
+            if (symbol == 16) {
+                if (i == 0) return false;
+                value = lengths[i - 1];
+                repeat = 3 + Bits(2);
+            } else if (symbol == 17) {
+                repeat = 3 + Bits(3);
+            } else {
+                repeat = 11 + Bits(7);
+            }
+            if (i + repeat > literalCount + distanceCount) return false;
+            while (repeat--) lengths[i++] = value;
+        }
+        Huffman literals, distances;
+        Build(literals, lengths, literalCount);
+        Build(distances, lengths + literalCount, distanceCount);
+        return !m_overrun && Codes(out, literals, distances);
+    }
+
+    bool Codes(std::vector<uint8_t>& out, const Huffman& literals, const Huffman& distances) {
+        static const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                                  35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+        static const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                                  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+        static const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                                    193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                                    6145, 8193, 12289, 16385, 24577 };
+        static const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6,
+                                                    6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+        for (;;) {
+            int symbol = Decode(literals);
+            if (m_overrun) return false;
+            if (symbol < 256) {
+                out.push_back((uint8_t)symbol);
+            } else if (symbol == 256) {
+                return true;
+            } else {
+                symbol -= 257;
+                if (symbol >= 29) return false;
+                int length = LENGTH_BASE[symbol] + Bits(LENGTH_EXTRA[symbol]);
+                int code = Decode(distances);
+                if (code >= 30) return false;
+                std::size_t distance = DISTANCE_BASE[code] + (std::size_t)Bits(DISTANCE_EXTRA[code]);
+                if (distance > out.size()) return false;
+                std::size_t from = out.size() - distance;
+                for (int i = 0; i < length; i++) out.push_back(out[from + (std::size_t)i]);
+            }
+        }
+    }
+
+    const uint8_t* m_data;
+    std::size_t m_size;
+    std::size_t m_position = 0;
+    uint32_t m_bitBuffer = 0;
+    int m_bitCount = 0;
+    bool m_overrun = false;
+};
+
+struct Image {
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> pixels;   // Straight alpha, 0xAARRGGBB
+};
+
+inline uint32_t BigEndian32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Decodes a PNG held in memory; false (with a reason in `error`) if it isn't supported
+inline bool Decode(const uint8_t* data, std::size_t size, Image& image, const char*& error) {
+    static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if (size < 8 || std::memcmp(data, SIGNATURE, 8) != 0) {
+        error = "not a PNG";
+        return false;
+    }
+    int bitDepth = 0, colourType = -1, interlace = 0;
+    std::vector<uint8_t> idat;
+    uint32_t palette[256] = {};
+    int paletteSize = 0;
+    const uint8_t* transparency = nullptr;
+    std::size_t transparencySize = 0;
+    for (std::size_t position = 8; position + 12 <= size;) {
+        uint32_t length = BigEndian32(data + position);
+        const uint8_t* kind = data + position + 4;
+        const uint8_t* body = data + position + 8;
+        if (position + 12 + (std::size_t)length > size) {
+            error = "truncated chunk";
+            return false;
+        }
+        if (std::memcmp(kind, "IHDR", 4) == 0 && length >= 13) {
+            image.width = (int)BigEndian32(body);
+            image.height = (int)BigEndian32(body + 4);
+            bitDepth = body[8];
+            colourType = body[9];
+            interlace = body[12];
+        } else if (std::memcmp(kind, "PLTE", 4) == 0) {
+            paletteSize = (int)(length / 3 > 256 ? 256 : length / 3);
+            for (int i = 0; i < paletteSize; i++) {
+                palette[i] = 0xFF000000u | ((uint32_t)body[i * 3] << 16) | ((uint32_t)body[i * 3 + 1] << 8) | body[i * 3 + 2];
+            }
+        } else if (std::memcmp(kind, "tRNS", 4) == 0) {
+            transparency = body;
+            transparencySize = length;
+        } else if (std::memcmp(kind, "IDAT", 4) == 0) {
+            idat.insert(idat.end(), body, body + length);
+        } else if (std::memcmp(kind, "IEND", 4) == 0) {
+            break;
+        }
+        position += 12 + (std::size_t)length;
+    }
+    if (bitDepth != 8 || interlace != 0 || image.width <= 0 || image.height <= 0) {
+        error = "only 8-bit non-interlaced PNGs are supported";
+        return false;
+    }
+    int channels = colourType == 0 ? 1 : colourType == 2 ? 3 : colourType == 3 ? 1 : colourType == 4 ? 2 : colourType == 6 ? 4 : 0;
+    if (channels == 0) {
+        error = "unknown colour type";
+        return false;
+    }
+
+    std::vector<uint8_t> raw;
+    if (!Inflater(idat.data(), idat.size()).Zlib(raw)) {
+        error = "bad zlib stream";
+        return false;
+    }
+    std::size_t stride = (std::size_t)image.width * channels;
+    if (raw.size() < (stride + 1) * image.height) {
+        error = "not enough image data";
+        return false;
+    }
+
+    // Undo the row filters in place
+    std::vector<uint8_t> previous(stride, 0);
+    image.pixels.resize((std::size_t)image.width * image.height);
+    for (int y = 0; y < image.height; y++) {
+        uint8_t filter = raw[y * (stride + 1)];
+        uint8_t* line = &raw[y * (stride + 1) + 1];
+        for (std::size_t i = 0; i < stride; i++) {
+            int left = i >= (std::size_t)channels ? line[i - channels] : 0;
+            int up = previous[i];
+            int upperLeft = i >= (std::size_t)channels ? previous[i - channels] : 0;
+            int predictor = 0;
+            switch (filter) {
+            case 1: predictor = left; break;
+            case 2: predictor = up; break;
+            case 3: predictor = (left + up) >> 1; break;
+            case 4: {
+                int p = left + up - upperLeft;
+                int pa = std::abs(p - left), pb = std::abs(p - up), pc = std::abs(p - upperLeft);
+                predictor = pa <= pb && pa <= pc ? left : (pb <= pc ? up : upperLeft);
+                break;
+            }
+            }
+            line[i] = (uint8_t)(line[i] + predictor);
+        }
+        std::memcpy(previous.data(), line, stride);
+
+        for (int x = 0; x < image.width; x++) {
+            const uint8_t* px = line + (std::size_t)x * channels;
+            uint32_t r, g, b, a = 255;
+            switch (colourType) {
+            case 0:
+                r = g = b = px[0];
+                if (transparencySize >= 2 && px[0] == transparency[1]) a = 0;
+                break;
+            case 2:
+                r = px[0], g = px[1], b = px[2];
+                if (transparencySize >= 6 && transparency[1] == r && transparency[3] == g && transparency[5] == b &&
+                    transparency[0] == 0 && transparency[2] == 0 && transparency[4] == 0) {
+                    a = 0;
+                }
+                break;
+            case 3:
+                r = (palette[px[0]] >> 16) & 0xFF, g = (palette[px[0]] >> 8) & 0xFF, b = palette[px[0]] & 0xFF;
+                a = px[0] < transparencySize ? transparency[px[0]] : 255;
+                break;
+            case 4:
+                r = g = b = px[0];
+                a = px[1];
+                break;
+            default:
+                r = px[0], g = px[1], b = px[2], a = px[3];
+                break;
+            }
+            image.pixels[(std::size_t)y * image.width + x] = (a << 24) | (r << 16) | (g << 8) | b;
+        }
+    }
+    return true;
+}
+
+inline bool ReadFile(const char* path, std::vector<uint8_t>& bytes) {
+    FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    uint8_t buffer[65536];
+    std::size_t read;
+    bytes.clear();
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        bytes.insert(bytes.end(), buffer, buffer + read);
+    }
+    std::fclose(file);
+    return true;
+}
+
+// Maps the ID_IMAGE_* RCDATA entries of app.rc to their files, like embed_sprites.py's
+// read_resources(). `names` and `paths` are filled in file order.
+inline bool ReadResourceScript(const char* path, std::vector<std::string>& names, std::vector<std::string>& paths) {
+    FILE* file = std::fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    char line[512];
+    while (std::fgets(line, sizeof(line), file)) {
+        char name[128], source[256];
+        if (std::sscanf(line, "%127s RCDATA \"%255[^\"]\"", name, source) == 2 && std::strncmp(name, "ID_IMAGE_", 9) == 0) {
+            names.push_back(name);
+            paths.push_back(source);
+        }
+    }
+    std::fclose(file);
+    return true;
+}
+
+} // namespace PngReader
@@ -0,0 +1,291 @@
+// Watches Linux pressure stall information through PressureSource (pressure_source.h),
+// and measures how much sooner a pressure trigger gets the face to react than the
+// periodic sampler would.
+//
+// Usage: pressure_watch [--root DIR] [--seconds N]
+//        pressure_watch --latency [--rounds N]
+//
+// The first form registers the default triggers (memory, cpu, io) and prints every
+// event for N seconds (default 10), saying whether the kernel signalled it or the
+// fallback poll found it. --root reads fixture files instead of /proc.
+//
+// --latency builds a fixture /proc in a temporary directory and runs a monitor thread
+// like the app's: a 500 ms sampling timer over LinuxSampler, the state machine, and a
+// pressure handler that schedules an immediate sample. Each round pushes memory to
+// 97% together with a jump in memory stall time and times how long until the state
+// machine shows GRIMACE_TWO_SWEAT, first with the pressure source and then without.
+//
+// Build: g++ -O2 -std=c++14 -pthread -o pressure_watch tools/pressure_watch.cpp
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include "../linux_sampler.h"
+#include "../pressure_source.h"
+#include "../state_machine.h"
+#include "../timer_scheduler.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static int Watch(const char* root, int seconds) {
+    PressureSource source(root);
+    int count = (int)(sizeof(DEFAULT_PRESSURE_TRIGGERS) / sizeof(DEFAULT_PRESSURE_TRIGGERS[0]));
+    if (!source.Open(DEFAULT_PRESSURE_TRIGGERS, count)) {
+        std::fprintf(stderr, "no pressure files under %s/proc/pressure\n", root);
+        return 1;
+    }
+    for (int i = 0; i < source.Triggers(); i++) {
+        const PressureTrigger& trigger = DEFAULT_PRESSURE_TRIGGERS[i];
+        std::printf("trigger %d: %s %s %u us per %u us (%s)\n", i, PRESSURE_RESOURCE_NAMES[trigger.resource],
+                    trigger.full ? "full" : "some", trigger.stallUs, trigger.windowUs,
+                    source.KernelTrigger(i) ? "kernel" : "fallback poll");
+    }
+    Clock::time_point start = Clock::now();
+    source.Start([&](const PressureEvent& event) {
+        const PressureTrigger& trigger = DEFAULT_PRESSURE_TRIGGERS[event.trigger];
+        const PressureLine& line = trigger.full ? event.reading.full : event.reading.some;
+        std::printf("%8.3f  %-6s %s avg10 %.2f%% total %llu us (%s)\n",
+                    std::chrono::duration<double>(Clock::now() - start).count(),
+                    PRESSURE_RESOURCE_NAMES[trigger.resource], trigger.full ? "full" : "some", line.avg10,
+                    (unsigned long long)line.totalUs, event.kernel ? "kernel" : "poll");
+        std::fflush(stdout);
+    });
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    source.Stop();
+    return 0;
+}
+
+// Rewrites a fixture file in place with one write. The readers keep their descriptors
+// open, so the file can't be replaced; every version has the same length instead,
+// which leaves no stale tail behind.
+static bool WriteFixture(const std::string& path, const std::string& text) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = pwrite(fd, text.data(), text.size(), 0) == (ssize_t)text.size();
+    close(fd);
+    return ok;
+}
+
+static std::string Meminfo(int usedPercent) {
+    char text[128];
+    std::snprintf(text, sizeof(text), "MemTotal: 16000000 kB\nMemFree: 100000 kB\nMemAvailable: %10d kB\n",
+                  16000000 / 100 * (100 - usedPercent));
+    return text;
+}
+
+static std::string Pressure(uint64_t totalUs) {
+    char text[192];
+    std::snprintf(text, sizeof(text), "some avg10=0.00 avg60=0.00 avg300=0.00 total=%-16llu\n"
+                                      "full avg10=0.00 avg60=0.00 avg300=0.00 total=%-16llu\n",
+                  (unsigned long long)totalUs, (unsigned long long)totalUs / 2);
+    return text;
+}
+
+enum LatencyTimer {
+    LATENCY_SAMPLE,      // The periodic sample
+    LATENCY_PRESSURE,    // An extra sample asked for by a pressure event
+    LATENCY_TIMER_COUNT
+};
+
+// The app's monitor thread in miniature: periodic samples, plus one on demand
+class Monitor {
+public:
+    explicit Monitor(const std::string& root) : m_sampler(root.c_str()) {}
+
+    bool Start() {
+        if (!m_sampler.Open()) {
+            return false;
+        }
+        m_thread = std::thread(&Monitor::Run, this);
+        return true;
+    }
+
+    void Stop() {
+        m_scheduler.Stop();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    // What a pressure event does in the app: sample now
+    void SampleNow() { m_scheduler.Schedule(LATENCY_PRESSURE, Clock::now()); }
+
+    // Waits until the state machine shows `state` and says when it changed to it
+    bool WaitFor(EmotionalState state, std::chrono::milliseconds limit, Clock::time_point& changedAt) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_changed.wait_for(lock, limit, [&] { return m_state == state; })) {
+            return false;
+        }
+        changedAt = m_changedAt;
+        return true;
+    }
+
+    uint64_t Samples() const { return m_samples.load(); }
+
+private:
+    void Run() {
+        Clock::time_point next = Clock::now();
+        m_scheduler.Schedule(LATENCY_SAMPLE, next);
+        StateMachine machine(&m_rules);
+        for (;;) {
+            int timer = m_scheduler.WaitNext();
+            if (timer < 0) {
+                break;
+            }
+            m_samples++;
+            int battery = 100;
+            bool hasBattery = false;
+            m_sampler.CheckBatteryStatus(battery, hasBattery);
+            double cpu = m_sampler.GetCPUUsage();
+            machine.SetMetrics(MakeMetrics(cpu, 0, hasBattery, battery, m_sampler.GetMemoryUsage()));
+            Clock::time_point now = Clock::now();
+            if (machine.Update(now).changed) {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_state = machine.State();
+                m_changedAt = now;
+                m_changed.notify_all();
+            }
+            if (timer == LATENCY_SAMPLE) {
+                next = (std::max)(next + std::chrono::milliseconds(500), now);
+                m_scheduler.Schedule(LATENCY_SAMPLE, next);
+            }
+        }
+    }
+
+    LinuxSampler m_sampler;
+    RuleSet m_rules = MakeRuleSet(STATE_RULES);
+    TimerScheduler<LATENCY_TIMER_COUNT> m_scheduler;
+    std::thread m_thread;
+    std::atomic<uint64_t> m_samples{ 0 };
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    EmotionalState m_state = HAPPY;
+    Clock::time_point m_changedAt;
+};
+
+static double Percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    return values[(std::size_t)((values.size() - 1) * p / 100.0 + 0.5)];
+}
+
+// One set of rounds; returns the latencies in milliseconds
+static bool MeasureRounds(const std::string& root, bool pressure, int rounds, std::vector<double>& latencies,
+                          uint64_t& samples) {
+    const std::string meminfo = root + "/proc/meminfo";
+    const std::string memoryPressure = root + "/proc/pressure/memory";
+    uint64_t stallUs = 1000000;
+    WriteFixture(meminfo, Meminfo(40));
+    WriteFixture(memoryPressure, Pressure(stallUs));
+
+    Monitor monitor(root);
+    PressureSource source(root.c_str());
+    const PressureTrigger trigger = { PRESSURE_MEMORY, false, 100000, 500000 };
+    if (!monitor.Start()) {
+        std::fprintf(stderr, "fixture under %s is incomplete\n", root.c_str());
+        return false;
+    }
+    if (pressure && (!source.Open(&trigger, 1, 5) || !source.Start([&](const PressureEvent&) { monitor.SampleNow(); }))) {
+        std::fprintf(stderr, "cannot watch %s\n", memoryPressure.c_str());
+        monitor.Stop();
+        return false;
+    }
+
+    std::mt19937 random(7);
+    bool ok = true;
+    for (int round = 0; round < rounds; round++) {
+        // Calm down first: back to HAPPY (through PLEASED and the hold time)
+        WriteFixture(meminfo, Meminfo(40));
+        Clock::time_point changed;
+        if (!monitor.WaitFor(HAPPY, std::chrono::seconds(10), changed)) {
+            std::fprintf(stderr, "round %d: never calmed down\n", round);
+            ok = false;
+            break;
+        }
+        // Land at a random point of the sampling period
+        std::this_thread::sleep_for(std::chrono::milliseconds(100 + random() % 500));
+
+        Clock::time_point start = Clock::now();
+        stallUs += 300000;
+        WriteFixture(meminfo, Meminfo(97));
+        WriteFixture(memoryPressure, Pressure(stallUs));
+        if (!monitor.WaitFor(GRIMACE_TWO_SWEAT, std::chrono::seconds(5), changed)) {
+            std::fprintf(stderr, "round %d: the state never changed\n", round);
+            ok = false;
+            break;
+        }
+        latencies.push_back(std::chrono::duration<double, std::milli>(changed - start).count());
+    }
+    source.Stop();
+    monitor.Stop();
+    samples = monitor.Samples();
+    return ok;
+}
+
+static int Latency(int rounds) {
+    char pattern[] = "/tmp/pressure_watch.XXXXXX";
+    if (!mkdtemp(pattern)) {
+        std::perror("mkdtemp");
+        return 1;
+    }
+    std::string root = pattern;
+    std::string proc = root + "/proc";
+    std::string pressureDir = proc + "/pressure";
+    mkdir(proc.c_str(), 0755);
+    mkdir(pressureDir.c_str(), 0755);
+    WriteFixture(proc + "/stat", "cpu  100 0 100 10000 0 0 0 0 0 0\ncpu0 100 0 100 10000 0 0 0 0 0 0\n");
+
+    bool ok = true;
+    for (int pressure = 1; pressure >= 0 && ok; pressure--) {
+        std::vector<double> latencies;
+        uint64_t samples = 0;
+        Clock::time_point start = Clock::now();
+        ok = MeasureRounds(root, pressure != 0, rounds, latencies, samples);
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        std::printf("%-22s p50 %6.1f ms  p90 %6.1f ms  max %6.1f ms  (%d rounds, %.1f samples/s)\n",
+                    pressure ? "with pressure trigger" : "periodic sampling only", Percentile(latencies, 50),
+                    Percentile(latencies, 90), Percentile(latencies, 100), (int)latencies.size(), samples / seconds);
+    }
+
+    for (const char* file : { "/proc/pressure/memory", "/proc/meminfo", "/proc/stat" }) {
+        std::remove((root + file).c_str());
+    }
+    rmdir(pressureDir.c_str());
+    rmdir(proc.c_str());
+    rmdir(root.c_str());
+    return ok ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    const char* root = "";
+    int seconds = 10;
+    int rounds = 8;
+    bool latency = false;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--root") == 0 && i + 1 < argc) {
+            root = argv[++i];
+        } else if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = (std::max)(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+            rounds = (std::max)(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--latency") == 0) {
+            latency = true;
+        } else {
+            std::fprintf(stderr, "usage: %s [--root DIR] [--seconds N] | --latency [--rounds N]\n", argv[0]);
+            return 2;
+        }
+    }
+    return latency ? Latency(rounds) : Watch(root, seconds);
+}
@@ -0,0 +1,165 @@
+// What the self profiler (self_profile.h) costs the code it times, off and on, and a
+// check that turning it on while stages are being recorded starts a clean period.
+//
+// Usage: profile_overhead [--iterations N]
+//
+// Build: cl /EHsc /O2 /nologo /Feprofile_overhead.exe tools\profile_overhead.cpp
+//        g++ -O2 -std=c++14 -pthread -o profile_overhead tools/profile_overhead.cpp
+//
+// Times N iterations (default 20000000) of a small piece of work, about the size of
+// a cheap stage, three ways: bare, inside PROFILE_SCOPE with profiling off, and with
+// it on, and the same for PROFILE_WAKEUP. Prints ns per iteration and the cost of the
+// scope over the bare loop; the times are reported, not checked.
+//
+// Then one thread records a stage and counts wakeups nonstop while another turns
+// profiling off and on and a third calls Report(). Every record is 1000 ns, so
+// whenever the recording thread is paused (500 times, after at least 100 toggles
+// and 1000 records each) the stage must hold count * 1000 ns in total and a max of
+// 1000 ns: a reset from another thread landing in the middle of a record leaves the
+// count, total and buckets disagreeing. A period just turned on must also read as
+// empty until its first record. Exits with 1 if any of it doesn't hold.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include "../self_profile.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static bool Check(bool condition, const char* what) {
+    if (!condition) std::printf("  FAIL: %s\n", what);
+    return condition;
+}
+
+// A few dozen dependent multiplies, so the scope has something to wrap
+static inline uint64_t Work(uint64_t x) {
+    for (int i = 0; i < 32; i++) x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    return x;
+}
+
+template <typename Body>
+static double NsPerIteration(long long iterations, Body body) {
+    Clock::time_point start = Clock::now();
+    for (long long i = 0; i < iterations; i++) body();
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / (double)iterations;
+}
+
+static void Overhead(long long iterations) {
+    SelfProfile profile;
+    uint64_t x = 1;
+    double bare = NsPerIteration(iterations, [&] { x = Work(x); });
+    double off = NsPerIteration(iterations, [&] {
+        PROFILE_SCOPE(profile, PROFILE_EVALUATE);
+        x = Work(x);
+    });
+    double wakeupOff = NsPerIteration(iterations, [&] {
+        PROFILE_WAKEUP(profile, PROFILE_THREAD_MONITOR);
+        x = Work(x);
+    });
+    profile.SetEnabled(true);
+    double on = NsPerIteration(iterations, [&] {
+        PROFILE_SCOPE(profile, PROFILE_EVALUATE);
+        x = Work(x);
+    });
+    double wakeupOn = NsPerIteration(iterations, [&] {
+        PROFILE_WAKEUP(profile, PROFILE_THREAD_MONITOR);
+        x = Work(x);
+    });
+    std::printf("%lld iterations (result %llx)\n", iterations, (unsigned long long)x);
+    std::printf("  bare loop                  %7.2f ns\n", bare);
+    std::printf("  PROFILE_SCOPE, off         %7.2f ns (%+.2f ns)\n", off, off - bare);
+    std::printf("  PROFILE_SCOPE, on          %7.2f ns (%+.2f ns)\n", on, on - bare);
+    std::printf("  PROFILE_WAKEUP, off        %7.2f ns (%+.2f ns)\n", wakeupOff, wakeupOff - bare);
+    std::printf("  PROFILE_WAKEUP, on         %7.2f ns (%+.2f ns)\n", wakeupOn, wakeupOn - bare);
+}
+
+// Count, total and buckets of a stage whose every record was 1000 ns agree
+static bool Coherent(const LatencyHistogram& stage) {
+    uint64_t count = stage.Count();
+    return stage.TotalNs() == count * 1000 &&
+           (count == 0 || (stage.MaxNs() == 1000 && stage.QuantileNs(100) >= 1000 && stage.QuantileNs(100) < 1200));
+}
+
+static bool CheckToggling() {
+    SelfProfile profile;
+    profile.SetEnabled(true);
+    std::atomic<bool> stop(false);
+    std::atomic<int> pause(0);     // 1: asked to pause, 2: paused
+    std::atomic<long long> records(0);
+    std::thread recorder([&] {
+        while (!stop.load()) {
+            if (pause.load() == 1) pause.store(2);
+            if (pause.load() == 2) {
+                std::this_thread::yield();
+                continue;
+            }
+            // As a scope that started before profiling was turned off would
+            profile.Record(PROFILE_SAMPLE, std::chrono::nanoseconds(1000));
+            records.store(records.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            PROFILE_WAKEUP(profile, PROFILE_THREAD_MONITOR);
+        }
+    });
+    std::thread reporter([&] {
+        std::string report;
+        while (!stop.load(std::memory_order_relaxed)) {
+            report.clear();
+            profile.Report(report);
+        }
+    });
+
+    // Rounds of toggling while the recorder records, each followed by a look at the
+    // stage with the recorder paused
+    const int ROUNDS = 500, TOGGLES = 100;
+    int incoherent = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        long long before = records.load();
+        for (int i = 0; i < TOGGLES || records.load() - before < 1000; i++) {
+            profile.SetEnabled(false);
+            profile.SetEnabled(true);
+        }
+        pause = 1;
+        while (pause.load() != 2) std::this_thread::yield();
+        incoherent += !Coherent(profile.Stage(PROFILE_SAMPLE));
+        pause = 0;
+    }
+    stop = true;
+    recorder.join();
+    reporter.join();
+    bool ok = Check(incoherent == 0, "a reset raced a record: the stage's count, total and buckets disagree");
+    ok &= Check(profile.Stage(PROFILE_SAMPLE).Count() <= (uint64_t)records.load(),
+                "the stage holds more records than were made");
+
+    // A period started while nothing records is empty until the writer catches up
+    profile.SetEnabled(false);
+    profile.SetEnabled(true);
+    ok &= Check(profile.Stage(PROFILE_SAMPLE).Count() == 0 && profile.Wakeups(PROFILE_THREAD_MONITOR) == 0,
+                "a new period shows the last one's numbers");
+    profile.Record(PROFILE_SAMPLE, std::chrono::nanoseconds(1000));
+    profile.Wakeup(PROFILE_THREAD_MONITOR);
+    ok &= Check(profile.Stage(PROFILE_SAMPLE).Count() == 1 && profile.Wakeups(PROFILE_THREAD_MONITOR) == 1,
+                "the first record of a new period didn't start from zero");
+    std::printf("%d rounds of toggling against %lld records, %d incoherent: %s\n", ROUNDS, records.load(),
+                incoherent, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    long long iterations = 20000000;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = std::max(1LL, std::atoll(argv[++i]));
+        } else {
+            std::fprintf(stderr, "usage: %s [--iterations N]\n", argv[0]);
+            return 2;
+        }
+    }
+    Overhead(iterations);
+    bool ok = CheckToggling();
+    std::printf("profiler checks: %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
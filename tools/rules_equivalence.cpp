@@ -0,0 +1,113 @@
+// Exhaustive check that the STATE_RULES table (state_rules.h) picks the same state as
+// the if/else chain it replaced, and that the shipped rules.conf does too.
+//
+// Usage: rules_equivalence [repo root]
+//
+// Build: cl /EHsc /O2 /nologo /Ferules_equivalence.exe tools\rules_equivalence.cpp
+//        g++ -O2 -std=c++14 -o rules_equivalence tools/rules_equivalence.cpp
+//
+// Walks CPU and memory from 0 to 100 in steps of 0.25 plus the neighbouring doubles
+// of every threshold (50, 70, 90, 95), saturated cores 0 to 2, and every battery
+// percent from 0 to 100 with and without a battery. For each point the state and
+// over-threshold flag from EvaluateRules(STATE_RULES) and from the rules parsed out of
+// rules.conf (without dwell, band or filters) must equal LegacyState(), which is the
+// chain from main.cpp before the rules became data. Prints the points checked and
+// the time per evaluation. Exits with 1 on any difference.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../state_rules.h"
+#include "../rules_config.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// The chain as it stood in main.cpp, thresholds written out as they were
+static EmotionalState LegacyState(double cpu, int saturatedCores, bool hasBattery, int battery, double memory,
+                                  bool& overThreshold) {
+    overThreshold = true;
+    if (cpu > 90) return ANGUISH_EXTREMELY;
+    if (cpu > 70) return ANGUISH_VERY;
+    if (cpu > 50 || saturatedCores > 0) return ANGUISH;
+    if (hasBattery && battery < 10) return TIRED_EXTREMELY;
+    if (hasBattery && battery < 20) return TIRED_VERY;
+    if (hasBattery && battery < 30) return TIRED;
+    if (memory > 95) return GRIMACE_TWO_SWEAT;
+    if (memory > 90) return NEUTRAL;
+    overThreshold = false;
+    return HAPPY;
+}
+
+// 0..100 in quarter steps, plus each threshold and the doubles either side of it
+static std::vector<double> PercentGrid(std::initializer_list<double> thresholds) {
+    std::vector<double> values;
+    for (int i = 0; i <= 400; i++) values.push_back(i * 0.25);
+    for (double threshold : thresholds) {
+        values.push_back(std::nextafter(threshold, -1.0));
+        values.push_back(std::nextafter(threshold, 200.0));
+    }
+    values.push_back(-1.0);
+    values.push_back(150.0);
+    return values;
+}
+
+int main(int argc, char** argv) {
+    std::string root = argc > 1 ? argv[1] : ".";
+    if (argc > 2) {
+        std::fprintf(stderr, "usage: %s [repo root]\n", argv[0]);
+        return 2;
+    }
+    RuleSet config;
+    std::string error;
+    std::string path = root + "/rules.conf";
+    if (!LoadRulesFile(RulePath(path.begin(), path.end()), config, &error)) {
+        std::fprintf(stderr, "%s: %s\n", path.c_str(), error.c_str());
+        return 1;
+    }
+
+    std::vector<double> cpus = PercentGrid({ 50, 70, 90 });
+    std::vector<double> memories = PercentGrid({ 90, 95 });
+    long long points = 0, tableMismatches = 0, configMismatches = 0;
+    double ns = 0;
+    for (double cpu : cpus) {
+        Clock::time_point start = Clock::now();
+        for (int saturated = 0; saturated <= 2; saturated++) {
+            for (int battery = -1; battery <= 100; battery++) {
+                bool hasBattery = battery >= 0;
+                for (double memory : memories) {
+                    MetricValues metrics = MakeMetrics(cpu, saturated, hasBattery, battery, memory);
+                    bool legacyOver;
+                    EmotionalState legacy = LegacyState(cpu, saturated, hasBattery, battery, memory, legacyOver);
+                    RuleResult table = EvaluateRules(STATE_RULES, metrics);
+                    int rule = FirstMatchingRule(config.rules, config.count, metrics);
+                    EmotionalState configured = rule >= 0 ? config.rules[rule].state : HAPPY;
+                    points++;
+                    if (table.state != legacy || table.overThreshold != legacyOver) {
+                        if (tableMismatches++ < 5) {
+                            std::printf("  FAIL: STATE_RULES cpu %.17g cores %d battery %d memory %.17g: %s, legacy %s\n",
+                                        cpu, saturated, battery, memory, EMOTIONAL_STATE_NAMES[table.state],
+                                        EMOTIONAL_STATE_NAMES[legacy]);
+                        }
+                    }
+                    if (configured != legacy || (rule >= 0) != legacyOver) {
+                        if (configMismatches++ < 5) {
+                            std::printf("  FAIL: rules.conf cpu %.17g cores %d battery %d memory %.17g: %s, legacy %s\n",
+                                        cpu, saturated, battery, memory, EMOTIONAL_STATE_NAMES[configured],
+                                        EMOTIONAL_STATE_NAMES[legacy]);
+                        }
+                    }
+                }
+            }
+        }
+        ns += std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+    std::printf("%lld points: STATE_RULES %lld differences, rules.conf %lld differences\n", points, tableMismatches,
+                configMismatches);
+    std::printf("%.1f ns per point (legacy chain, table and rules.conf together)\n", ns / points);
+    bool ok = tableMismatches == 0 && configMismatches == 0;
+    std::printf("equivalence: %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
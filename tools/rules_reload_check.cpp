@@ -0,0 +1,244 @@
+// Reloads rules.conf under load the way the app does and checks which writes reload.
+//
+// Usage: rules_reload_check [--busy N]
+//
+// Build: cl /EHsc /O2 /nologo /Ferules_reload_check.exe tools\rules_reload_check.cpp
+//        g++ -O2 -std=c++14 -pthread -o rules_reload_check tools/rules_reload_check.cpp
+//
+// Works in a scratch directory (rules_reload_check.tmp, in the current directory)
+// with a RuleFileWatcher (rules_config.h) on rules.conf. The callback parses the file
+// and hands the set over through an atomic pointer, as ReloadRules() does, and a
+// monitor thread picks it up every millisecond, skipping a set equal to the current
+// one as TIMER_RULES does, while evaluating random metrics. N threads (default 4)
+// spin to keep the machine busy. In order:
+//   - 200 writes and renames of other files in the directory: no reload at all,
+//   - 10 saves of rules.conf with the same rules: reloads, but the rules stay applied,
+//   - 10 saves with a changed threshold, in place or written elsewhere and renamed
+//     over: each is applied, and the time from save to applied is reported,
+//   - a save with a bad line: the last good rules stay.
+// Also reports the slowest evaluation on the monitor thread while reloads happen.
+// Exits with 1 if any check fails.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../rules_config.h"
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+static const char* const DIRECTORY = "rules_reload_check.tmp";
+
+static std::string PathOf(const char* name) {
+    return std::string(DIRECTORY) + "/" + name;
+}
+
+static bool WriteFile(const std::string& path, const std::string& text) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    bool ok = std::fwrite(text.data(), 1, text.size(), file) == text.size();
+    return std::fclose(file) == 0 && ok;
+}
+
+// Write-then-rename, the way many editors save
+static bool ReplaceFile(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+    return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return std::rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+static std::string RulesText(int cpuThreshold) {
+    return "cpu > " + std::to_string(cpuThreshold) + " ANGUISH_VERY 10 0 5\n"
+           "saturated_cores > 0 ANGUISH 20\n"
+           "memory > 90 NEUTRAL 30 0 1\n"
+           "filter cpu ewma 0.3\n";
+}
+
+static bool Check(bool condition, const char* what) {
+    if (!condition) std::printf("  FAIL: %s\n", what);
+    return condition;
+}
+
+struct Monitor {
+    std::atomic<RuleSet*> pending{ nullptr };
+    std::atomic<int> reloads{ 0 };       // Callbacks that parsed a good file
+    std::atomic<int> applied{ 0 };       // Sets that replaced the current one
+    std::atomic<int> skipped{ 0 };       // Sets equal to the current one
+    std::atomic<int> threshold{ 0 };     // CPU threshold of the applied set
+    std::atomic<long long> slowestNs{ 0 };
+    std::atomic<bool> stop{ false };
+
+    // The TIMER_RULES handler and the per-sample evaluation, on one thread
+    void Run(RuleSet* initial) {
+        std::unique_ptr<RuleSet> current(initial);
+        RuleEvaluator evaluator(current.get());
+        std::mt19937 random(5);
+        std::uniform_real_distribution<double> percent(0, 100);
+        while (!stop.load()) {
+            Clock::time_point start = Clock::now();
+            RuleSet* rules = pending.exchange(nullptr);
+            if (rules && *rules == *current) {
+                delete rules;
+                skipped++;
+            } else if (rules) {
+                evaluator.SetRules(rules);
+                current.reset(rules);
+                threshold = (int)rules->rules[0].threshold;
+                applied++;
+            }
+            evaluator.Evaluate(MakeMetrics(percent(random), 0, false, 0, percent(random)), start);
+            long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+            if (ns > slowestNs.load()) slowestNs = ns;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        delete pending.exchange(nullptr);
+    }
+};
+
+// Waits up to `timeout` for `done`, returning the time it took or -1
+template <typename Done>
+static double WaitFor(Done done, std::chrono::milliseconds timeout) {
+    Clock::time_point start = Clock::now();
+    while (!done()) {
+        if (Clock::now() - start > timeout) return -1;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    int busy = 4;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--busy") == 0 && i + 1 < argc) {
+            busy = std::max(0, std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr, "usage: %s [--busy N]\n", argv[0]);
+            return 2;
+        }
+    }
+#ifdef _WIN32
+    _mkdir(DIRECTORY);
+#else
+    mkdir(DIRECTORY, 0700);
+#endif
+    const std::string rulesPath = PathOf("rules.conf");
+    const RulePath watchedPath(rulesPath.begin(), rulesPath.end());
+    if (!WriteFile(rulesPath, RulesText(70))) {
+        std::fprintf(stderr, "can't write %s\n", rulesPath.c_str());
+        return 1;
+    }
+    std::unique_ptr<RuleSet> initial(new RuleSet);
+    std::string error;
+    if (!LoadRulesFile(watchedPath, *initial, &error)) {
+        std::fprintf(stderr, "%s: %s\n", rulesPath.c_str(), error.c_str());
+        return 1;
+    }
+
+    Monitor monitor;
+    monitor.threshold = 70;
+    std::thread monitorThread(&Monitor::Run, &monitor, initial.release());
+    std::atomic<bool> stopBusy(false);
+    std::vector<std::thread> spinners;
+    for (int i = 0; i < busy; i++) {
+        spinners.emplace_back([&stopBusy] {
+            volatile unsigned sink = 0;
+            while (!stopBusy.load(std::memory_order_relaxed)) sink = sink * 1664525u + 1013904223u;
+        });
+    }
+
+    RuleFileWatcher watcher;
+    bool ok = Check(watcher.Start(watchedPath, [&] {
+        std::unique_ptr<RuleSet> rules(new RuleSet);
+        if (LoadRulesFile(watchedPath, *rules)) {
+            monitor.reloads++;
+            delete monitor.pending.exchange(rules.release());
+        }
+    }), "the watcher didn't start");
+
+    // Other files in the same directory, including names that contain the rules file's
+    const char* const others[] = { "other.txt", "rules.conf.bak", "xrules.conf", "rules.con", "RULES.conf.tmp" };
+    for (int i = 0; i < 200 && ok; i++) {
+        std::string name = PathOf(others[i % 5]);
+        WriteFile(name, RulesText(i));
+        if (i % 3 == 0) ReplaceFile(name, PathOf("moved.txt"));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    ok &= Check(monitor.reloads.load() == 0, "writes to other files reloaded the rules");
+    std::printf("200 writes to other files: %d reloads\n", monitor.reloads.load());
+
+    // Saves that leave the rules as they were
+    for (int i = 0; i < 10 && ok; i++) {
+        int before = monitor.reloads.load();
+        if (i % 2) {
+            WriteFile(rulesPath, RulesText(70));
+        } else {
+            WriteFile(PathOf("rules.conf.new"), RulesText(70));
+            ReplaceFile(PathOf("rules.conf.new"), rulesPath);
+        }
+        ok &= Check(WaitFor([&] { return monitor.reloads.load() > before && !monitor.pending.load(); },
+                            std::chrono::milliseconds(2000)) >= 0, "an unchanged save didn't reload");
+    }
+    ok &= Check(monitor.applied.load() == 0, "an unchanged rule set was applied");
+    std::printf("10 unchanged saves: %d reloads, %d skipped, %d applied\n", monitor.reloads.load(),
+                monitor.skipped.load(), monitor.applied.load());
+
+    // Saves that change the rules
+    double slowest = 0, total = 0;
+    int changes = 0;
+    for (int i = 0; i < 10 && ok; i++) {
+        int threshold = 71 + i;
+        if (i % 2) {
+            WriteFile(rulesPath, RulesText(threshold));
+        } else {
+            WriteFile(PathOf("rules.conf.new"), RulesText(threshold));
+            ReplaceFile(PathOf("rules.conf.new"), rulesPath);
+        }
+        double ms = WaitFor([&] { return monitor.threshold.load() == threshold; }, std::chrono::milliseconds(2000));
+        ok &= Check(ms >= 0, "a changed save wasn't applied");
+        slowest = std::max(slowest, ms);
+        total += ms;
+        changes++;
+    }
+    std::printf("%d changed saves: applied %.1f ms after the save on average, %.1f ms at most\n", changes,
+                changes ? total / changes : 0.0, slowest);
+
+    // A broken save keeps the last good rules
+    int reloads = monitor.reloads.load();
+    WriteFile(rulesPath, RulesText(50) + "cpu >> 10 HAPPY 1\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    ok &= Check(monitor.reloads.load() == reloads && monitor.threshold.load() == 80, "a bad file replaced the rules");
+
+    watcher.Stop();
+    stopBusy = true;
+    for (std::thread& spinner : spinners) spinner.join();
+    monitor.stop = true;
+    monitorThread.join();
+    std::printf("slowest evaluation on the monitor thread: %.1f us (%d busy threads)\n", monitor.slowestNs.load() / 1000.0,
+                busy);
+
+    for (const char* name : { "rules.conf", "rules.conf.new", "other.txt", "rules.conf.bak", "xrules.conf", "rules.con",
+                              "RULES.conf.tmp", "moved.txt" }) {
+        std::remove(PathOf(name).c_str());
+    }
+#ifdef _WIN32
+    _rmdir(DIRECTORY);
+#else
+    rmdir(DIRECTORY);
+#endif
+    std::printf("reload checks: %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
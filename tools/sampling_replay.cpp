@@ -0,0 +1,212 @@
+// Replays synthetic load through the adaptive sampling controller
+// (adaptive_sampling.h) and through the old fixed 500 ms cadence, and compares how
+// often each one wakes up and which threshold crossings each one sees.
+//
+// Usage: sampling_replay [--seconds N] [--seed S]
+//
+// Build: cl /EHsc /O2 /nologo /Fesampling_replay.exe tools\sampling_replay.cpp
+//        g++ -O2 -std=c++14 -o sampling_replay tools/sampling_replay.cpp
+//
+// The ground truth is generated at 50 ms resolution for three profiles: a quiet
+// desktop, a busy machine whose CPU and memory wander across the rule thresholds,
+// and the same busy machine on battery. A threshold crossing is a stretch of at
+// least 500 ms in which a compiled-in rule (state_rules.h) matches the true metric;
+// the fixed cadence catches every such stretch by construction, and a sampler
+// "misses" one if none of its samples lands inside. Exits with 1 if the adaptive
+// sampler misses a crossing on AC power or fails to wake less on the quiet trace.
+//
+// On battery the controller samples every 5 s while nothing is near a threshold, so
+// a jump straight from far below to past one can start and end between two samples.
+// Near a threshold it still samples every 500 ms and can't miss. So on battery every
+// miss has to fall in a 5 s battery interval, and no more than MAX_BATTERY_MISSED_PERCENT
+// of the crossings may be missed (the worst of 80 seeds misses 5.6%); either failing
+// exits with 1 too.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+#include "../adaptive_sampling.h"
+#include "../state_rules.h"
+
+const int TICK_MS = 50;
+const int MIN_CROSSING_MS = NOMINAL_SAMPLING_MS;
+const double MAX_BATTERY_MISSED_PERCENT = 10.0;
+
+enum Profile { PROFILE_QUIET, PROFILE_BUSY, PROFILE_BUSY_BATTERY, PROFILE_COUNT };
+const char* const PROFILE_NAMES[PROFILE_COUNT] = { "quiet desktop", "busy", "busy on battery" };
+
+// One MetricValues per tick
+static std::vector<MetricValues> Generate(Profile profile, int seconds, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::normal_distribution<double> noise(0.0, 1.0);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    int ticks = seconds * 1000 / TICK_MS;
+    std::vector<MetricValues> truth;
+    truth.reserve(ticks);
+
+    double memory = profile == PROFILE_QUIET ? 45.0 : 91.0;
+    double battery = 80.0;
+    double cpuLevel = 5.0;
+    int regimeLeft = 0;
+    for (int tick = 0; tick < ticks; tick++) {
+        double cpu;
+        if (profile == PROFILE_QUIET) {
+            // Idle with the odd short burst of activity (opening a window, a search)
+            if (regimeLeft-- <= 0) {
+                cpuLevel = uniform(random) < 0.1 ? 12.0 + 10.0 * uniform(random) : 3.0 + 2.0 * uniform(random);
+                regimeLeft = (int)((cpuLevel > 10 ? 1000 + 2000 * uniform(random) : 20000 + 20000 * uniform(random)) / TICK_MS);
+            }
+            cpu = cpuLevel + 0.4 * noise(random);
+            memory += 0.002 * noise(random);
+        } else {
+            // Load regimes of 1-8 s, many of them right at a threshold, plus short spikes
+            if (regimeLeft-- <= 0) {
+                static const double LEVELS[] = { 15, 35, 47, 53, 66, 72, 85, 88, 93, 97 };
+                cpuLevel = LEVELS[random() % (sizeof(LEVELS) / sizeof(LEVELS[0]))];
+                regimeLeft = (int)((1000 + 7000 * uniform(random)) / TICK_MS);
+            }
+            cpu = cpuLevel + 3.0 * noise(random);
+            if (uniform(random) < 0.002) cpu = 95.0;
+            memory += 0.05 * noise(random) + (memory < 89.0 ? 0.02 : memory > 97.0 ? -0.02 : 0.0);
+            battery -= 0.0005;
+        }
+        cpu = (std::max)(0.0, (std::min)(100.0, cpu));
+        int saturated = cpu > 92.0 ? 1 : 0;
+        truth.push_back(MakeMetrics(cpu, saturated, profile == PROFILE_BUSY_BATTERY, (int)battery, memory));
+    }
+    return truth;
+}
+
+struct Crossing {
+    int startTick;
+    int endTick;   // Exclusive
+};
+
+// Stretches of at least MIN_CROSSING_MS where some compiled-in rule matches
+static std::vector<Crossing> FindCrossings(const std::vector<MetricValues>& truth) {
+    std::vector<Crossing> crossings;
+    const int rules = (int)(sizeof(STATE_RULES) / sizeof(STATE_RULES[0]));
+    for (int r = 0; r < rules; r++) {
+        int start = -1;
+        for (int tick = 0; tick <= (int)truth.size(); tick++) {
+            bool match = tick < (int)truth.size() && RuleMatches(STATE_RULES[r], truth[tick]);
+            if (match && start < 0) {
+                start = tick;
+            } else if (!match && start >= 0) {
+                if ((tick - start) * TICK_MS >= MIN_CROSSING_MS) crossings.push_back(Crossing{ start, tick });
+                start = -1;
+            }
+        }
+    }
+    return crossings;
+}
+
+struct Run {
+    std::vector<int> sampleTicks;
+    std::vector<SamplingReason> sampleReasons;   // Why the interval after each sample was chosen
+    int reasonSamples[SAMPLING_REASON_COUNT] = {};
+};
+
+static Run Replay(const std::vector<MetricValues>& truth, bool adaptive, bool onBattery) {
+    RuleSet rules = MakeRuleSet(STATE_RULES);
+    SamplingController controller;
+    std::chrono::steady_clock::time_point origin;
+    Run run;
+    int tick = 0;
+    while (tick < (int)truth.size()) {
+        run.sampleTicks.push_back(tick);
+        int intervalMs = NOMINAL_SAMPLING_MS;
+        SamplingReason reason = SAMPLING_NORMAL;
+        if (adaptive) {
+            intervalMs = (int)controller.Update(truth[tick], &rules, onBattery, origin + std::chrono::milliseconds(tick * TICK_MS)).count();
+            reason = controller.Reason();
+            run.reasonSamples[reason]++;
+        }
+        run.sampleReasons.push_back(reason);
+        tick += (std::max)(1, intervalMs / TICK_MS);
+    }
+    return run;
+}
+
+struct Misses {
+    int total = 0;
+    int outsideBattery = 0;   // Missed after a sample that didn't choose the battery interval
+};
+
+static Misses Missed(const std::vector<Crossing>& crossings, const Run& run) {
+    Misses misses;
+    for (const Crossing& crossing : crossings) {
+        std::vector<int>::const_iterator sample = std::lower_bound(run.sampleTicks.begin(), run.sampleTicks.end(), crossing.startTick);
+        if (sample != run.sampleTicks.end() && *sample < crossing.endTick) continue;
+        misses.total++;
+        // The crossing started after the previous sample; sample 0 is at tick 0
+        std::size_t previous = (std::size_t)(sample - run.sampleTicks.begin()) - 1;
+        misses.outsideBattery += run.sampleReasons[previous] != SAMPLING_ON_BATTERY;
+    }
+    return misses;
+}
+
+int main(int argc, char** argv) {
+    int seconds = 600;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = (std::max)(10, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            std::fprintf(stderr, "usage: %s [--seconds N] [--seed S]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    bool ok = true;
+    std::printf("%-16s %9s %12s %12s %9s %9s   adaptive samples by reason\n", "profile", "crossings",
+                "fixed/min", "adaptive/min", "missed", "missed");
+    std::printf("%-16s %9s %12s %12s %9s %9s\n", "", "", "", "", "fixed", "adaptive");
+    for (int p = 0; p < PROFILE_COUNT; p++) {
+        Profile profile = (Profile)p;
+        std::vector<MetricValues> truth = Generate(profile, seconds, seed + p);
+        std::vector<Crossing> crossings = FindCrossings(truth);
+        bool onBattery = profile == PROFILE_BUSY_BATTERY;
+        Run fixed = Replay(truth, false, onBattery);
+        Run adaptive = Replay(truth, true, onBattery);
+        int fixedMissed = Missed(crossings, fixed).total;
+        Misses adaptiveMisses = Missed(crossings, adaptive);
+        int adaptiveMissed = adaptiveMisses.total;
+        double minutes = seconds / 60.0;
+
+        std::printf("%-16s %9d %12.1f %12.1f %9d %9d  ", PROFILE_NAMES[p], (int)crossings.size(),
+                    fixed.sampleTicks.size() / minutes, adaptive.sampleTicks.size() / minutes, fixedMissed,
+                    adaptiveMissed);
+        for (int r = 0; r < SAMPLING_REASON_COUNT; r++) {
+            if (adaptive.reasonSamples[r]) std::printf(" %s %d", SAMPLING_REASON_NAMES[r], adaptive.reasonSamples[r]);
+        }
+        std::printf("\n");
+
+        if (!onBattery && adaptiveMissed > fixedMissed) {
+            std::printf("  FAIL: the adaptive sampler missed crossings the fixed cadence saw\n");
+            ok = false;
+        }
+        if (onBattery && adaptiveMisses.outsideBattery > 0) {
+            std::printf("  FAIL: %d crossings missed on battery outside a %d ms battery interval\n",
+                        adaptiveMisses.outsideBattery, SamplingPolicy().batteryMs);
+            ok = false;
+        }
+        if (onBattery && adaptiveMissed > MAX_BATTERY_MISSED_PERCENT / 100.0 * crossings.size()) {
+            std::printf("  FAIL: %d of %d crossings missed on battery, more than %.0f%%\n", adaptiveMissed,
+                        (int)crossings.size(), MAX_BATTERY_MISSED_PERCENT);
+            ok = false;
+        }
+        if (profile == PROFILE_QUIET && adaptive.sampleTicks.size() >= fixed.sampleTicks.size()) {
+            std::printf("  FAIL: the adaptive sampler didn't wake less on the quiet trace\n");
+            ok = false;
+        }
+    }
+    return ok ? 0 : 1;
+}
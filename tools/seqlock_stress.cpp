@@ -0,0 +1,191 @@
+// Stress test for the SeqLock that publishes SystemSnapshot (state_snapshot.h).
+//
+// Usage: seqlock_stress [--readers N] [--seconds N]
+//
+// Build: cl /EHsc /O2 /nologo /Feseqlock_stress.exe tools\seqlock_stress.cpp
+//        g++ -O2 -std=c++14 -pthread -o seqlock_stress tools/seqlock_stress.cpp
+//        (add -fsanitize=thread to check the memory ordering)
+//
+// One writer stores snapshots as fast as it can while N reader threads (default 4)
+// Load() them for --seconds (default 2). Every field of a snapshot is derived from
+// its sequence number, so a snapshot mixing two stores is caught as torn, and each
+// reader also checks the sequence never goes backwards. The same run is repeated
+// with the snapshot copied under a std::mutex, as the app did before the seqlock.
+// Prints stores and loads per second and the reader latency percentiles of both,
+// side by side; exits with 1 on any torn or stale read.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../state_snapshot.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static SystemSnapshot Make(uint64_t n) {
+    SystemSnapshot snapshot;
+    snapshot.sequence = n;
+    snapshot.cpuUsage = (double)(n % 1000) / 10.0;
+    snapshot.memoryUsage = (double)(n % 997) / 10.0;
+    snapshot.hottestCoreUsage = (float)(n % 101);
+    snapshot.saturatedCores = (int)(n % 64);
+    snapshot.batteryPercent = (int)(n % 101);
+    snapshot.hasBattery = (n & 1) != 0;
+    snapshot.isBlinking = (n & 2) != 0;
+    snapshot.state = (EmotionalState)(n % EMOTIONAL_STATE_COUNT);
+    snapshot.publishedMs = (int64_t)n * 3;
+    for (int i = 0; i < EMOTIONAL_STATE_COUNT; i++) {
+        snapshot.stateMs[i] = n * 7 + (uint64_t)i;
+        snapshot.transitions[i] = n ^ (uint64_t)i;
+    }
+    snapshot.samples = n + 1;
+    snapshot.monitorBusyNs = n * 11;
+    snapshot.monitorWakeups = n + 2;
+    snapshot.samplingIntervalMs = (int)(n % 5000);
+    return snapshot;
+}
+
+static bool Consistent(const SystemSnapshot& snapshot) {
+    // Compare field by field: the padding in Make()'s copy is not guaranteed to match
+    SystemSnapshot expected = Make(snapshot.sequence);
+    bool ok = snapshot.cpuUsage == expected.cpuUsage && snapshot.memoryUsage == expected.memoryUsage &&
+              snapshot.hottestCoreUsage == expected.hottestCoreUsage && snapshot.saturatedCores == expected.saturatedCores &&
+              snapshot.batteryPercent == expected.batteryPercent && snapshot.hasBattery == expected.hasBattery &&
+              snapshot.isBlinking == expected.isBlinking && snapshot.state == expected.state &&
+              snapshot.publishedMs == expected.publishedMs && snapshot.samples == expected.samples &&
+              snapshot.monitorBusyNs == expected.monitorBusyNs && snapshot.monitorWakeups == expected.monitorWakeups &&
+              snapshot.samplingIntervalMs == expected.samplingIntervalMs;
+    for (int i = 0; i < EMOTIONAL_STATE_COUNT; i++) {
+        ok &= snapshot.stateMs[i] == expected.stateMs[i] && snapshot.transitions[i] == expected.transitions[i];
+    }
+    return ok;
+}
+
+// The snapshot behind a lock, with the SeqLock's Store()/Load()
+class MutexSnapshot {
+public:
+    void Store(const SystemSnapshot& snapshot) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_snapshot = snapshot;
+    }
+
+    SystemSnapshot Load() const {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_snapshot;
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    SystemSnapshot m_snapshot;
+};
+
+struct ReaderResult {
+    uint64_t loads = 0;
+    uint64_t torn = 0;
+    uint64_t backwards = 0;
+    std::vector<uint32_t> latencyNs;   // A sample of Load() latencies
+};
+
+struct RunResult {
+    double elapsed = 0;
+    uint64_t stores = 0;
+    uint64_t loads = 0;
+    uint64_t torn = 0;
+    uint64_t backwards = 0;
+    std::vector<uint32_t> latencyNs;   // Sorted
+};
+
+template <typename Publisher>
+static RunResult Run(int readers, int seconds) {
+    Publisher publisher;
+    publisher.Store(Make(0));
+    std::atomic<bool> stop{ false };
+    std::vector<ReaderResult> results((std::size_t)readers);
+    std::vector<std::thread> threads;
+    for (int r = 0; r < readers; r++) {
+        threads.emplace_back([&, r] {
+            ReaderResult& result = results[(std::size_t)r];
+            uint64_t last = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                Clock::time_point start = Clock::now();
+                SystemSnapshot snapshot = publisher.Load();
+                Clock::time_point end = Clock::now();
+                result.loads++;
+                if ((result.loads & 15) == 0) {
+                    int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+                    result.latencyNs.push_back((uint32_t)(std::min)(ns, (int64_t)UINT32_MAX));
+                }
+                if (!Consistent(snapshot)) {
+                    result.torn++;
+                } else if (snapshot.sequence < last) {
+                    result.backwards++;
+                } else {
+                    last = snapshot.sequence;
+                }
+            }
+        });
+    }
+
+    RunResult run;
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::seconds(seconds);
+    while (Clock::now() < end) {
+        for (int i = 0; i < 64; i++) {
+            publisher.Store(Make(++run.stores));
+        }
+    }
+    stop = true;
+    for (std::thread& thread : threads) thread.join();
+    run.elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    for (const ReaderResult& result : results) {
+        run.loads += result.loads;
+        run.torn += result.torn;
+        run.backwards += result.backwards;
+        run.latencyNs.insert(run.latencyNs.end(), result.latencyNs.begin(), result.latencyNs.end());
+    }
+    std::sort(run.latencyNs.begin(), run.latencyNs.end());
+    return run;
+}
+
+static uint32_t Percentile(const RunResult& run, double p) {
+    return run.latencyNs.empty() ? 0u : run.latencyNs[(std::size_t)(p * (double)(run.latencyNs.size() - 1))];
+}
+
+static void Print(const char* name, const RunResult& run) {
+    std::printf("%-8s %12.0f %12.0f %8u %8u %8u %8u %6llu %9llu\n", name, run.stores / run.elapsed,
+                run.loads / run.elapsed, Percentile(run, 0.5), Percentile(run, 0.99), Percentile(run, 0.999),
+                Percentile(run, 1.0), (unsigned long long)run.torn, (unsigned long long)run.backwards);
+}
+
+int main(int argc, char** argv) {
+    int readers = 4;
+    int seconds = 2;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--readers") == 0 && i + 1 < argc) {
+            readers = (std::max)(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = (std::max)(1, std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr, "usage: %s [--readers N] [--seconds N]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    RunResult seqlock = Run<SeqLock<SystemSnapshot>>(readers, seconds);
+    RunResult mutex = Run<MutexSnapshot>(readers, seconds);
+    std::printf("%d readers, %d s per run (snapshot %u bytes); load latency in ns\n", readers, seconds,
+                (unsigned)sizeof(SystemSnapshot));
+    std::printf("%-8s %12s %12s %8s %8s %8s %8s %6s %9s\n", "", "stores/s", "loads/s", "p50", "p99", "p99.9", "max",
+                "torn", "backwards");
+    Print("seqlock", seqlock);
+    Print("mutex", mutex);
+    bool ok = seqlock.torn == 0 && seqlock.backwards == 0 && mutex.torn == 0 && mutex.backwards == 0;
+    std::printf("seqlock stress: %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+// Builds the sprite atlas (sprite_atlas.h) from the PNGs in img/ with a portable
+// decoder and checks it against the embedded sprites in sprites_generated.h.
+//
+// Usage: sprite_atlas_check [repo root]
+//
+// Build: cl /EHsc /O2 /nologo /Fesprite_atlas_check.exe tools\sprite_atlas_check.cpp
+//        g++ -O2 -std=c++14 -o sprite_atlas_check tools/sprite_atlas_check.cpp
+//
+// Follows DecodeSpriteResources() in main.cpp: every sprite the generated tables
+// reference is decoded once, reserved in a SpriteAtlas, premultiplied into its slot
+// and finished. Then for each sprite it checks:
+//   - the pixels equal the embedded plane expanded through the embedded palette,
+//   - it starts 16-byte aligned (the atlas stride is a multiple of 16 bytes too),
+//   - SpriteAtlas::IsOpaque() agrees with the generated opaque flag,
+//   - Draw() onto a background gives the same result as a per-pixel BlendOver().
+// It reports the decode time and memory of the old per-state path (one 32-bit image
+// per state and blink, TIRED decoding NEUTRAL_BLINK again) against the atlas.
+// Exits with 1 if any check fails.
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "../sprite_atlas.h"
+#include "../sprites_generated.h"
+#include "png_reader.h"
+
+typedef std::chrono::steady_clock Clock;
+
+#define RESOURCE(id) { id, #id }
+const struct {
+    int id;
+    const char* name;
+} RESOURCES[] = {
+    RESOURCE(ID_IMAGE_HAPPY), RESOURCE(ID_IMAGE_NEUTRAL), RESOURCE(ID_IMAGE_GRIMACE_TWO_SWEAT),
+    RESOURCE(ID_IMAGE_ANGUISH), RESOURCE(ID_IMAGE_ANGUISH_VERY), RESOURCE(ID_IMAGE_ANGUISH_EXTREMELY),
+    RESOURCE(ID_IMAGE_TIRED), RESOURCE(ID_IMAGE_TIRED_VERY), RESOURCE(ID_IMAGE_TIRED_EXTREMELY),
+    RESOURCE(ID_IMAGE_PLEASED), RESOURCE(ID_IMAGE_SURPRISED), RESOURCE(ID_IMAGE_GRIMACE),
+    RESOURCE(ID_IMAGE_HAPPY_BLINK), RESOURCE(ID_IMAGE_NEUTRAL_BLINK), RESOURCE(ID_IMAGE_GRIMACE_TWO_SWEAT_BLINK),
+    RESOURCE(ID_IMAGE_ANGUISH_BLINK), RESOURCE(ID_IMAGE_ANGUISH_VERY_BLINK), RESOURCE(ID_IMAGE_TIRED_VERY_BLINK),
+};
+#undef RESOURCE
+
+// The PNG behind a resource id, from app.rc
+static std::string ResourcePath(const std::string& root, int id) {
+    std::vector<std::string> names, paths;
+    PngReader::ReadResourceScript((root + "/app.rc").c_str(), names, paths);
+    for (const auto& resource : RESOURCES) {
+        if (resource.id != id) continue;
+        for (std::size_t i = 0; i < names.size(); i++) {
+            if (names[i] == resource.name) return root + "/" + paths[i];
+        }
+    }
+    return std::string();
+}
+
+// One pixel of an embedded sprite, straight from the generated tables
+static uint32_t EmbeddedPixel(const EmbeddedSprite& sprite, int x, int y) {
+    const uint8_t* plane = g_embeddedIndices + sprite.offset;
+    if (sprite.bits == 4) {
+        uint8_t byte = plane[y * ((sprite.width + 1) / 2) + x / 2];
+        return g_embeddedPalette[(x & 1) ? (byte >> 4) : (byte & 0x0F)];
+    }
+    if (sprite.bits == 8) {
+        return g_embeddedPalette[plane[y * sprite.width + x]];
+    }
+    uint32_t pixel;
+    std::memcpy(&pixel, plane + ((std::size_t)y * sprite.width + x) * 4, 4);
+    return pixel;
+}
+
+static bool Decode(const std::string& path, PngReader::Image& image) {
+    std::vector<uint8_t> bytes;
+    const char* error = "can't read the file";
+    if (!PngReader::ReadFile(path.c_str(), bytes) || !PngReader::Decode(bytes.data(), bytes.size(), image, error)) {
+        std::printf("  FAIL: %s: %s\n", path.c_str(), error);
+        return false;
+    }
+    return true;
+}
+
+static bool Check(bool condition, const char* what, int sprite) {
+    if (!condition) std::printf("  FAIL: sprite %d: %s\n", sprite, what);
+    return condition;
+}
+
+int main(int argc, char** argv) {
+    std::string root = argc > 1 ? argv[1] : ".";
+    if (argc > 2) {
+        std::fprintf(stderr, "usage: %s [repo root]\n", argv[0]);
+        return 2;
+    }
+
+    // Before: one decoded image per state and per blink, shared blinks decoded again
+    Clock::time_point start = Clock::now();
+    std::size_t perStateBytes = 0;
+    int perStateImages = 0;
+    for (int state = 0; state < EMOTIONAL_STATE_COUNT; state++) {
+        for (int sprite : { g_embeddedStateSprites[state], g_embeddedBlinkSprites[state] }) {
+            if (sprite < 0) continue;
+            PngReader::Image image;
+            if (!Decode(ResourcePath(root, g_embeddedSprites[sprite].resourceId), image)) return 1;
+            perStateBytes += image.pixels.size() * sizeof(uint32_t);
+            perStateImages++;
+        }
+    }
+    double perStateMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    // After: each resource decoded once into its atlas slot
+    start = Clock::now();
+    SpriteAtlas atlas;
+    std::vector<PngReader::Image> images(EMBEDDED_SPRITE_COUNT);
+    for (int i = 0; i < EMBEDDED_SPRITE_COUNT; i++) {
+        if (!Decode(ResourcePath(root, g_embeddedSprites[i].resourceId), images[i])) return 1;
+        atlas.AddSprite(images[i].width, images[i].height);
+    }
+    atlas.Allocate();
+    for (int i = 0; i < EMBEDDED_SPRITE_COUNT; i++) {
+        uint32_t* row = atlas.SpritePixels(i);
+        for (int y = 0; y < images[i].height; y++, row += atlas.Stride()) {
+            for (int x = 0; x < images[i].width; x++) {
+                row[x] = SpriteAtlas::Premultiply(images[i].pixels[(std::size_t)y * images[i].width + x]);
+            }
+        }
+        atlas.FinishSprite(i);
+    }
+    double atlasMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    bool ok = (atlas.Stride() * sizeof(uint32_t)) % 16 == 0;
+    if (!ok) std::printf("  FAIL: atlas stride is %d pixels, not a multiple of 16 bytes\n", atlas.Stride());
+    for (int i = 0; i < EMBEDDED_SPRITE_COUNT; i++) {
+        const EmbeddedSprite& embedded = g_embeddedSprites[i];
+        const SpriteRect& rect = atlas.Rect(i);
+        std::size_t offsetBytes = (std::size_t)(atlas.SpritePixels(i) - atlas.Pixels()) * sizeof(uint32_t);
+        ok &= Check(rect.width == embedded.width && rect.height == embedded.height, "size differs from the generated table", i);
+        ok &= Check(offsetBytes % 16 == 0, "not 16-byte aligned in the atlas", i);
+        ok &= Check(atlas.IsOpaque(i) == embedded.opaque, "opaque flag differs from the generated table", i);
+
+        int mismatches = 0;
+        const uint32_t* row = atlas.SpritePixels(i);
+        for (int y = 0; y < rect.height; y++, row += atlas.Stride()) {
+            for (int x = 0; x < rect.width; x++) {
+                mismatches += row[x] != EmbeddedPixel(embedded, x, y);
+            }
+        }
+        ok &= Check(mismatches == 0, "pixels differ from the embedded plane", i);
+
+        // Draw onto a half-transparent background, next to the per-pixel reference
+        const int margin = 3;
+        int width = rect.width + 2 * margin;
+        std::vector<uint32_t> drawn((std::size_t)width * (rect.height + 2 * margin), 0x80402010u);
+        std::vector<uint32_t> expected = drawn;
+        atlas.Draw(i, drawn.data(), width, margin, margin);
+        row = atlas.SpritePixels(i);
+        for (int y = 0; y < rect.height; y++, row += atlas.Stride()) {
+            for (int x = 0; x < rect.width; x++) {
+                uint32_t& out = expected[(std::size_t)(y + margin) * width + x + margin];
+                out = BlendOver(row[x], out);
+            }
+        }
+        ok &= Check(drawn == expected, "Draw() differs from BlendOver()", i);
+    }
+
+    std::printf("per-state images: %d decodes, %.2f ms, %zu bytes of pixels\n", perStateImages, perStateMs, perStateBytes);
+    std::printf("atlas:            %d decodes, %.2f ms, %zu bytes (%dx%d)\n", EMBEDDED_SPRITE_COUNT, atlasMs,
+                atlas.SizeInBytes(), atlas.Width(), atlas.Height());
+    std::printf("%d sprites checked against sprites_generated.h: %s\n", EMBEDDED_SPRITE_COUNT, ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
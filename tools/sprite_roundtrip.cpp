@@ -0,0 +1,205 @@
+// Round-trip check for the build-time embedded sprites (sprites_generated.h, written
+// by tools/embed_sprites.py): the embedded planes must decode back to the source PNGs.
+//
+// Usage: sprite_roundtrip [repo root]
+//
+// Build: cl /EHsc /O2 /nologo /Fesprite_roundtrip.exe tools\sprite_roundtrip.cpp
+//        g++ -O2 -std=c++14 -o sprite_roundtrip tools/sprite_roundtrip.cpp
+//
+// Loads the sprites the way LoadEmbeddedSprites() does (PaletteSpriteStore attached
+// to the read-only tables), expands every one and compares it pixel for pixel with
+// its PNG from app.rc, decoded and premultiplied. It also checks that each state and
+// blink table entry points at the resource LoadImages() used to load for it, so a
+// stale header (a PNG edited without rerunning the generator) or a mis-ordered table
+// fails. Then it times startup both ways: attaching the embedded tables against
+// reading, decoding, staging and palette-indexing the PNGs.
+// Exits with 1 if any check fails.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "../sprite_palette.h"
+#include "../sprites_generated.h"
+#include "png_reader.h"
+
+typedef std::chrono::steady_clock Clock;
+
+// The (image, blink) resources each state loaded before the sprites were embedded
+const struct {
+    const char* image;
+    const char* blink;   // nullptr = no blink
+} STATE_RESOURCES[EMOTIONAL_STATE_COUNT] = {
+    { "ID_IMAGE_HAPPY", "ID_IMAGE_HAPPY_BLINK" },
+    { "ID_IMAGE_PLEASED", nullptr },
+    { "ID_IMAGE_NEUTRAL", "ID_IMAGE_NEUTRAL_BLINK" },
+    { "ID_IMAGE_GRIMACE", nullptr },
+    { "ID_IMAGE_GRIMACE_TWO_SWEAT", "ID_IMAGE_GRIMACE_TWO_SWEAT_BLINK" },
+    { "ID_IMAGE_SURPRISED", nullptr },
+    { "ID_IMAGE_ANGUISH", "ID_IMAGE_ANGUISH_BLINK" },
+    { "ID_IMAGE_ANGUISH_VERY", "ID_IMAGE_ANGUISH_VERY_BLINK" },
+    { "ID_IMAGE_ANGUISH_EXTREMELY", nullptr },
+    { "ID_IMAGE_TIRED", "ID_IMAGE_NEUTRAL_BLINK" },   // Tired borrows neutral_blink
+    { "ID_IMAGE_TIRED_VERY", "ID_IMAGE_TIRED_VERY_BLINK" },
+    { "ID_IMAGE_TIRED_EXTREMELY", nullptr },
+};
+
+#define RESOURCE(id) { id, #id }
+const struct {
+    int id;
+    const char* name;
+} RESOURCE_IDS[] = {
+    RESOURCE(ID_IMAGE_HAPPY), RESOURCE(ID_IMAGE_NEUTRAL), RESOURCE(ID_IMAGE_GRIMACE_TWO_SWEAT),
+    RESOURCE(ID_IMAGE_ANGUISH), RESOURCE(ID_IMAGE_ANGUISH_VERY), RESOURCE(ID_IMAGE_ANGUISH_EXTREMELY),
+    RESOURCE(ID_IMAGE_TIRED), RESOURCE(ID_IMAGE_TIRED_VERY), RESOURCE(ID_IMAGE_TIRED_EXTREMELY),
+    RESOURCE(ID_IMAGE_PLEASED), RESOURCE(ID_IMAGE_SURPRISED), RESOURCE(ID_IMAGE_GRIMACE),
+    RESOURCE(ID_IMAGE_HAPPY_BLINK), RESOURCE(ID_IMAGE_NEUTRAL_BLINK), RESOURCE(ID_IMAGE_GRIMACE_TWO_SWEAT_BLINK),
+    RESOURCE(ID_IMAGE_ANGUISH_BLINK), RESOURCE(ID_IMAGE_ANGUISH_VERY_BLINK), RESOURCE(ID_IMAGE_TIRED_VERY_BLINK),
+};
+#undef RESOURCE
+
+static const char* ResourceName(int id) {
+    for (const auto& resource : RESOURCE_IDS) {
+        if (resource.id == id) return resource.name;
+    }
+    return "?";
+}
+
+struct Resources {
+    std::vector<std::string> names;
+    std::vector<std::string> paths;
+
+    std::string Path(const std::string& root, const char* name) const {
+        for (std::size_t i = 0; i < names.size(); i++) {
+            if (names[i] == name) return root + "/" + paths[i];
+        }
+        return std::string();
+    }
+};
+
+static bool DecodePremultiplied(const std::string& path, PngReader::Image& image) {
+    std::vector<uint8_t> bytes;
+    const char* error = "can't read the file";
+    if (!PngReader::ReadFile(path.c_str(), bytes) || !PngReader::Decode(bytes.data(), bytes.size(), image, error)) {
+        std::printf("  FAIL: %s: %s\n", path.c_str(), error);
+        return false;
+    }
+    for (uint32_t& pixel : image.pixels) {
+        pixel = SpriteAtlas::Premultiply(pixel);
+    }
+    return true;
+}
+
+static void LoadEmbedded(PaletteSpriteStore& store) {
+    store.AttachPalette(g_embeddedPalette, EMBEDDED_PALETTE_SIZE);
+    for (const EmbeddedSprite& sprite : g_embeddedSprites) {
+        store.AttachSprite(g_embeddedIndices + sprite.offset, sprite.width, sprite.height, sprite.bits, sprite.opaque);
+    }
+}
+
+// The ETM_DECODE_SPRITE_RESOURCES path with the portable decoder standing in for GDI+
+static bool LoadDecoded(const std::string& root, const Resources& resources, PaletteSpriteStore& store) {
+    std::vector<std::string> loaded;
+    SpriteAtlas atlas;
+    std::vector<PngReader::Image> images;
+    for (const auto& state : STATE_RESOURCES) {
+        for (const char* name : { state.image, state.blink }) {
+            if (!name || std::find(loaded.begin(), loaded.end(), name) != loaded.end()) continue;
+            loaded.push_back(name);
+            images.emplace_back();
+            if (!DecodePremultiplied(resources.Path(root, name), images.back())) return false;
+            atlas.AddSprite(images.back().width, images.back().height);
+        }
+    }
+    atlas.Allocate();
+    for (int i = 0; i < (int)images.size(); i++) {
+        uint32_t* row = atlas.SpritePixels(i);
+        for (int y = 0; y < images[i].height; y++, row += atlas.Stride()) {
+            std::memcpy(row, images[i].pixels.data() + (std::size_t)y * images[i].width, images[i].width * sizeof(uint32_t));
+        }
+        atlas.FinishSprite(i);
+        store.Add(atlas.SpritePixels(i), images[i].width, images[i].height, atlas.Stride());
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    std::string root = argc > 1 ? argv[1] : ".";
+    if (argc > 2) {
+        std::fprintf(stderr, "usage: %s [repo root]\n", argv[0]);
+        return 2;
+    }
+    Resources resources;
+    if (!PngReader::ReadResourceScript((root + "/app.rc").c_str(), resources.names, resources.paths)) {
+        std::fprintf(stderr, "can't read %s/app.rc\n", root.c_str());
+        return 1;
+    }
+
+    bool ok = true;
+    for (int state = 0; state < EMOTIONAL_STATE_COUNT; state++) {
+        const char* image = ResourceName(g_embeddedSprites[g_embeddedStateSprites[state]].resourceId);
+        int blink = g_embeddedBlinkSprites[state];
+        const char* blinkImage = blink >= 0 ? ResourceName(g_embeddedSprites[blink].resourceId) : nullptr;
+        bool blinkOk = STATE_RESOURCES[state].blink ? blinkImage && std::strcmp(blinkImage, STATE_RESOURCES[state].blink) == 0
+                                                    : blinkImage == nullptr;
+        if (std::strcmp(image, STATE_RESOURCES[state].image) != 0 || !blinkOk) {
+            std::printf("  FAIL: %s maps to %s / %s\n", EMOTIONAL_STATE_NAMES[state], image, blinkImage ? blinkImage : "no blink");
+            ok = false;
+        }
+    }
+
+    PaletteSpriteStore embedded;
+    LoadEmbedded(embedded);
+    for (int i = 0; i < EMBEDDED_SPRITE_COUNT; i++) {
+        const char* name = ResourceName(g_embeddedSprites[i].resourceId);
+        PngReader::Image image;
+        if (!DecodePremultiplied(resources.Path(root, name), image)) {
+            ok = false;
+            continue;
+        }
+        if (image.width != embedded.Width(i) || image.height != embedded.Height(i)) {
+            std::printf("  FAIL: %s is %dx%d, embedded as %dx%d\n", name, image.width, image.height, embedded.Width(i),
+                        embedded.Height(i));
+            ok = false;
+            continue;
+        }
+        std::vector<uint32_t> expanded(image.pixels.size());
+        embedded.Expand(i, expanded.data(), image.width);
+        int mismatches = 0;
+        bool opaque = true;
+        for (std::size_t p = 0; p < expanded.size(); p++) {
+            mismatches += expanded[p] != image.pixels[p];
+            opaque &= (image.pixels[p] >> 24) == 0xFF;
+        }
+        if (mismatches || opaque != embedded.IsOpaque(i)) {
+            std::printf("  FAIL: %s: %d pixels differ from the PNG%s\n", name, mismatches,
+                        opaque != embedded.IsOpaque(i) ? ", opaque flag wrong" : "");
+            ok = false;
+        }
+    }
+    std::printf("%d embedded sprites round-tripped against img/*.png: %s\n", EMBEDDED_SPRITE_COUNT, ok ? "ok" : "FAILED");
+
+    // Startup, both ways
+    const int ROUNDS = 50;
+    Clock::time_point start = Clock::now();
+    std::size_t footprint = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        PaletteSpriteStore store;
+        LoadEmbedded(store);
+        footprint = store.FootprintBytes();
+    }
+    double embeddedUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / ROUNDS;
+    start = Clock::now();
+    std::size_t decodedFootprint = 0;
+    for (int round = 0; round < ROUNDS && ok; round++) {
+        PaletteSpriteStore store;
+        ok &= LoadDecoded(root, resources, store);
+        decodedFootprint = store.FootprintBytes();
+    }
+    double decodedUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / ROUNDS;
+    std::printf("startup: embedded %.1f us (%zu bytes, read-only), decode path %.1f us (%zu bytes on the heap)\n",
+                embeddedUs, footprint, decodedUs, decodedFootprint);
+    return ok ? 0 : 1;
+}
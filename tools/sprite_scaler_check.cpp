@@ -0,0 +1,237 @@
+// Golden-image tests and a benchmark for the HiDPI sprite scaler (sprite_scaler.h).
+//
+// Usage: sprite_scaler_check [--goldens]
+//
+// Build: cl /EHsc /O2 /nologo /Fesprite_scaler_check.exe tools\sprite_scaler_check.cpp
+//        g++ -O2 -std=c++14 -o sprite_scaler_check tools/sprite_scaler_check.cpp
+//
+// Checks:
+//   - a 4x2 test image scaled to 2x, 3x, 125% and 150% against hand-worked goldens,
+//   - every embedded face at 100%, 125%, 150%, 200% and 300% against recorded
+//     FNV-1a hashes of the scaled pixels, and at whole-number factors that every
+//     source pixel became a solid factor x factor block,
+//   - ScaledSpriteCache: one scale per (sprite, scale) miss, Retain() dropping the
+//     other scales, and the byte budget holding after every Acquire() with
+//     least-recently-used sprites evicted first.
+// Then it times ScaleNearest() on a face at each scale. --goldens prints the hash
+// table for a deliberate change to the scaler or the sprites.
+// Exits with 1 if any check fails.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "../sprite_scaler.h"
+#include "../sprites_generated.h"
+
+typedef std::chrono::steady_clock Clock;
+
+const int SCALES[] = { 256, 320, 384, 512, 768 };   // 100%, 125%, 150%, 200%, 300%
+const int SCALE_COUNT = (int)(sizeof(SCALES) / sizeof(SCALES[0]));
+
+// FNV-1a of each embedded sprite scaled to SCALES[], recorded with --goldens
+const uint64_t GOLDEN_HASHES[EMBEDDED_SPRITE_COUNT][SCALE_COUNT] = {
+    { 0x112b3d508e08f1c3ull, 0x4365b32964e665a3ull, 0xfce8fadbeebd7ef3ull, 0xe465175bd9317a23ull, 0xb2ce3d23cc7c8fc3ull, },
+    { 0x2043ee4a35664883ull, 0x818839f71dc932dbull, 0x8e8e7fc1bdaac283ull, 0x8410ca80e8949083ull, 0xe86e53bdadd8b483ull, },
+    { 0x8bc098ad7c8fd063ull, 0x9bd9b0adbb5402c3ull, 0xd1b840cc2b63f06bull, 0x74ae78efcf2bc903ull, 0x30b8463e72364b63ull, },
+    { 0x3855e98e5429ded3ull, 0xfb25ce02cce9bc46ull, 0xbebe158072331e4bull, 0x9aecf8bcb74c0643ull, 0xb29fd2c6decb1a53ull, },
+    { 0xe05bf8636e7c1393ull, 0x2076c173bf06e70eull, 0x8185e3b23787dbdbull, 0xca3108d0e485f0a3ull, 0x30ab084260030113ull, },
+    { 0xba498960e1cc1c13ull, 0xac4fd4c97b0618b6ull, 0x1792b97644505453ull, 0x330339c7e4b38ca3ull, 0x7849e1f523e53793ull, },
+    { 0x0a4a7f75599b9573ull, 0xcaa5a804d454150eull, 0xc6163d7d988d1e63ull, 0x491fc3470594de83ull, 0x87d716e0bde34f33ull, },
+    { 0x7b1ecf74dc8686f3ull, 0xd386aaef1a7d1916ull, 0xc2f975bbeca047d3ull, 0xecf153c0b0d57783ull, 0x84051fb79c325e93ull, },
+    { 0xdb3ccd683eee8e96ull, 0x102550056f91572bull, 0x64b270232e4defdbull, 0xef6662c00ff7b8d3ull, 0x996bd64fcd8c6f5eull, },
+    { 0x65113e43ec2889e3ull, 0x2e153c96459f89f3ull, 0x585c65b6df162406ull, 0xf75b204090f86ba3ull, 0xfb9d0afe900d18e3ull, },
+    { 0xd1c699f5bdd5dc23ull, 0x83e75c74cd61f24bull, 0xd888735386f30616ull, 0x660a727e0a741aa3ull, 0xd886aca280b58103ull, },
+    { 0x0c2e23a3a0de482eull, 0x32533a810db0b913ull, 0x64b4f025d4d63556ull, 0x6e0fdfb1e0fbd973ull, 0xc4b1abcf45a34e36ull, },
+    { 0xab2e44bab5801423ull, 0x99854c895e08c24bull, 0x60f5ca826e28b896ull, 0xbe807ee769ad36a3ull, 0x3155a091551e4ec3ull, },
+    { 0x4a31bc3264199deeull, 0x1d1f4473746449e6ull, 0x430f527a02aefdf3ull, 0x4e2943b1c32d0e93ull, 0x4fa01d0a1836f3a6ull, },
+    { 0x20c9615288cc73c3ull, 0xad0b469d6461226bull, 0x325b51ef3862f33bull, 0x07240a80e69c08e3ull, 0x0fe9542e30185fc3ull, },
+    { 0x817f7762caad2b36ull, 0xf3c932f45bdda7e6ull, 0x1ab430b9ee14407bull, 0xb288ad8664875b13ull, 0x6c7fff1f57d81cfeull, },
+    { 0x7d676d2cf969eda6ull, 0x9dd85b0f1ceede53ull, 0x87eda7a3ccafad8bull, 0xfc1163a50c5a2573ull, 0x2d52f171088b4beeull, },
+    { 0x691695c08f86e6b3ull, 0x454a51d03f1aae56ull, 0xd6ab5565dd763a4bull, 0xc429b792f6f367a3ull, 0x91ed1e08fde3b393ull, },
+};
+
+static bool Check(bool condition, const char* what) {
+    if (!condition) std::printf("  FAIL: %s\n", what);
+    return condition;
+}
+
+static uint64_t Hash(const std::vector<uint32_t>& pixels) {
+    uint64_t hash = 1469598103934665603ull;
+    for (uint32_t pixel : pixels) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            hash = (hash ^ ((pixel >> shift) & 0xFF)) * 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+static std::vector<uint32_t> Scaled(const std::vector<uint32_t>& src, int width, int height, int scale, int& outWidth,
+                                    int& outHeight) {
+    outWidth = ScaledExtent(width, scale);
+    outHeight = ScaledExtent(height, scale);
+    std::vector<uint32_t> dst((std::size_t)outWidth * outHeight);
+    ScaleNearest(src.data(), width, height, width, dst.data(), outWidth, outHeight, outWidth);
+    return dst;
+}
+
+// A..H in a 4x2 image; the goldens below were worked out by hand from pixel centres
+static bool CheckSmallGoldens() {
+    enum { A = 1, B, C, D, E, F, G, H };
+    const std::vector<uint32_t> source = { A, B, C, D, E, F, G, H };
+    struct Golden {
+        int scale;
+        int width, height;
+        std::vector<uint32_t> pixels;
+    };
+    const Golden goldens[] = {
+        { 512, 8, 4, { A, A, B, B, C, C, D, D,
+                       A, A, B, B, C, C, D, D,
+                       E, E, F, F, G, G, H, H,
+                       E, E, F, F, G, G, H, H } },
+        { 768, 12, 6, { A, A, A, B, B, B, C, C, C, D, D, D,
+                        A, A, A, B, B, B, C, C, C, D, D, D,
+                        A, A, A, B, B, B, C, C, C, D, D, D,
+                        E, E, E, F, F, F, G, G, G, H, H, H,
+                        E, E, E, F, F, F, G, G, G, H, H, H,
+                        E, E, E, F, F, F, G, G, G, H, H, H } },
+        { 320, 5, 3, { A, B, C, C, D,
+                       E, F, G, G, H,
+                       E, F, G, G, H } },
+        { 384, 6, 3, { A, B, B, C, D, D,
+                       E, F, F, G, H, H,
+                       E, F, F, G, H, H } },
+    };
+    bool ok = true;
+    for (const Golden& golden : goldens) {
+        int width, height;
+        std::vector<uint32_t> scaled = Scaled(source, 4, 2, golden.scale, width, height);
+        if (width != golden.width || height != golden.height || scaled != golden.pixels) {
+            std::printf("  FAIL: 4x2 image at scale %d/256 differs from its golden\n", golden.scale);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static void LoadEmbedded(PaletteSpriteStore& store) {
+    store.AttachPalette(g_embeddedPalette, EMBEDDED_PALETTE_SIZE);
+    for (const EmbeddedSprite& sprite : g_embeddedSprites) {
+        store.AttachSprite(g_embeddedIndices + sprite.offset, sprite.width, sprite.height, sprite.bits, sprite.opaque);
+    }
+}
+
+static bool CheckSprites(const PaletteSpriteStore& store, bool printGoldens) {
+    bool ok = true;
+    for (int id = 0; id < store.SpriteCount(); id++) {
+        int width = store.Width(id), height = store.Height(id);
+        std::vector<uint32_t> base((std::size_t)width * height);
+        store.Expand(id, base.data(), width);
+        if (printGoldens) std::printf("    {");
+        for (int s = 0; s < SCALE_COUNT; s++) {
+            int outWidth, outHeight;
+            std::vector<uint32_t> scaled = Scaled(base, width, height, SCALES[s], outWidth, outHeight);
+            uint64_t hash = Hash(scaled);
+            if (printGoldens) {
+                std::printf(" 0x%016llxull,", (unsigned long long)hash);
+                continue;
+            }
+            if (hash != GOLDEN_HASHES[id][s]) {
+                std::printf("  FAIL: sprite %d at scale %d/256 differs from its golden hash\n", id, SCALES[s]);
+                ok = false;
+            }
+            if (SCALES[s] % SCALE_ONE == 0) {
+                int factor = SCALES[s] / SCALE_ONE;
+                int mismatches = 0;
+                for (int y = 0; y < outHeight; y++) {
+                    for (int x = 0; x < outWidth; x++) {
+                        mismatches += scaled[(std::size_t)y * outWidth + x] != base[(std::size_t)(y / factor) * width + x / factor];
+                    }
+                }
+                if (mismatches) {
+                    std::printf("  FAIL: sprite %d at %dx isn't made of %dx%d blocks\n", id, factor, factor, factor);
+                    ok = false;
+                }
+            }
+        }
+        if (printGoldens) std::printf(" },\n");
+    }
+    return ok;
+}
+
+static bool CheckCache(const PaletteSpriteStore& store) {
+    bool ok = true;
+    {
+        ScaledSpriteCache cache;
+        for (int round = 0; round < 3; round++) {
+            for (int id = 0; id < store.SpriteCount(); id++) cache.Acquire(store, id, 384);
+        }
+        ok &= Check(cache.Scaled() == (unsigned long)store.SpriteCount(), "a cached sprite was scaled again");
+        for (int id = 0; id < 4; id++) cache.Acquire(store, id, 512);
+        cache.Retain(512);
+        ok &= Check(cache.Count() == 4, "Retain() kept another scale");
+    }
+    {
+        // Room for three faces at 200% (48x32 -> 96x64, 24 KiB each)
+        const std::size_t budget = 3 * 96 * 64 * sizeof(uint32_t);
+        ScaledSpriteCache cache(budget);
+        bool underBudget = true;
+        for (int id = 0; id < store.SpriteCount(); id++) {
+            cache.Acquire(store, id, 512);
+            underBudget &= cache.Bytes() <= budget;
+        }
+        ok &= Check(underBudget && cache.Count() == 3, "cache grew past its budget");
+
+        // Touch the oldest survivor, add one more: the untouched middle one goes
+        int first = store.SpriteCount() - 3;
+        unsigned long scaled = cache.Scaled();
+        cache.Acquire(store, first, 512);
+        cache.Acquire(store, 0, 512);
+        ok &= Check(cache.Scaled() == scaled + 1, "a hit re-scaled");
+        cache.Acquire(store, first, 512);
+        cache.Acquire(store, first + 2, 512);
+        ok &= Check(cache.Scaled() == scaled + 1, "the recently used sprites were evicted");
+        cache.Acquire(store, first + 1, 512);
+        ok &= Check(cache.Scaled() == scaled + 2, "the least recently used sprite wasn't evicted");
+
+        // A single sprite larger than the budget is still kept for the draw
+        cache.Acquire(store, 0, 2048);
+        ok &= Check(cache.Count() == 1, "an oversized sprite didn't evict the rest");
+    }
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    bool printGoldens = argc == 2 && std::strcmp(argv[1], "--goldens") == 0;
+    if (argc > 1 && !printGoldens) {
+        std::fprintf(stderr, "usage: %s [--goldens]\n", argv[0]);
+        return 2;
+    }
+    PaletteSpriteStore store;
+    LoadEmbedded(store);
+    if (printGoldens) {
+        CheckSprites(store, true);
+        return 0;
+    }
+
+    bool small = CheckSmallGoldens();
+    bool sprites = CheckSprites(store, false);
+    bool cache = CheckCache(store);
+    std::printf("4x2 goldens: %s\nembedded sprite goldens: %s\ncache budget and eviction: %s\n", small ? "ok" : "FAILED",
+                sprites ? "ok" : "FAILED", cache ? "ok" : "FAILED");
+
+    std::vector<uint32_t> base((std::size_t)store.Width(0) * store.Height(0));
+    store.Expand(0, base.data(), store.Width(0));
+    std::printf("%8s %10s %12s\n", "scale", "size", "us/sprite");
+    for (int scale : SCALES) {
+        int width, height;
+        const int ROUNDS = 2000;
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < ROUNDS; i++) {
+            Scaled(base, store.Width(0), store.Height(0), scale, width, height);
+        }
+        double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / ROUNDS;
+        std::printf("%7d%% %5dx%-4d %12.2f\n", scale * 100 / SCALE_ONE, width, height, us);
+    }
+    return small && sprites && cache ? 0 : 1;
+}
@@ -0,0 +1,40 @@
+// Prints the current mood from the shared state page (state_page.h), for shell
+// prompts and status bars. No socket, no file: after the page is mapped a read is a
+// few loads.
+//
+// Usage: state_page_read [--json]
+//
+// Build: cl /EHsc /nologo /Festate_page_read.exe tools\state_page_read.cpp
+//        g++ -O2 -std=c++14 -o state_page_read tools/state_page_read.cpp -lrt
+//
+// Exits with 1 (and prints nothing) when the app isn't running.
+
+#include <cstdio>
+#include <cstring>
+#include "../state_page.h"
+
+int main(int argc, char** argv) {
+    bool json = argc > 1 && std::strcmp(argv[1], "--json") == 0;
+    if (argc > 1 && !json) {
+        std::fprintf(stderr, "usage: %s [--json]\n", argv[0]);
+        return 2;
+    }
+
+    StatePageReader reader;
+    StatePageData data;
+    if (!reader.Open() || !reader.Read(data)) {
+        return 1;
+    }
+    if (json) {
+        std::printf("{\"state\":\"%s\",\"cpu\":%.1f,\"memory\":%.1f,\"hottest_core\":%.1f,\"saturated_cores\":%d,"
+                    "\"battery\":%d,\"sequence\":%llu,\"time_ms\":%lld}\n",
+                    data.stateName, data.cpuUsage, data.memoryUsage, data.hottestCoreUsage, data.saturatedCores,
+                    data.batteryPercent, (unsigned long long)data.sequence, (long long)data.timeMs);
+    } else if (data.batteryPercent >= 0) {
+        std::printf("%s cpu %.0f%% mem %.0f%% bat %d%%\n", data.stateName, data.cpuUsage, data.memoryUsage,
+                    data.batteryPercent);
+    } else {
+        std::printf("%s cpu %.0f%% mem %.0f%%\n", data.stateName, data.cpuUsage, data.memoryUsage);
+    }
+    return 0;
+}
@@ -0,0 +1,188 @@
+// Stress test for the shared state page (state_page.h): one writer, concurrent
+// readers on their own mappings, and who gets to own the name.
+//
+// Usage: state_page_stress [--readers N] [--seconds N]
+//
+// Build: cl /EHsc /O2 /nologo /Festate_page_stress.exe tools\state_page_stress.cpp
+//        g++ -O2 -std=c++14 -pthread -o state_page_stress tools/state_page_stress.cpp -lrt
+//        (add -fsanitize=thread to check the memory ordering)
+//
+// Uses its own page name, so it can run next to the app. In order:
+//   - ownership: a second writer can't open a page that is already published, and
+//     can once the first one closes; on POSIX, a page left by a writer process that
+//     exited without closing is replaced,
+//   - torn reads: one writer publishes as fast as it can while N readers (default 4),
+//     each with its own StatePageReader and so its own mapping, read for --seconds
+//     (default 2). Every field of a publish is derived from its sequence, so a read
+//     mixing two publishes is caught, and each reader checks the sequence never goes
+//     backwards. Reads that gave up after their tries are counted, not failed.
+// Prints publishes and reads per second. Exits with 1 on any failed check.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "../state_page.h"
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+#ifdef _WIN32
+#define STRESS_PAGE_NAME L"Local\\EmotionalTaskManagerStateStress"
+#else
+#define STRESS_PAGE_NAME "/emotional-task-manager-stress"
+#endif
+
+static bool Check(bool condition, const char* what) {
+    if (!condition) std::printf("  FAIL: %s\n", what);
+    return condition;
+}
+
+static StatePageData Make(uint64_t n) {
+    StatePageData data = {};
+    data.sequence = n;
+    data.timeMs = (int64_t)n * 3 + 1700000000000LL;
+    data.cpuUsage = (double)(n % 1000) / 10.0;
+    data.memoryUsage = (double)(n % 997) / 10.0;
+    data.hottestCoreUsage = (float)(n % 101);
+    data.saturatedCores = (int32_t)(n % 64);
+    data.batteryPercent = (int32_t)(n % 102) - 1;
+    data.state = (uint8_t)(n % 12);
+    data.isBlinking = (uint8_t)(n & 1);
+    std::snprintf(data.stateName, sizeof(data.stateName), "S%llu", (unsigned long long)(n % 100000000));
+    return data;
+}
+
+static bool Consistent(const StatePageData& data) {
+    StatePageData expected = Make(data.sequence);
+    return data.timeMs == expected.timeMs && data.cpuUsage == expected.cpuUsage &&
+           data.memoryUsage == expected.memoryUsage && data.hottestCoreUsage == expected.hottestCoreUsage &&
+           data.saturatedCores == expected.saturatedCores && data.batteryPercent == expected.batteryPercent &&
+           data.state == expected.state && data.isBlinking == expected.isBlinking &&
+           std::strcmp(data.stateName, expected.stateName) == 0;
+}
+
+static bool CheckOwnership() {
+    StatePageWriter first, second;
+    bool ok = Check(first.Open(STRESS_PAGE_NAME), "can't create the page");
+    ok &= Check(!second.Open(STRESS_PAGE_NAME), "a second writer opened a page that is already published");
+    {
+        StatePageReader reader;
+        StatePageData data;
+        first.Publish(Make(7));
+        ok &= Check(reader.Open(STRESS_PAGE_NAME) && reader.Read(data) && data.sequence == 7,
+                    "the refused writer disturbed the published page");
+    }
+    first.Close();
+    ok &= Check(second.Open(STRESS_PAGE_NAME), "a writer couldn't open the page after the first one closed");
+    second.Close();
+
+#ifndef _WIN32
+    // A writer that dies without closing leaves the name behind
+    pid_t child = fork();
+    if (child == 0) {
+        StatePageWriter orphan;
+        _exit(orphan.Open(STRESS_PAGE_NAME) ? 0 : 1);   // No Close(): the name stays
+    }
+    int status = 0;
+    ok &= Check(child > 0 && waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0,
+                "the child writer didn't create the page");
+    StatePageReader left;
+    ok &= Check(left.Open(STRESS_PAGE_NAME), "the dead writer's page isn't there to replace");
+    left.Close();
+    ok &= Check(first.Open(STRESS_PAGE_NAME), "a page left by a dead writer wasn't replaced");
+    first.Close();
+#endif
+    std::printf("ownership: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+struct ReaderResult {
+    uint64_t reads = 0;
+    uint64_t gaveUp = 0;
+    uint64_t torn = 0;
+    uint64_t backwards = 0;
+    bool opened = false;
+};
+
+static bool CheckTornReads(int readers, int seconds) {
+    StatePageWriter writer;
+    if (!Check(writer.Open(STRESS_PAGE_NAME), "can't create the page")) return false;
+    writer.Publish(Make(1));
+
+    std::atomic<bool> stop(false);
+    std::vector<ReaderResult> results((std::size_t)readers);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readers; i++) {
+        threads.emplace_back([&stop, &results, i] {
+            ReaderResult& result = results[(std::size_t)i];
+            StatePageReader reader;
+            result.opened = reader.Open(STRESS_PAGE_NAME);
+            uint64_t last = 0;
+            StatePageData data;
+            while (result.opened && !stop.load(std::memory_order_relaxed)) {
+                if (!reader.Read(data)) {
+                    result.gaveUp++;
+                    continue;
+                }
+                result.reads++;
+                result.torn += !Consistent(data);
+                result.backwards += data.sequence < last;
+                last = data.sequence;
+            }
+        });
+    }
+
+    uint64_t publishes = 1;
+    Clock::time_point end = Clock::now() + std::chrono::seconds(seconds);
+    while (Clock::now() < end) {
+        for (int i = 0; i < 1000; i++) writer.Publish(Make(++publishes));
+    }
+    stop = true;
+    for (std::thread& thread : threads) thread.join();
+    writer.Close();
+
+    ReaderResult total;
+    bool opened = true;
+    for (const ReaderResult& result : results) {
+        total.reads += result.reads;
+        total.gaveUp += result.gaveUp;
+        total.torn += result.torn;
+        total.backwards += result.backwards;
+        opened &= result.opened;
+    }
+    std::printf("%d readers, %d s: %.1fM publishes/s, %.1fM reads/s, %llu gave up, %llu torn, %llu backwards\n",
+                readers, seconds, publishes / 1e6 / seconds, total.reads / 1e6 / seconds,
+                (unsigned long long)total.gaveUp, (unsigned long long)total.torn, (unsigned long long)total.backwards);
+    bool ok = Check(opened, "a reader couldn't open the page");
+    ok &= Check(total.reads > 0, "no read succeeded");
+    ok &= Check(total.torn == 0, "a read mixed two publishes");
+    ok &= Check(total.backwards == 0, "a reader saw the sequence go backwards");
+    std::printf("torn reads: %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    int readers = 4;
+    int seconds = 2;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--readers") == 0 && i + 1 < argc) {
+            readers = (std::max)(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = (std::max)(1, std::atoi(argv[++i]));
+        } else {
+            std::fprintf(stderr, "usage: %s [--readers N] [--seconds N]\n", argv[0]);
+            return 2;
+        }
+    }
+    bool ok = CheckOwnership();
+    ok &= CheckTornReads(readers, seconds);
+    std::printf("state page checks: %s\n", ok ? "ok" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,492 @@
+// Replays a trace of samples and events through the state machine (state_machine.h)
+// on a simulated clock, as fast as it can, and prints the resulting state timeline.
+//
+// Usage: state_replay [--rules rules.conf] [--expect timeline.txt] [--quiet] trace
+//        state_replay [--rules rules.conf] --synthetic N [--seed S] [--emit-trace]
+//        state_replay [--rules rules.conf] --flap-check [--min-reduction X] [--seed S]
+//        state_replay --suite tools/traces/golden.txt [--update]
+//
+// Build: cl /EHsc /O2 /nologo /Festate_replay.exe tools\state_replay.cpp
+//        g++ -O2 -std=c++14 -o state_replay tools/state_replay.cpp
+//
+// A trace is either a history ring (history_ring.h) recorded by the app, or text:
+//
+//   # time_ms  sample  cpu  saturated_cores  battery  memory   (battery "-" for none)
+//   0     sample 12.5 0 80 41.0
+//   500   sample 93.0 2 80 41.2
+//   900   event SURPRISED
+//
+// Times are milliseconds from any origin and must not go backwards. The timeline has
+// one line per state change: "time_ms STATE cause", the cause being sample, event or
+// expire (a temporary state ran out). With --expect the timeline is compared to a
+// file instead of printed, and the exit code says whether it matched, so a directory
+// of traces and timelines works as a regression suite. --synthetic generates N
+// samples of random load with events (0.5 s apart) and reports the replay rate;
+// with --emit-trace it prints them as a text trace instead.
+//
+// --flap-check replays an hour of noisy CPU hovering around the 50 and 70 thresholds
+// twice: with the rules as given, and with their filters, bands, dwell and hold times
+// stripped. Smoothing has to cut the state changes by at least X times (default 5)
+// and leave no more than 6 a minute, or it exits with 1.
+//
+// --suite replays each trace listed in a manifest, one "trace timeline [rules]" per
+// line with paths relative to the manifest, and compares it to its timeline. It
+// prints ok or FAILED per trace and exits with 1 if any differ. tools/traces holds
+// the golden set; after a deliberate change to the rules or the state machine,
+// --update rewrites the timelines, and the diff shows what the change did.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "../emotional_state.h"
+#include "../history_ring.h"
+#include "../rules_config.h"
+#include "../state_machine.h"
+
+struct TraceEntry {
+    int64_t timeMs;
+    bool event;                // Enter `state`; otherwise a sample of `metrics`
+    EmotionalState state;
+    MetricValues metrics;
+};
+
+static bool ReadFile(const char* path, std::string& text) {
+    FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    char buffer[65536];
+    std::size_t read;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, read);
+    }
+    std::fclose(file);
+    return true;
+}
+
+static int FindState(const char* name, std::size_t length) {
+    for (int i = 0; i < EMOTIONAL_STATE_COUNT; i++) {
+        if (std::strlen(EMOTIONAL_STATE_NAMES[i]) == length && std::strncmp(EMOTIONAL_STATE_NAMES[i], name, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool ParseTextTrace(const std::string& text, std::vector<TraceEntry>& trace, std::string& error) {
+    const char* p = text.c_str();
+    int line = 0;
+    while (*p) {
+        line++;
+        const char* eol = std::strchr(p, '\n');
+        if (!eol) eol = p + std::strlen(p);
+        while (p < eol && (*p == ' ' || *p == '\t')) p++;
+        if (p == eol || *p == '#' || *p == '\r') {
+            p = *eol ? eol + 1 : eol;
+            continue;
+        }
+
+        TraceEntry entry = {};
+        char* next;
+        entry.timeMs = std::strtoll(p, &next, 10);
+        bool ok = next != p;
+        p = next;
+        while (p < eol && (*p == ' ' || *p == '\t')) p++;
+        if (ok && std::strncmp(p, "event", 5) == 0) {
+            p += 5;
+            while (p < eol && (*p == ' ' || *p == '\t')) p++;
+            const char* name = p;
+            while (p < eol && *p != ' ' && *p != '\t' && *p != '\r') p++;
+            int state = FindState(name, (std::size_t)(p - name));
+            ok = state >= 0;
+            entry.event = true;
+            entry.state = (EmotionalState)(ok ? state : HAPPY);
+        } else if (ok && std::strncmp(p, "sample", 6) == 0) {
+            p += 6;
+            double cpu = std::strtod(p, &next);
+            ok = next != p;
+            int cores = (int)std::strtol(p = next, &next, 10);
+            ok = ok && next != p;
+            while (next < eol && (*next == ' ' || *next == '\t')) next++;
+            bool hasBattery = *next != '-';
+            int battery = hasBattery ? (int)std::strtol(p = next, &next, 10) : 0;
+            ok = ok && (!hasBattery || next != p);
+            if (!hasBattery) next++;
+            double memory = std::strtod(p = next, &next);
+            ok = ok && next != p;
+            entry.metrics = MakeMetrics(cpu, cores, hasBattery, battery, memory);
+        } else {
+            ok = false;
+        }
+        if (!ok || (!trace.empty() && entry.timeMs < trace.back().timeMs)) {
+            error = "line " + std::to_string(line) + (ok ? ": time goes backwards" : ": expected \"<ms> sample ...\" or \"<ms> event STATE\"");
+            return false;
+        }
+        trace.push_back(entry);
+        p = *eol ? eol + 1 : eol;
+    }
+    return true;
+}
+
+// Samples become samples; device changes and application errors become the events
+// the app entered SURPRISED and GRIMACE for
+static bool ParseHistoryRing(const std::string& data, std::vector<TraceEntry>& trace, std::string& error) {
+    HistoryHeader header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.version != HISTORY_VERSION || header.recordSize != sizeof(HistoryRecord) || header.capacity == 0 ||
+        data.size() < sizeof(header) + header.capacity * sizeof(HistoryRecord)) {
+        error = "not a usable history ring";
+        return false;
+    }
+    std::vector<HistoryRecord> records((std::size_t)header.capacity);
+    std::memcpy(records.data(), data.data() + sizeof(header), records.size() * sizeof(HistoryRecord));
+    ForEachHistoryRecord(records.data(), header.capacity, [&](const HistoryRecord& record) {
+        if (!trace.empty() && record.timeMs < trace.back().timeMs) {
+            return;   // Wall clock stepped back; keep the simulated clock monotonic
+        }
+        TraceEntry entry = {};
+        entry.timeMs = record.timeMs;
+        if (record.flags & (HISTORY_DEVICE_CHANGE | HISTORY_APP_ERROR)) {
+            entry.event = true;
+            entry.state = record.flags & HISTORY_DEVICE_CHANGE ? SURPRISED : GRIMACE;
+        } else if (record.flags & HISTORY_SAMPLE) {
+            entry.metrics = MakeMetrics(record.cpu / 100.0, record.saturatedCores, record.battery >= 0,
+                                        record.battery, record.memory / 100.0);
+        } else {
+            return;
+        }
+        trace.push_back(entry);
+    });
+    return true;
+}
+
+// Random walk load with bursts, a draining battery and the occasional event
+static void Synthesize(uint64_t count, uint32_t seed, std::vector<TraceEntry>& trace) {
+    std::mt19937 random(seed);
+    std::normal_distribution<double> noise(0.0, 1.0);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double cpu = 20.0;
+    double memory = 50.0;
+    double battery = 100.0;
+    int burst = 0;
+    trace.reserve((std::size_t)count);
+    for (uint64_t i = 0; i < count; i++) {
+        TraceEntry entry = {};
+        entry.timeMs = (int64_t)i * 500;
+        if (uniform(random) < 0.0005) {
+            entry.event = true;
+            entry.state = uniform(random) < 0.5 ? SURPRISED : GRIMACE;
+            entry.timeMs += 250;
+            trace.push_back(entry);
+            entry.event = false;
+            entry.timeMs -= 250;
+        }
+        if (burst == 0 && uniform(random) < 0.002) {
+            burst = 20 + (int)(uniform(random) * 200);
+        }
+        double target = burst > 0 ? 85.0 : 20.0;
+        burst -= burst > 0;
+        cpu = std::min(100.0, std::max(0.0, cpu + 0.2 * (target - cpu) + 4.0 * noise(random)));
+        memory = std::min(100.0, std::max(0.0, memory + 0.3 * noise(random)));
+        battery = battery <= 3.0 ? 100.0 : battery - 0.002;
+        entry.metrics = MakeMetrics(cpu, cpu > 97.0 ? 1 : 0, true, (int)battery, memory);
+        trace.push_back(entry);
+    }
+    std::stable_sort(trace.begin(), trace.end(), [](const TraceEntry& a, const TraceEntry& b) { return a.timeMs < b.timeMs; });
+}
+
+// An hour of CPU hovering around a threshold, 5 minutes at each level, no events
+static void SynthesizeHovering(uint32_t seed, std::vector<TraceEntry>& trace) {
+    std::mt19937 random(seed);
+    std::normal_distribution<double> noise(0.0, 6.0);
+    for (int64_t i = 0; i < 7200; i++) {
+        double level = (i / 600) % 2 ? 65.0 : 50.0;
+        TraceEntry entry = {};
+        entry.timeMs = i * 500;
+        entry.metrics = MakeMetrics(std::min(100.0, std::max(0.0, level + noise(random))), 0, true, 80, 40.0);
+        trace.push_back(entry);
+    }
+}
+
+// The same thresholds evaluated sample by sample, the way the if/else chain did
+static RuleSet Unconditioned(const RuleSet& rules) {
+    RuleSet raw = rules;
+    for (int i = 0; i < raw.count; i++) {
+        raw.rules[i].dwellMs = 0;
+        raw.rules[i].band = 0;
+    }
+    for (FilterConfig& filter : raw.filters) {
+        filter = NoFilter();
+    }
+    raw.holdMs = 0;
+    return raw;
+}
+
+static void EmitTrace(const std::vector<TraceEntry>& trace) {
+    std::printf("# time_ms sample cpu saturated_cores battery memory\n");
+    for (const TraceEntry& entry : trace) {
+        if (entry.event) {
+            std::printf("%lld event %s\n", (long long)entry.timeMs, EMOTIONAL_STATE_NAMES[entry.state]);
+        } else {
+            const MetricValues& m = entry.metrics;
+            char battery[16];
+            if (std::isnan(m[METRIC_BATTERY])) std::snprintf(battery, sizeof(battery), "-");
+            else std::snprintf(battery, sizeof(battery), "%d", (int)m[METRIC_BATTERY]);
+            std::printf("%lld sample %.2f %d %s %.2f\n", (long long)entry.timeMs, m[METRIC_CPU],
+                        (int)m[METRIC_SATURATED_CORES], battery, m[METRIC_MEMORY]);
+        }
+    }
+}
+
+// Drives the state machine the way the monitor thread does: samples and events in
+// order, with the temporary state expiring at its deadline in between
+static uint64_t Replay(const std::vector<TraceEntry>& trace, const RuleSet& rules, std::string& timeline) {
+    typedef StateMachine::TimePoint TimePoint;
+    StateMachine machine(&rules);
+    uint64_t changes = 0;
+    int64_t lastSampleMs = -1;
+    auto emit = [&](TimePoint at, const char* cause) {
+        char line[64];
+        long long ms = (long long)std::chrono::duration_cast<std::chrono::milliseconds>(at.time_since_epoch()).count();
+        int length = std::snprintf(line, sizeof(line), "%lld %s %s\n", ms, EMOTIONAL_STATE_NAMES[machine.State()], cause);
+        timeline.append(line, (std::size_t)length);
+        changes++;
+    };
+
+    for (const TraceEntry& entry : trace) {
+        TimePoint now = TimePoint(std::chrono::milliseconds(entry.timeMs));
+        while (machine.InTemporaryState() && machine.TemporaryDeadline() <= now) {
+            TimePoint deadline = machine.TemporaryDeadline();
+            if (machine.Update(deadline).changed) emit(deadline, "expire");
+        }
+        if (entry.event) {
+            if (machine.EnterTemporaryState(entry.state, now).changed) emit(now, "event");
+        } else {
+            // Weighted by the time since the last sample, like the app's adaptive cadence
+            double periods = 1.0;
+            if (lastSampleMs >= 0) {
+                periods = (std::min)((std::max)((entry.timeMs - lastSampleMs) / 500.0, 0.1), 20.0);
+            }
+            lastSampleMs = entry.timeMs;
+            machine.SetMetrics(entry.metrics, periods);
+            if (machine.Update(now).changed) emit(now, "sample");
+        }
+    }
+    return changes;
+}
+
+static std::vector<std::string> SplitLines(const std::string& text) {
+    std::vector<std::string> lines;
+    std::size_t start = 0;
+    while (start < text.size()) {
+        std::size_t end = text.find('\n', start);
+        if (end == std::string::npos) end = text.size();
+        std::string line = text.substr(start, end - start);
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        lines.push_back(line);
+        start = end + 1;
+    }
+    return lines;
+}
+
+// Prints the first line where the timelines differ
+static bool CompareTimelines(const std::string& actual, const std::string& expected) {
+    std::vector<std::string> got = SplitLines(actual);
+    std::vector<std::string> want = SplitLines(expected);
+    for (std::size_t i = 0; i < got.size() || i < want.size(); i++) {
+        if (i >= got.size() || i >= want.size() || got[i] != want[i]) {
+            std::fprintf(stderr, "timeline differs at line %zu\n  expected: %s\n  actual:   %s\n", i + 1,
+                         i < want.size() ? want[i].c_str() : "(end)", i < got.size() ? got[i].c_str() : "(end)");
+            return false;
+        }
+    }
+    return true;
+}
+
+// A history ring or a text trace, told apart by the ring's magic
+static bool LoadTrace(const std::string& path, std::vector<TraceEntry>& trace, std::string& error) {
+    std::string data;
+    if (!ReadFile(path.c_str(), data)) {
+        error = "cannot open";
+        return false;
+    }
+    bool ring = data.size() >= sizeof(HistoryHeader) && std::memcmp(data.data(), HISTORY_MAGIC, sizeof(HISTORY_MAGIC)) == 0;
+    return ring ? ParseHistoryRing(data, trace, error) : ParseTextTrace(data, trace, error);
+}
+
+// STATE_RULES when no file is given
+static bool LoadRules(const char* path, RuleSet& rules, std::string& error) {
+    rules = MakeRuleSet(STATE_RULES);
+    if (!path) return true;
+    std::string name = path;
+    return LoadRulesFile(RulePath(name.begin(), name.end()), rules, &error);
+}
+
+// Replays every "trace timeline [rules]" line of a manifest (paths relative to it,
+// # comments) and compares each timeline, or rewrites them with `update`
+static bool RunSuite(const char* manifestPath, bool update) {
+    std::string manifest;
+    if (!ReadFile(manifestPath, manifest)) {
+        std::fprintf(stderr, "%s: cannot open\n", manifestPath);
+        return false;
+    }
+    std::string directory = manifestPath;
+    std::size_t slash = directory.find_last_of("/\\");
+    directory = slash == std::string::npos ? "" : directory.substr(0, slash + 1);
+
+    int runs = 0, failures = 0;
+    std::vector<std::string> lines = SplitLines(manifest);
+    for (std::size_t n = 0; n < lines.size(); n++) {
+        char trace[256], timeline[256], rules[256] = "";
+        if (lines[n].empty() || lines[n][0] == '#') continue;
+        if (std::sscanf(lines[n].c_str(), "%255s %255s %255s", trace, timeline, rules) < 2) {
+            std::fprintf(stderr, "%s:%zu: expected \"trace timeline [rules]\"\n", manifestPath, n + 1);
+            return false;
+        }
+        runs++;
+        std::string tracePath = directory + trace;
+        std::string timelinePath = directory + timeline;
+        std::string rulesPath = directory + rules;
+        std::vector<TraceEntry> entries;
+        RuleSet ruleSet;
+        std::string error, actual, expected;
+        if (!LoadTrace(tracePath, entries, error)) {
+            std::printf("%s: %s: FAILED\n", trace, error.c_str());
+            failures++;
+            continue;
+        }
+        if (!LoadRules(rules[0] ? rulesPath.c_str() : nullptr, ruleSet, error)) {
+            std::printf("%s: %s: %s: FAILED\n", trace, rules, error.c_str());
+            failures++;
+            continue;
+        }
+        uint64_t changes = Replay(entries, ruleSet, actual);
+        if (update) {
+            FILE* file = std::fopen(timelinePath.c_str(), "wb");
+            bool written = file && std::fwrite(actual.data(), 1, actual.size(), file) == actual.size();
+            if (file && std::fclose(file) != 0) written = false;
+            std::printf("%s: %llu state changes written to %s%s\n", trace, (unsigned long long)changes, timeline,
+                        written ? "" : ": FAILED");
+            failures += !written;
+            continue;
+        }
+        bool matched = ReadFile(timelinePath.c_str(), expected) && CompareTimelines(actual, expected);
+        std::printf("%s: %llu state changes: %s\n", trace, (unsigned long long)changes, matched ? "ok" : "FAILED");
+        failures += !matched;
+    }
+    std::printf("%d traces, %d failed: %s\n", runs, failures, failures == 0 && runs > 0 ? "ok" : "FAILED");
+    return failures == 0 && runs > 0;
+}
+
+int main(int argc, char** argv) {
+    const char* tracePath = nullptr;
+    const char* rulesPath = nullptr;
+    const char* expectPath = nullptr;
+    const char* suitePath = nullptr;
+    uint64_t synthetic = 0;
+    uint32_t seed = 1;
+    bool emitTrace = false;
+    bool quiet = false;
+    bool flapCheck = false;
+    bool update = false;
+    double minReduction = 5.0;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--rules") == 0 && i + 1 < argc) {
+            rulesPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--expect") == 0 && i + 1 < argc) {
+            expectPath = argv[++i];
+        } else if (std::strcmp(argv[i], "--synthetic") == 0 && i + 1 < argc) {
+            synthetic = std::strtoull(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = (uint32_t)std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--emit-trace") == 0) {
+            emitTrace = true;
+        } else if (std::strcmp(argv[i], "--quiet") == 0) {
+            quiet = true;
+        } else if (std::strcmp(argv[i], "--flap-check") == 0) {
+            flapCheck = true;
+        } else if (std::strcmp(argv[i], "--min-reduction") == 0 && i + 1 < argc) {
+            minReduction = std::atof(argv[++i]);
+        } else if (std::strcmp(argv[i], "--suite") == 0 && i + 1 < argc) {
+            suitePath = argv[++i];
+        } else if (std::strcmp(argv[i], "--update") == 0) {
+            update = true;
+        } else if (argv[i][0] == '-' || tracePath) {
+            std::fprintf(stderr, "usage: %s [--rules FILE] [--expect FILE] [--quiet] (trace | --synthetic N [--seed S] [--emit-trace]"
+                                 " | --flap-check [--min-reduction X] [--seed S] | --suite FILE [--update])\n", argv[0]);
+            return 2;
+        } else {
+            tracePath = argv[i];
+        }
+    }
+    if (!tracePath && synthetic == 0 && !flapCheck && !suitePath) {
+        std::fprintf(stderr, "%s: no trace given (a file, or --synthetic N)\n", argv[0]);
+        return 2;
+    }
+
+    if (suitePath) {
+        return RunSuite(suitePath, update) ? 0 : 1;
+    }
+
+    RuleSet rules;
+    std::string error;
+    if (!LoadRules(rulesPath, rules, error)) {
+        std::fprintf(stderr, "%s: %s\n", rulesPath, error.c_str());
+        return 1;
+    }
+
+    if (flapCheck) {
+        std::vector<TraceEntry> hovering;
+        SynthesizeHovering(seed, hovering);
+        std::string timeline;
+        uint64_t raw = Replay(hovering, Unconditioned(rules), timeline);
+        uint64_t smoothed = Replay(hovering, rules, timeline);
+        double minutes = hovering.back().timeMs / 60000.0;
+        double reduction = (double)raw / (std::max)(smoothed, (uint64_t)1);
+        bool ok = reduction >= minReduction && smoothed <= 6 * minutes;
+        std::printf("%.0f minutes hovering: %llu state changes sample by sample, %llu smoothed (%.1fx fewer, %.2f a minute): %s\n",
+                    minutes, (unsigned long long)raw, (unsigned long long)smoothed, reduction, smoothed / minutes,
+                    ok ? "ok" : "FAILED");
+        return ok ? 0 : 1;
+    }
+
+    std::vector<TraceEntry> trace;
+    if (tracePath) {
+        if (!LoadTrace(tracePath, trace, error)) {
+            std::fprintf(stderr, "%s: %s\n", tracePath, error.c_str());
+            return 1;
+        }
+    } else {
+        Synthesize(synthetic, seed, trace);
+        if (emitTrace) {
+            EmitTrace(trace);
+            return 0;
+        }
+    }
+
+    std::string timeline;
+    auto start = std::chrono::steady_clock::now();
+    uint64_t changes = Replay(trace, rules, timeline);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!quiet) {
+        std::fprintf(stderr, "%zu entries, %llu state changes in %.3f s (%.1fM entries/s)\n", trace.size(),
+                     (unsigned long long)changes, seconds, seconds > 0 ? trace.size() / seconds / 1e6 : 0.0);
+    }
+
+    if (expectPath) {
+        std::string expected;
+        if (!ReadFile(expectPath, expected)) {
+            std::fprintf(stderr, "%s: cannot open\n", expectPath);
+            return 1;
+        }
+        return CompareTimelines(timeline, expected) ? 0 : 1;
+    }
+    std::fwrite(timeline.data(), 1, timeline.size(), stdout);
+    return 0;
+}
@@ -0,0 +1,443 @@
+// Checks a trace written by the --trace option (event_trace.h) and measures what
+// recording costs.
+//
+// Usage: trace_check <trace.json>
+//        trace_check --bench [events] [--threads N] [--out trace.json]
+//
+// The first form parses the file as JSON and checks it is something chrome://tracing
+// and Perfetto will load: every event has a name, phase, pid and tid, timestamps
+// and durations are non-negative, complete events on each thread nest properly, and
+// every thread is named. It prints a count per event name.
+//
+// --bench records `events` (default 1000000) scopes per thread on N threads (default
+// 3, like the app), three levels deep like sample -> GetCPUUsage, and reports the
+// cost per event three ways: recorded, dropped and with the tracer stopped. Events
+// are timed in batches of half a ring and the median batch is reported, so a thread
+// preempted by the others doesn't count their time. Recorded batches are written
+// out before the next one and none of them may be dropped; dropped batches are timed
+// against a full ring. Then it checks the trace of the recorded run.
+//
+// Build: cl /EHsc /O2 /nologo /Fetrace_check.exe tools\trace_check.cpp
+//        g++ -O2 -std=c++14 -pthread -o trace_check tools/trace_check.cpp
+//
+// Exits with 1 if the trace is malformed or the recorded run dropped events, 2 on bad
+// usage.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../event_trace.h"
+
+// Just enough JSON for trace files: objects, arrays, strings, numbers, literals
+struct JsonValue {
+    enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT } type = NUL;
+    double number = 0;
+    std::string text;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    const JsonValue* Find(const char* key) const {
+        for (const std::pair<std::string, JsonValue>& member : members) {
+            if (member.first == key) return &member.second;
+        }
+        return nullptr;
+    }
+};
+
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& text) : m_text(text) {}
+
+    bool Parse(JsonValue& value) {
+        if (!ParseValue(value, 0)) {
+            return false;
+        }
+        SkipSpace();
+        return m_pos == m_text.size() || Fail("trailing characters");
+    }
+
+    const std::string& Error() const { return m_error; }
+
+private:
+    bool Fail(const char* what) {
+        if (m_error.empty()) {
+            m_error = std::string(what) + " at offset " + std::to_string(m_pos);
+        }
+        return false;
+    }
+
+    void SkipSpace() {
+        while (m_pos < m_text.size() && std::strchr(" \t\r\n", m_text[m_pos])) m_pos++;
+    }
+
+    bool Expect(char c) {
+        SkipSpace();
+        if (m_pos < m_text.size() && m_text[m_pos] == c) {
+            m_pos++;
+            return true;
+        }
+        return false;
+    }
+
+    bool ParseValue(JsonValue& value, int depth) {
+        if (depth > 64) {
+            return Fail("nesting too deep");
+        }
+        SkipSpace();
+        if (m_pos >= m_text.size()) {
+            return Fail("unexpected end");
+        }
+        char c = m_text[m_pos];
+        if (c == '{') {
+            m_pos++;
+            value.type = JsonValue::OBJECT;
+            if (Expect('}')) return true;
+            do {
+                std::pair<std::string, JsonValue> member;
+                SkipSpace();
+                if (!ParseString(member.first) || !Expect(':') || !ParseValue(member.second, depth + 1)) {
+                    return Fail("bad object member");
+                }
+                value.members.push_back(std::move(member));
+            } while (Expect(','));
+            return Expect('}') || Fail("expected '}'");
+        }
+        if (c == '[') {
+            m_pos++;
+            value.type = JsonValue::ARRAY;
+            if (Expect(']')) return true;
+            do {
+                value.items.emplace_back();
+                if (!ParseValue(value.items.back(), depth + 1)) {
+                    return false;
+                }
+            } while (Expect(','));
+            return Expect(']') || Fail("expected ']'");
+        }
+        if (c == '"') {
+            value.type = JsonValue::STRING;
+            return ParseString(value.text);
+        }
+        for (const char* literal : { "true", "false", "null" }) {
+            if (m_text.compare(m_pos, std::strlen(literal), literal) == 0) {
+                m_pos += std::strlen(literal);
+                value.type = literal[0] == 'n' ? JsonValue::NUL : JsonValue::BOOL;
+                value.number = literal[0] == 't';
+                return true;
+            }
+        }
+        const char* start = m_text.c_str() + m_pos;
+        char* end = nullptr;
+        value.number = std::strtod(start, &end);
+        if (end == start) {
+            return Fail("unexpected character");
+        }
+        value.type = JsonValue::NUMBER;
+        m_pos += end - start;
+        return true;
+    }
+
+    bool ParseString(std::string& out) {
+        if (m_pos >= m_text.size() || m_text[m_pos] != '"') {
+            return Fail("expected string");
+        }
+        for (m_pos++; m_pos < m_text.size(); m_pos++) {
+            char c = m_text[m_pos];
+            if (c == '"') {
+                m_pos++;
+                return true;
+            }
+            if ((unsigned char)c < 0x20) {
+                return Fail("control character in string");
+            }
+            if (c == '\\') {
+                if (++m_pos >= m_text.size() || !std::strchr("\"\\/bfnrtu", m_text[m_pos])) {
+                    return Fail("bad escape");
+                }
+                c = m_text[m_pos];
+            }
+            out += c;
+        }
+        return Fail("unterminated string");
+    }
+
+    const std::string& m_text;
+    std::size_t m_pos = 0;
+    std::string m_error;
+};
+
+struct Span {
+    double start;
+    double end;
+    std::string name;
+};
+
+static bool ReadFile(const char* path, std::string& text) {
+    FILE* file = std::fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    char buffer[65536];
+    std::size_t read;
+    while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        text.append(buffer, read);
+    }
+    std::fclose(file);
+    return true;
+}
+
+static double Number(const JsonValue& event, const char* key, bool& ok) {
+    const JsonValue* value = event.Find(key);
+    if (!value || value->type != JsonValue::NUMBER) {
+        ok = false;
+        return 0;
+    }
+    return value->number;
+}
+
+// Prints what's wrong with the trace, if anything; true when it's well formed
+static bool CheckTrace(const char* path, bool quiet) {
+    std::string text;
+    if (!ReadFile(path, text)) {
+        std::fprintf(stderr, "%s: cannot read\n", path);
+        return false;
+    }
+    JsonValue root;
+    JsonParser parser(text);
+    if (!parser.Parse(root)) {
+        std::fprintf(stderr, "%s: not JSON: %s\n", path, parser.Error().c_str());
+        return false;
+    }
+    const JsonValue* events = root.Find("traceEvents");
+    if (root.type != JsonValue::OBJECT || !events || events->type != JsonValue::ARRAY) {
+        std::fprintf(stderr, "%s: no traceEvents array\n", path);
+        return false;
+    }
+
+    int errors = 0;
+    std::map<std::string, uint64_t> counts;
+    std::map<int, std::vector<Span>> spans;   // Complete events by tid
+    std::map<int, std::string> threadNames;
+    std::map<int, bool> threadsSeen;
+    for (std::size_t i = 0; i < events->items.size(); i++) {
+        const JsonValue& event = events->items[i];
+        const JsonValue* name = event.Find("name");
+        const JsonValue* phase = event.Find("ph");
+        bool ok = event.type == JsonValue::OBJECT && name && name->type == JsonValue::STRING && phase &&
+                  phase->type == JsonValue::STRING && phase->text.size() == 1;
+        int tid = (int)Number(event, "tid", ok);
+        Number(event, "pid", ok);
+        char ph = ok ? phase->text[0] : '?';
+        if (ok && ph == 'M') {
+            const JsonValue* args = event.Find("args");
+            const JsonValue* threadName = args ? args->Find("name") : nullptr;
+            ok = name->text != "thread_name" || (threadName && threadName->type == JsonValue::STRING);
+            if (ok && threadName) threadNames[tid] = threadName->text;
+        } else if (ok && (ph == 'X' || ph == 'i')) {
+            double ts = Number(event, "ts", ok);
+            double dur = ph == 'X' ? Number(event, "dur", ok) : 0;
+            ok = ok && ts >= 0 && dur >= 0;
+            if (ok) {
+                counts[name->text]++;
+                threadsSeen[tid] = true;
+                if (ph == 'X') spans[tid].push_back(Span{ ts, ts + dur, name->text });
+            }
+        } else {
+            ok = false;
+        }
+        if (!ok && errors++ < 10) {
+            std::fprintf(stderr, "%s: event %zu is malformed or has an unexpected phase\n", path, i);
+        }
+    }
+
+    for (std::map<int, std::vector<Span>>::value_type& thread : spans) {
+        std::vector<Span>& list = thread.second;
+        std::sort(list.begin(), list.end(), [](const Span& a, const Span& b) {
+            return a.start != b.start ? a.start < b.start : a.end > b.end;
+        });
+        std::vector<const Span*> open;
+        for (const Span& span : list) {
+            while (!open.empty() && open.back()->end <= span.start) open.pop_back();
+            // Timestamps are printed to the nanosecond, so allow that much rounding
+            if (!open.empty() && span.end > open.back()->end + 0.002) {
+                if (errors++ < 10) {
+                    std::fprintf(stderr, "%s: tid %d: %s at %.3f overlaps %s without nesting\n", path,
+                                 thread.first, span.name.c_str(), span.start, open.back()->name.c_str());
+                }
+                continue;
+            }
+            open.push_back(&span);
+        }
+    }
+    for (const std::map<int, bool>::value_type& thread : threadsSeen) {
+        if (!threadNames.count(thread.first) && errors++ < 10) {
+            std::fprintf(stderr, "%s: tid %d has events but no thread_name\n", path, thread.first);
+        }
+    }
+
+    if (!quiet) {
+        for (const std::map<int, std::string>::value_type& thread : threadNames) {
+            std::printf("thread %d %s\n", thread.first, thread.second.c_str());
+        }
+        for (const std::map<std::string, uint64_t>::value_type& count : counts) {
+            std::printf("%10llu  %s\n", (unsigned long long)count.second, count.first.c_str());
+        }
+        const JsonValue* other = root.Find("otherData");
+        const JsonValue* dropped = other ? other->Find("dropped_events") : nullptr;
+        if (dropped) std::printf("dropped %s\n", dropped->text.c_str());
+    }
+    if (errors) {
+        std::fprintf(stderr, "%s: %d problem(s)\n", path, errors);
+    }
+    return errors == 0;
+}
+
+static const char* const BENCH_NAMES[3] = { "SampleSystem", "GetCPUUsage", "InvalidateRect" };
+
+typedef std::chrono::steady_clock Clock;
+
+// Three nested scopes plus an instant per iteration, like one sample with a blink
+static void RecordEvents(EventTracer& tracer, long events) {
+    for (long i = 0; i < events; i += 4) {
+        TRACE_SCOPE(tracer, BENCH_NAMES[0]);
+        {
+            TRACE_SCOPE(tracer, BENCH_NAMES[1]);
+            {
+                TRACE_SCOPE(tracer, BENCH_NAMES[2]);
+            }
+        }
+        TRACE_INSTANT(tracer, "blink on");
+    }
+}
+
+// Batches timed on one thread
+struct BenchTime {
+    long events = 0;
+    std::vector<double> batchNs;   // Per event, one entry per batch
+    uint64_t dropped = 0;          // Recorded runs: events the ring dropped anyway
+};
+
+enum BenchMode { BENCH_STOPPED, BENCH_RECORDED, BENCH_DROPPED };
+
+// Batches of half a ring; each one is written out before the next when recording,
+// and the ring is kept full when dropping
+static const long BENCH_BATCH = TraceRing::CAPACITY / 2;
+
+static double TimeBatch(EventTracer& tracer, long batch) {
+    Clock::time_point start = Clock::now();
+    RecordEvents(tracer, batch);
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count() / batch;
+}
+
+static void BenchThread(EventTracer& tracer, const char* threadName, BenchMode mode, long events, BenchTime& time) {
+    if (mode != BENCH_STOPPED) tracer.RegisterThread(threadName);
+    // A dropping run fills the ring first. Only batches dropped whole count: the
+    // writer empties the ring now and then, and the batches refilling it are recorded.
+    if (mode == BENCH_DROPPED) RecordEvents(tracer, TraceRing::CAPACITY);
+    for (long tries = 0; time.events < events && tries < 100 * (events / BENCH_BATCH + 1); tries++) {
+        long batch = std::min(BENCH_BATCH, events - time.events);
+        uint64_t before = mode == BENCH_DROPPED ? tracer.Dropped() : 0;
+        double ns = TimeBatch(tracer, batch);
+        if (mode == BENCH_DROPPED && tracer.Dropped() - before != (uint64_t)batch) continue;
+        time.batchNs.push_back(ns);
+        time.events += batch;
+        while (mode == BENCH_RECORDED && tracer.Pending() > 0) {
+            tracer.Flush();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    if (mode == BENCH_RECORDED) time.dropped = tracer.Dropped();
+}
+
+// Every thread at it at once; the batches of all of them
+static BenchTime TimeEvents(EventTracer& tracer, BenchMode mode, int threads, long events) {
+    static const char* const THREAD_NAMES[] = { "monitor", "ui", "watcher", "worker" };
+    std::vector<BenchTime> times((std::size_t)threads);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back(BenchThread, std::ref(tracer), THREAD_NAMES[t % 4], mode, events, std::ref(times[(std::size_t)t]));
+    }
+    for (std::thread& worker : workers) worker.join();
+    BenchTime total;
+    for (const BenchTime& time : times) {
+        total.events += time.events;
+        total.batchNs.insert(total.batchNs.end(), time.batchNs.begin(), time.batchNs.end());
+        total.dropped += time.dropped;
+    }
+    return total;
+}
+
+// The median batch's nanoseconds per event
+static double NsPerEvent(BenchTime& time) {
+    if (time.batchNs.empty()) return 0.0;
+    std::vector<double>::iterator median = time.batchNs.begin() + time.batchNs.size() / 2;
+    std::nth_element(time.batchNs.begin(), median, time.batchNs.end());
+    return *median;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 2 && argv[1][0] != '-') {
+        return CheckTrace(argv[1], false) ? 0 : 1;
+    }
+    if (argc < 2 || std::strcmp(argv[1], "--bench") != 0) {
+        std::fprintf(stderr, "usage: %s <trace.json>\n       %s --bench [events] [--threads N] [--out trace.json]\n",
+                     argv[0], argv[0]);
+        return 2;
+    }
+
+    long events = 1000000;
+    int threads = 3;
+    const char* out = "trace_check.json";
+    for (int i = 2; i < argc; i++) {
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = std::max(1, std::atoi(argv[++i]));
+        } else if (std::strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out = argv[++i];
+        } else if (argv[i][0] != '-') {
+            events = std::max(4L, std::atol(argv[i]));
+        } else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+
+    // A separate tracer per run, so each running one starts with empty rings. The
+    // dropping run goes first; the recorded run's trace replaces its file.
+    std::unique_ptr<EventTracer> stopped(new EventTracer());
+    BenchTime stoppedTime = TimeEvents(*stopped, BENCH_STOPPED, threads, events);
+
+    std::unique_ptr<EventTracer> dropping(new EventTracer());
+    if (!dropping->Start(out)) {
+        std::fprintf(stderr, "%s: cannot write\n", out);
+        return 1;
+    }
+    BenchTime droppedTime = TimeEvents(*dropping, BENCH_DROPPED, threads, events);
+    dropping->Stop();
+
+    std::unique_ptr<EventTracer> recording(new EventTracer());
+    if (!recording->Start(out)) {
+        std::fprintf(stderr, "%s: cannot write\n", out);
+        return 1;
+    }
+    BenchTime recordedTime = TimeEvents(*recording, BENCH_RECORDED, threads, events);
+    recording->Stop();
+
+    std::printf("%ld events x %d threads: %.1f ns/event recorded, %.1f ns/event dropped, %.2f ns/event stopped\n",
+                events, threads, NsPerEvent(recordedTime), NsPerEvent(droppedTime), NsPerEvent(stoppedTime));
+    std::printf("(ring of %u events per thread; recorded in batches of %ld, %llu of them dropped; "
+                "%ld of %ld dropped events timed)\n", TraceRing::CAPACITY, BENCH_BATCH,
+                (unsigned long long)recordedTime.dropped, droppedTime.events, events * threads);
+    bool ok = CheckTrace(out, false);
+    if (recordedTime.dropped) {
+        std::fprintf(stderr, "%s: the recorded run dropped %llu events\n", out, (unsigned long long)recordedTime.dropped);
+        ok = false;
+    }
+    return ok ? 0 : 1;
+}